@@ -0,0 +1,285 @@
+#ifndef _BLE_ATTRIBUTE_ARENA_H_
+#define _BLE_ATTRIBUTE_ARENA_H_
+
+#include <mbed.h>
+
+#include "ble/BLE.h"
+#include "ble_trace.h"
+#include "ble_utils.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#ifndef BLE_ATTRIBUTE_ARENA
+#define BLE_ATTRIBUTE_ARENA 0 //!< Set to 1 to keep the characteristic values in the attribute arena
+#endif
+
+#define ATTRIBUTE_ARENA_SIZE 256		 //!< Bytes of the attribute value arena
+#define ATTRIBUTE_ARENA_SLOTS 32		 //!< Values kept in the arena, one dirty bit each
+#define ATTRIBUTE_ARENA_ALIGNMENT 32	 //!< Alignment of the arena, a cache line
+#define ATTRIBUTE_ARENA_MAGIC 0x41544c42 //!< "BLTA" in little endian, the start of a snapshot
+#define ATTRIBUTE_ARENA_VERSION 1		 //!< Version of the snapshot format
+
+namespace ble_arena {
+
+/**
+ * \brief A value in the arena
+ *
+ */
+struct arena_slot_t {
+	uint16_t offset;					//!< Offset of the value in the arena
+	uint16_t length;					//!< Length of the value
+	GattCharacteristic *characteristic; //!< The characteristic of the value, nullptr until it is bound
+};
+
+/**
+ * \brief Header of a snapshot of the arena
+ *
+ */
+struct __attribute__((packed)) arena_snapshot_header_t {
+	uint32_t magic;	  //!< ATTRIBUTE_ARENA_MAGIC
+	uint16_t version; //!< ATTRIBUTE_ARENA_VERSION
+	uint16_t length;  //!< Bytes of values following the header
+	uint32_t layout;  //!< Signature of the offsets and lengths of the values
+};
+
+/**
+ * \brief One contiguous store of the characteristic values
+ * \details The characteristics take their values from the arena in their construction order, which the member
+ * 			declaration order of the services fixes at compile time, so every start of a build has the same
+ * 			layout. The stack keeps a pointer to the value of each characteristic, so the values written by the
+ * 			peers land in the arena too. A value stored by the application is marked dirty until it is written
+ * 			to the stack, flush() writes all the dirty values in one pass. The whole arena is copied at once to
+ * 			a snapshot, and a snapshot of the same layout is restored at once.
+ *
+ * 			The arena is off by default: the application writes its values with CCharacteristic::set() and
+ * 			keeps no snapshot, so it keeps the values in the characteristics. The replay tool sets
+ * 			BLE_ATTRIBUTE_ARENA to run one device with the layout of the arena.
+ */
+class CAttributeArena {
+	static_assert(ATTRIBUTE_ARENA_SLOTS <= 32, "The dirty values are kept in a 32-bit mask");
+
+  private:
+	alignas(ATTRIBUTE_ARENA_ALIGNMENT) uint8_t _bytes[ATTRIBUTE_ARENA_SIZE]; //!< The values
+	arena_slot_t _slots[ATTRIBUTE_ARENA_SLOTS];								 //!< The values in the allocation order
+	uint8_t _count;															 //!< Number of values
+	uint16_t _used;															 //!< Bytes in use
+	uint32_t _dirty;														 //!< Values not written to the stack yet
+
+	CAttributeArena() : _count(0), _used(0), _dirty(0) {}
+
+	/**
+	 * \brief The FNV-1a signature of the offsets and lengths of the values
+	 *
+	 */
+	uint32_t layout() const {
+		uint32_t hash = 2166136261u;
+		for (uint8_t ii = 0; ii < _count; ii++) {
+			uint16_t fields[2] = {_slots[ii].offset, _slots[ii].length};
+			const uint8_t *p = reinterpret_cast<const uint8_t *>(fields);
+			for (size_t jj = 0; jj < sizeof(fields); jj++) {
+				hash = (hash ^ p[jj]) * 16777619u;
+			}
+		}
+		return hash;
+	}
+
+  public:
+	/**
+	 * \brief The attribute arena of the system
+	 *
+	 */
+	static CAttributeArena &instance() {
+		static CAttributeArena arena;
+		return arena;
+	}
+
+	/**
+	 * \brief Allocates a value, aligned for its type. The characteristics are constructed once at start, so an
+	 * 		  arena too small for them is a configuration error: it halts the system with the size needed.
+	 *
+	 * \param initialValue The initial value
+	 * \return uint8_t* The value
+	 */
+	template <typename T> uint8_t *allocate(const T &initialValue) {
+		uint16_t offset = (uint16_t)((_used + alignof(T) - 1) & ~(alignof(T) - 1));
+		if (_count == ATTRIBUTE_ARENA_SLOTS || offset + sizeof(T) > ATTRIBUTE_ARENA_SIZE) {
+			error("Attribute arena full: value %u needs %u of %u bytes, raise ATTRIBUTE_ARENA_SLOTS or "
+				  "ATTRIBUTE_ARENA_SIZE\n",
+				  (unsigned)_count + 1, (unsigned)(offset + sizeof(T)), (unsigned)ATTRIBUTE_ARENA_SIZE);
+		}
+		new (&_bytes[offset]) T(initialValue);
+		_slots[_count++] = {offset, (uint16_t)sizeof(T), nullptr};
+		_used = offset + sizeof(T);
+		return &_bytes[offset];
+	}
+
+	/**
+	 * \brief Binds the characteristic of an allocated value
+	 *
+	 * \param value The value returned by allocate()
+	 * \param characteristic The characteristic
+	 * \return unsigned The slot of the value, ATTRIBUTE_ARENA_SLOTS if the value is not in the arena
+	 */
+	unsigned bind(const uint8_t *value, GattCharacteristic *characteristic) {
+		for (uint8_t ii = 0; ii < _count; ii++) {
+			if (&_bytes[_slots[ii].offset] == value) {
+				_slots[ii].characteristic = characteristic;
+				return ii;
+			}
+		}
+		return ATTRIBUTE_ARENA_SLOTS;
+	}
+
+	/**
+	 * \brief Marks a value changed by the application and not written to the stack yet
+	 *
+	 * \param slot The slot returned by bind()
+	 */
+	void markDirty(unsigned slot) {
+		if (slot < _count) {
+			_dirty |= (1UL << slot);
+		}
+	}
+	/**
+	 * \brief Marks a value written to the stack
+	 *
+	 * \param slot The slot returned by bind()
+	 */
+	void clean(unsigned slot) {
+		if (slot < _count) {
+			_dirty &= ~(1UL << slot);
+		}
+	}
+	/**
+	 * \brief The dirty values, bit n for the slot n
+	 *
+	 */
+	uint32_t dirty() const { return _dirty; }
+
+	/**
+	 * \brief Writes the dirty values to the stack in one pass, which notifies the subscribed clients. A value
+	 * 		  the stack has no transmit buffer for stays dirty.
+	 *
+	 * \param server The GATT server of the stack
+	 * \param localOnly True to update the values without notifying the clients
+	 * \return unsigned Number of the values written
+	 */
+	unsigned flush(GattServer *server, bool localOnly = false) {
+		unsigned written = 0;
+		for (uint8_t ii = 0; ii < _count && _dirty != 0; ii++) {
+			const arena_slot_t &slot = _slots[ii];
+			if ((_dirty & (1UL << ii)) == 0 || slot.characteristic == nullptr) {
+				continue;
+			}
+			ble_error_t error =
+				server->write(slot.characteristic->getValueHandle(), &_bytes[slot.offset], slot.length, localOnly);
+			if (error == BLE_ERROR_NO_MEM) {
+				continue;
+			}
+			if (error != BLE_ERROR_NONE) {
+				ble_utils::printError(error, "CAttributeArena::flush() ");
+			} else {
+				if (!localOnly) {
+					ble_trace::CTracer::instance().notified(server, *slot.characteristic);
+					ble_utils::CNotificationFifo::notified(server, *slot.characteristic);
+				}
+				written++;
+			}
+			_dirty &= ~(1UL << ii);
+		}
+		return written;
+	}
+
+	/**
+	 * \brief Copies the arena to a snapshot
+	 *
+	 * \param buffer The snapshot buffer
+	 * \param size The size of the buffer
+	 * \return size_t Bytes of the snapshot, 0 if the buffer is too small
+	 */
+	size_t snapshot(uint8_t *buffer, size_t size) const {
+		if (size < sizeof(arena_snapshot_header_t) + _used) {
+			return 0;
+		}
+		arena_snapshot_header_t header = {ATTRIBUTE_ARENA_MAGIC, ATTRIBUTE_ARENA_VERSION, _used, layout()};
+		memcpy(buffer, &header, sizeof(header));
+		memcpy(buffer + sizeof(header), _bytes, _used);
+		return sizeof(header) + _used;
+	}
+
+	/**
+	 * \brief Restores the arena from a snapshot of the same layout. The values are marked dirty, flush() writes
+	 * 		  them to the stack.
+	 *
+	 * \param buffer The snapshot
+	 * \param size The size of the snapshot
+	 * \return true if the snapshot was restored
+	 * \return false if the snapshot is invalid or of another layout
+	 */
+	bool restore(const uint8_t *buffer, size_t size) {
+		arena_snapshot_header_t header;
+		if (size < sizeof(header)) {
+			return false;
+		}
+		memcpy(&header, buffer, sizeof(header));
+		if (header.magic != ATTRIBUTE_ARENA_MAGIC || header.version != ATTRIBUTE_ARENA_VERSION ||
+			header.length != _used || header.layout != layout() || size < sizeof(header) + _used) {
+			return false;
+		}
+		memcpy(_bytes, buffer + sizeof(header), _used);
+		_dirty = (_count == 32) ? 0xFFFFFFFFUL : ((1UL << _count) - 1);
+		return true;
+	}
+
+	/**
+	 * \brief Writes a snapshot to a file
+	 *
+	 * \param filepath The file, overwritten
+	 * \return true if the file was written
+	 */
+	bool save(const char *filepath) const {
+		FILE *file = fopen(filepath, "wb");
+		if (file == NULL) {
+			std::cout << "Cannot write the attribute values to " << filepath << std::endl;
+			return false;
+		}
+		uint8_t buffer[sizeof(arena_snapshot_header_t) + ATTRIBUTE_ARENA_SIZE];
+		size_t length = snapshot(buffer, sizeof(buffer));
+		bool written = fwrite(buffer, 1, length, file) == length;
+		fclose(file);
+		return written;
+	}
+
+	/**
+	 * \brief Restores a snapshot from a file
+	 *
+	 * \param filepath The file
+	 * \return true if the snapshot was restored
+	 */
+	bool load(const char *filepath) {
+		FILE *file = fopen(filepath, "rb");
+		if (file == NULL) {
+			return false;
+		}
+		uint8_t buffer[sizeof(arena_snapshot_header_t) + ATTRIBUTE_ARENA_SIZE];
+		size_t length = fread(buffer, 1, sizeof(buffer), file);
+		fclose(file);
+		return restore(buffer, length);
+	}
+
+	/**
+	 * \brief Prints the arena usage to the console
+	 *
+	 */
+	void printStats() const {
+		std::cout << "Attribute arena: " << std::dec << (int)_count << " values, " << _used << "/"
+				  << ATTRIBUTE_ARENA_SIZE << " bytes, dirty 0x" << std::hex << _dirty << std::dec << std::endl;
+	}
+};
+
+} // namespace ble_arena
+
+#endif //!_BLE_ATTRIBUTE_ARENA_H_
@@ -0,0 +1,185 @@
+#ifndef _BLE_EVENT_QUEUE_H_
+#define _BLE_EVENT_QUEUE_H_
+
+#include <mbed.h>
+
+#include "ble_utils.h"
+
+/**
+ * \brief Event queue statistics
+ *
+ */
+struct event_queue_stats_t {
+	uint32_t posted;						  //!< Events posted successfully
+	uint32_t failed;						  //!< Posts that failed because the queue was out of memory
+	uint32_t dispatched;					  //!< Events run, a periodic event counts each period
+	size_t capacityBytes;					  //!< Size of the event pool
+	size_t highWaterBytes;					  //!< Largest part of the pool ever in use
+	ble_utils::LatencyStats dispatchLatency; //!< Time from the due time of an event to its start
+	ble_utils::LatencyStats runTime;		  //!< Run time of the events
+};
+
+/**
+ * \brief Event queue that records its occupancy, the failed posts and the latency and run time of the events
+ * \details The call(), call_in() and call_every() functions hide the ones of events::EventQueue and wrap the
+ * 			function in a measuring event. The wrapper adds a few bytes to every event. The components of the
+ * 			system take a CEventQueue reference, so every post goes through the wrappers.
+ */
+class CEventQueue : public events::EventQueue {
+  private:
+	event_queue_stats_t _stats; //!< The statistics
+
+	/**
+	 * \brief Counts a post and updates the high-water mark, which only a post can raise. The interrupt handlers
+	 * 		  post too, so the statistics are updated in a critical section.
+	 *
+	 * \param id The id returned by the queue, 0 if the post failed
+	 * \return int The id
+	 */
+	int posted(int id) {
+		core_util_critical_section_enter();
+		if (id == 0) {
+			_stats.failed++;
+		} else {
+			_stats.posted++;
+			size_t used = usedBytes();
+			_stats.highWaterBytes = (used > _stats.highWaterBytes) ? used : _stats.highWaterBytes;
+		}
+		core_util_critical_section_exit();
+		return id;
+	}
+
+	/**
+	 * \brief Builds the measuring event of a function
+	 *
+	 * \param f The function
+	 * \param dueUs The time the function should run
+	 * \param periodUs The period of a periodic event, 0 otherwise
+	 */
+	template <typename F> auto measured(F f, uint32_t dueUs, uint32_t periodUs) {
+		return [this, f, dueUs, periodUs]() mutable {
+			uint32_t startUs = ble_utils::timestampUs();
+			_stats.dispatchLatency.add(startUs - dueUs);
+			dueUs += periodUs;
+			f();
+			_stats.runTime.addSince(startUs);
+			_stats.dispatched++;
+		};
+	}
+
+  public:
+	/**
+	 * \brief Construct a new CEventQueue object
+	 *
+	 * \param size Size of the event pool in bytes
+	 * \param buffer The event pool. If NULL, the pool is allocated from the heap.
+	 */
+	CEventQueue(unsigned size = EVENTS_QUEUE_SIZE, unsigned char *buffer = NULL) : events::EventQueue(size, buffer) {
+		_stats = event_queue_stats_t();
+		// the slab is the part of the pool that has never been carved into events
+		_stats.capacityBytes = _equeue.slab.size;
+	}
+
+	/**
+	 * \brief Converts a delay to microseconds without the int overflow of ms * 1000 past 35 minutes. The
+	 * 		  timestamps wrap around, so the result does too.
+	 *
+	 */
+	static uint32_t toUs(int ms) { return (uint32_t)((int64_t)ms * 1000); }
+
+	template <typename F> int call(F f) {
+		return posted(events::EventQueue::call(measured(f, ble_utils::timestampUs(), 0)));
+	}
+	template <typename T, typename R, typename... Args, typename... BoundArgs>
+	int call(T *obj, R (T::*method)(Args...), BoundArgs... args) {
+		return call([=]() { (obj->*method)(args...); });
+	}
+	template <typename F> int call_in(int ms, F f) {
+		return posted(events::EventQueue::call_in(ms, measured(f, ble_utils::timestampUs() + toUs(ms), 0)));
+	}
+	template <typename T, typename R, typename... Args, typename... BoundArgs>
+	int call_in(int ms, T *obj, R (T::*method)(Args...), BoundArgs... args) {
+		return call_in(ms, [=]() { (obj->*method)(args...); });
+	}
+	template <typename F> int call_every(int ms, F f) {
+		return posted(
+			events::EventQueue::call_every(ms, measured(f, ble_utils::timestampUs() + toUs(ms), toUs(ms))));
+	}
+	template <typename T, typename R, typename... Args, typename... BoundArgs>
+	int call_every(int ms, T *obj, R (T::*method)(Args...), BoundArgs... args) {
+		return call_every(ms, [=]() { (obj->*method)(args...); });
+	}
+
+	/**
+	 * \brief Get the number of pool bytes in use by the pending events
+	 *
+	 */
+	size_t usedBytes() {
+		size_t free = 0;
+		// the pool lock of the queue is a critical section
+		core_util_critical_section_enter();
+		for (struct equeue_event *chunk = _equeue.chunks; chunk != NULL; chunk = chunk->next) {
+			for (struct equeue_event *sibling = chunk; sibling != NULL; sibling = sibling->sibling) {
+				free += sibling->size;
+			}
+		}
+		size_t carved = _stats.capacityBytes - _equeue.slab.size;
+		core_util_critical_section_exit();
+		return carved - free;
+	}
+
+	/**
+	 * \brief Get the statistics
+	 *
+	 */
+	const event_queue_stats_t &getStats() const { return _stats; }
+
+	/**
+	 * \brief Clears the counters and the latency statistics. The high-water mark is kept.
+	 *
+	 */
+	void resetStats() {
+		core_util_critical_section_enter();
+		size_t capacity = _stats.capacityBytes;
+		size_t highWater = _stats.highWaterBytes;
+		_stats = event_queue_stats_t();
+		_stats.capacityBytes = capacity;
+		_stats.highWaterBytes = highWater;
+		core_util_critical_section_exit();
+	}
+
+	/**
+	 * \brief Prints the statistics to the console
+	 *
+	 * \param name The name printed before the statistics
+	 */
+	void printStats(const char *name) {
+		const event_queue_stats_t &stats = getStats();
+		std::cout << name << ": posted " << std::dec << stats.posted << " failed " << stats.failed << " dispatched "
+				  << stats.dispatched << " in use " << usedBytes() << " high-water " << stats.highWaterBytes << "/"
+				  << stats.capacityBytes << " bytes" << std::endl;
+		stats.dispatchLatency.print("\tdispatch latency");
+		stats.runTime.print("\trun time");
+	}
+};
+
+/**
+ * \brief The pool storage of CStaticEventQueue, a base class so that it is constructed before the queue
+ *
+ */
+template <size_t Size> struct CEventQueueStorage {
+	unsigned char _pool[Size]; //!< The event pool
+};
+
+/**
+ * \brief Instrumented event queue with a statically allocated event pool
+ *
+ * \tparam Size Size of the event pool in bytes
+ */
+template <size_t Size = EVENTS_QUEUE_SIZE>
+class CStaticEventQueue : private CEventQueueStorage<Size>, public CEventQueue {
+  public:
+	CStaticEventQueue() : CEventQueueStorage<Size>(), CEventQueue(Size, this->_pool) {}
+};
+
+#endif //!_BLE_EVENT_QUEUE_H_
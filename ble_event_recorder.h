@@ -0,0 +1,310 @@
+#ifndef _BLE_EVENT_RECORDER_H_
+#define _BLE_EVENT_RECORDER_H_
+
+#include <mbed.h>
+
+#include "ble/BLE.h"
+#include "ble_event_queue.h"
+#include "ble_utils.h"
+
+#include <cstdio>
+
+#ifndef BLE_RECORDER
+#define BLE_RECORDER 1 //!< Set to 0 to compile the event recording out
+#endif
+#define RECORDER_BUFFER_SIZE 2048		 //!< RAM of the records, two halves: one fills while the other is written
+#define RECORDER_MAX_PAYLOAD 64			 //!< Longest record payload, longer written values are truncated
+#define RECORDER_MAX_FILE_SIZE 65536	 //!< A trace file larger than this is restarted at the next start()
+#define RECORDER_MAGIC 0x52454c42		 //!< "BLER" in little endian, the start of the trace file
+#define RECORDER_VERSION 1				 //!< Version of the trace format
+#define RECORDER_ALIGNMENT 4			 //!< The records start at multiples of this
+
+namespace ble_recorder {
+
+/**
+ * \brief The recorded events. The payload of each type is little endian and packed.
+ *
+ */
+enum RecordType {
+	REC_SESSION_START = 0,	 /**< The recorder was started. No payload. */
+	REC_CHARACTERISTIC = 1,	 /**< A characteristic was registered, handle is its value handle. Payload: service
+							  * index uint8, characteristic index uint8, properties uint8, short UUID uint16 */
+	REC_CONNECTION = 2,		 /**< Handle is the connection. Payload: ble_error_t status uint8, peer address type
+							  * uint8, peer address 6 bytes */
+	REC_DISCONNECTION = 3,	 /**< Handle is the connection. Payload: reason uint8 */
+	REC_ADVERTISING_END = 4, /**< Payload: connected uint8 */
+	REC_WRITE = 5,			 /**< Handle is the attribute. Payload: connection uint16, write operation uint8,
+							  * offset uint16, the written bytes */
+	REC_READ = 6,			 /**< Handle is the attribute. Payload: connection uint16, offset uint16 */
+	REC_UPDATES_ENABLED = 7, /**< Handle is the attribute. No payload. */
+	REC_UPDATES_DISABLED = 8, /**< Handle is the attribute. No payload. */
+	REC_CONFIRMATION = 9,	 /**< Handle is the attribute. No payload. */
+	REC_DATA_SENT = 10,		 /**< Payload: count uint16 */
+	REC_PAIRING_RESULT = 11, /**< Handle is the connection. Payload: status uint8 */
+	REC_LINK_ENCRYPTION = 12, /**< Handle is the connection. Payload: link encryption uint8 */
+	REC_ALERT = 13,			 /**< The application raised an ANS alert. Payload: category uint8 */
+	REC_TYPES = 14
+};
+
+/**
+ * \brief The header at the start of the trace file
+ *
+ */
+struct __attribute__((packed)) recorder_file_header_t {
+	uint32_t magic;		 //!< RECORDER_MAGIC
+	uint16_t version;	 //!< RECORDER_VERSION
+	uint16_t headerSize; //!< Size of this header, the first record follows it
+};
+
+/**
+ * \brief The header of a record. The payload follows it and is padded to RECORDER_ALIGNMENT.
+ *
+ */
+struct __attribute__((packed)) record_header_t {
+	uint32_t timestampUs; //!< The time of the event, wraps around every ~71 minutes
+	uint16_t handle;	  //!< The attribute or connection handle of the event, 0 if there is none
+	uint8_t type;		  //!< The RecordType
+	uint8_t length;		  //!< Bytes of the payload, without the padding
+};
+
+/**
+ * \brief The padded size of a record
+ *
+ */
+inline size_t recordSize(uint8_t length) {
+	return (sizeof(record_header_t) + length + RECORDER_ALIGNMENT - 1) & ~(size_t)(RECORDER_ALIGNMENT - 1);
+}
+
+/**
+ * \brief Records the events that reach the GAP, the security manager and the GATT server into a binary trace
+ * \details The trace is append-only: a file header, then the records, each session starting with a
+ * 			REC_SESSION_START and the REC_CHARACTERISTIC records of the GATT server, so the handles can be mapped
+ * 			when the layout changes. The records are aligned, so the file can be memory-mapped and walked in
+ * 			place on the host. The records go into one half of a RAM buffer. A flush on the low priority queue
+ * 			swaps the halves under the lock and appends the full half to the file outside of it, when the half
+ * 			is half full and on every disconnection, so the recording never waits for the file system. A record
+ * 			that does not fit the half is counted and lost. The recorder must not be called from interrupt
+ * 			context, and the flushes must run on one queue.
+ */
+class CEventRecorder : private mbed::NonCopyable<CEventRecorder> {
+  private:
+	uint8_t _buffers[2][RECORDER_BUFFER_SIZE / 2]; //!< The records not written yet
+	uint8_t _active;							   //!< The half the records go into
+	size_t _used;								   //!< Bytes of the active half in use
+	const char *_filepath;						   //!< The trace file, NULL if the recorder is not started
+	CEventQueue *_eventQueue;					   //!< The queue that runs the flushes
+	bool _flushPending;							   //!< Set while a flush is queued
+	uint32_t _recorded;							   //!< Records written to the buffer
+	uint32_t _dropped;							   //!< Records lost because the buffer was full
+	uint32_t _flushed;							   //!< Bytes appended to the file
+	rtos::Mutex _mutex;							   //!< Guards the active half and its swap
+
+	CEventRecorder()
+		: _buffers(), _active(0), _used(0), _filepath(NULL), _eventQueue(nullptr), _flushPending(false),
+		  _recorded(0), _dropped(0), _flushed(0), _mutex() {}
+
+	/**
+	 * \brief Writes a record to the buffer
+	 *
+	 * \param type The RecordType
+	 * \param handle The handle of the event
+	 * \param head The first part of the payload
+	 * \param headLength Bytes of the first part
+	 * \param tail The second part of the payload, e.g. the written value
+	 * \param tailLength Bytes of the second part, truncated to fit RECORDER_MAX_PAYLOAD
+	 */
+	void record(RecordType type,
+				uint16_t handle,
+				const void *head = nullptr,
+				size_t headLength = 0,
+				const void *tail = nullptr,
+				size_t tailLength = 0) {
+#if BLE_RECORDER
+		if (_filepath == NULL) {
+			return;
+		}
+		ScopedMutexLock lock(_mutex);
+		tailLength = (headLength + tailLength > RECORDER_MAX_PAYLOAD) ? RECORDER_MAX_PAYLOAD - headLength : tailLength;
+		uint8_t length = (uint8_t)(headLength + tailLength);
+		size_t size = recordSize(length);
+		if (_used + size > sizeof(_buffers[0])) {
+			_dropped++;
+			return;
+		}
+		record_header_t header = {ble_utils::timestampUs(), handle, (uint8_t)type, length};
+		uint8_t *p = _buffers[_active] + _used;
+		memcpy(p, &header, sizeof(header));
+		memcpy(p + sizeof(header), head, headLength);
+		memcpy(p + sizeof(header) + headLength, tail, tailLength);
+		memset(p + sizeof(header) + length, 0, size - sizeof(header) - length);
+		_used += size;
+		_recorded++;
+		if (_used >= sizeof(_buffers[0]) / 2 && !_flushPending) {
+			_flushPending = _eventQueue->call(this, &CEventRecorder::flush) != 0;
+		}
+#else
+		(void)type;
+		(void)handle;
+		(void)head;
+		(void)headLength;
+		(void)tail;
+		(void)tailLength;
+#endif
+	}
+
+  public:
+	/**
+	 * \brief The recorder of the system
+	 *
+	 */
+	static CEventRecorder &instance() {
+		static CEventRecorder recorder;
+		return recorder;
+	}
+
+	/**
+	 * \brief Starts recording a new session. Call it before the stack is initialized, so the session has the
+	 * 		  characteristic records.
+	 *
+	 * \param filepath The trace file. The session is appended, unless the file is larger than
+	 * 				   RECORDER_MAX_FILE_SIZE: then the file is restarted.
+	 * \param eventQueue The low priority queue that runs the flushes, not the queue of the BLE events
+	 * \return true if the file can be written
+	 */
+	bool start(const char *filepath, CEventQueue &eventQueue) {
+		FILE *file = fopen(filepath, "ab");
+		if (file == NULL) {
+			std::cout << "Cannot record the events to " << filepath << std::endl;
+			return false;
+		}
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		if (size > RECORDER_MAX_FILE_SIZE) {
+			fclose(file);
+			file = fopen(filepath, "wb");
+			size = 0;
+		}
+		bool written = file != NULL;
+		if (written && size == 0) {
+			recorder_file_header_t header = {RECORDER_MAGIC, RECORDER_VERSION, sizeof(recorder_file_header_t)};
+			written = fwrite(&header, sizeof(header), 1, file) == 1;
+		}
+		if (file != NULL) {
+			fclose(file);
+		}
+		if (!written) {
+			std::cout << "Cannot record the events to " << filepath << std::endl;
+			return false;
+		}
+		_filepath = filepath;
+		_eventQueue = &eventQueue;
+		_used = 0;
+		record(REC_SESSION_START, 0);
+		return true;
+	}
+
+	/**
+	 * \brief Appends the buffered records to the file. The halves are swapped under the lock, the file is
+	 * 		  written outside of it.
+	 *
+	 */
+	void flush() {
+		const uint8_t *buffer;
+		size_t used;
+		{
+			ScopedMutexLock lock(_mutex);
+			_flushPending = false;
+			if (_filepath == NULL || _used == 0) {
+				return;
+			}
+			buffer = _buffers[_active];
+			used = _used;
+			_active ^= 1;
+			_used = 0;
+		}
+		FILE *file = fopen(_filepath, "ab");
+		if (file == NULL || fwrite(buffer, 1, used, file) != used) {
+			std::cout << "Event trace write failed, " << std::dec << used << " bytes lost" << std::endl;
+		} else {
+			_flushed += used;
+		}
+		if (file != NULL) {
+			fclose(file);
+		}
+	}
+
+	/**
+	 * \brief Records a registered characteristic
+	 *
+	 * \param characteristic The characteristic, its value handle is assigned
+	 * \param serviceIndex The index of its service in the registration order
+	 * \param characteristicIndex Its index in the service
+	 */
+	void characteristic(GattCharacteristic &characteristic, uint8_t serviceIndex, uint8_t characteristicIndex) {
+		uint16_t uuid = characteristic.getValueAttribute().getUUID().getShortUUID();
+		uint8_t payload[5] = {serviceIndex, characteristicIndex, characteristic.getProperties(), (uint8_t)uuid,
+							  (uint8_t)(uuid >> 8)};
+		record(REC_CHARACTERISTIC, characteristic.getValueHandle(), payload, sizeof(payload));
+	}
+
+	void connection(const ble::ConnectionCompleteEvent &event) {
+		uint8_t payload[8] = {(uint8_t)event.getStatus(), event.getPeerAddressType().value()};
+		memcpy(payload + 2, event.getPeerAddress().data(), 6);
+		record(REC_CONNECTION, event.getConnectionHandle(), payload, sizeof(payload));
+	}
+
+	void disconnection(const ble::DisconnectionCompleteEvent &event) {
+		uint8_t reason = event.getReason().value();
+		record(REC_DISCONNECTION, event.getConnectionHandle(), &reason, 1);
+	}
+
+	void advertisingEnd(const ble::AdvertisingEndEvent &event) {
+		uint8_t connected = event.isConnected();
+		record(REC_ADVERTISING_END, 0, &connected, 1);
+	}
+
+	void write(const GattWriteCallbackParams *e) {
+		uint8_t payload[5] = {(uint8_t)e->connHandle, (uint8_t)(e->connHandle >> 8), (uint8_t)e->writeOp,
+							  (uint8_t)e->offset, (uint8_t)(e->offset >> 8)};
+		record(REC_WRITE, e->handle, payload, sizeof(payload), e->data, e->len);
+	}
+
+	void read(const GattReadCallbackParams *e) {
+		uint8_t payload[4] = {(uint8_t)e->connHandle, (uint8_t)(e->connHandle >> 8), (uint8_t)e->offset,
+							  (uint8_t)(e->offset >> 8)};
+		record(REC_READ, e->handle, payload, sizeof(payload));
+	}
+
+	void updatesEnabled(uint16_t handle) { record(REC_UPDATES_ENABLED, handle); }
+	void updatesDisabled(uint16_t handle) { record(REC_UPDATES_DISABLED, handle); }
+	void confirmation(uint16_t handle) { record(REC_CONFIRMATION, handle); }
+
+	void dataSent(unsigned count) {
+		uint8_t payload[2] = {(uint8_t)count, (uint8_t)(count >> 8)};
+		record(REC_DATA_SENT, 0, payload, sizeof(payload));
+	}
+
+	void pairingResult(ble::connection_handle_t connectionHandle, uint8_t status) {
+		record(REC_PAIRING_RESULT, connectionHandle, &status, 1);
+	}
+
+	void linkEncryption(ble::connection_handle_t connectionHandle, ble::link_encryption_t result) {
+		uint8_t value = result.value();
+		record(REC_LINK_ENCRYPTION, connectionHandle, &value, 1);
+	}
+
+	void alert(uint8_t category) { record(REC_ALERT, 0, &category, 1); }
+
+	/**
+	 * \brief Prints the recorded, lost and written amounts
+	 *
+	 */
+	void printStats() const {
+		std::cout << "Event recorder: " << std::dec << _recorded << " records, " << _dropped << " lost, " << _flushed
+				  << " bytes written, " << _used << " buffered" << std::endl;
+	}
+};
+
+} // namespace ble_recorder
+
+#endif //!_BLE_EVENT_RECORDER_H_
\ No newline at end of file
@@ -0,0 +1,151 @@
+#ifndef _BLE_EVENT_SCHEDULER_H_
+#define _BLE_EVENT_SCHEDULER_H_
+
+#include <mbed.h>
+
+#include "ble_event_queue.h"
+#include "ble_utils.h"
+
+/**
+ * \brief Two level event scheduler on top of two chained event queues
+ * \details The high priority queue is chained to the low priority queue, and the low priority queue is the
+ * 			one dispatched by the application. Every low priority event first drains the pending high priority
+ * 			events, so the BLE stack processing and the GATT callbacks never wait behind the UI, logging and
+ * 			housekeeping work that is already queued. A high priority event waits at most for the low priority
+ * 			event that is running, as the events are not preempted.
+ */
+class CEventScheduler : private mbed::NonCopyable<CEventScheduler> {
+  public:
+	/**
+	 * \brief The event priorities
+	 *
+	 */
+	enum Priority {
+		PRIORITY_HIGH = 0, /**< BLE stack processing and GATT callbacks */
+		PRIORITY_LOW = 1,  /**< UI, logging and housekeeping */
+	};
+
+  private:
+	CEventQueue &_high;					 //!< The queue of the high priority events
+	CEventQueue &_low;					 //!< The queue of the low priority events, dispatched by run()
+	ble_utils::LatencyStats _queueDelay[2];		 //!< The time the events waited in each queue
+	CEventQueue &queue(Priority priority) { return (priority == PRIORITY_HIGH) ? _high : _low; }
+
+	/**
+	 * \brief Called before every event. Low priority events let the high priority events run first.
+	 *
+	 * \param priority The priority of the event
+	 * \param dueUs The time the event should have run
+	 */
+	void beforeEvent(Priority priority, uint32_t dueUs) {
+		if (priority == PRIORITY_LOW) {
+			_high.dispatch(0);
+		}
+		_queueDelay[priority].addSince(dueUs);
+	}
+
+  public:
+	/**
+	 * \brief Construct a new CEventScheduler object
+	 *
+	 * \param high The queue of the high priority events. The BLE stack events are posted here.
+	 * \param low The queue of the low priority events
+	 */
+	CEventScheduler(CEventQueue &high, CEventQueue &low) : _high(high), _low(low) {
+		_high.chain(&_low);
+	}
+
+	/**
+	 * \brief Get the queue of the high priority events, for the components that post to a queue directly
+	 *
+	 */
+	CEventQueue &high() { return _high; }
+	/**
+	 * \brief Get the queue of the low priority events
+	 *
+	 */
+	CEventQueue &low() { return _low; }
+
+	/**
+	 * \brief Posts an event
+	 *
+	 * \param priority The priority of the event
+	 * \param f The function to be called
+	 * \return int The event id, 0 if the queue is out of memory
+	 */
+	template <typename F> int call(Priority priority, F f) {
+		uint32_t postedUs = ble_utils::timestampUs();
+		return queue(priority).call([this, priority, postedUs, f]() {
+			beforeEvent(priority, postedUs);
+			f();
+		});
+	}
+
+	/**
+	 * \brief Posts an event to be called after a delay
+	 *
+	 * \param priority The priority of the event
+	 * \param ms The delay in milliseconds
+	 * \param f The function to be called
+	 * \return int The event id, 0 if the queue is out of memory
+	 */
+	template <typename F> int call_in(Priority priority, int ms, F f) {
+		uint32_t dueUs = ble_utils::timestampUs() + CEventQueue::toUs(ms);
+		return queue(priority).call_in(ms, [this, priority, dueUs, f]() {
+			beforeEvent(priority, dueUs);
+			f();
+		});
+	}
+
+	/**
+	 * \brief Posts a periodic event
+	 *
+	 * \param priority The priority of the event
+	 * \param ms The period in milliseconds
+	 * \param f The function to be called
+	 * \return int The event id, 0 if the queue is out of memory
+	 */
+	template <typename F> int call_every(Priority priority, int ms, F f) {
+		uint32_t dueUs = ble_utils::timestampUs() + CEventQueue::toUs(ms);
+		uint32_t periodUs = CEventQueue::toUs(ms);
+		return queue(priority).call_every(ms, [this, priority, dueUs, periodUs, f]() mutable {
+			beforeEvent(priority, dueUs);
+			dueUs += periodUs;
+			f();
+		});
+	}
+
+	/**
+	 * \brief Cancels an event
+	 *
+	 * \param priority The priority the event was posted with
+	 * \param id The event id
+	 */
+	void cancel(Priority priority, int id) { queue(priority).cancel(id); }
+
+	/**
+	 * \brief Prints the queue delay and the occupancy statistics of both priorities
+	 *
+	 */
+	void printStats() {
+		_queueDelay[PRIORITY_HIGH].print("High priority queue delay");
+		_queueDelay[PRIORITY_LOW].print("Low priority queue delay");
+		_high.printStats("High priority queue");
+		_low.printStats("Low priority queue");
+	}
+
+	/**
+	 * \brief Dispatches the events forever
+	 *
+	 * \param statsPeriodMs The period of the queue delay statistics printout, 0 (the default) prints them only
+	 * 						when printStats() is called, e.g. on disconnection
+	 */
+	void dispatch_forever(int statsPeriodMs = 0) {
+		if (statsPeriodMs != 0) {
+			call_every(PRIORITY_LOW, statsPeriodMs, callback(this, &CEventScheduler::printStats));
+		}
+		_low.dispatch_forever();
+	}
+};
+
+#endif //!_BLE_EVENT_SCHEDULER_H_
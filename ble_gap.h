@@ -1,267 +1,854 @@
-#ifndef _BLE_GAP_H
-#define _BLE_GAP_H
-
-#include <mbed.h>
-
-#include "ble/BLE.h"
-#include "ble/Gap.h"
-#include "ble/GapAdvertisingData.h"
-#include "ble/GapAdvertisingParams.h"
-#include "ble_utils.h"
-/**
- * \brief
- *
- */
-class CGap : private mbed::NonCopyable<CGap>, public ble::Gap::EventHandler {
-  protected:
-	BLE &_ble;						 //!< The one and only BLE instance of the system
-	events::EventQueue &_eventQueue; //!< The event queue of the system
-	const char *_deviceName;		 //!< The name of the device
-	DigitalOut _advertisementLed;	 //!< The Advertisement LED that blinks when the device is advertising
-	DigitalOut
-		_connectedLed; //!< The Connected LED that turns on/off when the device connection state changes
-
-	uint8_t _advertisementDataBuffer[ble::LEGACY_ADVERTISING_MAX_SIZE]; //!< The advertisement data buffer to
-																		//! be used by the builder
-	ble::AdvertisingDataBuilder
-		_advertisementDataBuilder; //!< The advertisement data builder to build advertisement data structures
-	mbed::Callback<void(void)> _onInitComplete; //!< The user configurable callback to be called when the
-												//! stack initialization completes
-	mbed::Callback<void(void)>
-		_onConnection; //!< The user configurable callback to be called when connection completes
-	mbed::Callback<void(void)>
-		_onDisconnection; //!< The user configurable function to be called when peer device disconnects
-
-	bool _advertising; //!< The advertising flag. Set/Cleared when advertsing state changes.
-	bool _connected;   //!< The connected flag. Set/Cleared when connection state changes
-
-  protected:
-	/**
-	 * \brief Called when connection attempt ends or an advertising device has been connected.
-	 *
-	 * \param event The connection complete event object
-	 */
-	virtual void onConnectionComplete(const ble::ConnectionCompleteEvent &event) override {
-		ble_utils::printError(event.getStatus(), "onConnectionComplete() ");
-		ble_utils::printDeviceAddress(event.getPeerAddressType(), event.getPeerAddress());
-		_connected = true;
-		// call the user callback
-		if(_onConnection){
-			_onConnection();
-		}
-	}
-
-	/**
-	 * \brief Called when advertising ends.
-	 *
-	 * \details Advertising ends when the process timeout or if it is stopped by the
-	 * application or if the local device accepts a connection request.
-	 *
-	 *
-	 * \param event The advertisement end event object
-	 */
-	void onAdvertisingEnd(const ble::AdvertisingEndEvent &event) override {
-		_advertising = false;
-		// turn off the led
-		_advertisementLed = 1;
-		std::cout << "onAdvertisingEnd(). Connected " << event.isConnected() << std::endl;
-	}
-
-	/**
-	 * \brief Called when a peer connected to this device is disconnected for some reason
-	 *
-	 * \param event Disconnection complete event
-	 */
-	void onDisconnectionComplete(const ble::DisconnectionCompleteEvent &event) override {
-		std::cout << "onDisconnectionComplete(). Reason ";
-		switch (event.getReason().value()) {
-		case ble::disconnection_reason_t::type::AUTHENTICATION_FAILURE:
-			std::cout << "AUTHENTICATION FAILURE" << std::endl;
-			break;
-		case ble::disconnection_reason_t::type::CONNECTION_TIMEOUT:
-			std::cout << "CONNECTION TIMEOUT" << std::endl;
-			break;
-		case ble::disconnection_reason_t::type::REMOTE_USER_TERMINATED_CONNECTION:
-			std::cout << "REMOTE USER TERMINATED CONNECTION" << std::endl;
-			break;
-		case ble::disconnection_reason_t::type::REMOTE_DEV_TERMINATION_DUE_TO_LOW_RESOURCES:
-			std::cout << "REMOTE DEVICE HAS LOW RESOURCES" << std::endl;
-			break;
-		case ble::disconnection_reason_t::type::REMOTE_DEV_TERMINATION_DUE_TO_POWER_OFF:
-			std::cout << "REMOTE DEVICE POWER OFF" << std::endl;
-			break;
-		case ble::disconnection_reason_t::type::LOCAL_HOST_TERMINATED_CONNECTION:
-			std::cout << "LOCAL HOST TERMINATED CONNECTION" << std::endl;
-			break;
-		case ble::disconnection_reason_t::type::UNACCEPTABLE_CONNECTION_PARAMETERS:
-			std::cout << "UNACCEPTABLE CONNECTION PARAMETERS" << std::endl;
-			break;
-		default:
-			std::cout << "UNKNOWN" << std::endl;
-			break;
-		}
-		// turn off the led
-		_connectedLed = 1;
-		_connected = false;
-		// start advertising
-		startAdvertising();
-		// call the user callback
-		if(_onDisconnection){
-			_onDisconnection();
-		}
-	}
-
-	/**
-	 * \brief This function is called when the MTU size negotiation completes.
-	 *
-	 * \param connectionHandle The connection handle
-	 * \param txSize The new MTU size for transmissions
-	 * \param rxSize The new MTU size for receptions
-	 */
-	void onDataLengthChange(ble::connection_handle_t connectionHandle,
-							uint16_t txSize,
-							uint16_t rxSize) override {
-		std::cout << "BLE Connection Data Length negotiated for connection: " << connectionHandle
-				  << " txSize " << (int)txSize << " rxSize " << (int)rxSize << std::endl;
-	}
-	/**
-	 * \brief Starts the advertisement process. This function is called when the system is initialized
-	 * 		  or when the device state is changed to disconnected.
-	 *
-	 */
-	void startAdvertising() {
-		// adjust the advertisement parameters, set the advertisement events,
-		// and start advertising
-		ble::AdvertisingParameters adv_parameters(ble::advertising_type_t::CONNECTABLE_UNDIRECTED,
-												  ble::adv_interval_t(ble::millisecond_t(100)));
-
-		_advertisementDataBuilder.setFlags();
-		_advertisementDataBuilder.setName(_deviceName);
-
-		/* Setup advertising */
-
-		ble_error_t error =
-			_ble.gap().setAdvertisingParameters(ble::LEGACY_ADVERTISING_HANDLE, adv_parameters);
-		ble_utils::printError(error, "_ble.gap().setAdvertisingParameters() ");
-
-		error = _ble.gap().setAdvertisingPayload(ble::LEGACY_ADVERTISING_HANDLE,
-												 _advertisementDataBuilder.getAdvertisingData());
-		ble_utils::printError(error, "_ble.gap().setAdvertisingPayload() ");
-
-		/* Start advertising */
-
-		error = _ble.gap().startAdvertising(ble::LEGACY_ADVERTISING_HANDLE);
-		ble_utils::printError(error, "_ble.gap().startAdvertising() ");
-		if (error == BLE_ERROR_NONE) {
-			_advertising = true;
-			_connectedLed = 1;
-			_advertisementLed = 0;
-		}
-	}
-
-	/**
-	 * The device state LED display callback
-	 */
-	void showDeviceState() {
-		if (_connected) {
-			_connectedLed = 0;
-		} else {
-			if (_advertising) {
-				_advertisementLed = !_advertisementLed;
-			}
-		}
-	}
-
-	/**
-	 * \brief Called by BLE stack when there are some BLE events to be processed.
-	 *
-	 * \param context The event context
-	 */
-	void scheduleBLEEvents(BLE::OnEventsToProcessCallbackContext *context) {
-		_eventQueue.call(Callback<void()>(&context->ble, &BLE::processEvents));
-	}
-
-  public:
-	/**
-	 * \brief Construct a new CGap object
-	 *
-	 * \param ble A reference to one only BLE instance of the system
-	 * \param eventQueue The event queue of the application
-	 * \param deviceName The Bluetooth Device Name
-	 * \param advLed Advertisement LED to be blinked when advertising
-	 * \param connectedLed Connected LED to be lit when connected.
-	 */
-	CGap(BLE &ble,
-		 events::EventQueue &eventQueue,
-		 const char *deviceName,
-		 PinName advLed = LED1,
-		 PinName connectedLed = LED1)
-		: ble::Gap::EventHandler(), _ble(ble), _eventQueue(eventQueue), _deviceName(deviceName),
-		  _advertisementLed(advLed, 1), _connectedLed(connectedLed, 1),
-		  _advertisementDataBuilder(_advertisementDataBuffer), _onInitComplete(), _onConnection(),
-		  _onDisconnection(), _advertising(false), _connected(false) {}
-	~CGap() {
-		if (_ble.hasInitialized()) {
-			_ble.shutdown();
-		}
-	}
-	/**
-	 * \brief Callback called when the BLE stack initialization completes
-	 * \param context Initialization complete context
-	 */
-	virtual void onBleStackInitComplete(BLE::InitializationCompleteCallbackContext *context) {
-		ble_utils::printError(context->error, "BLE Stack initialization completed with code ");
-		if (context->error != BLE_ERROR_NONE) {
-			std::cout << "BLE stack initialization completed with error!" << std::endl;
-		} else {
-			Gap::AddressType_t addr_type;
-			Gap::Address_t address;
-			_ble.gap().getAddress(&addr_type, address);
-			ble_utils::printDeviceAddress(addr_type, address);
-
-			// set the devicename characteristics of the GAP
-			_ble.gap().setDeviceName(reinterpret_cast<const std::uint8_t *>(_deviceName));
-
-			startAdvertising();
-			if (_onInitComplete) {
-				_onInitComplete();
-			}
-		}
-	}
-	/**
-	 * The run function of the GAP implementation
-	 */
-	void run() {
-		ble_error_t error;
-
-		_ble.onEventsToProcess(makeFunctionPointer(this, &CGap::scheduleBLEEvents));
-		// register BLE init complete callback to the function of this class
-		error = _ble.init(this, &CGap::onBleStackInitComplete);
-		if (error != BLE_ERROR_NONE) {
-			std::cout << "BLE stack initialization completed with error " << error << std::endl;
-			return;
-		}
-
-		// set the GAP event handler
-		_ble.gap().setEventHandler(this);
-		_eventQueue.call_every(500, this, &CGap::showDeviceState);
-		// dispatch the event queue forever
-		_eventQueue.dispatch_forever();
-	}
-
-	/**
-	 * \brief Sets the setOnInitCallback function to be called when initialization completes.
-	 * \details This function is sets a callback object, which is called
-	 * 			when the stack initialization completes. The callback can be used by the
-	 * 			application to trigger certain operations in the application side.
-	 *
-	 * \param callback The callback object. If this is nullptr, it disables callback calling.
-	 */
-	void setOnInitCallback(mbed::Callback<void(void)> callback) { _onInitComplete = callback; }
-
-	void setOnConnection(mbed::Callback<void(void)> callback) { _onConnection = callback; }
-
-	void setOnDisconnection(mbed::Callback<void(void)> callback) { _onDisconnection = callback; }
-};
-
-#endif //!_BLE_GAP_H
+#ifndef _BLE_GAP_H
+#define _BLE_GAP_H
+
+#include <mbed.h>
+
+#include "ble/BLE.h"
+#include "ble/Gap.h"
+#include "ble/GapAdvertisingData.h"
+#include "ble/GapAdvertisingParams.h"
+#include "ble_event_queue.h"
+#include "ble_event_recorder.h"
+#include "ble_event_scheduler.h"
+#include "ble_profiler.h"
+#include "ble_trace.h"
+#include "ble_scan_pipeline.h"
+#include "ble_utils.h"
+
+#define ACCEPT_LIST_CAPACITY 8				//!< Maximum number of bonded identities in the filter accept list
+#define ACCEPT_LIST_FALLBACK_TIMEOUT_MS 30000 //!< Default filtered advertising time before open advertising
+#define OPEN_ADVERTISING_WINDOW_MS 30000		//!< Default duration of the open advertising fallback
+#define SCAN_DELIVERY_PERIOD_MS 200			//!< Default period of the scan result delivery
+#define LED_BLINK_ON_MS 100					//!< On time of the advertising blink
+#define LED_BLINK_OFF_MS 1900				//!< Off time of the advertising blink, bonded peers only
+#define LED_OPEN_BLINK_OFF_MS 400			//!< Off time of the advertising blink, all peers accepted
+#define LED_POLL_WAKEUPS_PER_HOUR 7200		//!< Wakeups of the former 500 ms LED poll, for comparison
+#define GAP_MAX_LINKS 4						//!< Connections tracked at once, in the central and peripheral roles
+/**
+ * \brief
+ *
+ */
+class CGap : private mbed::NonCopyable<CGap>, public ble::Gap::EventHandler {
+  protected:
+	BLE &_ble;						 //!< The one and only BLE instance of the system
+	CEventQueue &_eventQueue; //!< The event queue of the system
+	CEventScheduler *_scheduler;	 //!< The two level scheduler, if the application uses one
+	const char *_deviceName;		 //!< The name of the device
+	DigitalOut _advertisementLed;	 //!< The Advertisement LED that blinks when the device is advertising
+	DigitalOut
+		_connectedLed; //!< The Connected LED that turns on/off when the device connection state changes
+
+	uint8_t _advertisementDataBuffer[ble::LEGACY_ADVERTISING_MAX_SIZE]; //!< The advertisement data buffer to
+																		//! be used by the builder
+	ble::AdvertisingDataBuilder
+		_advertisementDataBuilder; //!< The advertisement data builder to build advertisement data structures
+	mbed::Callback<void(void)> _onInitComplete; //!< The user configurable callback to be called when the
+												//! stack initialization completes
+	mbed::Callback<void(void)>
+		_onConnection; //!< The user configurable callback to be called when connection completes
+	mbed::Callback<void(void)>
+		_onDisconnection; //!< The user configurable function to be called when peer device disconnects
+	mbed::Callback<void(const ble::ConnectionCompleteEvent &)>
+		_onConnectionEvent; //!< The user configurable callback that receives the connection complete event
+	mbed::Callback<void(const ble::DisconnectionCompleteEvent &)>
+		_onDisconnectionEvent; //!< The user configurable callback that receives the disconnection event
+
+	bool _advertising; //!< The advertising flag. Set/Cleared when advertsing state changes.
+	bool _connected;   //!< Set while a peer is connected to the advertising, i.e. in the peripheral role
+	bool _connecting;  //!< Set while a connect() in the central role is pending
+
+	/**
+	 * \brief An open connection
+	 *
+	 */
+	struct gap_link_t {
+		bool used;						 //!< Set if the slot holds a connection
+		ble::connection_handle_t handle; //!< The connection handle
+		bool central;					 //!< Set if this device is the central of the connection
+	};
+	gap_link_t _links[GAP_MAX_LINKS]; //!< The open connections
+
+	BLEProtocol::Address_t _acceptListAddresses[ACCEPT_LIST_CAPACITY]; //!< Storage of the accept list entries
+	Gap::Whitelist_t _acceptList; //!< The filter accept list of the bonded peer identities
+	bool _acceptListMode;		  //!< Set when advertising should only accept connections from the accept list
+	bool _openAdvertising;		  //!< Set while the open advertising fallback is active
+	uint32_t _fallbackTimeoutMs;  //!< Filtered advertising time before falling back to open advertising
+	uint32_t _openWindowMs;		  //!< Duration of the open advertising fallback
+	int _advertisingModeEvent;	  //!< The event queue id of the pending advertising mode switch
+
+	CScanPipelineBase *_scanPipeline; //!< The pipeline receiving the advertisement reports while scanning
+	int _scanDeliveryEvent;			  //!< The event queue id of the periodic scan result delivery
+	bool _scanning;					  //!< The scanning flag. Set/Cleared when scanning state changes.
+
+	/**
+	 * \brief The states shown by the LEDs
+	 *
+	 */
+	enum LedState { LED_IDLE = 0, LED_ADVERTISING, LED_CONNECTED, LED_STATES };
+	LedState _ledState;					  //!< The state the LEDs show
+	int _blinkEvent;					  //!< The event id of the pending blink timer, 0 if none
+	bool _blinkOn;						  //!< Set while the advertising LED is on in the blink pattern
+	uint32_t _ledWakeups[LED_STATES];	  //!< Blink timer wakeups in each state
+	uint64_t _ledStateTimeMs[LED_STATES]; //!< Time spent in each state
+	uint64_t _ledStateSinceMs;			  //!< The time the current state was entered
+
+  protected:
+	/**
+	 * \brief Called when connection attempt ends or an advertising device has been connected.
+	 *
+	 * \param event The connection complete event object
+	 */
+	virtual void onConnectionComplete(const ble::ConnectionCompleteEvent &event) override {
+		ble_recorder::CEventRecorder::instance().connection(event);
+		ble_utils::printError(event.getStatus(), "onConnectionComplete() ");
+		ble_utils::printDeviceAddress(event.getPeerAddressType(), event.getPeerAddress());
+		bool central = (event.getOwnRole() == ble::connection_role_t::CENTRAL);
+		if (central) {
+			_connecting = false;
+		}
+		if (event.getStatus() != BLE_ERROR_NONE) {
+			// no link was opened, a failed connect() may be retried
+			return;
+		}
+		if (!addLink(event.getConnectionHandle(), central)) {
+			std::cout << "No link slot for connection " << event.getConnectionHandle() << std::endl;
+		}
+		ble_utils::activityCounters().connections++;
+		if (!central) {
+			_connected = true;
+			cancelAdvertisingModeSwitch();
+		}
+		updateLedState();
+		// the user callbacks of the connection state serve the peripheral link
+		if (!central && _onConnection) {
+			_onConnection();
+		}
+		if (_onConnectionEvent) {
+			_onConnectionEvent(event);
+		}
+	}
+
+	/**
+	 * \brief Adds an open connection to the link table
+	 *
+	 * \param handle The connection handle
+	 * \param central Set if this device is the central of the connection
+	 * \return true if the connection is tracked
+	 * \return false if all the GAP_MAX_LINKS slots are used
+	 */
+	bool addLink(ble::connection_handle_t handle, bool central) {
+		for (auto &link : _links) {
+			if (!link.used) {
+				link = {true, handle, central};
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * \brief Removes a closed connection from the link table
+	 *
+	 * \param handle The connection handle
+	 * \param central Set to the role of the connection
+	 * \return true if the connection was tracked
+	 */
+	bool removeLink(ble::connection_handle_t handle, bool &central) {
+		for (auto &link : _links) {
+			if (link.used && link.handle == handle) {
+				link.used = false;
+				central = link.central;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * \brief Called when advertising ends.
+	 *
+	 * \details Advertising ends when the process timeout or if it is stopped by the
+	 * application or if the local device accepts a connection request.
+	 *
+	 *
+	 * \param event The advertisement end event object
+	 */
+	void onAdvertisingEnd(const ble::AdvertisingEndEvent &event) override {
+		ble_recorder::CEventRecorder::instance().advertisingEnd(event);
+		_advertising = false;
+		// turn off the led
+		updateLedState();
+		std::cout << "onAdvertisingEnd(). Connected " << event.isConnected() << std::endl;
+	}
+
+	/**
+	 * \brief Called for every advertisement report received while scanning.
+	 * \details The stack may report thousands of advertisements per second in a busy environment, so the
+	 * 			report is only copied into the scan pipeline here. The pipeline is processed at the delivery rate.
+	 *
+	 * \param event The advertisement report
+	 */
+	void onAdvertisingReport(const ble::AdvertisingReportEvent &event) override {
+		if (_scanPipeline != nullptr) {
+			_scanPipeline->push(event);
+		}
+	}
+
+	/**
+	 * \brief Called when scanning ends because the scan duration elapsed
+	 *
+	 * \param event The scan timeout event
+	 */
+	void onScanTimeout(const ble::ScanTimeoutEvent &event) override {
+		std::cout << "onScanTimeout()" << std::endl;
+		stopScanDelivery();
+		_scanning = false;
+	}
+
+	/**
+	 * \brief Delivers the scan results of the period
+	 *
+	 */
+	void deliverScanResults() {
+		if (_scanPipeline != nullptr) {
+			_scanPipeline->deliver();
+		}
+	}
+
+	/**
+	 * \brief Stops the periodic scan result delivery and delivers the remaining reports
+	 *
+	 */
+	void stopScanDelivery() {
+		if (_scanDeliveryEvent != 0) {
+			_eventQueue.cancel(_scanDeliveryEvent);
+			_scanDeliveryEvent = 0;
+		}
+		deliverScanResults();
+	}
+
+	/**
+	 * \brief Called when a peer connected to this device is disconnected for some reason
+	 *
+	 * \param event Disconnection complete event
+	 */
+	void onDisconnectionComplete(const ble::DisconnectionCompleteEvent &event) override {
+		ble_recorder::CEventRecorder::instance().disconnection(event);
+		std::cout << "onDisconnectionComplete(). Reason ";
+		switch (event.getReason().value()) {
+		case ble::disconnection_reason_t::type::AUTHENTICATION_FAILURE:
+			std::cout << "AUTHENTICATION FAILURE" << std::endl;
+			break;
+		case ble::disconnection_reason_t::type::CONNECTION_TIMEOUT:
+			std::cout << "CONNECTION TIMEOUT" << std::endl;
+			break;
+		case ble::disconnection_reason_t::type::REMOTE_USER_TERMINATED_CONNECTION:
+			std::cout << "REMOTE USER TERMINATED CONNECTION" << std::endl;
+			break;
+		case ble::disconnection_reason_t::type::REMOTE_DEV_TERMINATION_DUE_TO_LOW_RESOURCES:
+			std::cout << "REMOTE DEVICE HAS LOW RESOURCES" << std::endl;
+			break;
+		case ble::disconnection_reason_t::type::REMOTE_DEV_TERMINATION_DUE_TO_POWER_OFF:
+			std::cout << "REMOTE DEVICE POWER OFF" << std::endl;
+			break;
+		case ble::disconnection_reason_t::type::LOCAL_HOST_TERMINATED_CONNECTION:
+			std::cout << "LOCAL HOST TERMINATED CONNECTION" << std::endl;
+			break;
+		case ble::disconnection_reason_t::type::UNACCEPTABLE_CONNECTION_PARAMETERS:
+			std::cout << "UNACCEPTABLE CONNECTION PARAMETERS" << std::endl;
+			break;
+		default:
+			std::cout << "UNKNOWN" << std::endl;
+			break;
+		}
+		bool central = false;
+		removeLink(event.getConnectionHandle(), central);
+		if (!central) {
+			_connected = (getLinkCount(false) != 0);
+			_openAdvertising = false;
+		}
+		// turn off the led
+		updateLedState();
+		printLedWakeups();
+		if (central) {
+			// the advertising is not stopped by the central links
+			if (_onDisconnectionEvent) {
+				_onDisconnectionEvent(event);
+			}
+			return;
+		}
+		// start advertising
+		startAdvertising();
+		// call the user callback
+		if(_onDisconnection){
+			_onDisconnection();
+		}
+		if (_onDisconnectionEvent) {
+			_onDisconnectionEvent(event);
+		}
+	}
+
+	/**
+	 * \brief This function is called when the MTU size negotiation completes.
+	 *
+	 * \param connectionHandle The connection handle
+	 * \param txSize The new MTU size for transmissions
+	 * \param rxSize The new MTU size for receptions
+	 */
+	void onDataLengthChange(ble::connection_handle_t connectionHandle,
+							uint16_t txSize,
+							uint16_t rxSize) override {
+		std::cout << "BLE Connection Data Length negotiated for connection: " << connectionHandle
+				  << " txSize " << (int)txSize << " rxSize " << (int)rxSize << std::endl;
+	}
+	/**
+	 * \brief Starts the advertisement process. This function is called when the system is initialized
+	 * 		  or when the device state is changed to disconnected.
+	 *
+	 */
+	void startAdvertising() {
+		// adjust the advertisement parameters, set the advertisement events,
+		// and start advertising
+		ble::AdvertisingParameters adv_parameters(ble::advertising_type_t::CONNECTABLE_UNDIRECTED,
+												  ble::adv_interval_t(ble::millisecond_t(100)));
+		bool filtered = isAcceptListFiltering();
+		if (filtered) {
+			// the controller drops the connection requests of unknown identities
+			adv_parameters.setFilter(ble::advertising_filter_policy_t::FILTER_CONNECTION_REQUEST);
+		}
+
+		_advertisementDataBuilder.setFlags();
+		_advertisementDataBuilder.setName(_deviceName);
+
+		/* Setup advertising */
+
+		ble_error_t error =
+			_ble.gap().setAdvertisingParameters(ble::LEGACY_ADVERTISING_HANDLE, adv_parameters);
+		ble_utils::printError(error, "_ble.gap().setAdvertisingParameters() ");
+
+		error = _ble.gap().setAdvertisingPayload(ble::LEGACY_ADVERTISING_HANDLE,
+												 _advertisementDataBuilder.getAdvertisingData());
+		ble_utils::printError(error, "_ble.gap().setAdvertisingPayload() ");
+
+		/* Start advertising */
+
+		error = _ble.gap().startAdvertising(ble::LEGACY_ADVERTISING_HANDLE);
+		ble_utils::printError(error, "_ble.gap().startAdvertising() ");
+		if (error == BLE_ERROR_NONE) {
+			_advertising = true;
+			updateLedState();
+			std::cout << (filtered ? "Advertising to bonded peers only" : "Advertising to all peers") << std::endl;
+			scheduleAdvertisingModeSwitch();
+		}
+	}
+
+	/**
+	 * \brief Restarts advertising, so that changed advertising parameters take effect.
+	 *
+	 */
+	void restartAdvertising() {
+		if (_connected) {
+			return;
+		}
+		if (_advertising) {
+			ble_error_t error = _ble.gap().stopAdvertising(ble::LEGACY_ADVERTISING_HANDLE);
+			ble_utils::printError(error, "_ble.gap().stopAdvertising() ");
+			_advertising = false;
+			updateLedState();
+		}
+		startAdvertising();
+	}
+
+	/**
+	 * \brief Checks whether the advertising should accept connections only from the accept list
+	 *
+	 * \return true if the connection requests are filtered
+	 * \return false if any peer can connect
+	 */
+	bool isAcceptListFiltering() const { return _acceptListMode && !_openAdvertising && _acceptList.size != 0; }
+
+	/**
+	 * \brief Schedules the switch between filtered and open advertising
+	 * \details Filtered advertising falls back to open advertising after the fallback timeout, and open
+	 * 			advertising returns to filtered advertising after the open window.
+	 */
+	void scheduleAdvertisingModeSwitch() {
+		cancelAdvertisingModeSwitch();
+		if (isAcceptListFiltering()) {
+			if (_fallbackTimeoutMs != 0) {
+				_advertisingModeEvent =
+					_eventQueue.call_in(_fallbackTimeoutMs, this, &CGap::onAcceptListFallbackTimeout);
+			}
+		} else if (_openAdvertising) {
+			_advertisingModeEvent = _eventQueue.call_in(_openWindowMs, this, &CGap::onOpenWindowTimeout);
+		}
+	}
+
+	/**
+	 * \brief Cancels the pending advertising mode switch
+	 *
+	 */
+	void cancelAdvertisingModeSwitch() {
+		if (_advertisingModeEvent != 0) {
+			_eventQueue.cancel(_advertisingModeEvent);
+			_advertisingModeEvent = 0;
+		}
+	}
+
+	/**
+	 * \brief Called when no bonded peer connected during the filtered advertising
+	 *
+	 */
+	void onAcceptListFallbackTimeout() {
+		_advertisingModeEvent = 0;
+		std::cout << "No bonded peer connected, falling back to open advertising" << std::endl;
+		openAdvertising();
+	}
+
+	/**
+	 * \brief Called when the open advertising window ends
+	 *
+	 */
+	void onOpenWindowTimeout() {
+		_advertisingModeEvent = 0;
+		_openAdvertising = false;
+		restartAdvertising();
+	}
+
+	/**
+	 * \brief Shows the device state on the LEDs. Called on every advertising and connection state change.
+	 * \details The LEDs are set once per transition. Only the advertising blink needs a timer, and the timer
+	 * 			is a one-shot event re-armed for each edge of the pattern, so the CPU is not woken in the
+	 * 			connected and idle states.
+	 */
+	void updateLedState() {
+		LedState state = (getLinkCount(false) + getLinkCount(true) != 0)
+							 ? LED_CONNECTED
+							 : (_advertising ? LED_ADVERTISING : LED_IDLE);
+		if (state == _ledState && state != LED_ADVERTISING) {
+			return;
+		}
+		uint64_t nowMs = rtos::Kernel::get_ms_count();
+		_ledStateTimeMs[_ledState] += nowMs - _ledStateSinceMs;
+		_ledStateSinceMs = nowMs;
+		_ledState = state;
+		cancelBlink();
+		// the LEDs are active low and may share a pin, so the LED of the new state is written last
+		if (state == LED_CONNECTED) {
+			_advertisementLed = 1;
+			_connectedLed = 0;
+			return;
+		}
+		_connectedLed = 1;
+		_advertisementLed = 1;
+		if (state == LED_ADVERTISING) {
+			// the pattern restarts, e.g. when the advertising mode changes
+			_blinkOn = true;
+			_advertisementLed = 0;
+			scheduleBlink(LED_BLINK_ON_MS);
+		}
+	}
+
+	/**
+	 * \brief Arms the blink timer. The blink is UI work, it runs with low priority when there is a scheduler.
+	 *
+	 * \param ms Time to the next edge of the pattern
+	 */
+	void scheduleBlink(int ms) {
+		mbed::Callback<void()> onBlinkTimer = BLE_PROFILED(this, CGap, onBlinkTimer);
+		if (_scheduler != nullptr) {
+			_blinkEvent = _scheduler->call_in(CEventScheduler::PRIORITY_LOW, ms, onBlinkTimer);
+		} else {
+			_blinkEvent = _eventQueue.call_in(ms, onBlinkTimer);
+		}
+	}
+
+	/**
+	 * \brief Cancels the pending blink timer
+	 *
+	 */
+	void cancelBlink() {
+		if (_blinkEvent == 0) {
+			return;
+		}
+		if (_scheduler != nullptr) {
+			_scheduler->cancel(CEventScheduler::PRIORITY_LOW, _blinkEvent);
+		} else {
+			_eventQueue.cancel(_blinkEvent);
+		}
+		_blinkEvent = 0;
+	}
+
+	/**
+	 * \brief Called at each edge of the advertising blink pattern
+	 *
+	 */
+	void onBlinkTimer() {
+		_blinkEvent = 0;
+		_ledWakeups[_ledState]++;
+		if (_ledState != LED_ADVERTISING) {
+			return;
+		}
+		_blinkOn = !_blinkOn;
+		_advertisementLed = _blinkOn ? 0 : 1;
+		scheduleBlink(_blinkOn ? LED_BLINK_ON_MS
+							   : (isAcceptListFiltering() ? LED_BLINK_OFF_MS : LED_OPEN_BLINK_OFF_MS));
+	}
+
+	/**
+	 * \brief Called by BLE stack when there are some BLE events to be processed.
+	 *
+	 * \param context The event context
+	 */
+	void scheduleBLEEvents(BLE::OnEventsToProcessCallbackContext *context) {
+		// the trace id links the arrival of the stack events to their dispatch and to the GATT handlers
+		uint16_t eventId = ble_trace::CTracer::instance().arrival();
+		mbed::Callback<void()> processEvents = BLE_PROFILED(&context->ble, BLE, processEvents);
+		auto process = [eventId, processEvents]() {
+			ble_trace::CTraceDispatch dispatch(eventId);
+			processEvents();
+		};
+		if (_scheduler != nullptr) {
+			_scheduler->call(CEventScheduler::PRIORITY_HIGH, process);
+		} else {
+			_eventQueue.call(process);
+		}
+	}
+
+  public:
+	/**
+	 * \brief Construct a new CGap object
+	 *
+	 * \param ble A reference to one only BLE instance of the system
+	 * \param eventQueue The event queue of the application
+	 * \param deviceName The Bluetooth Device Name
+	 * \param advLed Advertisement LED to be blinked when advertising
+	 * \param connectedLed Connected LED to be lit when connected.
+	 */
+	CGap(BLE &ble,
+		 CEventQueue &eventQueue,
+		 const char *deviceName,
+		 PinName advLed = LED1,
+		 PinName connectedLed = LED1)
+		: ble::Gap::EventHandler(), _ble(ble), _eventQueue(eventQueue), _scheduler(nullptr),
+		  _deviceName(deviceName),
+		  _advertisementLed(advLed, 1), _connectedLed(connectedLed, 1),
+		  _advertisementDataBuffer(), _advertisementDataBuilder(_advertisementDataBuffer), _onInitComplete(), _onConnection(),
+		  _onDisconnection(), _advertising(false), _connected(false), _connecting(false), _links(),
+		  _acceptListMode(false),
+		  _openAdvertising(false), _fallbackTimeoutMs(ACCEPT_LIST_FALLBACK_TIMEOUT_MS),
+		  _openWindowMs(OPEN_ADVERTISING_WINDOW_MS), _advertisingModeEvent(0), _scanPipeline(nullptr),
+		  _scanDeliveryEvent(0), _scanning(false), _ledState(LED_IDLE), _blinkEvent(0), _blinkOn(false),
+		  _ledWakeups(), _ledStateTimeMs(), _ledStateSinceMs(0) {
+		_acceptList.addresses = _acceptListAddresses;
+		_acceptList.size = 0;
+		_acceptList.capacity = ACCEPT_LIST_CAPACITY;
+	}
+	~CGap() {
+		if (_ble.hasInitialized()) {
+			_ble.shutdown();
+		}
+	}
+	/**
+	 * \brief Callback called when the BLE stack initialization completes
+	 * \param context Initialization complete context
+	 */
+	virtual void onBleStackInitComplete(BLE::InitializationCompleteCallbackContext *context) {
+		ble_utils::printError(context->error, "BLE Stack initialization completed with code ");
+		if (context->error != BLE_ERROR_NONE) {
+			std::cout << "BLE stack initialization completed with error!" << std::endl;
+		} else {
+			Gap::AddressType_t addr_type;
+			Gap::Address_t address;
+			_ble.gap().getAddress(&addr_type, address);
+			ble_utils::printDeviceAddress(addr_type, address);
+
+			// set the devicename characteristics of the GAP
+			_ble.gap().setDeviceName(reinterpret_cast<const std::uint8_t *>(_deviceName));
+
+			startAdvertising();
+			if (_onInitComplete) {
+				_onInitComplete();
+			}
+		}
+	}
+	/**
+	 * \brief Starts the stack initialization without dispatching the events, e.g. for a host tool that
+	 * 		  dispatches the queue itself
+	 *
+	 * \return true if the initialization was started
+	 */
+	bool start() {
+		ble_error_t error;
+
+		_ble.onEventsToProcess(BLE_PROFILED(this, CGap, scheduleBLEEvents));
+		// register BLE init complete callback to the function of this class
+		error = _ble.init(this, &CGap::onBleStackInitComplete);
+		if (error != BLE_ERROR_NONE) {
+			std::cout << "BLE stack initialization completed with error " << error << std::endl;
+			return false;
+		}
+
+		// set the GAP event handler
+		_ble.gap().setEventHandler(this);
+		_ledStateSinceMs = rtos::Kernel::get_ms_count();
+		return true;
+	}
+
+	/**
+	 * The run function of the GAP implementation
+	 */
+	void run() {
+		if (!start()) {
+			return;
+		}
+		if (_scheduler != nullptr) {
+			_scheduler->dispatch_forever();
+		} else {
+			// dispatch the event queue forever
+			_eventQueue.dispatch_forever();
+		}
+	}
+
+	/**
+	 * \brief Sets the two level scheduler. The BLE stack events are then posted with high priority,
+	 * 		  the LED blink timers with low priority, and run() dispatches the scheduler.
+	 * \details The event queue given to the constructor must be the high priority queue of the scheduler.
+	 *
+	 * \param scheduler The scheduler
+	 */
+	void setScheduler(CEventScheduler &scheduler) { _scheduler = &scheduler; }
+
+	/**
+	 * \brief Sets the setOnInitCallback function to be called when initialization completes.
+	 * \details This function is sets a callback object, which is called
+	 * 			when the stack initialization completes. The callback can be used by the
+	 * 			application to trigger certain operations in the application side.
+	 *
+	 * \param callback The callback object. If this is nullptr, it disables callback calling.
+	 */
+	void setOnInitCallback(mbed::Callback<void(void)> callback) { _onInitComplete = callback; }
+
+	/**
+	 * \brief Sets the callback called when a peer connects to the advertising, i.e. in the peripheral role
+	 *
+	 * \param callback The callback object. If this is nullptr, it disables callback calling.
+	 */
+	void setOnConnection(mbed::Callback<void(void)> callback) { _onConnection = callback; }
+
+	/**
+	 * \brief Sets the callback called when a connection in the peripheral role is closed
+	 *
+	 * \param callback The callback object. If this is nullptr, it disables callback calling.
+	 */
+	void setOnDisconnection(mbed::Callback<void(void)> callback) { _onDisconnection = callback; }
+
+	/**
+	 * \brief Sets the callback that receives the connection complete event of both roles, e.g. to attach a
+	 * 		  GATT client. Failed connection attempts are not delivered.
+	 *
+	 * \param callback The callback object. If this is nullptr, it disables callback calling.
+	 */
+	void setOnConnectionEvent(mbed::Callback<void(const ble::ConnectionCompleteEvent &)> callback) {
+		_onConnectionEvent = callback;
+	}
+
+	/**
+	 * \brief Sets the callback that receives the disconnection complete event of both roles
+	 *
+	 * \param callback The callback object. If this is nullptr, it disables callback calling.
+	 */
+	void setOnDisconnectionEvent(mbed::Callback<void(const ble::DisconnectionCompleteEvent &)> callback) {
+		_onDisconnectionEvent = callback;
+	}
+
+	/**
+	 * \brief Prints the LED timer wakeups per hour in each state, next to the wakeups of the former 500 ms poll
+	 *
+	 */
+	void printLedWakeups() {
+		static const char *names[LED_STATES] = {"idle", "advertising", "connected"};
+		uint64_t nowMs = rtos::Kernel::get_ms_count();
+		std::cout << "LED wakeups per hour (500 ms poll: " << std::dec << LED_POLL_WAKEUPS_PER_HOUR << ")";
+		for (int ii = 0; ii < LED_STATES; ii++) {
+			uint64_t timeMs = _ledStateTimeMs[ii] + ((ii == _ledState) ? nowMs - _ledStateSinceMs : 0);
+			std::cout << " " << names[ii] << " ";
+			if (timeMs == 0) {
+				std::cout << "-";
+			} else {
+				std::cout << (uint32_t)((uint64_t)_ledWakeups[ii] * 3600000 / timeMs);
+			}
+		}
+		std::cout << std::endl;
+	}
+
+	/**
+	 * \brief Connects to a peripheral in the central role
+	 *
+	 * \param peerAddressType The address type of the peripheral
+	 * \param peerAddress The address of the peripheral
+	 * \return BLE_ERROR_NONE if the connection was initiated, an appropriate error code otherwise
+	 */
+	ble_error_t connect(ble::peer_address_type_t peerAddressType, const ble::address_t &peerAddress) {
+		if (_connecting) {
+			// the controller initiates one connection at a time
+			return BLE_ERROR_INVALID_STATE;
+		}
+		if (getLinkCount(false) + getLinkCount(true) == GAP_MAX_LINKS) {
+			return BLE_ERROR_NO_MEM;
+		}
+		ble_error_t error = _ble.gap().connect(peerAddressType, peerAddress, ble::ConnectionParameters());
+		ble_utils::printError(error, "_ble.gap().connect() ");
+		_connecting = (error == BLE_ERROR_NONE);
+		return error;
+	}
+
+	/**
+	 * \brief Gets the number of open connections in a role
+	 *
+	 * \param central True for the connections this device initiated, false for the peripheral ones
+	 * \return uint8_t The number of connections
+	 */
+	uint8_t getLinkCount(bool central) const {
+		uint8_t count = 0;
+		for (const auto &link : _links) {
+			count += (link.used && link.central == central) ? 1 : 0;
+		}
+		return count;
+	}
+
+	/**
+	 * \brief Checks whether a connection is open
+	 *
+	 * \param handle The connection handle
+	 */
+	bool isConnected(ble::connection_handle_t handle) const {
+		for (const auto &link : _links) {
+			if (link.used && link.handle == handle) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * \brief Enables/disables the filter accept list advertising mode
+	 * \details When enabled and the accept list is not empty, the advertising accepts connection requests
+	 * 			only from the identities in the accept list. If no bonded peer connects within the fallback
+	 * 			timeout, the device advertises to all peers for the open advertising window.
+	 *
+	 * \param enable True to enable, False to disable the mode
+	 * \param fallbackTimeoutMs Filtered advertising time before open advertising. 0 disables the fallback.
+	 * \param openWindowMs Duration of the open advertising fallback
+	 */
+	void enableAcceptListAdvertising(bool enable = true,
+									 uint32_t fallbackTimeoutMs = ACCEPT_LIST_FALLBACK_TIMEOUT_MS,
+									 uint32_t openWindowMs = OPEN_ADVERTISING_WINDOW_MS) {
+		_acceptListMode = enable;
+		_fallbackTimeoutMs = fallbackTimeoutMs;
+		_openWindowMs = openWindowMs;
+		if (_ble.hasInitialized()) {
+			restartAdvertising();
+		}
+	}
+
+	/**
+	 * \brief Sets the filter accept list of the controller
+	 *
+	 * \param acceptList The identities accepted in the filtered advertising mode
+	 */
+	void setAcceptList(const Gap::Whitelist_t &acceptList) {
+		_acceptList.size = 0;
+		for (uint8_t ii = 0; ii < acceptList.size && ii < _acceptList.capacity; ii++) {
+			_acceptListAddresses[ii] = acceptList.addresses[ii];
+			_acceptList.size++;
+		}
+		std::cout << "Accept list updated with " << std::dec << (int)_acceptList.size << " entries" << std::endl;
+		bool wasAdvertising = _advertising;
+		if (_advertising) {
+			// the filter accept list cannot be changed while advertising
+			ble_error_t error = _ble.gap().stopAdvertising(ble::LEGACY_ADVERTISING_HANDLE);
+			ble_utils::printError(error, "_ble.gap().stopAdvertising() ");
+			_advertising = false;
+			updateLedState();
+		}
+		ble_error_t error = _ble.gap().setWhitelist(_acceptList);
+		ble_utils::printError(error, "_ble.gap().setWhitelist() ");
+		if (wasAdvertising) {
+			startAdvertising();
+		}
+	}
+
+	/**
+	 * \brief Starts the observer mode. The advertisement reports are fed to the scan pipeline.
+	 * \details The scan is passive and continuous, the window equals the interval. The duplicate filtering
+	 * 			of the controller is disabled, because the pipeline needs every report for the RSSI aggregation
+	 * 			and does the dedup itself.
+	 *
+	 * \param pipeline The scan pipeline. It must outlive the scanning.
+	 * \param deliveryPeriodMs The period of the result delivery
+	 * \param intervalMs The scan interval and window
+	 * \return BLE_ERROR_NONE if the scanning started, an appropriate error code otherwise
+	 */
+	ble_error_t startScanning(CScanPipelineBase &pipeline,
+							  uint32_t deliveryPeriodMs = SCAN_DELIVERY_PERIOD_MS,
+							  uint32_t intervalMs = 100) {
+		if (_scanning) {
+			stopScanning();
+		}
+		ble::ScanParameters scanParameters(ble::phy_t::LE_1M,
+										   ble::scan_interval_t(ble::millisecond_t(intervalMs)),
+										   ble::scan_window_t(ble::millisecond_t(intervalMs)), false);
+		ble_error_t error = _ble.gap().setScanParameters(scanParameters);
+		ble_utils::printError(error, "_ble.gap().setScanParameters() ");
+		if (error != BLE_ERROR_NONE) {
+			return error;
+		}
+		_scanPipeline = &pipeline;
+		error = _ble.gap().startScan(ble::duplicates_filter_t::DISABLE);
+		ble_utils::printError(error, "_ble.gap().startScan() ");
+		if (error == BLE_ERROR_NONE) {
+			_scanning = true;
+			_scanDeliveryEvent = _eventQueue.call_every(deliveryPeriodMs, this, &CGap::deliverScanResults);
+		}
+		return error;
+	}
+
+	/**
+	 * \brief Stops the observer mode and delivers the remaining reports
+	 *
+	 */
+	void stopScanning() {
+		if (!_scanning) {
+			return;
+		}
+		ble_error_t error = _ble.gap().stopScan();
+		ble_utils::printError(error, "_ble.gap().stopScan() ");
+		_scanning = false;
+		stopScanDelivery();
+		const scan_stats_t &stats = _scanPipeline->getStats();
+		std::cout << "Scan stopped: " << std::dec << stats.received << " reports, " << stats.dropped
+				  << " dropped, " << stats.duplicates << " duplicates, " << stats.delivered << " results"
+				  << std::endl;
+	}
+
+	/**
+	 * \brief Checks whether the device is scanning
+	 *
+	 */
+	bool isScanning() const { return _scanning; }
+
+	/**
+	 * \brief Starts the open advertising fallback, e.g. when the user presses the pairing button.
+	 * \details Any peer can connect and pair during the open advertising window.
+	 */
+	void openAdvertising() {
+		if (!_acceptListMode || _connected) {
+			return;
+		}
+		_openAdvertising = true;
+		restartAdvertising();
+	}
+};
+
+#endif //!_BLE_GAP_H
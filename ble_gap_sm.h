@@ -1,200 +1,383 @@
-#ifndef _BLE_GAP_SM_H_
-#define _BLE_GAP_SM_H_
-#include "ble/SecurityManager.h"
-#include "ble_gap.h"
-
-/**
- * \brief Security manager event handler class derived from CGap class
- *
- */
-class CGapSecurity : private mbed::NonCopyable<CGapSecurity>,
-					 public CGap,
-					 public SecurityManager::EventHandler {
-  protected:
-	SecurityManager::SecurityIOCapabilities_t _io_capability; //!< The device IO capability
-  public:
-	/**
-	 * \brief Construct a new CGapSecurity object
-	 * \param ble A reference to one only BLE instance of the system
-	 * \param eventQueue The event queue of the application
-	 * \param deviceName The Bluetooth Device Name
-	 * \param advLed Advertisement LED to be blinked when advertising
-	 * \param connectedLed Connected LED to be lit when connected.
-	 * \param ioCapability IO capability of the device
-	 */
-	CGapSecurity(BLE &ble,
-				 events::EventQueue &eventQueue,
-				 const char *deviceName,
-				 SecurityManager::SecurityIOCapabilities_t ioCapability = SecurityManager::IO_CAPS_NONE,
-                 PinName advLed = LED1,
-				 PinName connectedLed = LED1)
-		: CGap(ble, eventQueue, deviceName, advLed, connectedLed), _io_capability(ioCapability) {}
-	/**
-	 * \brief Override of the Stack initialization complete function
-	 *
-	 * \param context Initialization complete context
-	 */
-	void onBleStackInitComplete(BLE::InitializationCompleteCallbackContext *context) override {
-		ble_error_t error;
-		if (context->error) {
-			std::cout << "Error during the initialisation" << std::endl;
-			return;
-		}
-		/* If the security manager is required this needs to be called before any
-		 * calls to the Security manager happen. */
-		error = CGap::_ble.securityManager().init(false /* Enable bonding*/,
-												  true /*Require MITM protection*/,
-												  _io_capability /*IO capabilities*/,
-												  NULL /*Passkey*/,
-												  false /*Support data signing*/);
-		ble_utils::printError(error, "_ble.securityManager().init() ");
-		if (error != BLE_ERROR_NONE) {
-			return;
-		}
-		// enable legacy pairing
-		_ble.securityManager().allowLegacyPairing(true);
-		// set the event handler to this object
-		_ble.securityManager().setSecurityManagerEventHandler(this);
-		/** This tells the stack to generate a pairingRequest event
-		 * which will require this application to respond before pairing
-		 * can proceed. Setting it to false will automatically accept
-		 * pairing. */
-		_ble.securityManager().setPairingRequestAuthorisation(true);
-
-		CGap::onBleStackInitComplete(context);
-		/*Enable privacy so we can find the keys */
-		error = _ble.gap().enablePrivacy(true);
-
-		ble_utils::printError(error, "_ble.gap().enablePrivacy() ");
-		Gap::PeripheralPrivacyConfiguration_t configuration_p = {
-			/* use_non_resolvable_random_address */ false,
-			Gap::PeripheralPrivacyConfiguration_t::REJECT_NON_RESOLVED_ADDRESS};
-		_ble.gap().setPeripheralPrivacyConfiguration(&configuration_p);
-	}
-	/**
-	 * \brief Override of connection complete function
-	 *
-	 * \param event The connection complete event
-	 */
-	virtual void onConnectionComplete(const ble::ConnectionCompleteEvent &event) override {
-		// ble_error_t error;
-		ble_utils::printError(event.getStatus(), "onConnectionComplete() ");
-		ble_utils::printDeviceAddress(event.getPeerAddressType(), event.getPeerAddress());
-		ble::connection_handle_t handle = event.getConnectionHandle();
-		/* Request a change in link security. This will be done
-		 * indirectly by asking the master of the connection to
-		 * change it. Depending on circumstances different actions
-		 * may be taken by the master which will trigger events
-		 * which the applications should deal with. */
-		ble_error_t error =
-			_ble.securityManager().setLinkSecurity(handle,
-												   SecurityManager::SECURITY_MODE_ENCRYPTION_WITH_MITM);
-
-		ble_utils::printError(error, "_ble.securityManager().setLinkSecuirty() ");
-	}
-	/**
-	 * \brief Request application to accept or reject pairing. Application should respond by
-	 * calling the appropriate function: acceptPairingRequest or cancelPairingRequest
-	 *
-	 * \param connectionHandle The connection handle of the link associated with the pairing process
-	 */
-	virtual void pairingRequest(ble::connection_handle_t connectionHandle) override {
-		std::cout << "Pairing requested - authorising" << std::endl;
-		_ble.securityManager().acceptPairingRequest(connectionHandle);
-	}
-	/**
-	 * \brief Inform the device of the encryption state of a given link.
-	 *
-	 * \param connectionHandle The connection handle of the link
-	 * \param result the encryption process result
-	 */
-	virtual void linkEncryptionResult(ble::connection_handle_t connectionHandle,
-									  ble::link_encryption_t result) override {
-		if (result == ble::link_encryption_t::ENCRYPTED) {
-			std::cout << "Link ENCRYPTED" << std::endl;
-		} else if (result == ble::link_encryption_t::ENCRYPTED_WITH_MITM) {
-			std::cout << "Link ENCRYPTED_WITH_MITM" << std::endl;
-		} else if (result == ble::link_encryption_t::NOT_ENCRYPTED) {
-			std::cout << "Link NOT_ENCRYPTED" << std::endl;
-		}
-	}
-
-	/**
-	 * \brief Display the given passkey on the local device.
-	 *
-	 * \param connectionHandle The handle of the connection
-	 * \param passkey The passkey to be displayed
-	 */
-	virtual void passkeyDisplay(ble::connection_handle_t connectionHandle,
-								const SecurityManager::Passkey_t passkey) override {
-		std::cout << "Input passKey: ";
-		for (unsigned i = 0; i < Gap::ADDR_LEN; i++) {
-			printf("%c ", passkey[Gap::ADDR_LEN - 1 - i]);
-		}
-		std::cout << std::endl;
-	}
-	/**
-	 * \brief Indicate to the application that a confirmation is required. This is used
-	 * when the device does not have a keyboard but has a yes/no button. The device
-	 * displays numbers on its display in response to passkeyDisplay and the user
-	 * checks if they are the same on both devices. The application should proceed
-	 * by supplying the confirmation using the confirmationEntered function
-	 *
-	 * \param connectionHandle The handle of the connection
-	 */
-	virtual void confirmationRequest(ble::connection_handle_t connectionHandle) override {
-		std::cout << "Confirmation required!" << std::endl;
-		_ble.securityManager().confirmationEntered(connectionHandle, true);
-	}
-
-	/**
-	 * \brief Indicate to the application that a passkey is required. The application should
-	 * proceed by supplying the passkey through the passkeyEntered function.
-	 *
-	 * \param connectionHandle The handle of the connection
-	 */
-	virtual void passkeyRequest(ble::connection_handle_t connectionHandle) override {
-		std::cout << "passkeyRequest" << std::endl;
-	}
-
-	/**
-	 * \brief Notify the application that a key was pressed by the peer during passkey entry.
-	 *
-	 * \param connectionHandle The handle of the connection
-	 * \param keypress The keypress event type
-	 */
-	virtual void keypressNotification(ble::connection_handle_t connectionHandle,
-									  SecurityManager::Keypress_t keypress) override {
-		std::cout << "keypressNotification" << std::endl;
-	}
-
-	/**
-	 * \brief Delivers the CSRK to the application
-	 *
-	 * \param connectionHandle The handle of the connection
-	 * \param csrk The Connection Signature Resolving Key
-	 * \param authenticated True if authenticated
-	 */
-	virtual void signingKey(ble::connection_handle_t connectionHandle,
-							const ble::csrk_t *csrk,
-							bool authenticated) override {
-		std::cout << "signingKey" << std::endl;
-	}
-
-	/**
-	 * \brief Indicate to the application that pairing has completed
-	 *
-	 * \param connectionHandle The handle of the connect
-	 * \param result The pairing completion result
-	 */
-	virtual void pairingResult(ble::connection_handle_t connectionHandle,
-							   SecurityManager::SecurityCompletionStatus_t result) override {
-		printf("Security status 0x%02x\r\n", result);
-		if (result == SecurityManager::SEC_STATUS_SUCCESS) {
-			std::cout << "Security success" << std::endl;
-		} else {
-			std::cout << "Security failed" << std::endl;
-		}
-	}
-};
-#endif //! _BLE_GAP_SM_H_
+#ifndef _BLE_GAP_SM_H_
+#define _BLE_GAP_SM_H_
+#include "ble/SecurityManager.h"
+#include "ble_gap.h"
+
+#define SIGNING_KEY_SLOTS 4 //!< Number of connections whose signing key is kept
+
+/**
+ * \brief Security manager event handler class derived from CGap class
+ *
+ */
+class CGapSecurity : private mbed::NonCopyable<CGapSecurity>,
+					 public CGap,
+					 public SecurityManager::EventHandler {
+  protected:
+	SecurityManager::SecurityIOCapabilities_t _io_capability; //!< The device IO capability
+	const char *_db_filepath; //!< The security database file path. NULL keeps the bonds in RAM only.
+
+	uint32_t _connection_time_us;			//!< Timestamp of the last connection complete event
+	bool _pairing_performed;				//!< Set if the current link went through pairing
+	ble_utils::LatencyStats _pairing_latency;		//!< Connection to encryption latency with pairing
+	ble_utils::LatencyStats _reencryption_latency; //!< Connection to encryption latency using stored LTK
+
+	BLEProtocol::Address_t _bondedIdentityAddresses[ACCEPT_LIST_CAPACITY]; //!< Storage of the bonded identities
+	Gap::Whitelist_t _bondedIdentities; //!< The bonded identities read from the bond table
+	mbed::Callback<void(ble::connection_handle_t)> _onBonded; //!< The user callback of a completed pairing
+
+	/**
+	 * \brief The signing key of a connected peer
+	 *
+	 */
+	struct signing_key_t {
+		bool valid;								 //!< Set if the slot holds a key
+		ble::connection_handle_t connectionHandle; //!< The connection the key belongs to
+		ble::csrk_t csrk;						 //!< The Connection Signature Resolving Key of the peer
+		bool authenticated;						 //!< True if the key was distributed over an authenticated link
+	};
+	signing_key_t _signing_keys[SIGNING_KEY_SLOTS]; //!< The signing keys of the connected peers
+
+  public:
+	/**
+	 * \brief Construct a new CGapSecurity object
+	 * \param ble A reference to one only BLE instance of the system
+	 * \param eventQueue The event queue of the application
+	 * \param deviceName The Bluetooth Device Name
+	 * \param advLed Advertisement LED to be blinked when advertising
+	 * \param connectedLed Connected LED to be lit when connected.
+	 * \param ioCapability IO capability of the device
+	 * \param dbFilepath Path of the file where the bonding keys are stored. The file system must be
+	 * 					mounted before the stack is initialized. If NULL, the bonds are kept in RAM only.
+	 */
+	CGapSecurity(BLE &ble,
+				 CEventQueue &eventQueue,
+				 const char *deviceName,
+				 SecurityManager::SecurityIOCapabilities_t ioCapability = SecurityManager::IO_CAPS_NONE,
+                 PinName advLed = LED1,
+				 PinName connectedLed = LED1,
+				 const char *dbFilepath = NULL)
+		: CGap(ble, eventQueue, deviceName, advLed, connectedLed), _io_capability(ioCapability),
+		  _db_filepath(dbFilepath), _connection_time_us(0), _pairing_performed(false) {
+		for (auto &key : _signing_keys) {
+			key.valid = false;
+		}
+		// empty until the bond table is read at the initialization
+		_bondedIdentities.addresses = _bondedIdentityAddresses;
+		_bondedIdentities.size = 0;
+		_bondedIdentities.capacity = ACCEPT_LIST_CAPACITY;
+	}
+	/**
+	 * \brief Override of the Stack initialization complete function
+	 *
+	 * \param context Initialization complete context
+	 */
+	void onBleStackInitComplete(BLE::InitializationCompleteCallbackContext *context) override {
+		ble_error_t error;
+		if (context->error) {
+			std::cout << "Error during the initialisation" << std::endl;
+			return;
+		}
+		/* If the security manager is required this needs to be called before any
+		 * calls to the Security manager happen. */
+		error = CGap::_ble.securityManager().init(true /* Enable bonding*/,
+												  true /*Require MITM protection*/,
+												  _io_capability /*IO capabilities*/,
+												  NULL /*Passkey*/,
+												  true /*Support data signing*/,
+												  _db_filepath /*Security database file*/);
+		ble_utils::printError(error, "_ble.securityManager().init() ");
+		if (error != BLE_ERROR_NONE) {
+			return;
+		}
+		// keep the bonds over resets so that bonded peers can restore encryption from the stored LTK
+		error = _ble.securityManager().preserveBondingStateOnReset(_db_filepath != NULL);
+		ble_utils::printError(error, "_ble.securityManager().preserveBondingStateOnReset() ");
+		// enable legacy pairing
+		_ble.securityManager().allowLegacyPairing(true);
+		// set the event handler to this object
+		_ble.securityManager().setSecurityManagerEventHandler(this);
+		/** This tells the stack to generate a pairingRequest event
+		 * which will require this application to respond before pairing
+		 * can proceed. Setting it to false will automatically accept
+		 * pairing. */
+		_ble.securityManager().setPairingRequestAuthorisation(true);
+
+		CGap::onBleStackInitComplete(context);
+		/*Enable privacy so we can find the keys */
+		error = _ble.gap().enablePrivacy(true);
+
+		ble_utils::printError(error, "_ble.gap().enablePrivacy() ");
+		Gap::PeripheralPrivacyConfiguration_t configuration_p = {
+			/* use_non_resolvable_random_address */ false,
+			Gap::PeripheralPrivacyConfiguration_t::REJECT_NON_RESOLVED_ADDRESS};
+		_ble.gap().setPeripheralPrivacyConfiguration(&configuration_p);
+		/* The stack fills the resolving list from the bond table when privacy is enabled.
+		 * Fill the filter accept list with the bonded identities too. */
+		refreshAcceptList();
+	}
+
+	/**
+	 * \brief Requests the filter accept list to be generated from the bond table.
+	 * \details The list is delivered asynchronously to whitelistFromBondTable().
+	 */
+	void refreshAcceptList() {
+		_bondedIdentities.addresses = _bondedIdentityAddresses;
+		_bondedIdentities.size = 0;
+		_bondedIdentities.capacity = ACCEPT_LIST_CAPACITY;
+		ble_error_t error = _ble.securityManager().generateWhitelistFromBondTable(&_bondedIdentities);
+		ble_utils::printError(error, "_ble.securityManager().generateWhitelistFromBondTable() ");
+	}
+
+	/**
+	 * \brief Checks whether a peer is in the bond table
+	 *
+	 * \param address The identity address of the peer, as resolved by the stack
+	 * \return true if the peer is bonded
+	 */
+	bool isBonded(const ble::address_t &address) const {
+		for (size_t ii = 0; ii < _bondedIdentities.size; ii++) {
+			const BLEProtocol::Address_t &bond = _bondedIdentityAddresses[ii];
+			if (memcmp(bond.address, address.data(), sizeof(bond.address)) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * \brief Sets the callback called when a pairing has completed and the peer is bonded
+	 *
+	 * \param callback The callback object. If this is nullptr, it disables callback calling.
+	 */
+	void setOnBonded(mbed::Callback<void(ble::connection_handle_t)> callback) { _onBonded = callback; }
+
+	/**
+	 * \brief Delivers the identities of the bonded peers
+	 *
+	 * \param whitelist The list of the bonded identities
+	 */
+	virtual void whitelistFromBondTable(Gap::Whitelist_t *whitelist) override { setAcceptList(*whitelist); }
+	/**
+	 * \brief Override of connection complete function
+	 *
+	 * \param event The connection complete event
+	 */
+	virtual void onConnectionComplete(const ble::ConnectionCompleteEvent &event) override {
+		// ble_error_t error;
+		CGap::onConnectionComplete(event);
+		if (event.getStatus() != BLE_ERROR_NONE) {
+			return;
+		}
+		ble::connection_handle_t handle = event.getConnectionHandle();
+		_connection_time_us = ble_utils::timestampUs();
+		_pairing_performed = false;
+		/* Request a change in link security. This will be done
+		 * indirectly by asking the master of the connection to
+		 * change it. Depending on circumstances different actions
+		 * may be taken by the master which will trigger events
+		 * which the applications should deal with. */
+		ble_error_t error =
+			_ble.securityManager().setLinkSecurity(handle,
+												   SecurityManager::SECURITY_MODE_ENCRYPTION_WITH_MITM);
+
+		ble_utils::printError(error, "_ble.securityManager().setLinkSecuirty() ");
+	}
+
+	/**
+	 * \brief Override of disconnection complete function
+	 *
+	 * \param event The disconnection complete event
+	 */
+	virtual void onDisconnectionComplete(const ble::DisconnectionCompleteEvent &event) override {
+		signing_key_t *key = findSigningKey(event.getConnectionHandle());
+		if (key != nullptr) {
+			key->valid = false;
+		}
+		CGap::onDisconnectionComplete(event);
+	}
+
+	/**
+	 * \brief Finds the signing key slot of a connection
+	 *
+	 * \param connectionHandle The connection handle
+	 * \return signing_key_t* The slot or nullptr if the peer has not distributed a key
+	 */
+	signing_key_t *findSigningKey(ble::connection_handle_t connectionHandle) {
+		for (auto &key : _signing_keys) {
+			if (key.valid && key.connectionHandle == connectionHandle) {
+				return &key;
+			}
+		}
+		return nullptr;
+	}
+	/**
+	 * \brief Request application to accept or reject pairing. Application should respond by
+	 * calling the appropriate function: acceptPairingRequest or cancelPairingRequest
+	 *
+	 * \param connectionHandle The connection handle of the link associated with the pairing process
+	 */
+	virtual void pairingRequest(ble::connection_handle_t connectionHandle) override {
+		std::cout << "Pairing requested - authorising" << std::endl;
+		_pairing_performed = true;
+		_ble.securityManager().acceptPairingRequest(connectionHandle);
+	}
+	/**
+	 * \brief Inform the device of the encryption state of a given link.
+	 *
+	 * \param connectionHandle The connection handle of the link
+	 * \param result the encryption process result
+	 */
+	virtual void linkEncryptionResult(ble::connection_handle_t connectionHandle,
+									  ble::link_encryption_t result) override {
+		ble_recorder::CEventRecorder::instance().linkEncryption(connectionHandle, result);
+		if (result == ble::link_encryption_t::ENCRYPTED) {
+			std::cout << "Link ENCRYPTED" << std::endl;
+		} else if (result == ble::link_encryption_t::ENCRYPTED_WITH_MITM) {
+			std::cout << "Link ENCRYPTED_WITH_MITM" << std::endl;
+		} else if (result == ble::link_encryption_t::NOT_ENCRYPTED) {
+			std::cout << "Link NOT_ENCRYPTED" << std::endl;
+		}
+		if (result == ble::link_encryption_t::ENCRYPTED || result == ble::link_encryption_t::ENCRYPTED_WITH_MITM) {
+			// a bonded peer restores the encryption without the pairing request
+			if (_pairing_performed) {
+				_pairing_latency.addSince(_connection_time_us);
+			} else {
+				_reencryption_latency.addSince(_connection_time_us);
+			}
+			printSecurityLatency();
+		}
+	}
+
+	/**
+	 * \brief Prints the connection to encryption latency of paired and re-encrypted links
+	 *
+	 */
+	void printSecurityLatency() const {
+		_pairing_latency.print("Pairing latency");
+		_reencryption_latency.print("Re-encryption latency");
+	}
+
+	/**
+	 * \brief Removes all the bonds from the security database
+	 *
+	 * \return BLE_ERROR_NONE on success, an appropriate error code otherwise
+	 */
+	ble_error_t clearBonds() {
+		ble_error_t error = _ble.securityManager().purgeAllBondingState();
+		ble_utils::printError(error, "_ble.securityManager().purgeAllBondingState() ");
+		refreshAcceptList();
+		return error;
+	}
+
+	/**
+	 * \brief Display the given passkey on the local device.
+	 *
+	 * \param connectionHandle The handle of the connection
+	 * \param passkey The passkey to be displayed
+	 */
+	virtual void passkeyDisplay(ble::connection_handle_t connectionHandle,
+								const SecurityManager::Passkey_t passkey) override {
+		std::cout << "Input passKey: ";
+		for (unsigned i = 0; i < Gap::ADDR_LEN; i++) {
+			printf("%c ", passkey[Gap::ADDR_LEN - 1 - i]);
+		}
+		std::cout << std::endl;
+	}
+	/**
+	 * \brief Indicate to the application that a confirmation is required. This is used
+	 * when the device does not have a keyboard but has a yes/no button. The device
+	 * displays numbers on its display in response to passkeyDisplay and the user
+	 * checks if they are the same on both devices. The application should proceed
+	 * by supplying the confirmation using the confirmationEntered function
+	 *
+	 * \param connectionHandle The handle of the connection
+	 */
+	virtual void confirmationRequest(ble::connection_handle_t connectionHandle) override {
+		std::cout << "Confirmation required!" << std::endl;
+		_ble.securityManager().confirmationEntered(connectionHandle, true);
+	}
+
+	/**
+	 * \brief Indicate to the application that a passkey is required. The application should
+	 * proceed by supplying the passkey through the passkeyEntered function.
+	 *
+	 * \param connectionHandle The handle of the connection
+	 */
+	virtual void passkeyRequest(ble::connection_handle_t connectionHandle) override {
+		std::cout << "passkeyRequest" << std::endl;
+	}
+
+	/**
+	 * \brief Notify the application that a key was pressed by the peer during passkey entry.
+	 *
+	 * \param connectionHandle The handle of the connection
+	 * \param keypress The keypress event type
+	 */
+	virtual void keypressNotification(ble::connection_handle_t connectionHandle,
+									  SecurityManager::Keypress_t keypress) override {
+		std::cout << "keypressNotification" << std::endl;
+	}
+
+	/**
+	 * \brief Delivers the CSRK to the application
+	 *
+	 * \param connectionHandle The handle of the connection
+	 * \param csrk The Connection Signature Resolving Key
+	 * \param authenticated True if authenticated
+	 */
+	virtual void signingKey(ble::connection_handle_t connectionHandle,
+							const ble::csrk_t *csrk,
+							bool authenticated) override {
+		std::cout << "signingKey authenticated " << authenticated << std::endl;
+		signing_key_t *key = findSigningKey(connectionHandle);
+		for (int ii = 0; key == nullptr && ii < SIGNING_KEY_SLOTS; ii++) {
+			if (!_signing_keys[ii].valid) {
+				key = &_signing_keys[ii];
+			}
+		}
+		if (key == nullptr) {
+			std::cout << "No free signing key slot" << std::endl;
+			return;
+		}
+		key->valid = true;
+		key->connectionHandle = connectionHandle;
+		key->csrk = *csrk;
+		key->authenticated = authenticated;
+	}
+
+	/**
+	 * \brief Checks whether the peer can send authenticated Signed Write Commands
+	 *
+	 * \param connectionHandle The handle of the connection
+	 * \return true if the peer distributed a CSRK over an authenticated link
+	 * \return false otherwise
+	 */
+	bool hasAuthenticatedSigningKey(ble::connection_handle_t connectionHandle) {
+		signing_key_t *key = findSigningKey(connectionHandle);
+		return (key != nullptr) && key->authenticated;
+	}
+
+	/**
+	 * \brief Indicate to the application that pairing has completed
+	 *
+	 * \param connectionHandle The handle of the connect
+	 * \param result The pairing completion result
+	 */
+	virtual void pairingResult(ble::connection_handle_t connectionHandle,
+							   SecurityManager::SecurityCompletionStatus_t result) override {
+		BLE_PROFILE_SCOPE("CGapSecurity::pairingResult");
+		ble_recorder::CEventRecorder::instance().pairingResult(connectionHandle, (uint8_t)result);
+		printf("Security status 0x%02x\r\n", result);
+		if (result == SecurityManager::SEC_STATUS_SUCCESS) {
+			std::cout << "Security success" << std::endl;
+			// a new bond may have been created
+			refreshAcceptList();
+			if (_onBonded) {
+				_onBonded(connectionHandle);
+			}
+		} else {
+			std::cout << "Security failed" << std::endl;
+		}
+	}
+};
+#endif //! _BLE_GAP_SM_H_
@@ -0,0 +1,108 @@
+#ifndef _ALERT_NOTIFICATION_TYPES_H_
+#define _ALERT_NOTIFICATION_TYPES_H_
+
+#include <stdint.h>
+
+/**
+ * \brief The Alert Notification Service protocol types
+ * \details The types depend only on the standard headers, so the same definitions are used by the service
+ * 			on the target and by the host side central, which talks to the service over the air.
+ */
+struct CAlertNotificationServiceTypes {
+	/**
+	 * \brief Alert notification control point commands, as defined in the Alert Notification Specification.
+	 * UUID: 0x2A44.
+	 */
+	enum CategoryId {
+		ANS_TYPE_SIMPLE_ALERT = 0,			 /**< General text alert or non-text alert.*/
+		ANS_TYPE_EMAIL = 1,					 /**< Email message arrives.*/
+		ANS_TYPE_NEWS = 2,					 /**< News feeds such as RSS, Atom.*/
+		ANS_TYPE_NOTIFICATION_CALL = 3,		 /**< Incoming call.*/
+		ANS_TYPE_MISSED_CALL = 4,			 /**< Missed call.*/
+		ANS_TYPE_SMS_MMS = 5,				 /**< SMS or MMS message arrives.*/
+		ANS_TYPE_VOICE_MAIL = 6,			 /**< Voice mail.*/
+		ANS_TYPE_SCHEDULE = 7,				 /**< Alert that occurs on calendar, planner.*/
+		ANS_TYPE_HIGH_PRIORITIZED_ALERT = 8, /**< Alert to be handled as high priority.*/
+		ANS_TYPE_INSTANT_MESSAGE = 9,		 /**< Alert for incoming instant messages.*/
+		ANS_TYPE_ALL_ALERTS = 0xFF			 /**< Identifies all alerts. */
+	};
+	enum CategoryMaskId {
+		ANS_TYPE_MASK_SIMPLE_ALERT = (1 << 0),			 /**< General text alert or non-text alert.*/
+		ANS_TYPE_MASK_EMAIL = (1 << 1),					 /**< Email message arrives.*/
+		ANS_TYPE_MASK_NEWS = (1 << 2),					 /**< News feeds such as RSS, Atom.*/
+		ANS_TYPE_MASK_NOTIFICATION_CALL = (1 << 3),		 /**< Incoming call.*/
+		ANS_TYPE_MASK_MISSED_CALL = (1 << 4),			 /**< Missed call.*/
+		ANS_TYPE_MASK_SMS_MMS = (1 << 5),				 /**< SMS or MMS message arrives.*/
+		ANS_TYPE_MASK_VOICE_MAIL = (1 << 6),			 /**< Voice mail.*/
+		ANS_TYPE_MASK_SCHEDULE = (1 << 7),				 /**< Alert that occurs on calendar, planner.*/
+		ANS_TYPE_MASK_HIGH_PRIORITIZED_ALERT = (1 << 8), /**< Alert to be handled as high priority.*/
+		ANS_TYPE_MASK_INSTANT_MESSAGE = (1 << 9),		 /**< Alert for incoming instant messages.*/
+		ANS_TYPE_MASK_ALL_ALERTS = 0x03FF				 /**< Identifies all alerts. */
+	};
+	/**
+	 * \brief Alert notification control point commands, as defined in the Alert Notification Specification.
+	 * UUID: 0x2A44
+	 */
+	enum CommandId {
+		ANS_ENABLE_NEW_INCOMING_ALERT_NOTIFICATION = 0,		/**< Enable New Incoming Alert Notification.*/
+		ANS_ENABLE_UNREAD_CATEGORY_STATUS_NOTIFICATION = 1, /**< Enable Unread Category Status Notification.*/
+		ANS_DISABLE_NEW_INCOMING_ALERT_NOTIFICATION = 2,	/**< Disable New Incoming Alert Notification.*/
+		ANS_DISABLE_UNREAD_CATEGORY_STATUS_NOTIFICATION =
+			3,											   /**< Disable Unread Category Status Notification.*/
+		ANS_NOTIFY_NEW_INCOMING_ALERT_IMMEDIATELY = 4,	   /**< Notify New Incoming Alert immediately.*/
+		ANS_NOTIFY_UNREAD_CATEGORY_STATUS_IMMEDIATELY = 5, /**< Notify Unread Category Status immediately.*/
+		ANS_COMMAND_COUNT = 6							   /**< Number of commands.*/
+	};
+	/**
+	 * \brief The supported categories a control point command is checked against
+	 *
+	 */
+	enum CommandTarget {
+		ANS_TARGET_NEW_ALERT = 0,	 /**< The Supported New Alert Category.*/
+		ANS_TARGET_UNREAD_ALERT = 1, /**< The Supported Unread Alert Category.*/
+		ANS_TARGET_INVALID = 2		 /**< The command is not supported.*/
+	};
+	/**
+	 * \brief The Attribute Protocol application errors of the service
+	 *
+	 */
+	enum ErrorCode {
+		ANS_ERROR_COMMAND_NOT_SUPPORTED = 0xA0 /**< Unknown command, or a category that is not supported.*/
+	};
+	/**
+	 * \brief The control point validation table, indexed by CommandId
+	 *
+	 * \param command The command of a control point write
+	 * \return CommandTarget The categories the command is checked against, ANS_TARGET_INVALID if not supported
+	 */
+	static constexpr CommandTarget commandTarget(uint8_t command) {
+		constexpr CommandTarget targets[ANS_COMMAND_COUNT] = {ANS_TARGET_NEW_ALERT, ANS_TARGET_UNREAD_ALERT,
+															   ANS_TARGET_NEW_ALERT, ANS_TARGET_UNREAD_ALERT,
+															   ANS_TARGET_NEW_ALERT, ANS_TARGET_UNREAD_ALERT};
+		return (command < ANS_COMMAND_COUNT) ? targets[command] : ANS_TARGET_INVALID;
+	}
+	/**
+	 * \brief The ANS control point commands
+	 *
+	 */
+	union control_point_t {
+		uint16_t value;
+		struct control_point_fields {
+			uint8_t command;
+			uint8_t category;
+		} fields;
+	};
+	/**
+	 * \brief Alert status data structure
+	 *
+	 */
+	union alert_status_t {
+		uint16_t value;
+		struct alert_status_fields {
+			uint8_t category; //!< The alert category
+			uint8_t count;	  //!< The number of unread alerts
+		} fields;
+	};
+};
+
+#endif //!_ALERT_NOTIFICATION_TYPES_H_
\ No newline at end of file
@@ -1,272 +1,563 @@
-#ifndef _BLE_CHARACTERISTIC_H_
-#define _BLE_CHARACTERISTIC_H_
-
-#include <iostream>
-#include <mbed.h>
-
-#include "ble/BLE.h"
-/**
- * \brief General Characteristic class
- *
- * \tparam T The value type of the characteristic
- */
-template <typename T> class CCharacteristic : public GattCharacteristic {
-  private:
-	T _value;
-
-  public:
-	/**
-	 * Construct a characteristic that can be read or written and emit
-	 * notification or indication.
-	 *
-	 * @param[in] uuid The UUID of the characteristic.
-	 * @param[in] initial_value Initial value contained by the characteristic.
-	 */
-	//
-	/**
-	 * \brief Construct a new CCharacteristic object
-	 *
-	 * \param uuid The UUID of the characteristic
-	 * \param initialValue The initial value of the characteristic
-	 * \param properties The properties of the characteristic. This is a bitfield.
-	 * \param descriptors The characteristics descriptors
-	 * \param numOfDescriptos number of descriptors
-	 */
-	CCharacteristic(const UUID &uuid,
-					const T &initialValue,
-					const uint8_t properties,
-					GattAttribute *descriptors[] = NULL,
-					int numOfDescriptors = 0)
-		: _value(initialValue), GattCharacteristic(/* UUID */ uuid,
-												   /* Initial value */ reinterpret_cast<uint8_t *>(&_value),
-												   /* Value size */ sizeof(T),
-												   /* Value capacity */ sizeof(T),
-												   /* Properties */ properties,
-												   /* Descriptors */ descriptors,
-												   /* Num descriptors */ numOfDescriptors,
-												   /* variable len */ false) {}
-
-	/**
-	 * Get the value of this characteristic.
-	 *
-	 * @param[in] server GattServer instance that contain the characteristic
-	 * value.
-	 * @param[in] dst Variable that will receive the characteristic value.
-	 *
-	 * @return BLE_ERROR_NONE in case of success or an appropriate error code.
-	 */
-	ble_error_t get(GattServer *server, T &dst) const {
-		uint16_t value_length = sizeof(dst);
-		return server->read(getValueHandle(), (uint8_t *)&dst, &value_length);
-	}
-
-	/**
-	 * Assign a new value to this characteristic.
-	 *
-	 * @param[in] server GattServer instance that will receive the new value.
-	 * @param[in] value The new value to set.
-	 * @param[in] local_only Flag that determine if the change should be kept
-	 * locally or forwarded to subscribed clients.
-	 */
-	ble_error_t set(GattServer *server, const T &value, bool localOnly = false) {
-		_value = value;
-		return server->write(getValueHandle(),
-							 reinterpret_cast<uint8_t *>(&_value),
-							 sizeof(T),
-							 localOnly);
-	}
-};
-/**
- * \brief Characteristics comparison function
- *
- * \param obj1 The first object to compared
- * \param obj2  The second object of the comparison
- * \return true if the first object should placed before object 2
- * \return false otherwise
- */
-static bool compareCharacteristics(const GattCharacteristic *obj1, const GattCharacteristic *obj2) {
-	return (obj1->getValueAttribute().getUUID().getShortUUID() <=
-			obj2->getValueAttribute().getUUID().getShortUUID());
-}
-
-/**
- * \brief  Read only characteristic
- *
- * \tparam T The value type of the characteristic
- */
-template <typename T> class CReadOnlyCharacteristic : public CCharacteristic<T> {
-  public:
-	/**
-	 * \brief Construct a new CReadOnlyCharacteristic object
-	 *
-	 * \param uuid The UUID of the characteristic
-	 * \param initialValue The initial value of the characteristic
-	 * \param descriptors The characteristics descriptors
-	 * \param numOfDescriptos number of descriptors
-	 */
-	CReadOnlyCharacteristic(const UUID &uuid,
-							const T &initialValue,
-							GattAttribute *descriptors[] = NULL,
-							int numOfDescriptors = 0)
-		: CCharacteristic<T>(uuid,
-							 initialValue,
-							 (uint8_t)GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ,
-							 descriptors,
-							 numOfDescriptors) {}
-};
-
-template <typename T> class CWriteOnlyCharacteristic : public CCharacteristic<T> {
-  public:
-	/**
-	 * \brief Construct a new CReadOnlyCharacteristic object
-	 *
-	 * \param uuid The UUID of the characteristic
-	 * \param initialValue The initial value of the characteristic
-	 * \param descriptors The characteristics descriptors
-	 * \param numOfDescriptos number of descriptors
-	 */
-	CWriteOnlyCharacteristic(const UUID &uuid,
-							 const T &initialValue,
-							 GattAttribute *descriptors[] = NULL,
-							 int numOfDescriptors = 0)
-		: CCharacteristic<T>(uuid,
-							 initialValue,
-							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE,
-							 descriptors,
-							 numOfDescriptors) {}
-};
-
-template <typename T> class CNotifyOnlyCharacteristic : public CCharacteristic<T> {
-  public:
-	/**
-	 * \brief Construct a new CReadOnlyCharacteristic object
-	 *
-	 * \param uuid The UUID of the characteristic
-	 * \param initialValue The initial value of the characteristic
-	 * \param descriptors The characteristics descriptors
-	 * \param numOfDescriptos number of descriptors
-	 */
-	CNotifyOnlyCharacteristic(const UUID &uuid,
-							  const T &initialValue,
-							  GattAttribute *descriptors[] = NULL,
-							  int numOfDescriptors = 0)
-		: CCharacteristic<T>(uuid,
-							 initialValue,
-							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY,
-							 descriptors,
-							 numOfDescriptors) {}
-};
-
-template <typename T> class CReadWriteCharacteristic : public CCharacteristic<T> {
-  public:
-	/**
-	 * \brief Construct a new CReadOnlyCharacteristic object
-	 *
-	 * \param uuid The UUID of the characteristic
-	 * \param initialValue The initial value of the characteristic
-	 * \param descriptors The characteristics descriptors
-	 * \param numOfDescriptos number of descriptors
-	 */
-	CReadWriteCharacteristic(const UUID &uuid,
-							 const T &initialValue,
-							 GattAttribute *descriptors[] = NULL,
-							 int numOfDescriptors = 0)
-		: CCharacteristic<T>(uuid,
-							 initialValue,
-							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
-								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE,
-							 descriptors,
-							 numOfDescriptors) {}
-};
-
-template <typename T> class CReadNotifyCharacteristic : public CCharacteristic<T> {
-  public:
-	/**
-	 * \brief Construct a new CReadOnlyCharacteristic object
-	 *
-	 * \param uuid The UUID of the characteristic
-	 * \param initialValue The initial value of the characteristic
-	 * \param descriptors The characteristics descriptors
-	 * \param numOfDescriptos number of descriptors
-	 */
-	CReadNotifyCharacteristic(const UUID &uuid,
-							  const T &initialValue,
-							  GattAttribute *descriptors[] = NULL,
-							  int numOfDescriptors = 0)
-		: CCharacteristic<T>(uuid,
-							 initialValue,
-							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
-								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY,
-							 descriptors,
-							 numOfDescriptors) {}
-};
-
-template <typename T> class CReadWriteNotifyCharacteristic : public CCharacteristic<T> {
-  public:
-	/**
-	 * \brief Construct a new CReadOnlyCharacteristic object
-	 *
-	 * \param uuid The UUID of the characteristic
-	 * \param initialValue The initial value of the characteristic
-	 * \param descriptors The characteristics descriptors
-	 * \param numOfDescriptos number of descriptors
-	 */
-	CReadWriteNotifyCharacteristic(const UUID &uuid,
-								   const T &initialValue,
-								   GattAttribute *descriptors[] = NULL,
-								   int numOfDescriptors = 0)
-		: CCharacteristic<T>(uuid,
-							 initialValue,
-							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
-								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE |
-								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY,
-							 descriptors,
-							 numOfDescriptors) {}
-};
-
-template <typename T> class CReadIndicateCharacteristic : public CCharacteristic<T> {
-  public:
-	/**
-	 * \brief Construct a new CReadOnlyCharacteristic object
-	 *
-	 * \param uuid The UUID of the characteristic
-	 * \param initialValue The initial value of the characteristic
-	 * \param descriptors The characteristics descriptors
-	 * \param numOfDescriptos number of descriptors
-	 */
-	CReadIndicateCharacteristic(const UUID &uuid,
-								const T &initialValue,
-								GattAttribute *descriptors[] = NULL,
-								int numOfDescriptors = 0)
-		: CCharacteristic<T>(uuid,
-							 initialValue,
-							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
-								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE,
-							 descriptors,
-							 numOfDescriptors) {}
-};
-
-template <typename T> class CReadWriteIndicateCharacteristic : public CCharacteristic<T> {
-  public:
-	/**
-	 * \brief Construct a new CReadOnlyCharacteristic object
-	 *
-	 * \param uuid The UUID of the characteristic
-	 * \param initialValue The initial value of the characteristic
-	 * \param descriptors The characteristics descriptors
-	 * \param numOfDescriptos number of descriptors
-	 */
-	CReadWriteIndicateCharacteristic(const UUID &uuid,
-									 const T &initialValue,
-									 GattAttribute *descriptors[] = NULL,
-									 int numOfDescriptors = 0)
-		: CCharacteristic<T>(uuid,
-							 initialValue,
-							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
-								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE |
-								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE,
-							 descriptors,
-							 numOfDescriptors) {}
-};
-
-#endif //! _BLE_CHARACTERISTIC_H_
+#ifndef _BLE_CHARACTERISTIC_H_
+#define _BLE_CHARACTERISTIC_H_
+
+#include <iostream>
+#include <mbed.h>
+
+#include "ble/BLE.h"
+#include "ble_attribute_arena.h"
+#include "ble_trace.h"
+
+/**
+ * \brief The authorization chain of a characteristic, for the writes or the reads
+ * \details The stack keeps one write and one read authorization callback per characteristic. A CCharacteristic
+ * 			installs its chains as those callbacks. A chain runs the gate of the server first, e.g. the write
+ * 			rate limit, and then the authorization of the characteristic, so neither replaces the other. The
+ * 			chains are linked in a list, so the server finds the chain of a characteristic it only knows as a
+ * 			GattCharacteristic.
+ *
+ * \tparam Params GattWriteAuthCallbackParams or GattReadAuthCallbackParams
+ */
+template <typename Params> class CAuthorizationChain : private mbed::NonCopyable<CAuthorizationChain<Params> > {
+  private:
+	const GattCharacteristic &_characteristic; //!< The characteristic of the chain
+	CAuthorizationChain *_next;				   //!< The next chain in the list
+
+	mbed::Callback<void(Params *)> _gate;	   //!< The check of the server, runs first
+	mbed::Callback<void(Params *)> _authorize; //!< The check of the characteristic
+
+	/**
+	 * \brief The first chain of the list
+	 *
+	 */
+	static CAuthorizationChain *&first() {
+		static CAuthorizationChain *chain = nullptr;
+		return chain;
+	}
+
+  public:
+	/**
+	 * \brief Construct a new CAuthorizationChain object and link it to the list
+	 *
+	 * \param characteristic The characteristic of the chain
+	 */
+	CAuthorizationChain(const GattCharacteristic &characteristic) : _characteristic(characteristic), _next(first()) {
+		first() = this;
+	}
+	~CAuthorizationChain() {
+		for (CAuthorizationChain **link = &first(); *link != nullptr; link = &(*link)->_next) {
+			if (*link == this) {
+				*link = _next;
+				break;
+			}
+		}
+	}
+
+	/**
+	 * \brief Finds the chain of a characteristic
+	 *
+	 * \param characteristic The characteristic
+	 * \return CAuthorizationChain* The chain, nullptr if the characteristic is not a CCharacteristic
+	 */
+	static CAuthorizationChain *find(const GattCharacteristic *characteristic) {
+		for (CAuthorizationChain *chain = first(); chain != nullptr; chain = chain->_next) {
+			if (&chain->_characteristic == characteristic) {
+				return chain;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * \brief Sets the check of the server, run before the check of the characteristic
+	 *
+	 */
+	void setGate(mbed::Callback<void(Params *)> gate) { _gate = gate; }
+	/**
+	 * \brief Sets the check of the characteristic
+	 *
+	 */
+	void setAuthorization(mbed::Callback<void(Params *)> authorize) { _authorize = authorize; }
+
+	/**
+	 * \brief The authorization callback of the stack. The first check that does not reply
+	 * 		  AUTH_CALLBACK_REPLY_SUCCESS rejects the request.
+	 *
+	 * \param params The write or the read
+	 */
+	void authorize(Params *params) {
+		params->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+		if (_gate) {
+			_gate(params);
+			if (params->authorizationReply != AUTH_CALLBACK_REPLY_SUCCESS) {
+				return;
+			}
+		}
+		if (_authorize) {
+			_authorize(params);
+		}
+	}
+};
+
+typedef CAuthorizationChain<GattWriteAuthCallbackParams> CWriteAuthorization; //!< The write authorization chain
+typedef CAuthorizationChain<GattReadAuthCallbackParams> CReadAuthorization;	  //!< The read authorization chain
+
+/**
+ * \brief General Characteristic class
+ *
+ * \tparam T The value type of the characteristic
+ */
+template <typename T> class CCharacteristic : public GattCharacteristic {
+  private:
+#if BLE_ATTRIBUTE_ARENA
+	unsigned _slot; //!< The slot of the value in the attribute arena
+#else
+	T _own_value; //!< The value, when it is not kept in the attribute arena
+#endif
+	T &_value; //!< The value, the stack keeps a pointer to it
+
+	mbed::Callback<void(T &)> _compute; //!< Computes the value when a client reads it
+	uint32_t _cache_ms;					//!< Time a computed value is reused for
+	uint32_t _computed_ms;				//!< Time of the last computation
+	bool _computed;						//!< Set if the value has been computed
+
+	mbed::Callback<GattAuthCallbackReply_t(const T &)> _validate; //!< Checks a written value, empty to accept all
+	CWriteAuthorization _write_authorization;					   //!< The write authorization chain
+	CReadAuthorization _read_authorization;						   //!< The read authorization chain
+
+	/**
+	 * \brief The write authorization callback of a validated value
+	 *
+	 */
+	void onWriteAuthorization(GattWriteAuthCallbackParams *params) { params->authorizationReply = validateWrite(params); }
+
+	/**
+	 * \brief The read authorization callback of a computed value. The value is computed at the start of a read
+	 * 		  unless the cached one is recent enough, the following Read Blob requests of a long read get the
+	 * 		  same value. The stack reads the value through its pointer, so it is computed in place.
+	 *
+	 */
+	void onReadAuthorization(GattReadAuthCallbackParams *params) {
+		if (params->offset == 0) {
+			uint32_t now = (uint32_t)rtos::Kernel::get_ms_count();
+			if (!_computed || now - _computed_ms >= _cache_ms) {
+				_compute(_value);
+				_computed_ms = now;
+				_computed = true;
+			}
+		}
+		params->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+	}
+
+  public:
+	/**
+	 * Construct a characteristic that can be read or written and emit
+	 * notification or indication.
+	 *
+	 * @param[in] uuid The UUID of the characteristic.
+	 * @param[in] initial_value Initial value contained by the characteristic.
+	 */
+	//
+	/**
+	 * \brief Construct a new CCharacteristic object
+	 *
+	 * \param uuid The UUID of the characteristic
+	 * \param initialValue The initial value of the characteristic
+	 * \param properties The properties of the characteristic. This is a bitfield.
+	 * \param descriptors The characteristics descriptors
+	 * \param numOfDescriptos number of descriptors
+	 */
+	CCharacteristic(const UUID &uuid,
+					const T &initialValue,
+					const uint8_t properties,
+					GattAttribute *descriptors[] = NULL,
+					int numOfDescriptors = 0)
+		: GattCharacteristic(/* UUID */ uuid,
+#if BLE_ATTRIBUTE_ARENA
+							 /* Initial value */ ble_arena::CAttributeArena::instance().allocate(initialValue),
+#else
+							 /* Initial value */ reinterpret_cast<uint8_t *>(&_own_value),
+#endif
+							 /* Value size */ sizeof(T),
+							 /* Value capacity */ sizeof(T),
+							 /* Properties */ properties,
+							 /* Descriptors */ descriptors,
+							 /* Num descriptors */ numOfDescriptors,
+							 /* variable len */ false),
+#if BLE_ATTRIBUTE_ARENA
+		  _slot(ble_arena::CAttributeArena::instance().bind(getValueAttribute().getValuePtr(), this)),
+#else
+		  _own_value(initialValue),
+#endif
+		  _value(*reinterpret_cast<T *>(getValueAttribute().getValuePtr())), _cache_ms(0), _computed_ms(0),
+		  _computed(false), _write_authorization(*this), _read_authorization(*this) {
+		if ((properties & (BLE_GATT_CHAR_PROPERTIES_WRITE | BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE |
+						   BLE_GATT_CHAR_PROPERTIES_AUTHENTICATED_SIGNED_WRITES)) != 0) {
+			setWriteAuthorizationCallback(&_write_authorization, &CWriteAuthorization::authorize);
+		}
+		if ((properties & BLE_GATT_CHAR_PROPERTIES_READ) != 0) {
+			setReadAuthorizationCallback(&_read_authorization, &CReadAuthorization::authorize);
+		}
+	}
+
+	/**
+	 * Sets the write authorization of the characteristic. It runs after the checks of the server, e.g. the
+	 * write rate limit, instead of replacing them.
+	 *
+	 * @param[in] authorize Sets the reply of the write, AUTH_CALLBACK_REPLY_SUCCESS to accept it.
+	 */
+	void setWriteAuthorization(mbed::Callback<void(GattWriteAuthCallbackParams *)> authorize) {
+		_write_authorization.setAuthorization(authorize);
+	}
+
+	/**
+	 * Computes the value when a client reads it, instead of setting it whenever it may change. The
+	 * computation is the read authorization of the characteristic, it runs after the checks of the server.
+	 *
+	 * @param[in] compute Computes the value into its argument.
+	 * @param[in] cacheMs Time a computed value is reused for, 0 to compute it on every read.
+	 */
+	void setOnRead(mbed::Callback<void(T &)> compute, uint32_t cacheMs = 0) {
+		_compute = compute;
+		_cache_ms = cacheMs;
+		_computed = false;
+		_read_authorization.setAuthorization(callback(this, &CCharacteristic::onReadAuthorization));
+	}
+
+	/**
+	 * Makes the next read compute the value, e.g. when its inputs changed within the cache time.
+	 */
+	void invalidate() { _computed = false; }
+
+	/**
+	 * Checks the written values before the stack accepts them, a rejected write changes nothing. The
+	 * validator is the authorization of the characteristic, it runs after the write rate limit of the server.
+	 *
+	 * @param[in] validate Returns AUTH_CALLBACK_REPLY_SUCCESS for a valid value, else the ATT error.
+	 */
+	void setWriteValidator(mbed::Callback<GattAuthCallbackReply_t(const T &)> validate) {
+		_validate = validate;
+		_write_authorization.setAuthorization(callback(this, &CCharacteristic::onWriteAuthorization));
+	}
+
+	/**
+	 * Checks a write with the validator. Only whole values are validated, a partial write is rejected.
+	 *
+	 * @param[in] params The write.
+	 *
+	 * @return AUTH_CALLBACK_REPLY_SUCCESS if the write is valid or there is no validator, else the ATT error.
+	 */
+	GattAuthCallbackReply_t validateWrite(const GattWriteAuthCallbackParams *params) const {
+		if (!_validate) {
+			return AUTH_CALLBACK_REPLY_SUCCESS;
+		}
+		if (params->offset != 0 || params->len != sizeof(T)) {
+			return AUTH_CALLBACK_REPLY_ATTERR_INVALID_ATT_VAL_LENGTH;
+		}
+		T value;
+		memcpy(&value, params->data, sizeof(T));
+		return _validate(value);
+	}
+
+	/**
+	 * Get the value of this characteristic.
+	 *
+	 * @param[in] server GattServer instance that contain the characteristic
+	 * value.
+	 * @param[in] dst Variable that will receive the characteristic value.
+	 *
+	 * @return BLE_ERROR_NONE in case of success or an appropriate error code.
+	 */
+	ble_error_t get(GattServer *server, T &dst) const {
+		uint16_t value_length = sizeof(dst);
+		return server->read(getValueHandle(), (uint8_t *)&dst, &value_length);
+	}
+
+	/**
+	 * Assign a new value to this characteristic.
+	 *
+	 * @param[in] server GattServer instance that will receive the new value.
+	 * @param[in] value The new value to set.
+	 * @param[in] local_only Flag that determine if the change should be kept
+	 * locally or forwarded to subscribed clients.
+	 */
+	ble_error_t set(GattServer *server, const T &value, bool localOnly = false) {
+		_value = value;
+		ble_error_t error = server->write(getValueHandle(),
+										  reinterpret_cast<uint8_t *>(&_value),
+										  sizeof(T),
+										  localOnly);
+		if (error == BLE_ERROR_NONE && !localOnly) {
+			ble_trace::CTracer::instance().notified(server, *this);
+			ble_utils::CNotificationFifo::notified(server, *this);
+		}
+#if BLE_ATTRIBUTE_ARENA
+		if (error != BLE_ERROR_NO_MEM) {
+			ble_arena::CAttributeArena::instance().clean(_slot);
+		}
+#endif
+		return error;
+	}
+
+#if BLE_ATTRIBUTE_ARENA
+	/**
+	 * Stores a new value in the attribute arena only. The value is written to the stack, and the subscribed
+	 * clients notified, by the next CAttributeArena::flush().
+	 *
+	 * @param[in] value The new value.
+	 */
+	void store(const T &value) {
+		_value = value;
+		ble_arena::CAttributeArena::instance().markDirty(_slot);
+	}
+#endif
+};
+/**
+ * \brief Characteristics comparison function
+ *
+ * \param obj1 The first object to compared
+ * \param obj2  The second object of the comparison
+ * \return true if the first object should placed before object 2
+ * \return false otherwise
+ */
+static bool compareCharacteristics(const GattCharacteristic *obj1, const GattCharacteristic *obj2) {
+	return (obj1->getValueAttribute().getUUID().getShortUUID() <=
+			obj2->getValueAttribute().getUUID().getShortUUID());
+}
+
+/**
+ * \brief  Read only characteristic
+ *
+ * \tparam T The value type of the characteristic
+ */
+template <typename T> class CReadOnlyCharacteristic : public CCharacteristic<T> {
+  public:
+	/**
+	 * \brief Construct a new CReadOnlyCharacteristic object
+	 *
+	 * \param uuid The UUID of the characteristic
+	 * \param initialValue The initial value of the characteristic
+	 * \param descriptors The characteristics descriptors
+	 * \param numOfDescriptos number of descriptors
+	 */
+	CReadOnlyCharacteristic(const UUID &uuid,
+							const T &initialValue,
+							GattAttribute *descriptors[] = NULL,
+							int numOfDescriptors = 0)
+		: CCharacteristic<T>(uuid,
+							 initialValue,
+							 (uint8_t)GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ,
+							 descriptors,
+							 numOfDescriptors) {}
+};
+
+template <typename T> class CWriteOnlyCharacteristic : public CCharacteristic<T> {
+  public:
+	/**
+	 * \brief Construct a new CReadOnlyCharacteristic object
+	 *
+	 * \param uuid The UUID of the characteristic
+	 * \param initialValue The initial value of the characteristic
+	 * \param descriptors The characteristics descriptors
+	 * \param numOfDescriptos number of descriptors
+	 * \param signedWrites True to accept Signed Write Commands from peers that distributed a CSRK
+	 */
+	CWriteOnlyCharacteristic(const UUID &uuid,
+							 const T &initialValue,
+							 GattAttribute *descriptors[] = NULL,
+							 int numOfDescriptors = 0,
+							 bool signedWrites = false)
+		: CCharacteristic<T>(uuid,
+							 initialValue,
+							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE |
+								 (signedWrites ? GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_AUTHENTICATED_SIGNED_WRITES
+											   : 0),
+							 descriptors,
+							 numOfDescriptors) {}
+};
+
+/**
+ * \brief Write only characteristic that is written with Write Without Response (ATT Write Command)
+ *
+ * \tparam T The value type of the characteristic
+ */
+template <typename T> class CWriteWithoutResponseCharacteristic : public CCharacteristic<T> {
+  public:
+	/**
+	 * \brief Construct a new CWriteWithoutResponseCharacteristic object
+	 *
+	 * \param uuid The UUID of the characteristic
+	 * \param initialValue The initial value of the characteristic
+	 * \param descriptors The characteristics descriptors
+	 * \param numOfDescriptos number of descriptors
+	 * \param signedWrites True to accept Signed Write Commands from peers that distributed a CSRK
+	 */
+	CWriteWithoutResponseCharacteristic(const UUID &uuid,
+										const T &initialValue,
+										GattAttribute *descriptors[] = NULL,
+										int numOfDescriptors = 0,
+										bool signedWrites = false)
+		: CCharacteristic<T>(uuid,
+							 initialValue,
+							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE |
+								 (signedWrites ? GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_AUTHENTICATED_SIGNED_WRITES
+											   : 0),
+							 descriptors,
+							 numOfDescriptors) {}
+};
+
+template <typename T> class CNotifyOnlyCharacteristic : public CCharacteristic<T> {
+  public:
+	/**
+	 * \brief Construct a new CReadOnlyCharacteristic object
+	 *
+	 * \param uuid The UUID of the characteristic
+	 * \param initialValue The initial value of the characteristic
+	 * \param descriptors The characteristics descriptors
+	 * \param numOfDescriptos number of descriptors
+	 */
+	CNotifyOnlyCharacteristic(const UUID &uuid,
+							  const T &initialValue,
+							  GattAttribute *descriptors[] = NULL,
+							  int numOfDescriptors = 0)
+		: CCharacteristic<T>(uuid,
+							 initialValue,
+							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY,
+							 descriptors,
+							 numOfDescriptors) {}
+};
+
+template <typename T> class CReadWriteCharacteristic : public CCharacteristic<T> {
+  public:
+	/**
+	 * \brief Construct a new CReadOnlyCharacteristic object
+	 *
+	 * \param uuid The UUID of the characteristic
+	 * \param initialValue The initial value of the characteristic
+	 * \param descriptors The characteristics descriptors
+	 * \param numOfDescriptos number of descriptors
+	 */
+	CReadWriteCharacteristic(const UUID &uuid,
+							 const T &initialValue,
+							 GattAttribute *descriptors[] = NULL,
+							 int numOfDescriptors = 0)
+		: CCharacteristic<T>(uuid,
+							 initialValue,
+							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
+								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE,
+							 descriptors,
+							 numOfDescriptors) {}
+};
+
+template <typename T> class CIndicateOnlyCharacteristic : public CCharacteristic<T> {
+  public:
+	/**
+	 * \brief Construct a new CIndicateOnlyCharacteristic object
+	 *
+	 * \param uuid The UUID of the characteristic
+	 * \param initialValue The initial value of the characteristic
+	 * \param descriptors The characteristics descriptors
+	 * \param numOfDescriptos number of descriptors
+	 */
+	CIndicateOnlyCharacteristic(const UUID &uuid,
+								const T &initialValue,
+								GattAttribute *descriptors[] = NULL,
+								int numOfDescriptors = 0)
+		: CCharacteristic<T>(uuid,
+							 initialValue,
+							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE,
+							 descriptors,
+							 numOfDescriptors) {}
+};
+
+template <typename T> class CReadNotifyCharacteristic : public CCharacteristic<T> {
+  public:
+	/**
+	 * \brief Construct a new CReadOnlyCharacteristic object
+	 *
+	 * \param uuid The UUID of the characteristic
+	 * \param initialValue The initial value of the characteristic
+	 * \param descriptors The characteristics descriptors
+	 * \param numOfDescriptos number of descriptors
+	 */
+	CReadNotifyCharacteristic(const UUID &uuid,
+							  const T &initialValue,
+							  GattAttribute *descriptors[] = NULL,
+							  int numOfDescriptors = 0)
+		: CCharacteristic<T>(uuid,
+							 initialValue,
+							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
+								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY,
+							 descriptors,
+							 numOfDescriptors) {}
+};
+
+template <typename T> class CReadWriteNotifyCharacteristic : public CCharacteristic<T> {
+  public:
+	/**
+	 * \brief Construct a new CReadOnlyCharacteristic object
+	 *
+	 * \param uuid The UUID of the characteristic
+	 * \param initialValue The initial value of the characteristic
+	 * \param descriptors The characteristics descriptors
+	 * \param numOfDescriptos number of descriptors
+	 */
+	CReadWriteNotifyCharacteristic(const UUID &uuid,
+								   const T &initialValue,
+								   GattAttribute *descriptors[] = NULL,
+								   int numOfDescriptors = 0)
+		: CCharacteristic<T>(uuid,
+							 initialValue,
+							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
+								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE |
+								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY,
+							 descriptors,
+							 numOfDescriptors) {}
+};
+
+template <typename T> class CReadIndicateCharacteristic : public CCharacteristic<T> {
+  public:
+	/**
+	 * \brief Construct a new CReadOnlyCharacteristic object
+	 *
+	 * \param uuid The UUID of the characteristic
+	 * \param initialValue The initial value of the characteristic
+	 * \param descriptors The characteristics descriptors
+	 * \param numOfDescriptos number of descriptors
+	 */
+	CReadIndicateCharacteristic(const UUID &uuid,
+								const T &initialValue,
+								GattAttribute *descriptors[] = NULL,
+								int numOfDescriptors = 0)
+		: CCharacteristic<T>(uuid,
+							 initialValue,
+							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
+								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE,
+							 descriptors,
+							 numOfDescriptors) {}
+};
+
+template <typename T> class CReadWriteIndicateCharacteristic : public CCharacteristic<T> {
+  public:
+	/**
+	 * \brief Construct a new CReadOnlyCharacteristic object
+	 *
+	 * \param uuid The UUID of the characteristic
+	 * \param initialValue The initial value of the characteristic
+	 * \param descriptors The characteristics descriptors
+	 * \param numOfDescriptos number of descriptors
+	 */
+	CReadWriteIndicateCharacteristic(const UUID &uuid,
+									 const T &initialValue,
+									 GattAttribute *descriptors[] = NULL,
+									 int numOfDescriptors = 0)
+		: CCharacteristic<T>(uuid,
+							 initialValue,
+							 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ |
+								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE |
+								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE,
+							 descriptors,
+							 numOfDescriptors) {}
+};
+
+#endif //! _BLE_CHARACTERISTIC_H_
@@ -0,0 +1,992 @@
+#ifndef _BLE_GATT_CLIENT_H_
+#define _BLE_GATT_CLIENT_H_
+
+#include "BLE.h"
+#include "ble/GattClient.h"
+#include "ble_event_queue.h"
+#include "ble_gatt_generic_attribute_service.h"
+#include "ble_profiler.h"
+#include "ble_utils.h"
+#include "mbed.h"
+
+#include <cstdio>
+#include <cstring>
+
+#define GATT_CLIENT_MAX_LINKS 4					//!< Maximum number of simultaneously attached peers
+#define GATT_CLIENT_CACHE_PEERS 4				//!< Number of peers kept in the attribute cache
+#define GATT_CLIENT_CACHE_SERVICES 8			//!< Maximum number of cached services per peer
+#define GATT_CLIENT_CACHE_CHARACTERISTICS 16	//!< Maximum number of cached characteristics per peer
+#define GATT_CLIENT_CACHE_VERSION 1				//!< Version of the serialized cache format
+#define GATT_CLIENT_CACHE_MAX_SIZE (4 + GATT_CLIENT_CACHE_PEERS * (27 + GATT_CLIENT_CACHE_SERVICES * 6 + GATT_CLIENT_CACHE_CHARACTERISTICS * 8))
+#define CCCD_NOTIFICATIONS 0x0001				//!< CCCD value enabling notifications
+#define CCCD_INDICATIONS 0x0002					//!< CCCD value enabling indications
+
+/**
+ * \brief The remote attribute cache of the GATT client.
+ * \details The cache keeps the services and characteristics of a fixed number of peers. An entry is keyed by
+ * the identity address of the peer and validated with the Database Hash of the peer, so the service
+ * discovery is run only once per peer and layout. 16-bit UUIDs are cached, attributes with 128-bit UUIDs
+ * are left out. The cache is serialized into a compact little endian format for persistent storage.
+ */
+class CGattClientCache {
+  public:
+	/**
+	 * \brief A cached service
+	 *
+	 */
+	struct service_t {
+		uint16_t uuid;	//!< The 16-bit UUID of the service
+		uint16_t start; //!< The first handle of the service
+		uint16_t end;	//!< The last handle of the service
+	};
+	/**
+	 * \brief A cached characteristic
+	 *
+	 */
+	struct characteristic_t {
+		uint16_t uuid;		  //!< The 16-bit UUID of the characteristic
+		uint8_t properties;	  //!< The GattCharacteristic::Properties_t bit field
+		uint8_t service;	  //!< Index of the service the characteristic belongs to
+		uint16_t valueHandle; //!< The handle of the characteristic value
+		uint16_t cccdHandle;  //!< The handle of the CCCD, GattAttribute::INVALID_HANDLE if none
+	};
+	/**
+	 * \brief The cached attribute layout of one peer
+	 *
+	 */
+	struct entry_t {
+		bool valid;					 //!< Set if the entry holds a validated layout
+		uint8_t pins;				 //!< Number of attached links using the entry, a pinned entry is not replaced
+		uint8_t addressType;		 //!< The peer identity address type
+		ble::address_t address;		 //!< The peer identity address
+		uint8_t hash[16];			 //!< The Database Hash of the peer when the layout was discovered
+		uint16_t hashHandle;		 //!< The handle of the Database Hash characteristic of the peer
+		uint8_t serviceCount;		 //!< Number of cached services
+		uint8_t characteristicCount; //!< Number of cached characteristics
+		uint32_t lastUsed;			 //!< Use counter for the least recently used replacement
+		service_t services[GATT_CLIENT_CACHE_SERVICES];
+		characteristic_t characteristics[GATT_CLIENT_CACHE_CHARACTERISTICS];
+	};
+
+  protected:
+	entry_t _entries[GATT_CLIENT_CACHE_PEERS]; //!< The cached peers
+	uint32_t _useCounter;					   //!< Incremented on every lookup
+
+	/**
+	 * \brief Little endian writer helpers
+	 * @{
+	 */
+	static uint8_t *put8(uint8_t *p, uint8_t value) {
+		*p++ = value;
+		return p;
+	}
+	static uint8_t *put16(uint8_t *p, uint16_t value) {
+		*p++ = (uint8_t)(value & 0xFF);
+		*p++ = (uint8_t)(value >> 8);
+		return p;
+	}
+	static uint16_t get16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+	/** }@*/
+
+  public:
+	/**
+	 * \brief Construct a new CGattClientCache object
+	 *
+	 */
+	CGattClientCache() : _entries(), _useCounter(0) {}
+
+	/**
+	 * \brief Removes all the entries. The pins are kept, the links still refer to their entries.
+	 *
+	 */
+	void clear() {
+		for (auto &entry : _entries) {
+			entry.valid = false;
+		}
+	}
+
+	/**
+	 * \brief Marks an entry used by an attached link, so that allocate() does not replace it
+	 *
+	 * \param entry The entry
+	 */
+	static void pin(entry_t &entry) { entry.pins++; }
+	/**
+	 * \brief Releases an entry pinned with pin()
+	 *
+	 * \param entry The entry
+	 */
+	static void unpin(entry_t &entry) { entry.pins--; }
+
+	/**
+	 * \brief Finds the entry of a peer
+	 *
+	 * \param addressType The identity address type of the peer
+	 * \param address The identity address of the peer
+	 * \return entry_t* The entry or nullptr if the peer is not cached
+	 */
+	entry_t *find(uint8_t addressType, const ble::address_t &address) {
+		for (auto &entry : _entries) {
+			if (entry.valid && entry.addressType == addressType && entry.address == address) {
+				entry.lastUsed = ++_useCounter;
+				return &entry;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * \brief Allocates an empty entry for a peer, replacing the old entry of the peer, a free entry or the least
+	 * recently used entry that no attached link has pinned. The entry is not valid until the layout has been
+	 * discovered.
+	 *
+	 * \param addressType The identity address type of the peer
+	 * \param address The identity address of the peer
+	 * \return entry_t* The entry, nullptr if all the other entries are pinned
+	 */
+	entry_t *allocate(uint8_t addressType, const ble::address_t &address) {
+		entry_t *entry = nullptr;
+		for (auto &e : _entries) {
+			if ((e.valid || e.pins > 0) && e.addressType == addressType && e.address == address) {
+				entry = &e;
+				break;
+			}
+		}
+		for (int ii = 0; entry == nullptr && ii < GATT_CLIENT_CACHE_PEERS; ii++) {
+			if (!_entries[ii].valid && _entries[ii].pins == 0) {
+				entry = &_entries[ii];
+			}
+		}
+		if (entry == nullptr) {
+			for (auto &e : _entries) {
+				if (e.pins == 0 && (entry == nullptr || e.lastUsed < entry->lastUsed)) {
+					entry = &e;
+				}
+			}
+		}
+		if (entry == nullptr) {
+			return nullptr;
+		}
+		uint8_t pins = entry->pins;
+		*entry = entry_t();
+		entry->pins = pins;
+		entry->addressType = addressType;
+		entry->address = address;
+		entry->lastUsed = ++_useCounter;
+		return entry;
+	}
+
+	/**
+	 * \brief Serializes the valid entries
+	 *
+	 * \param buffer The destination buffer
+	 * \param capacity The size of the buffer, GATT_CLIENT_CACHE_MAX_SIZE is always large enough
+	 * \return size_t The number of bytes written, 0 if the buffer is too small
+	 */
+	size_t serialize(uint8_t *buffer, size_t capacity) const {
+		if (capacity < GATT_CLIENT_CACHE_MAX_SIZE) {
+			return 0;
+		}
+		uint8_t *p = buffer;
+		uint8_t count = 0;
+		for (auto &entry : _entries) {
+			count += entry.valid ? 1 : 0;
+		}
+		p = put8(p, 'G');
+		p = put8(p, 'C');
+		p = put8(p, GATT_CLIENT_CACHE_VERSION);
+		p = put8(p, count);
+		for (auto &entry : _entries) {
+			if (!entry.valid) {
+				continue;
+			}
+			p = put8(p, entry.addressType);
+			memcpy(p, entry.address.data(), 6);
+			p += 6;
+			memcpy(p, entry.hash, sizeof(entry.hash));
+			p += sizeof(entry.hash);
+			p = put16(p, entry.hashHandle);
+			p = put8(p, entry.serviceCount);
+			p = put8(p, entry.characteristicCount);
+			for (uint8_t ii = 0; ii < entry.serviceCount; ii++) {
+				p = put16(p, entry.services[ii].uuid);
+				p = put16(p, entry.services[ii].start);
+				p = put16(p, entry.services[ii].end);
+			}
+			for (uint8_t ii = 0; ii < entry.characteristicCount; ii++) {
+				p = put16(p, entry.characteristics[ii].uuid);
+				p = put8(p, entry.characteristics[ii].properties);
+				p = put8(p, entry.characteristics[ii].service);
+				p = put16(p, entry.characteristics[ii].valueHandle);
+				p = put16(p, entry.characteristics[ii].cccdHandle);
+			}
+		}
+		return (size_t)(p - buffer);
+	}
+
+	/**
+	 * \brief Restores the entries from serialized data
+	 *
+	 * \param buffer The serialized data
+	 * \param length The length of the data
+	 * \return true if the data was valid
+	 * \return false if the data was invalid, the cache is left empty, or if an attached link has pinned an
+	 * entry, the cache is left unchanged
+	 */
+	bool deserialize(const uint8_t *buffer, size_t length) {
+		for (auto &entry : _entries) {
+			if (entry.pins > 0) {
+				return false;
+			}
+		}
+		clear();
+		const uint8_t *p = buffer;
+		const uint8_t *end = buffer + length;
+		if (length < 4 || p[0] != 'G' || p[1] != 'C' || p[2] != GATT_CLIENT_CACHE_VERSION ||
+			p[3] > GATT_CLIENT_CACHE_PEERS) {
+			return false;
+		}
+		uint8_t count = p[3];
+		p += 4;
+		for (uint8_t ee = 0; ee < count; ee++) {
+			entry_t &entry = _entries[ee];
+			if (end - p < 27) {
+				clear();
+				return false;
+			}
+			entry.addressType = *p++;
+			entry.address = ble::address_t(p);
+			p += 6;
+			memcpy(entry.hash, p, sizeof(entry.hash));
+			p += sizeof(entry.hash);
+			entry.hashHandle = get16(p);
+			p += 2;
+			entry.serviceCount = *p++;
+			entry.characteristicCount = *p++;
+			if (entry.serviceCount > GATT_CLIENT_CACHE_SERVICES ||
+				entry.characteristicCount > GATT_CLIENT_CACHE_CHARACTERISTICS ||
+				end - p < entry.serviceCount * 6 + entry.characteristicCount * 8) {
+				clear();
+				return false;
+			}
+			for (uint8_t ii = 0; ii < entry.serviceCount; ii++, p += 6) {
+				entry.services[ii].uuid = get16(p);
+				entry.services[ii].start = get16(p + 2);
+				entry.services[ii].end = get16(p + 4);
+			}
+			for (uint8_t ii = 0; ii < entry.characteristicCount; ii++, p += 8) {
+				if (p[3] >= entry.serviceCount) {
+					// findCharacteristic() indexes the services with it
+					clear();
+					return false;
+				}
+				entry.characteristics[ii].uuid = get16(p);
+				entry.characteristics[ii].properties = p[2];
+				entry.characteristics[ii].service = p[3];
+				entry.characteristics[ii].valueHandle = get16(p + 4);
+				entry.characteristics[ii].cccdHandle = get16(p + 6);
+			}
+			entry.lastUsed = 0;
+			entry.valid = true;
+		}
+		return true;
+	}
+
+	/**
+	 * \brief Stores the cache into a file
+	 *
+	 * \param filepath The file path
+	 * \return true on success
+	 */
+	bool save(const char *filepath) const {
+		static uint8_t buffer[GATT_CLIENT_CACHE_MAX_SIZE];
+		size_t length = serialize(buffer, sizeof(buffer));
+		FILE *file = fopen(filepath, "wb");
+		if (file == NULL) {
+			return false;
+		}
+		bool saved = (fwrite(buffer, 1, length, file) == length);
+		fclose(file);
+		return saved;
+	}
+
+	/**
+	 * \brief Restores the cache from a file
+	 *
+	 * \param filepath The file path
+	 * \return true on success
+	 */
+	bool load(const char *filepath) {
+		static uint8_t buffer[GATT_CLIENT_CACHE_MAX_SIZE];
+		FILE *file = fopen(filepath, "rb");
+		if (file == NULL) {
+			return false;
+		}
+		size_t length = fread(buffer, 1, sizeof(buffer), file);
+		fclose(file);
+		return deserialize(buffer, length);
+	}
+};
+
+/**
+ * \brief The GATT client class of the system, the central role counterpart of CGattServer.
+ * \details The client discovers the services and characteristics of an attached peer once and keeps them in
+ * the CGattClientCache. When a cached peer reconnects, only its Database Hash is read to validate the
+ * cache, and the reads, writes and subscriptions use the cached handles right away.
+ *
+ * The service discoveries of the attached peers are run one at a time. An attached link pins its cache entry,
+ * so no other peer replaces it; a link that finds every entry pinned waits for a detach. The client subscribes
+ * to Service Changed, an indication invalidates the cached layout and the peer is discovered again.
+ * host/ble_gatt_client_exercise.cpp runs it against the device on the host stack.
+ */
+class CGattClient : private mbed::NonCopyable<CGattClient> {
+  public:
+	/**
+	 * \brief The state of an attached peer
+	 *
+	 */
+	enum LinkState {
+		LINK_FREE,						 /**< Link slot not in use.*/
+		LINK_VALIDATING,				 /**< Reading the Database Hash of a cached peer.*/
+		LINK_WAITING_DISCOVERY,			 /**< Waiting for an other discovery to complete.*/
+		LINK_DISCOVERING,				 /**< Discovering the services and characteristics.*/
+		LINK_DISCOVERING_DESCRIPTORS,	 /**< Discovering the CCCDs of the characteristics.*/
+		LINK_READING_HASH,				 /**< Reading the Database Hash after the discovery.*/
+		LINK_READY						 /**< The cached handles can be used.*/
+	};
+
+  protected:
+	/**
+	 * \brief An attached peer
+	 *
+	 */
+	struct link_t {
+		LinkState state;							//!< The state of the link
+		ble::connection_handle_t connectionHandle;	//!< The connection handle
+		uint8_t addressType;						//!< The identity address type of the peer
+		ble::address_t address;						//!< The identity address of the peer
+		CGattClientCache::entry_t *entry;			//!< The cache entry of the peer
+		DiscoveredCharacteristic pending[GATT_CLIENT_CACHE_CHARACTERISTICS]; //!< Characteristics with descriptors to be discovered
+		uint8_t pendingCount;						//!< Number of pending characteristics
+		uint8_t pendingIndex;						//!< The characteristic whose descriptors are being discovered
+		uint32_t startUs;							//!< Timestamp of the attach
+	};
+
+	BLE &_ble;						 //!< The one and only BLE instance
+	CEventQueue &_eventQueue; //!< The event queue of the application
+	GattClient *_client;			 //!< The GATT client of the stack
+	CGattClientCache _cache;		 //!< The remote attribute cache
+	const char *_cacheFilepath;		 //!< The file the cache is stored in. NULL if not persistent.
+	link_t _links[GATT_CLIENT_MAX_LINKS]; //!< The attached peers
+	link_t *_discovering;			 //!< The link whose service discovery is running
+
+	mbed::Callback<void(ble::connection_handle_t, bool)> _onReady;		//!< Called when the handles are known
+	mbed::Callback<void(const GattReadCallbackParams *)> _onDataRead;	//!< Called when a read completes
+	mbed::Callback<void(const GattHVXCallbackParams *)> _onHVX;			//!< Called on notifications and indications
+
+	ble_utils::LatencyStats _discoveryLatency; //!< Attach to ready latency with the service discovery
+	ble_utils::LatencyStats _cachedLatency;	   //!< Attach to ready latency with a validated cache
+
+	/**
+	 * \brief Finds the link of a connection
+	 *
+	 * \param connectionHandle The connection handle
+	 * \return link_t* The link or nullptr if the connection is not attached
+	 */
+	link_t *findLink(ble::connection_handle_t connectionHandle) {
+		for (auto &link : _links) {
+			if (link.state != LINK_FREE && link.connectionHandle == connectionHandle) {
+				return &link;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * \brief Sets the cache entry of a link, the link keeps its entry pinned
+	 *
+	 * \param link The link
+	 * \param entry The entry, nullptr to release the entry of the link
+	 */
+	void setEntry(link_t &link, CGattClientCache::entry_t *entry) {
+		if (entry != nullptr) {
+			CGattClientCache::pin(*entry);
+		}
+		if (link.entry != nullptr) {
+			CGattClientCache::unpin(*link.entry);
+		}
+		link.entry = entry;
+	}
+
+	/**
+	 * \brief Starts the service discovery of a link, or queues it if an other discovery is running or if the
+	 * other links have pinned all the cache entries
+	 *
+	 * \param link The link
+	 */
+	void startDiscovery(link_t &link) {
+		if (_discovering != nullptr) {
+			link.state = LINK_WAITING_DISCOVERY;
+			return;
+		}
+		CGattClientCache::entry_t *entry = _cache.allocate(link.addressType, link.address);
+		if (entry == nullptr) {
+			// a detach releases an entry and starts the queued discovery
+			link.state = LINK_WAITING_DISCOVERY;
+			return;
+		}
+		setEntry(link, entry);
+		link.pendingCount = 0;
+		link.pendingIndex = 0;
+		link.state = LINK_DISCOVERING;
+		_discovering = &link;
+		ble_error_t error = _client->launchServiceDiscovery(link.connectionHandle,
+															BLE_PROFILED(this, CGattClient, onServiceDiscovered),
+															BLE_PROFILED(this, CGattClient, onCharacteristicDiscovered));
+		ble_utils::printError(error, "GattClient->launchServiceDiscovery() ");
+		if (error != BLE_ERROR_NONE) {
+			_discovering = nullptr;
+			link.state = LINK_READY;
+			startNextDiscovery();
+		}
+	}
+
+	/**
+	 * \brief Starts the queued discovery, if any
+	 *
+	 */
+	void startNextDiscovery() {
+		for (auto &link : _links) {
+			if (link.state == LINK_WAITING_DISCOVERY) {
+				startDiscovery(link);
+				return;
+			}
+		}
+	}
+
+	/**
+	 * \brief Called for every discovered service
+	 *
+	 * \param service The discovered service
+	 */
+	void onServiceDiscovered(const DiscoveredService *service) {
+		if (_discovering == nullptr) {
+			return;
+		}
+		CGattClientCache::entry_t *entry = _discovering->entry;
+		if (service->getUUID().shortOrLong() != UUID::UUID_TYPE_SHORT ||
+			entry->serviceCount >= GATT_CLIENT_CACHE_SERVICES) {
+			return;
+		}
+		CGattClientCache::service_t &s = entry->services[entry->serviceCount++];
+		s.uuid = service->getUUID().getShortUUID();
+		s.start = service->getStartHandle();
+		s.end = service->getEndHandle();
+	}
+
+	/**
+	 * \brief Called for every discovered characteristic
+	 *
+	 * \param characteristic The discovered characteristic
+	 */
+	void onCharacteristicDiscovered(const DiscoveredCharacteristic *characteristic) {
+		if (_discovering == nullptr) {
+			return;
+		}
+		CGattClientCache::entry_t *entry = _discovering->entry;
+		if (characteristic->getUUID().shortOrLong() != UUID::UUID_TYPE_SHORT ||
+			entry->characteristicCount >= GATT_CLIENT_CACHE_CHARACTERISTICS) {
+			return;
+		}
+		uint16_t valueHandle = characteristic->getValueHandle();
+		uint8_t service = 0;
+		while (service < entry->serviceCount &&
+			   (valueHandle < entry->services[service].start || valueHandle > entry->services[service].end)) {
+			service++;
+		}
+		if (service == entry->serviceCount) {
+			// the service has a 128-bit UUID
+			return;
+		}
+		const DiscoveredCharacteristic::Properties_t &props = characteristic->getProperties();
+		CGattClientCache::characteristic_t &c = entry->characteristics[entry->characteristicCount++];
+		c.uuid = characteristic->getUUID().getShortUUID();
+		c.service = service;
+		c.valueHandle = valueHandle;
+		c.cccdHandle = GattAttribute::INVALID_HANDLE;
+		c.properties = (props.broadcast() ? GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_BROADCAST : 0) |
+					   (props.read() ? GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ : 0) |
+					   (props.writeWoResp() ? GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE : 0) |
+					   (props.write() ? GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE : 0) |
+					   (props.notify() ? GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY : 0) |
+					   (props.indicate() ? GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE : 0) |
+					   (props.authSignedWrite() ? GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_AUTHENTICATED_SIGNED_WRITES : 0);
+		if (c.uuid == UUID_DATABASE_HASH_CHAR) {
+			entry->hashHandle = valueHandle;
+		}
+		if (props.notify() || props.indicate()) {
+			// the CCCD is found by the descriptor discovery after the service discovery
+			_discovering->pending[_discovering->pendingCount++] = *characteristic;
+		}
+	}
+
+	/**
+	 * \brief Called when the service discovery of a connection ends
+	 *
+	 * \param connectionHandle The connection handle
+	 */
+	void onServiceDiscoveryTermination(ble::connection_handle_t connectionHandle) {
+		link_t *link = findLink(connectionHandle);
+		if (link == nullptr || link != _discovering) {
+			return;
+		}
+		link->state = LINK_DISCOVERING_DESCRIPTORS;
+		discoverNextDescriptors(*link);
+	}
+
+	/**
+	 * \brief Discovers the descriptors of the next pending characteristic
+	 *
+	 * \param link The link being discovered
+	 */
+	void discoverNextDescriptors(link_t &link) {
+		while (link.pendingIndex < link.pendingCount) {
+			ble_error_t error = link.pending[link.pendingIndex].discoverDescriptors(
+				BLE_PROFILED(this, CGattClient, onDescriptorDiscovered),
+				BLE_PROFILED(this, CGattClient, onDescriptorDiscoveryTermination));
+			if (error == BLE_ERROR_NONE) {
+				return;
+			}
+			ble_utils::printError(error, "DiscoveredCharacteristic.discoverDescriptors() ");
+			link.pendingIndex++;
+		}
+		onDiscoveryComplete(link);
+	}
+
+	/**
+	 * \brief Called for every discovered descriptor
+	 *
+	 * \param params The discovered descriptor
+	 */
+	void onDescriptorDiscovered(const CharacteristicDescriptorDiscovery::DiscoveryCallbackParams_t *params) {
+		if (_discovering == nullptr || params->descriptor.getUUID().shortOrLong() != UUID::UUID_TYPE_SHORT ||
+			params->descriptor.getUUID().getShortUUID() != ATT_UUID_CCCD) {
+			return;
+		}
+		CGattClientCache::characteristic_t *c = findByValueHandle(*_discovering->entry,
+																  params->characteristic.getValueHandle());
+		if (c != nullptr) {
+			c->cccdHandle = params->descriptor.getAttributeHandle();
+		}
+	}
+
+	/**
+	 * \brief Called when the descriptor discovery of a characteristic ends
+	 *
+	 * \param params The termination parameters
+	 */
+	void onDescriptorDiscoveryTermination(const CharacteristicDescriptorDiscovery::TerminationCallbackParams_t *params) {
+		(void)params;
+		if (_discovering == nullptr) {
+			return;
+		}
+		_discovering->pendingIndex++;
+		discoverNextDescriptors(*_discovering);
+	}
+
+	/**
+	 * \brief Called when the layout of a peer has been discovered. The Database Hash of the peer is read
+	 * before the entry is validated.
+	 *
+	 * \param link The discovered link
+	 */
+	void onDiscoveryComplete(link_t &link) {
+		_discovering = nullptr;
+		if (link.entry->hashHandle != GattAttribute::INVALID_HANDLE) {
+			link.state = LINK_READING_HASH;
+			ble_error_t error = _client->read(link.connectionHandle, link.entry->hashHandle, 0);
+			ble_utils::printError(error, "GattClient->read() Database Hash ");
+			if (error == BLE_ERROR_NONE) {
+				startNextDiscovery();
+				return;
+			}
+		}
+		// without the Database Hash the layout cannot be validated on reconnection, so it is not cached
+		setReady(link, false);
+		startNextDiscovery();
+	}
+
+	/**
+	 * \brief Finds a Service Changed characteristic of the peer. A peer built on CGattServer has two Generic
+	 * 		  Attribute services, the one of its stack and the one with the caching characteristics, which comes
+	 * 		  last and is the one indicated.
+	 *
+	 * \param entry The cache entry of the peer
+	 * \param valueHandle The value handle to match, INVALID_HANDLE for the last instance
+	 * \return const CGattClientCache::characteristic_t* The characteristic or nullptr if not found
+	 */
+	static const CGattClientCache::characteristic_t *findServiceChanged(const CGattClientCache::entry_t &entry,
+																		GattAttribute::Handle_t valueHandle) {
+		const CGattClientCache::characteristic_t *found = nullptr;
+		for (uint8_t ii = 0; ii < entry.characteristicCount; ii++) {
+			const CGattClientCache::characteristic_t &c = entry.characteristics[ii];
+			if (c.uuid == GattCharacteristic::UUID_SERVICE_CHANGED_CHAR &&
+				entry.services[c.service].uuid == UUID_GENERIC_ATTRIBUTE_SERVICE) {
+				if (c.valueHandle == valueHandle) {
+					return &c;
+				}
+				found = (valueHandle == GattAttribute::INVALID_HANDLE) ? &c : found;
+			}
+		}
+		return found;
+	}
+
+	/**
+	 * \brief Writes the CCCD of a characteristic of an attached peer
+	 *
+	 * \param connectionHandle The connection handle
+	 * \param c The characteristic
+	 * \param enable True to subscribe, False to unsubscribe
+	 * \return BLE_ERROR_NONE on success, an appropriate error code otherwise
+	 */
+	ble_error_t subscribe(ble::connection_handle_t connectionHandle,
+						  const CGattClientCache::characteristic_t &c,
+						  bool enable) {
+		if (c.cccdHandle == GattAttribute::INVALID_HANDLE) {
+			return BLE_ERROR_NOT_FOUND;
+		}
+		uint16_t value = 0;
+		if (enable) {
+			value = (c.properties & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY) ? CCCD_NOTIFICATIONS
+																						: CCCD_INDICATIONS;
+		}
+		uint8_t cccd[2] = {(uint8_t)(value & 0xFF), (uint8_t)(value >> 8)};
+		return _client->write(GattClient::GATT_OP_WRITE_REQ, connectionHandle, c.cccdHandle, sizeof(cccd), cccd);
+	}
+
+	/**
+	 * \brief Marks the link ready for the operations
+	 *
+	 * \param link The link
+	 * \param fromCache True if the validated cache was used
+	 */
+	void setReady(link_t &link, bool fromCache) {
+		link.state = LINK_READY;
+		(fromCache ? _cachedLatency : _discoveryLatency).addSince(link.startUs);
+		std::cout << "GATT client ready for connection " << std::dec << link.connectionHandle
+				  << (fromCache ? " from the cache" : " after the discovery") << std::endl;
+		// a changed layout of the peer is indicated through Service Changed, see onHVX()
+		const CGattClientCache::characteristic_t *serviceChanged =
+			findServiceChanged(*link.entry, GattAttribute::INVALID_HANDLE);
+		if (serviceChanged != nullptr) {
+			subscribe(link.connectionHandle, *serviceChanged, true);
+		}
+		if (_onReady) {
+			_onReady(link.connectionHandle, fromCache);
+		}
+	}
+
+	/**
+	 * \brief Handler called when a read completes
+	 *
+	 * \param params The read parameters
+	 */
+	void onDataRead(const GattReadCallbackParams *params) {
+		link_t *link = findLink(params->connHandle);
+		if (link != nullptr && link->entry != nullptr && params->handle == link->entry->hashHandle) {
+			bool hashRead = (params->status == BLE_ERROR_NONE && params->len == sizeof(link->entry->hash));
+			if (link->state == LINK_VALIDATING) {
+				if (hashRead && memcmp(link->entry->hash, params->data, sizeof(link->entry->hash)) == 0) {
+					setReady(*link, true);
+				} else {
+					std::cout << "GATT client cache outdated, discovering" << std::endl;
+					link->entry->valid = false;
+					startDiscovery(*link);
+				}
+				return;
+			}
+			if (link->state == LINK_READING_HASH) {
+				if (hashRead) {
+					memcpy(link->entry->hash, params->data, sizeof(link->entry->hash));
+					link->entry->valid = true;
+					_eventQueue.call(this, &CGattClient::saveCache);
+				}
+				setReady(*link, false);
+				return;
+			}
+		}
+		if (_onDataRead) {
+			_onDataRead(params);
+		}
+	}
+
+	/**
+	 * \brief Handler called on notifications and indications. A Service Changed indication invalidates the
+	 * cached layout of the peer, which is discovered again.
+	 *
+	 * \param params The notification or indication parameters
+	 */
+	void onHVX(const GattHVXCallbackParams *params) {
+		link_t *link = findLink(params->connHandle);
+		if (link != nullptr && link->state == LINK_READY && link->entry != nullptr &&
+			findServiceChanged(*link->entry, params->handle) != nullptr) {
+			std::cout << "GATT client service changed on connection " << std::dec << link->connectionHandle
+					  << ", discovering" << std::endl;
+			link->entry->valid = false;
+			_eventQueue.call(this, &CGattClient::saveCache);
+			link->startUs = ble_utils::timestampUs();
+			startDiscovery(*link);
+			return;
+		}
+		if (_onHVX) {
+			_onHVX(params);
+		}
+	}
+
+	/**
+	 * \brief Finds a cached characteristic by its value handle
+	 *
+	 * \param entry The cache entry
+	 * \param valueHandle The value handle
+	 * \return CGattClientCache::characteristic_t* The characteristic or nullptr
+	 */
+	static CGattClientCache::characteristic_t *findByValueHandle(CGattClientCache::entry_t &entry,
+																 uint16_t valueHandle) {
+		for (uint8_t ii = 0; ii < entry.characteristicCount; ii++) {
+			if (entry.characteristics[ii].valueHandle == valueHandle) {
+				return &entry.characteristics[ii];
+			}
+		}
+		return nullptr;
+	}
+
+  public:
+	/**
+	 * \brief Construct a new CGattClient object
+	 *
+	 * \param ble The one and only BLE instance
+	 * \param eventQueue The event queue of the application
+	 * \param cacheFilepath The file to store the attribute cache. If NULL, the cache is kept in RAM only.
+	 */
+	CGattClient(BLE &ble, CEventQueue &eventQueue, const char *cacheFilepath = NULL)
+		: _ble(ble), _eventQueue(eventQueue), _client(nullptr), _cacheFilepath(cacheFilepath),
+		  _discovering(nullptr) {
+		for (auto &link : _links) {
+			link.state = LINK_FREE;
+			link.entry = nullptr;
+		}
+	}
+
+	/**
+	 * \brief Starts the GATT client. This function should be called when the BLE stack is initialized.
+	 *
+	 */
+	void start() {
+		_client = &_ble.gattClient();
+		if (_cacheFilepath != NULL && _cache.load(_cacheFilepath)) {
+			std::cout << "GATT client cache loaded" << std::endl;
+		}
+		_client->onServiceDiscoveryTermination(BLE_PROFILED(this, CGattClient, onServiceDiscoveryTermination));
+		_client->onDataRead(BLE_PROFILED(this, CGattClient, onDataRead));
+		_client->onHVX(BLE_PROFILED(this, CGattClient, onHVX));
+	}
+
+	/**
+	 * \brief Attaches a connected peer. A cached peer is validated with its Database Hash, an unknown peer
+	 * is discovered.
+	 *
+	 * \param connectionHandle The connection handle
+	 * \param addressType The identity address type of the peer
+	 * \param address The identity address of the peer
+	 * \return BLE_ERROR_NONE on success, BLE_ERROR_NO_MEM if all the link slots are in use
+	 */
+	ble_error_t attach(ble::connection_handle_t connectionHandle, ble::peer_address_type_t addressType,
+					   const ble::address_t &address) {
+		link_t *link = findLink(connectionHandle);
+		for (int ii = 0; link == nullptr && ii < GATT_CLIENT_MAX_LINKS; ii++) {
+			if (_links[ii].state == LINK_FREE) {
+				link = &_links[ii];
+			}
+		}
+		if (link == nullptr) {
+			return BLE_ERROR_NO_MEM;
+		}
+		link->connectionHandle = connectionHandle;
+		link->addressType = addressType.value();
+		link->address = address;
+		link->startUs = ble_utils::timestampUs();
+		setEntry(*link, _cache.find(link->addressType, address));
+		if (link->entry != nullptr && link->entry->hashHandle != GattAttribute::INVALID_HANDLE) {
+			link->state = LINK_VALIDATING;
+			ble_error_t error = _client->read(connectionHandle, link->entry->hashHandle, 0);
+			ble_utils::printError(error, "GattClient->read() Database Hash ");
+			if (error == BLE_ERROR_NONE) {
+				return error;
+			}
+		}
+		startDiscovery(*link);
+		return BLE_ERROR_NONE;
+	}
+
+	/**
+	 * \brief Detaches a disconnected peer
+	 *
+	 * \param connectionHandle The connection handle
+	 */
+	void detach(ble::connection_handle_t connectionHandle) {
+		link_t *link = findLink(connectionHandle);
+		if (link == nullptr) {
+			return;
+		}
+		if (link == _discovering) {
+			_discovering = nullptr;
+			link->entry->valid = false;
+		}
+		setEntry(*link, nullptr);
+		link->state = LINK_FREE;
+		// the released entry may let a queued discovery start
+		startNextDiscovery();
+	}
+
+	/**
+	 * \brief Finds a characteristic of an attached peer
+	 *
+	 * \param connectionHandle The connection handle
+	 * \param serviceUuid The 16-bit UUID of the service
+	 * \param characteristicUuid The 16-bit UUID of the characteristic
+	 * \return const CGattClientCache::characteristic_t* The characteristic or nullptr if not found
+	 */
+	const CGattClientCache::characteristic_t *findCharacteristic(ble::connection_handle_t connectionHandle,
+																 uint16_t serviceUuid,
+																 uint16_t characteristicUuid) {
+		link_t *link = findLink(connectionHandle);
+		if (link == nullptr || link->state != LINK_READY || link->entry == nullptr) {
+			return nullptr;
+		}
+		CGattClientCache::entry_t &entry = *link->entry;
+		for (uint8_t ii = 0; ii < entry.characteristicCount; ii++) {
+			const CGattClientCache::characteristic_t &c = entry.characteristics[ii];
+			if (c.uuid == characteristicUuid && entry.services[c.service].uuid == serviceUuid) {
+				return &c;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * \brief Reads a characteristic of an attached peer. The result is delivered to the onDataRead callback.
+	 *
+	 * \param connectionHandle The connection handle
+	 * \param serviceUuid The 16-bit UUID of the service
+	 * \param characteristicUuid The 16-bit UUID of the characteristic
+	 * \return BLE_ERROR_NONE on success, an appropriate error code otherwise
+	 */
+	ble_error_t read(ble::connection_handle_t connectionHandle, uint16_t serviceUuid, uint16_t characteristicUuid) {
+		const CGattClientCache::characteristic_t *c = findCharacteristic(connectionHandle, serviceUuid, characteristicUuid);
+		if (c == nullptr) {
+			return BLE_ERROR_NOT_FOUND;
+		}
+		return _client->read(connectionHandle, c->valueHandle, 0);
+	}
+
+	/**
+	 * \brief Writes a characteristic of an attached peer. Write Without Response is used when the
+	 * characteristic supports only it or when the response is not wanted.
+	 *
+	 * \param connectionHandle The connection handle
+	 * \param serviceUuid The 16-bit UUID of the service
+	 * \param characteristicUuid The 16-bit UUID of the characteristic
+	 * \param data The data to be written
+	 * \param length The length of the data
+	 * \param withResponse True to use Write Request if the characteristic supports it
+	 * \return BLE_ERROR_NONE on success, an appropriate error code otherwise
+	 */
+	ble_error_t write(ble::connection_handle_t connectionHandle,
+					  uint16_t serviceUuid,
+					  uint16_t characteristicUuid,
+					  const uint8_t *data,
+					  uint16_t length,
+					  bool withResponse = true) {
+		const CGattClientCache::characteristic_t *c = findCharacteristic(connectionHandle, serviceUuid, characteristicUuid);
+		if (c == nullptr) {
+			return BLE_ERROR_NOT_FOUND;
+		}
+		bool request = (c->properties & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE) != 0;
+		bool command = (c->properties & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE) != 0;
+		if (!request && !command) {
+			return BLE_ERROR_OPERATION_NOT_PERMITTED;
+		}
+		GattClient::WriteOp_t op =
+			(request && (withResponse || !command)) ? GattClient::GATT_OP_WRITE_REQ : GattClient::GATT_OP_WRITE_CMD;
+		return _client->write(op, connectionHandle, c->valueHandle, length, data);
+	}
+
+	/**
+	 * \brief Subscribes to the notifications or indications of a characteristic of an attached peer
+	 *
+	 * \param connectionHandle The connection handle
+	 * \param serviceUuid The 16-bit UUID of the service
+	 * \param characteristicUuid The 16-bit UUID of the characteristic
+	 * \param enable True to subscribe, False to unsubscribe
+	 * \return BLE_ERROR_NONE on success, an appropriate error code otherwise
+	 */
+	ble_error_t subscribe(ble::connection_handle_t connectionHandle,
+						  uint16_t serviceUuid,
+						  uint16_t characteristicUuid,
+						  bool enable = true) {
+		const CGattClientCache::characteristic_t *c = findCharacteristic(connectionHandle, serviceUuid, characteristicUuid);
+		if (c == nullptr) {
+			return BLE_ERROR_NOT_FOUND;
+		}
+		return subscribe(connectionHandle, *c, enable);
+	}
+
+	/**
+	 * \brief Stores the cache into the cache file
+	 *
+	 */
+	void saveCache() {
+		if (_cacheFilepath != NULL && !_cache.save(_cacheFilepath)) {
+			std::cout << "GATT client cache cannot be stored" << std::endl;
+		}
+	}
+
+	/**
+	 * \brief Prints the attach to ready latency with and without the cache
+	 *
+	 */
+	void printLatency() const {
+		_discoveryLatency.print("GATT client discovery latency");
+		_cachedLatency.print("GATT client cached latency");
+	}
+
+	/**
+	 * \brief Get the Cache object
+	 *
+	 * \return CGattClientCache& The remote attribute cache
+	 */
+	CGattClientCache &getCache() { return _cache; }
+
+	/**
+	 * \brief Sets the callback called when the handles of an attached peer are known
+	 *
+	 * \param callback The callback with the connection handle and true if the cache was used
+	 */
+	void setOnReady(mbed::Callback<void(ble::connection_handle_t, bool)> callback) { _onReady = callback; }
+
+	/**
+	 * \brief Sets the callback called when a read completes
+	 *
+	 * \param callback The callback
+	 */
+	void setOnDataRead(mbed::Callback<void(const GattReadCallbackParams *)> callback) { _onDataRead = callback; }
+
+	/**
+	 * \brief Sets the callback called on notifications and indications
+	 *
+	 * \param callback The callback
+	 */
+	void setOnHVX(mbed::Callback<void(const GattHVXCallbackParams *)> callback) { _onHVX = callback; }
+};
+
+#endif //! _BLE_GATT_CLIENT_H_
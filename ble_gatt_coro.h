@@ -0,0 +1,425 @@
+#ifndef _BLE_GATT_CORO_H_
+#define _BLE_GATT_CORO_H_
+
+/*
+ * The coroutine layer needs C++20. The mbed OS 5 toolchain profiles build with gnu++14, so the header is empty
+ * unless the application is built with -std=gnu++20 or later.
+ */
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine)
+
+#include <coroutine>
+#include <cstddef>
+
+#include "ble_event_queue.h"
+#include "ble_gatt_characteristic.h"
+#include "ble_gatt_server.h"
+#include "ble_utils.h"
+#include "mbed.h"
+
+#define GATT_CORO_FRAME_SIZE 256 //!< Largest coroutine frame served by the frame pool
+#define GATT_CORO_FRAMES 4		 //!< Number of coroutine frames in the pool
+#define GATT_CORO_WAITERS 4		 //!< Number of coroutines that can wait for a GATT event at the same time
+#define GATT_CORO_RETRY_MS 10	 //!< Delay of the retry when the event queue refused a resumption
+
+/**
+ * \brief Fixed pool of coroutine frames, so that starting a coroutine never allocates from the heap
+ *
+ */
+class CCoroFramePool {
+  private:
+	alignas(std::max_align_t) uint8_t _frames[GATT_CORO_FRAMES][GATT_CORO_FRAME_SIZE]; //!< The frame storage
+	uint32_t _used;																	   //!< Bit mask of the frames in use
+	uint32_t _failed;	 //!< Allocations that did not fit in the pool
+	size_t _largest;	 //!< Largest frame size requested
+
+  public:
+	CCoroFramePool() : _used(0), _failed(0), _largest(0) {}
+
+	/**
+	 * \brief The pool of the system
+	 *
+	 */
+	static CCoroFramePool &instance() {
+		static CCoroFramePool pool;
+		return pool;
+	}
+
+	/**
+	 * \brief Allocates a frame
+	 *
+	 * \param size The frame size the compiler needs
+	 * \return void* The frame or nullptr if the frame is too large or the pool is exhausted
+	 */
+	void *allocate(size_t size) {
+		CriticalSectionLock lock;
+		_largest = (size > _largest) ? size : _largest;
+		if (size <= GATT_CORO_FRAME_SIZE) {
+			for (int ii = 0; ii < GATT_CORO_FRAMES; ii++) {
+				if ((_used & (1u << ii)) == 0) {
+					_used |= (1u << ii);
+					return _frames[ii];
+				}
+			}
+		}
+		_failed++;
+		return nullptr;
+	}
+
+	/**
+	 * \brief Releases a frame
+	 *
+	 */
+	void deallocate(void *frame) {
+		CriticalSectionLock lock;
+		int index = (static_cast<uint8_t *>(frame) - &_frames[0][0]) / GATT_CORO_FRAME_SIZE;
+		_used &= ~(1u << index);
+	}
+
+	/**
+	 * \brief Prints the pool usage
+	 *
+	 */
+	void printStats() const {
+		std::cout << "Coroutine frames: largest " << std::dec << _largest << " of " << GATT_CORO_FRAME_SIZE
+				  << " bytes, failed allocations " << _failed << std::endl;
+	}
+};
+
+/**
+ * \brief The return type of the GATT coroutines
+ * \details The coroutine starts at once and runs until its first co_await. It is resumed from the event queue,
+ * 			and its frame is released when it returns. If the frame pool is exhausted, the coroutine does not
+ * 			start and started() returns false.
+ *
+ */
+class CGattTask {
+  private:
+	bool _started; //!< Set if the coroutine got a frame
+
+	explicit CGattTask(bool started) : _started(started) {}
+
+  public:
+	struct promise_type {
+		static void *operator new(size_t size) noexcept { return CCoroFramePool::instance().allocate(size); }
+		static void operator delete(void *frame) noexcept { CCoroFramePool::instance().deallocate(frame); }
+		static CGattTask get_return_object_on_allocation_failure() { return CGattTask(false); }
+		CGattTask get_return_object() { return CGattTask(true); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() {}
+	};
+
+	/**
+	 * \brief Checks whether the coroutine started
+	 *
+	 */
+	bool started() const { return _started; }
+};
+
+/**
+ * \brief Awaitable GATT server operations
+ * \details The awaitables suspend the coroutine until the GATT server reports the matching event and resume it
+ * 			from the event queue, outside of the stack callback. Every awaitable records its latency.
+ *
+ * 			CGattTask notifyThenIndicate(CGattCoro &gatt) {
+ * 				co_await gatt.waitForConnection();
+ * 				ble_error_t error = co_await gatt.set(_new_alert_characteristic, status);
+ * 				if (error == BLE_ERROR_NONE) {
+ * 					error = co_await gatt.indicate(_service_changed_characteristic, range);
+ * 				}
+ * 			}
+ */
+class CGattCoro : private mbed::NonCopyable<CGattCoro> {
+  public:
+	/**
+	 * \brief The events a coroutine can wait for
+	 *
+	 */
+	enum WaitKind {
+		WAIT_DATA_SENT = 0,	   /**< A notification has been sent */
+		WAIT_CONFIRMATION = 1, /**< An indication has been confirmed */
+		WAIT_CONNECTION = 2,   /**< A peer has connected */
+		WAIT_KINDS = 3
+	};
+
+  protected:
+	/**
+	 * \brief A suspended coroutine
+	 *
+	 */
+	struct waiter_t {
+		bool used;
+		bool woken;						  //!< Set once the result is known, until the resumption is posted
+		WaitKind kind;
+		uint16_t handle;				  //!< The value handle of the notification or indication
+		std::coroutine_handle<> coroutine; //!< The suspended coroutine
+		uint32_t startUs;				  //!< The time the coroutine suspended
+		ble_error_t *result;			  //!< The result of the awaitable, in the coroutine frame
+	};
+
+	CGattServer &_server;					   //!< The GATT server
+	CEventQueue &_eventQueue;				   //!< The queue the coroutines are resumed from
+	waiter_t _waiters[GATT_CORO_WAITERS];	   //!< The suspended coroutines
+	bool _connected;						   //!< The connection state
+	bool _retryPosted;						   //!< Set while a retry of the refused resumptions is queued
+	mbed::Timeout _retryTimer;				   //!< Posts the retry when the queue refused it too
+	ble_utils::LatencyStats _latency[WAIT_KINDS]; //!< The latency of the awaitables
+
+	/**
+	 * \brief The callbacks the GATT server had before, called after the ones of the coroutines
+	 * @{
+	 */
+	mbed::Callback<void(uint16_t)> _nextNotificationSent;
+	mbed::Callback<void(uint16_t)> _nextConfirmation;
+	mbed::Callback<void(bool)> _nextConnectionChanged;
+	/** }@*/
+
+	/**
+	 * \brief Posts the resumption of a woken coroutine to the event queue
+	 *
+	 * \return false if the queue is full, the waiter stays woken
+	 */
+	bool post(waiter_t &waiter) {
+		std::coroutine_handle<> coroutine = waiter.coroutine;
+		if (_eventQueue.call([coroutine]() { coroutine.resume(); }) == 0) {
+			return false;
+		}
+		waiter.used = false;
+		return true;
+	}
+
+	/**
+	 * \brief Posts the resumptions the full queue refused before
+	 *
+	 */
+	void retryWoken() {
+		for (auto &waiter : _waiters) {
+			if (waiter.used && waiter.woken && !post(waiter)) {
+				scheduleRetry();
+			}
+		}
+	}
+
+	/**
+	 * \brief Queues a retry of the refused resumptions, so that it does not depend on an other GATT event. If the
+	 * 		  full queue refuses the retry too, a timer posts it, as the timer needs no room in the queue.
+	 *
+	 */
+	void scheduleRetry() {
+		if (_retryPosted) {
+			return;
+		}
+		_retryPosted = true;
+		if (_eventQueue.call_in(GATT_CORO_RETRY_MS, this, &CGattCoro::onRetry) == 0) {
+			_retryTimer.attach(BLE_PROFILED(this, CGattCoro, onRetryTimer), GATT_CORO_RETRY_MS / 1000.0f);
+		}
+	}
+	/**
+	 * \brief The retry timer, in the interrupt context. It only posts the retry, again until the queue has room.
+	 *
+	 */
+	void onRetryTimer() {
+		if (_eventQueue.call(this, &CGattCoro::onRetry) == 0) {
+			_retryTimer.attach(BLE_PROFILED(this, CGattCoro, onRetryTimer), GATT_CORO_RETRY_MS / 1000.0f);
+		}
+	}
+	void onRetry() {
+		_retryPosted = false;
+		retryWoken();
+	}
+
+	/**
+	 * \brief Resumes a waiting coroutine from the event queue, never from the stack callback. If the queue is
+	 * 		  full, the coroutine keeps its result and the resumption is retried.
+	 *
+	 */
+	void wake(waiter_t &waiter, ble_error_t result) {
+		*waiter.result = result;
+		_latency[waiter.kind].addSince(waiter.startUs);
+		waiter.woken = true;
+		if (!post(waiter)) {
+			scheduleRetry();
+		}
+	}
+
+	/**
+	 * \brief Checks whether a coroutine waits for the event
+	 *
+	 */
+	static bool waits(const waiter_t &waiter, WaitKind kind) {
+		return waiter.used && !waiter.woken && waiter.kind == kind;
+	}
+
+	void onNotificationSent(uint16_t handle) {
+		retryWoken();
+		for (auto &waiter : _waiters) {
+			if (waits(waiter, WAIT_DATA_SENT) && waiter.handle == handle) {
+				// one notification completes one wait
+				wake(waiter, BLE_ERROR_NONE);
+				break;
+			}
+		}
+		if (_nextNotificationSent) {
+			_nextNotificationSent(handle);
+		}
+	}
+
+	void onConfirmation(uint16_t handle) {
+		retryWoken();
+		for (auto &waiter : _waiters) {
+			if (waits(waiter, WAIT_CONFIRMATION) && waiter.handle == handle) {
+				wake(waiter, BLE_ERROR_NONE);
+			}
+		}
+		if (_nextConfirmation) {
+			_nextConfirmation(handle);
+		}
+	}
+
+	void onConnectionChanged(bool connected) {
+		_connected = connected;
+		retryWoken();
+		for (auto &waiter : _waiters) {
+			if (!waiter.used || waiter.woken) {
+				continue;
+			}
+			if (connected && waiter.kind == WAIT_CONNECTION) {
+				wake(waiter, BLE_ERROR_NONE);
+			} else if (!connected && waiter.kind != WAIT_CONNECTION) {
+				// the peer is gone, nothing will be sent or confirmed
+				wake(waiter, BLE_ERROR_INVALID_STATE);
+			}
+		}
+		if (_nextConnectionChanged) {
+			_nextConnectionChanged(connected);
+		}
+	}
+
+	/**
+	 * \brief Registers a suspended coroutine
+	 *
+	 * \return true if the coroutine waits
+	 * \return false if all waiter slots are in use, the coroutine continues with BLE_ERROR_NO_MEM
+	 */
+	bool suspend(WaitKind kind, uint16_t handle, std::coroutine_handle<> coroutine, ble_error_t *result) {
+		for (auto &waiter : _waiters) {
+			if (!waiter.used) {
+				waiter = {true, false, kind, handle, coroutine, ble_utils::timestampUs(), result};
+				return true;
+			}
+		}
+		*result = BLE_ERROR_NO_MEM;
+		return false;
+	}
+
+  public:
+	/**
+	 * \brief Awaitable that writes a characteristic value and waits until it has been sent or confirmed
+	 *
+	 */
+	template <typename T> class CUpdateAwaiter {
+	  private:
+		CGattCoro &_coro;
+		CCharacteristic<T> &_characteristic;
+		T _value;
+		WaitKind _kind;
+		ble_error_t _result;
+
+	  public:
+		CUpdateAwaiter(CGattCoro &coro, CCharacteristic<T> &characteristic, const T &value, WaitKind kind)
+			: _coro(coro), _characteristic(characteristic), _value(value), _kind(kind), _result(BLE_ERROR_NONE) {}
+
+		bool await_ready() {
+			GattServer *server = _coro._server.getGattServer();
+			if (server == nullptr) {
+				_result = BLE_ERROR_INITIALIZATION_INCOMPLETE;
+				return true;
+			}
+			bool enabled = false;
+			server->areUpdatesEnabled(_characteristic, &enabled);
+			_result = _characteristic.set(server, _value);
+			// without a subscribed client the value is only stored, there is nothing to wait for
+			return _result != BLE_ERROR_NONE || !enabled;
+		}
+		bool await_suspend(std::coroutine_handle<> coroutine) {
+			return _coro.suspend(_kind, _characteristic.getValueHandle(), coroutine, &_result);
+		}
+		ble_error_t await_resume() { return _result; }
+	};
+
+	/**
+	 * \brief Awaitable that waits for a connection
+	 *
+	 */
+	class CConnectionAwaiter {
+	  private:
+		CGattCoro &_coro;
+		ble_error_t _result;
+
+	  public:
+		explicit CConnectionAwaiter(CGattCoro &coro) : _coro(coro), _result(BLE_ERROR_NONE) {}
+
+		bool await_ready() { return _coro._connected; }
+		bool await_suspend(std::coroutine_handle<> coroutine) {
+			return _coro.suspend(WAIT_CONNECTION, 0, coroutine, &_result);
+		}
+		ble_error_t await_resume() { return _result; }
+	};
+
+	/**
+	 * \brief Construct a new CGattCoro object. It hooks the notification sent, confirmation and connection
+	 * 		  callbacks of the GATT server and calls the callbacks set before after its own.
+	 *
+	 * \param server The GATT server
+	 * \param eventQueue The queue the coroutines are resumed from
+	 */
+	CGattCoro(CGattServer &server, CEventQueue &eventQueue)
+		: _server(server), _eventQueue(eventQueue), _waiters(), _connected(false), _retryPosted(false),
+		  _nextNotificationSent(server.getOnNotificationSent()), _nextConfirmation(server.getOnConfirmation()),
+		  _nextConnectionChanged(server.getOnConnectionChanged()) {
+		_server.setOnNotificationSent(callback(this, &CGattCoro::onNotificationSent));
+		_server.setOnConfirmation(callback(this, &CGattCoro::onConfirmation));
+		_server.setOnConnectionChanged(callback(this, &CGattCoro::onConnectionChanged));
+	}
+
+	/**
+	 * \brief Writes the value and, if a client is subscribed, waits until the notification has been sent
+	 *
+	 * \return The awaitable. co_await gives BLE_ERROR_NONE or an appropriate error code.
+	 */
+	template <typename T> CUpdateAwaiter<T> set(CCharacteristic<T> &characteristic, const T &value) {
+		return CUpdateAwaiter<T>(*this, characteristic, value, WAIT_DATA_SENT);
+	}
+
+	/**
+	 * \brief Writes the value and, if a client is subscribed, waits until the indication has been confirmed
+	 *
+	 * \return The awaitable. co_await gives BLE_ERROR_NONE or an appropriate error code.
+	 */
+	template <typename T> CUpdateAwaiter<T> indicate(CCharacteristic<T> &characteristic, const T &value) {
+		return CUpdateAwaiter<T>(*this, characteristic, value, WAIT_CONFIRMATION);
+	}
+
+	/**
+	 * \brief Waits until a peer is connected
+	 *
+	 * \return The awaitable. co_await gives BLE_ERROR_NONE or BLE_ERROR_NO_MEM.
+	 */
+	CConnectionAwaiter waitForConnection() { return CConnectionAwaiter(*this); }
+
+	/**
+	 * \brief Prints the latency of the awaitables and the frame pool usage
+	 *
+	 */
+	void printLatency() const {
+		_latency[WAIT_DATA_SENT].print("co_await set()");
+		_latency[WAIT_CONFIRMATION].print("co_await indicate()");
+		_latency[WAIT_CONNECTION].print("co_await waitForConnection()");
+		CCoroFramePool::instance().printStats();
+	}
+};
+
+#endif // C++20 coroutines
+
+#endif //!_BLE_GATT_CORO_H_
@@ -0,0 +1,253 @@
+#ifndef _DIAGNOSTICS_SERVICE_H_
+#define _DIAGNOSTICS_SERVICE_H_
+#include "ble/GattServer.h"
+#include "ble/GattService.h"
+#include "ble_event_queue.h"
+#include "ble_gatt_characteristic.h"
+#include "ble_gatt_service.h"
+#include "ble_profiler.h"
+#include "ble_utils.h"
+
+#define UUID_DIAGNOSTICS_SERVICE "c0de0001-5b6e-4a7b-9a3e-6f1d2c3b4a50"		//!< Diagnostics service UUID
+#define UUID_DIAGNOSTICS_SNAPSHOT_CHAR "c0de0002-5b6e-4a7b-9a3e-6f1d2c3b4a50" //!< Snapshot characteristic UUID
+#define UUID_DIAGNOSTICS_DELTA_CHAR "c0de0003-5b6e-4a7b-9a3e-6f1d2c3b4a50"	//!< Delta characteristic UUID
+#define UUID_DIAGNOSTICS_PERIOD_CHAR "c0de0004-5b6e-4a7b-9a3e-6f1d2c3b4a50"	//!< Delta period characteristic UUID
+#define DIAGNOSTICS_HANDLERS 8				//!< Number of handlers in the snapshot
+#define DIAGNOSTICS_DEFAULT_PERIOD_MS 5000	//!< Default period of the delta notifications
+#define DIAGNOSTICS_MIN_PERIOD_MS 100		//!< Shortest accepted delta period, 0 stops the notifications
+#define DIAGNOSTICS_SNAPSHOT_CACHE_MS 100	//!< Time a snapshot is reused for by the following reads
+
+/**
+ * \brief The runtime metrics snapshot, little endian and packed as read by the client
+ *
+ */
+struct __attribute__((packed)) diagnostics_snapshot_t {
+	uint32_t uptimeMs;							  //!< Time since the start
+	uint32_t notificationsSent;					  //!< Notifications and indications sent
+	uint32_t notificationsDropped;				  //!< Updates given up
+	uint32_t noMemRetries;						  //!< Updates deferred for lack of transmit buffers
+	uint32_t connections;						  //!< Connections completed
+	uint16_t queueHighWaterBytes;				  //!< Event queue high-water mark
+	uint16_t queueCapacityBytes;				  //!< Event queue pool size
+	uint32_t heapInUseBytes;					  //!< Heap in use, 0 without MBED_HEAP_STATS_ENABLED
+	uint16_t handlerMaxUs[DIAGNOSTICS_HANDLERS]; //!< Longest run of each handler, see handlerNames()
+};
+
+/**
+ * \brief The change of the counters over a period, notified to the client. Fits the default ATT MTU.
+ *
+ */
+struct __attribute__((packed)) diagnostics_delta_t {
+	uint16_t periodMs;				//!< The time covered by the delta
+	uint16_t notificationsSent;		//!< Notifications and indications sent in the period
+	uint16_t notificationsDropped;	//!< Updates given up in the period
+	uint16_t noMemRetries;			//!< Updates deferred in the period
+	uint16_t connections;			//!< Connections completed in the period
+	uint16_t queueHighWaterBytes;	//!< Event queue high-water mark
+	uint32_t heapInUseBytes;		//!< Heap in use
+};
+
+/**
+ * \brief Diagnostics service server class
+ * \details A vendor specific service that exposes the runtime metrics of the device. The snapshot
+ * 			characteristic is computed when a client reads it, at most DIAGNOSTICS_SNAPSHOT_CACHE_MS old, and
+ * 			nothing is computed or allocated between the reads. The delta characteristic notifies the change
+ * 			of the counters at the period written to the period characteristic while a client is connected.
+ */
+class CDiagnosticsServiceServer : public CGattService {
+  private:
+	CEventQueue &_eventQueue; //!< The queue whose occupancy is reported and which runs the delta timer
+
+	CReadOnlyCharacteristic<diagnostics_snapshot_t> _snapshot_characteristic;
+	CNotifyOnlyCharacteristic<diagnostics_delta_t> _delta_characteristic;
+	CReadWriteCharacteristic<uint16_t> _period_characteristic;
+	GattCharacteristic *_characteristics[3]; //!< The characteristics of the service
+
+	ble_profiler::profile_entry_t *_handlers[DIAGNOSTICS_HANDLERS]; //!< The profiles of the reported handlers
+	ble_utils::activity_counters_t _last;						   //!< The counters of the previous delta
+	uint16_t _periodMs;											   //!< The delta period, 0 if stopped
+	uint16_t _deferredPeriods;									   //!< Periods of a delta the stack had no buffer for
+	int _deltaEvent;											   //!< The delta timer event, 0 if none
+	bool _connected;											   //!< Connected flag
+
+	/**
+	 * \brief Get the heap in use
+	 *
+	 */
+	static uint32_t heapInUse() {
+#if defined(MBED_HEAP_STATS_ENABLED) && MBED_HEAP_STATS_ENABLED
+		mbed_stats_heap_t heap;
+		mbed_stats_heap_get(&heap);
+		return heap.current_size;
+#else
+		return 0;
+#endif
+	}
+
+	static uint16_t saturate16(uint32_t value) { return (value > UINT16_MAX) ? UINT16_MAX : (uint16_t)value; }
+
+	/**
+	 * \brief Assembles the snapshot
+	 *
+	 */
+	void fillSnapshot(diagnostics_snapshot_t &snapshot) {
+		const ble_utils::activity_counters_t &counters = ble_utils::activityCounters();
+		const event_queue_stats_t &queue = _eventQueue.getStats();
+		snapshot.uptimeMs = (uint32_t)rtos::Kernel::get_ms_count();
+		snapshot.notificationsSent = counters.notificationsSent;
+		snapshot.notificationsDropped = counters.notificationsDropped;
+		snapshot.noMemRetries = counters.noMemRetries;
+		snapshot.connections = counters.connections;
+		snapshot.queueHighWaterBytes = saturate16(queue.highWaterBytes);
+		snapshot.queueCapacityBytes = saturate16(queue.capacityBytes);
+		snapshot.heapInUseBytes = heapInUse();
+		uint32_t perUs = ble_profiler::cyclesPerUs();
+		for (int ii = 0; ii < DIAGNOSTICS_HANDLERS; ii++) {
+			snapshot.handlerMaxUs[ii] = saturate16(_handlers[ii]->max / perUs);
+		}
+	}
+
+	/**
+	 * \brief Notifies the change of the counters since the previous delta. If the stack has no transmit
+	 * 		  buffer, the counters are kept and the next period notifies the change over both periods.
+	 *
+	 */
+	void onDeltaTimer() {
+		const ble_utils::activity_counters_t &counters = ble_utils::activityCounters();
+		diagnostics_delta_t delta;
+		delta.periodMs = saturate16((uint32_t)_periodMs * (_deferredPeriods + 1));
+		delta.notificationsSent = saturate16(counters.notificationsSent - _last.notificationsSent);
+		delta.notificationsDropped = saturate16(counters.notificationsDropped - _last.notificationsDropped);
+		delta.noMemRetries = saturate16(counters.noMemRetries - _last.noMemRetries);
+		delta.connections = saturate16(counters.connections - _last.connections);
+		delta.queueHighWaterBytes = saturate16(_eventQueue.getStats().highWaterBytes);
+		delta.heapInUseBytes = heapInUse();
+		ble_error_t error = _delta_characteristic.set(_server, delta);
+		if (error == BLE_ERROR_NO_MEM) {
+			ble_utils::activityCounters().noMemRetries++;
+			_deferredPeriods++;
+			return;
+		}
+		if (error != BLE_ERROR_NONE) {
+			ble_utils::printError(error, "CDiagnosticsServiceServer delta ");
+		}
+		_last = counters;
+		_deferredPeriods = 0;
+	}
+
+	/**
+	 * \brief Starts the delta timer at the current period, or stops it if the period is 0
+	 *
+	 */
+	void restartDeltaTimer() {
+		if (_deltaEvent != 0) {
+			_eventQueue.cancel(_deltaEvent);
+			_deltaEvent = 0;
+		}
+		if (_connected && _periodMs != 0) {
+			_last = ble_utils::activityCounters();
+			_deferredPeriods = 0;
+			_deltaEvent = _eventQueue.call_every(_periodMs, this, &CDiagnosticsServiceServer::onDeltaTimer);
+		}
+	}
+
+  public:
+	/**
+	 * \brief Construct a new CDiagnosticsServiceServer object
+	 *
+	 * \param eventQueue The queue of the BLE events, its occupancy is reported
+	 * \param periodMs The initial delta period, 0 to notify only after the client writes a period
+	 */
+	CDiagnosticsServiceServer(CEventQueue &eventQueue, uint16_t periodMs = DIAGNOSTICS_DEFAULT_PERIOD_MS)
+		: CGattService(UUID(UUID_DIAGNOSTICS_SERVICE), _characteristics, 3), _eventQueue(eventQueue),
+		  _snapshot_characteristic(UUID(UUID_DIAGNOSTICS_SNAPSHOT_CHAR), diagnostics_snapshot_t()),
+		  _delta_characteristic(UUID(UUID_DIAGNOSTICS_DELTA_CHAR), diagnostics_delta_t()),
+		  _period_characteristic(UUID(UUID_DIAGNOSTICS_PERIOD_CHAR), periodMs), _last(), _periodMs(periodMs),
+		  _deferredPeriods(0), _deltaEvent(0), _connected(false) {
+		_characteristics[0] = &_snapshot_characteristic;
+		_characteristics[1] = &_delta_characteristic;
+		_characteristics[2] = &_period_characteristic;
+		_snapshot_characteristic.setOnRead(callback(this, &CDiagnosticsServiceServer::fillSnapshot),
+										   DIAGNOSTICS_SNAPSHOT_CACHE_MS);
+		const char *const *names = handlerNames();
+		for (int ii = 0; ii < DIAGNOSTICS_HANDLERS; ii++) {
+			_handlers[ii] = ble_profiler::CProfiler::instance().add(names[ii]);
+		}
+	}
+
+	/**
+	 * \brief The handlers in the order of diagnostics_snapshot_t::handlerMaxUs
+	 *
+	 */
+	static const char *const *handlerNames() {
+		static const char *const names[DIAGNOSTICS_HANDLERS] = {
+			"BLE::processEvents",
+			"CGattServer::onDataWritten",
+			"CGattServer::onDataRead",
+			"CGattServer::onDataSent",
+			"CAlertNotificationServiceServer::onWrite",
+			"CImmediateAlertServiceServer::onWrite",
+			"CGapSecurity::pairingResult",
+			"CHomework::onAlertLevelChanged",
+		};
+		return names;
+	}
+
+	/**
+	 * \brief on Connection handler of the service
+	 *
+	 */
+	virtual void onConnection() override {
+		_connected = true;
+		restartDeltaTimer();
+	}
+	/**
+	 * \brief on Disconnection handler of the service
+	 *
+	 */
+	virtual void onDisconnection() override {
+		_connected = false;
+		restartDeltaTimer();
+	}
+	/**
+	 * \brief on Read handler of the service
+	 *
+	 * \param handle The attribute handle of the characteristic value attribute
+	 */
+	virtual void onRead(uint16_t handle) override { (void)handle; }
+	/**
+	 * \brief onWrite handler of the service. Applies a new delta period.
+	 *
+	 * \param handle The attribute handle of the characteristic value attribute
+	 */
+	virtual void onWrite(uint16_t handle) override {
+		if (handle != _period_characteristic.getValueHandle()) {
+			return;
+		}
+		uint16_t periodMs = 0;
+		ble_error_t error = _period_characteristic.get(_server, periodMs);
+		ble_utils::printError(error, "Diagnostics period characteristic ");
+		if (periodMs != 0 && periodMs < DIAGNOSTICS_MIN_PERIOD_MS) {
+			periodMs = DIAGNOSTICS_MIN_PERIOD_MS;
+			_period_characteristic.set(_server, periodMs, true);
+		}
+		_periodMs = periodMs;
+		restartDeltaTimer();
+	}
+
+	/**
+	 * \brief Enables/disables authentication for the diagnostics characteristics
+	 *
+	 * \param enable True enable, False to disable authentication
+	 */
+	virtual void enableAuthentication(bool enable = true) override {
+		ble::att_security_requirement_t requirement =
+			enable ? ble::att_security_requirement_t::AUTHENTICATED : ble::att_security_requirement_t::NONE;
+		_snapshot_characteristic.setReadSecurityRequirement(requirement);
+		_delta_characteristic.setUpdateSecurityRequirement(requirement);
+		_period_characteristic.setReadSecurityRequirement(requirement);
+		_period_characteristic.setWriteSecurityRequirement(requirement);
+	}
+};
+
+#endif //!_DIAGNOSTICS_SERVICE_H_
\ No newline at end of file
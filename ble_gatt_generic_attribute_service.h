@@ -0,0 +1,664 @@
+#ifndef _GENERIC_ATTRIBUTE_SERVICE_H_
+#define _GENERIC_ATTRIBUTE_SERVICE_H_
+
+#include "ble/GattServer.h"
+#include "ble/GattService.h"
+#include "ble_gatt_characteristic.h"
+#include "ble_gatt_service.h"
+#include "ble_utils.h"
+#include "mbedtls/aes.h"
+
+#include <cstdio>
+#include <cstring>
+
+#define UUID_GENERIC_ATTRIBUTE_SERVICE 0x1801	   //!< Generic Attribute service UUID
+#define UUID_CLIENT_SUPPORTED_FEATURES_CHAR 0x2B29 //!< Client Supported Features characteristic UUID
+#define UUID_DATABASE_HASH_CHAR 0x2B2A			   //!< Database Hash characteristic UUID
+#define CLIENT_FEATURE_ROBUST_CACHING 0x01		   //!< Robust caching bit of the Client Supported Features
+#define GATT_CACHING_CLIENTS 8					   //!< Bonded clients whose caching state is kept
+#define ATT_ERROR_DATABASE_OUT_OF_SYNC 0x12		   //!< ATT error of a request from a change-unaware client
+#define ATT_ERROR_VALUE_NOT_ALLOWED 0x13		   //!< ATT error of a write that disables a client feature
+
+#define ATT_UUID_PRIMARY_SERVICE 0x2800		 //!< Primary service declaration attribute type
+#define ATT_UUID_CHARACTERISTIC 0x2803		 //!< Characteristic declaration attribute type
+#define ATT_UUID_FIRST_HASHED_DESCRIPTOR 0x2900 //!< First descriptor type included in the database hash
+#define ATT_UUID_LAST_HASHED_DESCRIPTOR 0x2905	 //!< Last descriptor type included in the database hash
+#define ATT_UUID_CCCD 0x2902				 //!< Client Characteristic Configuration descriptor type
+#define ATT_UUID_GENERIC_ACCESS 0x1800		 //!< Generic Access service of the stack
+#define ATT_UUID_DEVICE_NAME 0x2A00			 //!< Device Name characteristic of the stack
+#define ATT_UUID_APPEARANCE 0x2A01			 //!< Appearance characteristic of the stack
+#define ATT_UUID_PPCP 0x2A04				 //!< Peripheral Preferred Connection Parameters characteristic of the stack
+
+/**
+ * \brief AES-CMAC calculation with a 128-bit key, as defined in RFC 4493.
+ * \details The message is processed one block at a time, so it does not have to be kept in memory.
+ */
+class CAesCmac : private mbed::NonCopyable<CAesCmac> {
+  private:
+	mbedtls_aes_context _aes; //!< The AES-128 context
+	uint8_t _mac[16];		  //!< The running CBC-MAC
+	uint8_t _block[16];		  //!< The block that has not been processed yet
+	size_t _length;			  //!< Number of bytes in _block
+
+	/**
+	 * \brief Doubles a value in GF(2^128), used to derive the subkeys
+	 *
+	 * \param value The value to be doubled in place
+	 */
+	static void doubleSubkey(uint8_t value[16]) {
+		uint8_t carry = value[0] & 0x80;
+		for (int ii = 0; ii < 15; ii++) {
+			value[ii] = (uint8_t)((value[ii] << 1) | (value[ii + 1] >> 7));
+		}
+		value[15] = (uint8_t)(value[15] << 1);
+		if (carry != 0) {
+			value[15] ^= 0x87;
+		}
+	}
+
+	/**
+	 * \brief Adds a block to the running MAC
+	 *
+	 * \param block The block
+	 */
+	void processBlock(const uint8_t block[16]) {
+		for (int ii = 0; ii < 16; ii++) {
+			_mac[ii] ^= block[ii];
+		}
+		mbedtls_aes_crypt_ecb(&_aes, MBEDTLS_AES_ENCRYPT, _mac, _mac);
+	}
+
+  public:
+	/**
+	 * \brief Construct a new CAesCmac object
+	 *
+	 * \param key The 128-bit key
+	 */
+	CAesCmac(const uint8_t key[16]) : _length(0) {
+		mbedtls_aes_init(&_aes);
+		mbedtls_aes_setkey_enc(&_aes, key, 128);
+		memset(_mac, 0, sizeof(_mac));
+	}
+	~CAesCmac() { mbedtls_aes_free(&_aes); }
+
+	/**
+	 * \brief Adds data to the message
+	 *
+	 * \param data The data
+	 * \param length The length of the data
+	 */
+	void update(const uint8_t *data, size_t length) {
+		for (size_t ii = 0; ii < length; ii++) {
+			// the last block is processed with a subkey, so keep a full block until more data arrives
+			if (_length == sizeof(_block)) {
+				processBlock(_block);
+				_length = 0;
+			}
+			_block[_length++] = data[ii];
+		}
+	}
+
+	/**
+	 * \brief Adds a 16-bit value to the message in little endian order
+	 *
+	 * \param value The value
+	 */
+	void update(uint16_t value) {
+		uint8_t bytes[2] = {(uint8_t)(value & 0xFF), (uint8_t)(value >> 8)};
+		update(bytes, sizeof(bytes));
+	}
+
+	/**
+	 * \brief Completes the calculation
+	 *
+	 * \param mac The 128-bit message authentication code
+	 */
+	void final(uint8_t mac[16]) {
+		uint8_t subkey[16] = {0};
+		mbedtls_aes_crypt_ecb(&_aes, MBEDTLS_AES_ENCRYPT, subkey, subkey);
+		doubleSubkey(subkey);
+		if (_length != sizeof(_block)) {
+			// incomplete (or empty) last block is padded and uses the second subkey
+			_block[_length++] = 0x80;
+			while (_length < sizeof(_block)) {
+				_block[_length++] = 0;
+			}
+			doubleSubkey(subkey);
+		}
+		for (int ii = 0; ii < 16; ii++) {
+			_block[ii] ^= subkey[ii];
+		}
+		processBlock(_block);
+		memcpy(mac, _mac, sizeof(_mac));
+	}
+};
+
+/**
+ * \brief Generic Attribute service server class
+ * \details Implements the GATT caching characteristics of the Generic Attribute service: Service Changed,
+ * Client Supported Features and Database Hash. A client that has cached the attribute layout reads the
+ * Database Hash on reconnection and skips the service discovery if the hash has not changed. When the
+ * layout changes, the Service Changed characteristic is indicated to the clients that have not seen the
+ * new layout yet.
+ *
+ * The hash covers the whole attribute table: the Generic Access and Generic Attribute services the stack
+ * registers ahead of the application, then the services registered through CGattServer. The GattServer API
+ * cannot add characteristics to the Generic Attribute service of the stack, so this service is a second
+ * instance with the caching characteristics. The clients look up Database Hash and Client Supported Features
+ * by their characteristic UUID, which only this instance has. The Service Changed of the stack is never
+ * indicated, the clients subscribe to the one of this instance, see CGattClient.
+ *
+ * The change-aware state and the Client Supported Features of a bonded client last over connections and
+ * resets, they are stored with the hash next to the bond storage. A change-unaware client that enabled robust
+ * caching gets the Database Out Of Sync error on its requests until it reads the Database Hash or sends the
+ * next request, as the Core Specification Vol 3 Part G 2.5.2.1 requires. The requests are checked by
+ * authorizeRequest(), the GATT server runs it ahead of the authorization of every characteristic.
+ */
+class CGenericAttributeServiceServer : public CGattService {
+  public:
+	/**
+	 * \brief The Database Hash characteristic value
+	 *
+	 */
+	struct database_hash_t {
+		uint8_t bytes[16]; //!< The AES-CMAC of the attribute layout
+	};
+	/**
+	 * \brief The Service Changed characteristic value
+	 *
+	 */
+	struct service_changed_t {
+		uint16_t start; //!< The first affected attribute handle
+		uint16_t end;	//!< The last affected attribute handle
+	};
+
+  protected:
+	/**
+	 * \brief The service characteristics
+	 * @{
+	 */
+	CIndicateOnlyCharacteristic<service_changed_t> _service_changed_characteristic;
+	CReadWriteCharacteristic<uint8_t> _client_supported_features_characteristic;
+	CReadOnlyCharacteristic<database_hash_t> _database_hash_characteristic;
+
+	GattCharacteristic *_characteristics[3];
+	/** }@*/
+
+	/**
+	 * \brief The caching state of a bonded client
+	 *
+	 */
+	struct caching_client_t {
+		uint8_t address[6]; //!< The identity address of the client
+		uint8_t features;	//!< The Client Supported Features the client enabled
+		uint8_t changeAware; //!< 1 if the client knows the current layout
+	};
+
+	database_hash_t _hash;		   //!< The hash of the current attribute layout
+	const char *_caching_filepath; //!< The file storing the hash and the bonded clients. NULL if not persistent.
+	bool _database_changed;		   //!< Set if the layout changed since the previous start
+
+	caching_client_t _clients[GATT_CACHING_CLIENTS]; //!< The caching state of the bonded clients
+	uint8_t _client_count;							 //!< Number of the bonded clients
+
+	ble::address_t _peer_address; //!< The identity address of the connected client
+	bool _peer_bonded;			  //!< Set if the connected client is bonded
+	bool _client_change_aware;	  //!< Set when the connected client knows the current layout
+	uint8_t _client_features;	  //!< The Client Supported Features of the connected client
+	bool _out_of_sync_sent;		  //!< Set once the change-unaware client got the Database Out Of Sync error
+
+	/**
+	 * \brief Reads the hash and the bonded clients of the previous start
+	 *
+	 * \param hash The stored hash
+	 * \return true if the hash was read
+	 * \return false if there is no stored hash
+	 */
+	bool loadCachingState(database_hash_t &hash) {
+		if (_caching_filepath == NULL) {
+			return false;
+		}
+		FILE *file = fopen(_caching_filepath, "rb");
+		if (file == NULL) {
+			return false;
+		}
+		bool loaded = (fread(hash.bytes, 1, sizeof(hash.bytes), file) == sizeof(hash.bytes));
+		uint8_t count = 0;
+		_client_count = 0;
+		if (loaded && fread(&count, 1, 1, file) == 1 && count <= GATT_CACHING_CLIENTS &&
+			fread(_clients, sizeof(caching_client_t), count, file) == count) {
+			_client_count = count;
+		}
+		fclose(file);
+		return loaded;
+	}
+
+	/**
+	 * \brief Stores the hash of the current layout and the bonded clients
+	 *
+	 */
+	void storeCachingState() {
+		if (_caching_filepath == NULL) {
+			return;
+		}
+		FILE *file = fopen(_caching_filepath, "wb");
+		if (file == NULL) {
+			std::cout << "\tGATT caching state cannot be stored" << std::endl;
+			return;
+		}
+		fwrite(_hash.bytes, 1, sizeof(_hash.bytes), file);
+		fwrite(&_client_count, 1, 1, file);
+		fwrite(_clients, sizeof(caching_client_t), _client_count, file);
+		fclose(file);
+	}
+
+	/**
+	 * \brief Finds the caching state of a bonded client
+	 *
+	 * \param address The identity address of the client
+	 * \return caching_client_t* The state, nullptr if the client has none
+	 */
+	caching_client_t *findClient(const ble::address_t &address) {
+		for (uint8_t ii = 0; ii < _client_count; ii++) {
+			if (memcmp(_clients[ii].address, address.data(), sizeof(_clients[ii].address)) == 0) {
+				return &_clients[ii];
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * \brief Stores the state of the connected client if it is bonded. A new client replaces the oldest one
+	 * 		  when the table is full, that client rediscovers the layout on its next connection.
+	 *
+	 */
+	void storeConnectedClient() {
+		if (!_peer_bonded) {
+			return;
+		}
+		caching_client_t *client = findClient(_peer_address);
+		if (client == nullptr) {
+			if (_client_count == GATT_CACHING_CLIENTS) {
+				memmove(&_clients[0], &_clients[1], (GATT_CACHING_CLIENTS - 1) * sizeof(caching_client_t));
+				_client_count--;
+			}
+			client = &_clients[_client_count++];
+			memcpy(client->address, _peer_address.data(), sizeof(client->address));
+		} else if (client->features == _client_features && client->changeAware == (_client_change_aware ? 1 : 0)) {
+			return;
+		}
+		client->features = _client_features;
+		client->changeAware = _client_change_aware ? 1 : 0;
+		storeCachingState();
+	}
+
+	/**
+	 * \brief Removes the state of a client that is not bonded any more
+	 *
+	 * \param address The identity address of the client
+	 */
+	void removeClient(const ble::address_t &address) {
+		caching_client_t *client = findClient(address);
+		if (client == nullptr) {
+			return;
+		}
+		memmove(client, client + 1, (&_clients[_client_count] - (client + 1)) * sizeof(caching_client_t));
+		_client_count--;
+		storeCachingState();
+	}
+
+	/**
+	 * \brief The connected client knows the current layout
+	 *
+	 */
+	void setChangeAware() {
+		if (_client_change_aware) {
+			return;
+		}
+		_client_change_aware = true;
+		storeConnectedClient();
+	}
+
+	/**
+	 * \brief Checks a write of the Client Supported Features, a client cannot disable a feature once enabled
+	 *
+	 * \param features The written features
+	 * \return GattAuthCallbackReply_t AUTH_CALLBACK_REPLY_SUCCESS or the Value Not Allowed error
+	 */
+	GattAuthCallbackReply_t validateClientFeatures(const uint8_t &features) {
+		if ((_client_features & ~features) != 0) {
+			return (GattAuthCallbackReply_t)(0x0100 | ATT_ERROR_VALUE_NOT_ALLOWED);
+		}
+		return AUTH_CALLBACK_REPLY_SUCCESS;
+	}
+
+	/**
+	 * \brief Indicates the whole handle range as changed to the connected client
+	 *
+	 */
+	void indicateServiceChanged() {
+		service_changed_t range = {0x0001, 0xFFFF};
+		ble_error_t error = _service_changed_characteristic.set(_server, range);
+		ble_utils::printError(error, "\tGATT Service Changed indication ");
+	}
+
+	/**
+	 * \brief An attribute of the services the stack registers ahead of the application
+	 *
+	 */
+	struct stack_attribute_t {
+		uint16_t type;		//!< The declaration or descriptor type, 0 for a characteristic value
+		uint16_t uuid;		//!< The UUID of the declared service or characteristic
+		uint8_t properties; //!< The properties of a declared characteristic
+	};
+
+	/**
+	 * \brief Adds the services of the stack to the hash
+	 * \details The Cordio port of mbed OS registers the Generic Access service (Device Name, Appearance,
+	 * Peripheral Preferred Connection Parameters) and the Generic Attribute service (Service Changed) from
+	 * handle 1. The GattServer API does not expose them, so their layout is described here and used when the
+	 * first registered service starts right after it. A stack without own services, as the host stack,
+	 * registers the application from handle 1.
+	 *
+	 * \param services The registered services in the handle order
+	 * \param cmac The hash calculation
+	 */
+	static void hashStackServices(const CGattServicesSet &services, CAesCmac &cmac) {
+		static const stack_attribute_t attributes[] = {
+			{ATT_UUID_PRIMARY_SERVICE, ATT_UUID_GENERIC_ACCESS, 0},
+			{ATT_UUID_CHARACTERISTIC, ATT_UUID_DEVICE_NAME, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ},
+			{0, ATT_UUID_DEVICE_NAME, 0},
+			{ATT_UUID_CHARACTERISTIC, ATT_UUID_APPEARANCE, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ},
+			{0, ATT_UUID_APPEARANCE, 0},
+			{ATT_UUID_CHARACTERISTIC, ATT_UUID_PPCP, GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ},
+			{0, ATT_UUID_PPCP, 0},
+			{ATT_UUID_PRIMARY_SERVICE, UUID_GENERIC_ATTRIBUTE_SERVICE, 0},
+			{ATT_UUID_CHARACTERISTIC, GattCharacteristic::UUID_SERVICE_CHANGED_CHAR,
+			 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE},
+			{0, GattCharacteristic::UUID_SERVICE_CHANGED_CHAR, 0},
+			{ATT_UUID_CCCD, 0, 0},
+		};
+		const uint16_t count = sizeof(attributes) / sizeof(attributes[0]);
+		uint16_t firstHandle = services.empty() ? 1 : services.front()->getHandle();
+		if (firstHandle == 1) {
+			return;
+		}
+		if (firstHandle != count + 1) {
+			std::cout << "\tGATT Database Hash: unknown layout of the stack services, handle 0x"
+					  << HEX_SHORT_IOSTREAM(firstHandle) << " comes first" << std::endl;
+			return;
+		}
+		for (uint16_t handle = 1; handle <= count; handle++) {
+			const stack_attribute_t &attribute = attributes[handle - 1];
+			if (attribute.type == 0) {
+				continue;
+			}
+			cmac.update(handle);
+			cmac.update(attribute.type);
+			if (attribute.type == ATT_UUID_PRIMARY_SERVICE) {
+				cmac.update(attribute.uuid);
+			} else if (attribute.type == ATT_UUID_CHARACTERISTIC) {
+				cmac.update(&attribute.properties, 1);
+				cmac.update((uint16_t)(handle + 1));
+				cmac.update(attribute.uuid);
+			}
+		}
+	}
+
+  public:
+	/**
+	 * \brief Construct a new CGenericAttributeServiceServer object
+	 *
+	 * \param cachingFilepath The file where the hash and the state of the bonded clients are stored over
+	 * 						resets, on the file system of the bonds. If NULL, the layout is considered
+	 * 						changed on every start.
+	 */
+	CGenericAttributeServiceServer(const char *cachingFilepath = NULL)
+		: CGattService(UUID_GENERIC_ATTRIBUTE_SERVICE, _characteristics, 3),
+		  _service_changed_characteristic(GattCharacteristic::UUID_SERVICE_CHANGED_CHAR, {0, 0}),
+		  _client_supported_features_characteristic(UUID_CLIENT_SUPPORTED_FEATURES_CHAR, 0),
+		  _database_hash_characteristic(UUID_DATABASE_HASH_CHAR, database_hash_t()), _hash(),
+		  _caching_filepath(cachingFilepath), _database_changed(true), _client_count(0), _peer_bonded(false),
+		  _client_change_aware(false), _client_features(0), _out_of_sync_sent(false) {
+		_characteristics[0] = &_service_changed_characteristic;
+		_characteristics[1] = &_client_supported_features_characteristic;
+		_characteristics[2] = &_database_hash_characteristic;
+		_client_supported_features_characteristic.setWriteValidator(
+			callback(this, &CGenericAttributeServiceServer::validateClientFeatures));
+	}
+
+	/**
+	 * \brief Calculates the Database Hash of the attribute table
+	 * \details The hash is the AES-CMAC with a zero key over the handle, type and value of the service and
+	 * characteristic declarations and the handle and type of the descriptors, in the handle order. The
+	 * stack adds the CCCD after the other descriptors of a characteristic.
+	 *
+	 * \param services The services in the handle order
+	 * \param hash The calculated hash
+	 */
+	static void computeDatabaseHash(const CGattServicesSet &services, database_hash_t &hash) {
+		const uint8_t key[16] = {0};
+		CAesCmac cmac(key);
+		hashStackServices(services, cmac);
+		for (auto s : services) {
+			// service declaration
+			cmac.update(s->getHandle());
+			cmac.update((uint16_t)ATT_UUID_PRIMARY_SERVICE);
+			cmac.update(s->getUUID().getBaseUUID(), s->getUUID().getLen());
+			for (uint8_t ii = 0; ii < s->getCharacteristicCount(); ii++) {
+				GattCharacteristic *c = s->getCharacteristic(ii);
+				GattAttribute::Handle_t lastHandle = c->getValueHandle();
+				bool hasCccd = false;
+				// characteristic declaration
+				cmac.update((uint16_t)(c->getValueHandle() - 1));
+				cmac.update((uint16_t)ATT_UUID_CHARACTERISTIC);
+				uint8_t properties = c->getProperties();
+				cmac.update(&properties, 1);
+				cmac.update(c->getValueHandle());
+				cmac.update(c->getValueAttribute().getUUID().getBaseUUID(), c->getValueAttribute().getUUID().getLen());
+				// descriptors
+				for (uint8_t dd = 0; dd < c->getDescriptorCount(); dd++) {
+					GattAttribute *d = c->getDescriptor(dd);
+					uint16_t type = d->getUUID().getShortUUID();
+					lastHandle = d->getHandle();
+					hasCccd |= (type == ATT_UUID_CCCD);
+					if (d->getUUID().shortOrLong() == UUID::UUID_TYPE_SHORT &&
+						type >= ATT_UUID_FIRST_HASHED_DESCRIPTOR && type <= ATT_UUID_LAST_HASHED_DESCRIPTOR) {
+						cmac.update(d->getHandle());
+						cmac.update(type);
+					}
+				}
+				if (!hasCccd && (properties & (GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY |
+											   GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE))) {
+					cmac.update((uint16_t)(lastHandle + 1));
+					cmac.update((uint16_t)ATT_UUID_CCCD);
+				}
+			}
+		}
+		cmac.final(hash.bytes);
+	}
+
+	/**
+	 * \brief Calculates the hash of the registered layout and compares it to the hash of the previous start
+	 *
+	 * \param services All the services of the server in the handle order
+	 */
+	virtual void onServerStarted(const CGattServicesSet &services) override {
+		computeDatabaseHash(services, _hash);
+		ble_error_t error = _database_hash_characteristic.set(_server, _hash, true);
+		ble_utils::printError(error, "\tGATT Database Hash set ");
+
+		database_hash_t stored;
+		_database_changed =
+			!loadCachingState(stored) || (memcmp(stored.bytes, _hash.bytes, sizeof(_hash.bytes)) != 0);
+		std::cout << "\tGATT Database Hash ";
+		for (size_t ii = 0; ii < sizeof(_hash.bytes); ii++) {
+			std::cout << HEX_BYTE_IOSTREAM(_hash.bytes[ii]);
+		}
+		std::cout << (_database_changed ? " changed" : " unchanged") << ", " << (int)_client_count
+				  << " bonded clients" << std::endl;
+		if (_database_changed) {
+			// the bonded clients have cached the previous layout
+			for (uint8_t ii = 0; ii < _client_count; ii++) {
+				_clients[ii].changeAware = 0;
+			}
+			storeCachingState();
+		}
+	}
+
+	/**
+	 * \brief on Connection handler of the service, the client is not known until onPeerConnected()
+	 *
+	 */
+	virtual void onConnection() override {
+		_peer_bonded = false;
+		_client_change_aware = !_database_changed;
+		_client_features = 0;
+		_out_of_sync_sent = false;
+	}
+	/**
+	 * \brief on Disconnection handler of the service
+	 *
+	 */
+	virtual void onDisconnection() override {
+		_peer_bonded = false;
+		_client_change_aware = false;
+		_client_features = 0;
+		_out_of_sync_sent = false;
+	}
+
+	/**
+	 * \brief Restores the caching state of the connected client. A bonded client has its indications enabled
+	 * 		  already, so it is told about a changed layout right away. A client that is not bonded discovers
+	 * 		  the layout on every connection, it is change aware.
+	 *
+	 * \param address The identity address of the client
+	 * \param bonded Set if the client is bonded
+	 */
+	void onPeerConnected(const ble::address_t &address, bool bonded) {
+		_peer_address = address;
+		_peer_bonded = bonded;
+		_out_of_sync_sent = false;
+		caching_client_t *client = findClient(address);
+		if (!bonded) {
+			removeClient(address);
+			_client_features = 0;
+			_client_change_aware = true;
+		} else if (client != nullptr) {
+			_client_features = client->features;
+			_client_change_aware = (client->changeAware != 0);
+		} else {
+			// bonded before its state was kept, or replaced in the full table
+			_client_features = 0;
+			_client_change_aware = false;
+		}
+		_client_supported_features_characteristic.set(_server, _client_features, true);
+		if (!_client_change_aware) {
+			indicateServiceChanged();
+		}
+	}
+
+	/**
+	 * \brief The connected client has bonded, its caching state is kept from now on
+	 *
+	 * \param connection The connection of the client
+	 */
+	void onPeerBonded(ble::connection_handle_t connection) {
+		(void)connection;
+		_peer_bonded = true;
+		storeConnectedClient();
+	}
+
+	/**
+	 * \brief Checks a request of the connected client. A change-unaware client with robust caching gets the
+	 * 		  Database Out Of Sync error once, the next request or a read of the Database Hash makes it change
+	 * 		  aware.
+	 *
+	 * \param connection The connection of the request
+	 * \param handle The attribute handle of the request
+	 * \return GattAuthCallbackReply_t AUTH_CALLBACK_REPLY_SUCCESS or the Database Out Of Sync error
+	 */
+	GattAuthCallbackReply_t authorizeRequest(ble::connection_handle_t connection, GattAttribute::Handle_t handle) {
+		(void)connection;
+		if (_client_change_aware || (_client_features & CLIENT_FEATURE_ROBUST_CACHING) == 0) {
+			return AUTH_CALLBACK_REPLY_SUCCESS;
+		}
+		if (handle == _database_hash_characteristic.getValueHandle() || _out_of_sync_sent) {
+			setChangeAware();
+			return AUTH_CALLBACK_REPLY_SUCCESS;
+		}
+		_out_of_sync_sent = true;
+		std::cout << "\tGATT Database Out Of Sync on handle 0x" << HEX_SHORT_IOSTREAM(handle) << std::endl;
+		return (GattAuthCallbackReply_t)(0x0100 | ATT_ERROR_DATABASE_OUT_OF_SYNC);
+	}
+	/**
+	 * \brief on Read handler of the service
+	 *
+	 * \param handle The attribute handle of the characteristic value attribute
+	 */
+	virtual void onRead(uint16_t handle) override { (void)handle; }
+	/**
+	 * \brief onWrite handler of the service
+	 *
+	 * \param handle The attribute handle of the characteristic value attribute
+	 */
+	virtual void onWrite(uint16_t handle) override {
+		BLE_PROFILE_SCOPE("CGenericAttributeServiceServer::onWrite");
+		if (handle == _client_supported_features_characteristic.getValueHandle()) {
+			// the validator has rejected the writes that disable a feature
+			_client_supported_features_characteristic.get(_server, _client_features);
+			storeConnectedClient();
+			std::cout << "\tGATT Robust caching "
+					  << (((_client_features & CLIENT_FEATURE_ROBUST_CACHING) != 0) ? "enabled" : "disabled")
+					  << std::endl;
+		}
+	}
+	/**
+	 * \brief A client that subscribes to Service Changed is told about a changed layout
+	 *
+	 * \param handle The attribute handle of the characteristic value attribute
+	 */
+	virtual void onUpdatesEnabled(uint16_t handle) override {
+		if (handle == _service_changed_characteristic.getValueHandle() && !_client_change_aware) {
+			indicateServiceChanged();
+		}
+	}
+	/**
+	 * \brief The client is change aware once it has confirmed the Service Changed indication
+	 *
+	 * \param handle The attribute handle of the characteristic value attribute
+	 */
+	virtual void onConfirmationReceived(uint16_t handle) override {
+		if (handle == _service_changed_characteristic.getValueHandle()) {
+			setChangeAware();
+		}
+	}
+	/**
+	 * \brief The caching characteristics are available without authentication, so that a client can
+	 * validate its cache before the link is encrypted.
+	 *
+	 * \param enable Ignored
+	 */
+	virtual void enableAuthentication(bool enable = true) override { (void)enable; }
+
+	/**
+	 * \brief Get the Database Hash of the current layout
+	 *
+	 * \return const database_hash_t& The hash
+	 */
+	const database_hash_t &getDatabaseHash() const { return _hash; }
+	/**
+	 * \brief Checks whether the connected client has enabled robust caching
+	 *
+	 * \return true if robust caching is enabled
+	 */
+	bool isRobustCachingEnabled() const { return (_client_features & CLIENT_FEATURE_ROBUST_CACHING) != 0; }
+	/**
+	 * \brief Checks whether the connected client knows the current layout
+	 *
+	 * \return true if the client is change aware
+	 */
+	bool isClientChangeAware() const { return _client_change_aware; }
+};
+
+#endif //!_GENERIC_ATTRIBUTE_SERVICE_H_
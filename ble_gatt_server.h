@@ -1,167 +1,652 @@
-#ifndef _BLE_GATT_SERVER_H_
-#define _BLE_GATT_SERVER_H_
-
-#include "BLE.h"
-#include "ble_utils.h"
-#include "mbed.h"
-
-#include <ble_gatt_service.h>
-#include <sstream>
-/**
- * The GATT server class used by the system. This class has all the services the system has implemented.
- */
-class CGattServer {
-  protected:
-	CGattServicesSet _services;
-
-	//!< the GATT server
-	GattServer *_server;
-	//!< the event queue of the application
-	events::EventQueue &_eventQueue;
-	//!< the one only BLE instance
-	BLE &_ble;
-
-  private:
-	/**
-	 * Handler called when a notification or an indication has been sent.
-	 */
-	void onDataSent(unsigned count) { std::cout << "onDataSent() for " << count << " updates" << std::endl; }
-
-	/**
-	 * Handler called after an attribute has been written.
-	 */
-	void onDataWritten(const GattWriteCallbackParams *e) {
-		std::cout << "onDataWritten() using Conn. Handle 0x" << HEX_SHORT_IOSTREAM(e->connHandle)
-				  << " for Att. Handle 0x" << HEX_SHORT_IOSTREAM(e->handle) << std::endl;
-		std::cout << "\twrite operation: " << e->writeOp << std::endl;
-		std::cout << "\toffset: " << e->offset << std::endl;
-		std::cout << "\tlength: " << e->len << std::endl;
-		std::cout << "\tdata: ";
-
-		for (size_t i = 0; i < e->len; ++i) {
-			printf("%02X ", e->data[i]);
-		}
-
-		std::cout << std::endl;
-
-		for (auto s : _services) {
-			s->onWrite(e->handle);
-		}
-	}
-
-	/**
-	 * Handler called after an attribute has been read.
-	 */
-	void onDataRead(const GattReadCallbackParams *e) {
-		std::cout << "onDataRead() using Conn. Handle 0x" << HEX_SHORT_IOSTREAM(e->connHandle)
-				  << " for Att. Handle 0x" << HEX_SHORT_IOSTREAM(e->handle) << std::endl;
-	}
-
-	/**
-	 * Handler called after a client has subscribed to notification or indication.
-	 *
-	 * @param handle Handle of the characteristic value affected by the change.
-	 */
-	void onUpdatesEnabled(GattAttribute::Handle_t handle) {
-		std::cout << "Updates enabled on handle 0x" << HEX_SHORT_IOSTREAM(handle) << std::endl;
-	}
-
-	/**
-	 * Handler called after a client has cancelled his subscription from
-	 * notification or indication.
-	 *
-	 * @param handle Handle of the characteristic value affected by the change.
-	 */
-	void onUpdatesDisabled(GattAttribute::Handle_t handle) {
-		std::cout << "Updates disabled on handle 0x" << HEX_SHORT_IOSTREAM(handle) << std::endl;
-	}
-
-	/**
-	 * Handler called when an indication confirmation has been received.
-	 *
-	 * @param handle Handle of the characteristic value that has emitted the
-	 * indication.
-	 */
-	void onConfirmationReceived(GattAttribute::Handle_t handle) {
-		std::cout << "Confirmation received on handle 0x" << HEX_SHORT_IOSTREAM(handle) << std::endl;
-	}
-
-  public:
-	/**
-	 * The full constructor
-	 */
-	CGattServer(BLE &ble, events::EventQueue &eventQueue, CGattServicesSet &&services)
-		: _server(nullptr), _services(services), _eventQueue(eventQueue), _ble(ble) {}
-	/**
-	 * Starts the GATT service. This function is should be called when the
-	 * the BLE stack is initialized
-	 */
-	void start() {
-		_server = &_ble.gattServer();
-
-		// register the service
-		std::cout << "Adding the service" << std::endl;
-		int ii = 0;
-		for (auto s : _services) {
-			s->setServer(_server);
-			ble_error_t err = _server->addService(*s);
-			std::ostringstream sstr;
-			sstr << "GATTServer->addService() " << ii << " ";
-			ble_utils::printError(err, sstr.str().c_str());
-		}
-
-		// read write handler
-		_server->onDataSent(makeFunctionPointer(this, &CGattServer::onDataSent));
-		_server->onDataWritten(makeFunctionPointer(this, &CGattServer::onDataWritten));
-		_server->onDataRead(makeFunctionPointer(this, &CGattServer::onDataRead));
-
-		// updates subscribtion handlers
-		_server->onUpdatesEnabled(makeFunctionPointer(this, &CGattServer::onUpdatesEnabled));
-		_server->onUpdatesDisabled(makeFunctionPointer(this, &CGattServer::onUpdatesDisabled));
-		_server->onConfirmationReceived(makeFunctionPointer(this, &CGattServer::onConfirmationReceived));
-
-		// print the handles
-		int ss = 0;
-		for (auto s : _services) {
-			std::cout << "\tService " << ss << " Handle 0x" << HEX_SHORT_IOSTREAM(s->getHandle())
-					  << " registered." << std::endl;
-			auto chars = s->getCharacteristics();
-			int ii = 0;
-			for (auto c : chars) {
-				std::cout << "\t\tCharacteristic " << ii << " UUID 0x"
-						  << HEX_SHORT_IOSTREAM(c->getValueAttribute().getUUID().getShortUUID())
-						  << " value handle 0x" << HEX_SHORT_IOSTREAM(c->getValueHandle()) << std::endl;
-				ii++;
-			}
-			ss++;
-		}
-	}
-
-	/**
-	 * \brief Get the Service object
-	 *
-	 * \return CGattServicesSet&
-	 */
-	CGattServicesSet &getService() { return _services; }
-
-	/**
-	 * \brief Called when a peer is connected
-	 *
-	 */
-	void onConnection() {
-		for (auto s : _services) {
-			s->onConnection();
-		}
-	}
-	/**
-	 * \brief Called when a peer is disconnected
-	 *
-	 */
-	void onDisconnection() {
-		for (auto s : _services) {
-			s->onDisconnection();
-		}
-	}
-};
-
-#endif //! _BLE_GATT_SERVER_H_
+#ifndef _BLE_GATT_SERVER_H_
+#define _BLE_GATT_SERVER_H_
+
+#include "BLE.h"
+#include "ble_event_queue.h"
+#include "ble_event_recorder.h"
+#include "ble_profiler.h"
+#include "ble_trace.h"
+#include "ble_utils.h"
+#include "mbed.h"
+
+#include <ble_gatt_service.h>
+#include <sstream>
+
+#define WRITE_BURST_GAP_US 1000000 //!< Writes further apart than this are not part of the same burst
+#define WRITE_LIMIT_RATE 10			  //!< Default writes per second a connection may sustain to a characteristic
+#define WRITE_LIMIT_BURST 5			  //!< Default writes a connection may send back to back to a characteristic
+#define WRITE_LIMIT_BUCKETS 8		  //!< Token buckets of the connection and characteristic pairs
+#define WRITE_LIMIT_CHARACTERISTICS 8 //!< Characteristics with a write limit of their own
+
+/**
+ * \brief The write limit of a characteristic
+ *
+ */
+struct write_limit_t {
+	const GattCharacteristic *characteristic; //!< The characteristic, nullptr for the default limit
+	uint16_t ratePerSecond;					  //!< Sustained writes per second, 0 disables the limit
+	uint16_t burst;							  //!< Writes accepted back to back
+};
+
+/**
+ * \brief The token bucket of a connection and characteristic pair
+ *
+ */
+struct write_bucket_t {
+	ble::connection_handle_t connection; //!< The connection
+	GattAttribute::Handle_t handle;		 //!< The value handle of the characteristic, 0 if the bucket is free
+	uint32_t tokens;					 //!< The tokens in thousandths of a write
+	uint32_t refillUs;					 //!< Time of the last refill
+};
+
+/**
+ * The GATT server of the system, without the dispatch of the events to the services.
+ * \details The server class passes itself as the template argument and dispatches the events of the stack to its
+ * 			services with dispatchWrite(), dispatchRead(), dispatchDataSent(), dispatchUpdatesEnabled(),
+ * 			dispatchConfirmation(), dispatchConnection() and dispatchDisconnection(). CGattServer calls the
+ * 			services through their CGattService interface, CStaticGattServer calls the concrete service types
+ * 			directly. The services are also kept in the registration order list for the start-up, which does
+ * 			not need the speed.
+ *
+ * \tparam Server The server class
+ */
+template <class Server> class CGattServerBase {
+  protected:
+	CGattServicesSet _services;
+
+	//!< the GATT server
+	GattServer *_server;
+	//!< the event queue of the application
+	CEventQueue &_eventQueue;
+	//!< the one only BLE instance
+	BLE &_ble;
+
+	uint32_t _last_write_us;								  //!< Timestamp of the previous write
+	GattWriteCallbackParams::WriteOp_t _last_write_op;		  //!< Operation of the previous write
+	ble_utils::LatencyStats _write_request_interval;		  //!< Interval of back to back Write Requests
+	ble_utils::LatencyStats _write_command_interval;		  //!< Interval of back to back Write Commands
+	ble_utils::LatencyStats _signed_write_interval;			  //!< Interval of back to back Signed Write Commands
+
+	write_limit_t _default_write_limit;								//!< The limit of the other writable characteristics
+	write_limit_t _write_limits[WRITE_LIMIT_CHARACTERISTICS];		//!< The characteristics with a limit of their own
+	uint8_t _write_limit_count;										//!< Number of the characteristic limits
+	write_bucket_t _write_buckets[WRITE_LIMIT_BUCKETS];				//!< The token buckets
+	GattAuthCallbackReply_t _write_limit_reply;						//!< The ATT error of a write over the limit
+	uint32_t _writes_limited;										//!< Writes rejected or dropped by the limit
+	uint32_t _signed_writes_ignored;								//!< Signed writes without an authenticated key
+
+	mbed::Callback<GattAuthCallbackReply_t(ble::connection_handle_t, GattAttribute::Handle_t)>
+		_authorizeRequest; //!< Checks every write and read of a client ahead of the limits, empty to accept all
+	mbed::Callback<bool(ble::connection_handle_t)>
+		_hasAuthenticatedSigningKey; //!< Checks the signing key of a Signed Write Command, empty to accept all
+
+	ble_utils::CNotificationFifo _notifications; //!< The notifications waiting for the sent event of the stack
+
+	mbed::Callback<void(unsigned)> _onDataSent;		  //!< The user callback of the sent notifications and indications
+	mbed::Callback<void(uint16_t)> _onNotificationSent; //!< The user callback of each sent notification, by handle
+	mbed::Callback<void(uint16_t)> _onConfirmation;	  //!< The user callback of the indication confirmations
+	mbed::Callback<void(bool)> _onConnectionChanged; //!< The user callback of the connection state changes
+
+  private:
+	/**
+	 * \brief The server class, which dispatches the events to the services
+	 *
+	 */
+	Server &server() { return *static_cast<Server *>(this); }
+
+	/**
+	 * \brief Finds the write limit of a characteristic
+	 *
+	 * \param handle The value handle of the characteristic
+	 * \return const write_limit_t& The limit of the characteristic or the default limit
+	 */
+	const write_limit_t &writeLimit(GattAttribute::Handle_t handle) const {
+		for (uint8_t ii = 0; ii < _write_limit_count; ii++) {
+			if (_write_limits[ii].characteristic->getValueHandle() == handle) {
+				return _write_limits[ii];
+			}
+		}
+		return _default_write_limit;
+	}
+
+	/**
+	 * \brief Finds the token bucket of a connection and characteristic pair. A new pair takes a free bucket or
+	 * 		  the least recently used one, with a full burst.
+	 *
+	 */
+	write_bucket_t &writeBucket(ble::connection_handle_t connection,
+								GattAttribute::Handle_t handle,
+								const write_limit_t &limit) {
+		uint32_t now = ble_utils::timestampUs();
+		write_bucket_t *result = &_write_buckets[0];
+		for (int ii = 0; ii < WRITE_LIMIT_BUCKETS; ii++) {
+			write_bucket_t &bucket = _write_buckets[ii];
+			if (bucket.handle == handle && bucket.connection == connection) {
+				return bucket;
+			}
+			if (result->handle != 0 && (bucket.handle == 0 || now - bucket.refillUs > now - result->refillUs)) {
+				result = &bucket;
+			}
+		}
+		result->connection = connection;
+		result->handle = handle;
+		result->tokens = limit.burst * 1000UL;
+		result->refillUs = now;
+		return *result;
+	}
+
+	/**
+	 * \brief Write authorization gate of the writable characteristics, limits the write rate of each
+	 * 		  connection before the authorization of the characteristic checks the write
+	 *
+	 * \param params The write, the reply is set if the write is over the limit
+	 */
+	void authorizeWrite(GattWriteAuthCallbackParams *params) {
+		if (_authorizeRequest) {
+			params->authorizationReply = _authorizeRequest(params->connHandle, params->handle);
+			if (params->authorizationReply != AUTH_CALLBACK_REPLY_SUCCESS) {
+				return;
+			}
+		}
+		const write_limit_t &limit = writeLimit(params->handle);
+		if (limit.ratePerSecond == 0) {
+			return;
+		}
+		write_bucket_t &bucket = writeBucket(params->connHandle, params->handle, limit);
+		uint32_t now = ble_utils::timestampUs();
+		uint64_t tokens = bucket.tokens + (uint64_t)(now - bucket.refillUs) * limit.ratePerSecond / 1000;
+		bucket.tokens = (tokens < limit.burst * 1000UL) ? (uint32_t)tokens : limit.burst * 1000UL;
+		bucket.refillUs = now;
+		if (bucket.tokens >= 1000) {
+			bucket.tokens -= 1000;
+			return;
+		}
+		// the stack answers a Write Request with the error and drops a Write Command, the value is not changed
+		_writes_limited++;
+		params->authorizationReply = _write_limit_reply;
+	}
+
+	/**
+	 * \brief Read authorization gate of the readable characteristics, runs the request check before the
+	 * 		  authorization of the characteristic, e.g. the computation of the value
+	 *
+	 * \param params The read, the reply is set if the request is rejected
+	 */
+	void authorizeRead(GattReadAuthCallbackParams *params) {
+		if (_authorizeRequest) {
+			params->authorizationReply = _authorizeRequest(params->connHandle, params->handle);
+		}
+	}
+
+	/**
+	 * \brief Frees the token buckets, a new connection starts with full bursts
+	 *
+	 */
+	void clearWriteBuckets() {
+		for (int ii = 0; ii < WRITE_LIMIT_BUCKETS; ii++) {
+			_write_buckets[ii] = {0, 0, 0, 0};
+		}
+	}
+
+	/**
+	 * Handler called when a notification or an indication has been sent.
+	 */
+	void onDataSent(unsigned count) {
+		std::cout << "onDataSent() for " << count << " updates" << std::endl;
+		uint16_t traced[TRACE_PENDING_SENDS];
+		ble_trace::CTracer::instance().sent(count, traced);
+		uint16_t handles[NOTIFICATION_FIFO_SIZE];
+		unsigned linked = _notifications.sent(count, handles);
+		ble_recorder::CEventRecorder::instance().dataSent(count);
+		ble_utils::activityCounters().notificationsSent += count;
+		server().dispatchDataSent(count);
+		if (_onDataSent) {
+			_onDataSent(count);
+		}
+		for (unsigned ii = 0; ii < linked && _onNotificationSent; ii++) {
+			_onNotificationSent(handles[ii]);
+		}
+	}
+
+	/**
+	 * \brief Checks whether the write operation completes a new attribute value
+	 *
+	 * \param op The write operation
+	 * \return true for Write Requests, Write Commands, Signed Write Commands and executed prepared writes
+	 * \return false for the operations that do not change the value yet
+	 */
+	static bool isValueWrite(GattWriteCallbackParams::WriteOp_t op) {
+		switch (op) {
+		case GattWriteCallbackParams::OP_WRITE_REQ:
+		case GattWriteCallbackParams::OP_WRITE_CMD:
+		case GattWriteCallbackParams::OP_SIGN_WRITE_CMD:
+		case GattWriteCallbackParams::OP_EXEC_WRITE_REQ_NOW:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	/**
+	 * \brief Records the interval between back to back writes of the same operation
+	 *
+	 * \param op The write operation
+	 */
+	void recordWriteInterval(GattWriteCallbackParams::WriteOp_t op) {
+		uint32_t now = ble_utils::timestampUs();
+		uint32_t interval = now - _last_write_us;
+		if (op == _last_write_op && interval < WRITE_BURST_GAP_US) {
+			if (op == GattWriteCallbackParams::OP_WRITE_REQ) {
+				_write_request_interval.add(interval);
+			} else if (op == GattWriteCallbackParams::OP_WRITE_CMD) {
+				_write_command_interval.add(interval);
+			} else if (op == GattWriteCallbackParams::OP_SIGN_WRITE_CMD) {
+				_signed_write_interval.add(interval);
+			}
+		}
+		_last_write_us = now;
+		_last_write_op = op;
+	}
+
+	/**
+	 * Handler called after an attribute has been written.
+	 */
+	void onDataWritten(const GattWriteCallbackParams *e) {
+		ble_trace::CTraceHandler trace(e->handle);
+		ble_recorder::CEventRecorder::instance().write(e);
+		std::cout << "onDataWritten() using Conn. Handle 0x" << HEX_SHORT_IOSTREAM(e->connHandle)
+				  << " for Att. Handle 0x" << HEX_SHORT_IOSTREAM(e->handle) << std::endl;
+		std::cout << "\twrite operation: " << e->writeOp << std::endl;
+		std::cout << "\toffset: " << e->offset << std::endl;
+		std::cout << "\tlength: " << e->len << std::endl;
+		std::cout << "\tdata: ";
+
+		for (size_t i = 0; i < e->len; ++i) {
+			printf("%02X ", e->data[i]);
+		}
+
+		std::cout << std::endl;
+
+		recordWriteInterval(e->writeOp);
+		// Write Requests and (signed) Write Commands are handled the same way by the services.
+		// The stack has already verified the signature against the CSRK of the peer, the characteristics
+		// require authenticated signed writes, so the key must have been distributed over an authenticated link.
+		if (!isValueWrite(e->writeOp)) {
+			return;
+		}
+		if (e->writeOp == GattWriteCallbackParams::OP_SIGN_WRITE_CMD && _hasAuthenticatedSigningKey &&
+			!_hasAuthenticatedSigningKey(e->connHandle)) {
+			std::cout << "	signed without an authenticated key, ignored" << std::endl;
+			_signed_writes_ignored++;
+			return;
+		}
+		server().dispatchWrite(e->handle);
+	}
+
+	/**
+	 * Handler called after an attribute has been read.
+	 */
+	void onDataRead(const GattReadCallbackParams *e) {
+		ble_trace::CTraceHandler trace(e->handle);
+		ble_recorder::CEventRecorder::instance().read(e);
+		std::cout << "onDataRead() using Conn. Handle 0x" << HEX_SHORT_IOSTREAM(e->connHandle)
+				  << " for Att. Handle 0x" << HEX_SHORT_IOSTREAM(e->handle) << std::endl;
+		server().dispatchRead(e->handle);
+	}
+
+	/**
+	 * Handler called after a client has subscribed to notification or indication.
+	 *
+	 * @param handle Handle of the characteristic value affected by the change.
+	 */
+	void onUpdatesEnabled(GattAttribute::Handle_t handle) {
+		ble_trace::CTraceHandler trace(handle);
+		ble_recorder::CEventRecorder::instance().updatesEnabled(handle);
+		std::cout << "Updates enabled on handle 0x" << HEX_SHORT_IOSTREAM(handle) << std::endl;
+		server().dispatchUpdatesEnabled(handle);
+	}
+
+	/**
+	 * Handler called after a client has cancelled his subscription from
+	 * notification or indication.
+	 *
+	 * @param handle Handle of the characteristic value affected by the change.
+	 */
+	void onUpdatesDisabled(GattAttribute::Handle_t handle) {
+		ble_recorder::CEventRecorder::instance().updatesDisabled(handle);
+		std::cout << "Updates disabled on handle 0x" << HEX_SHORT_IOSTREAM(handle) << std::endl;
+	}
+
+	/**
+	 * Handler called when an indication confirmation has been received.
+	 *
+	 * @param handle Handle of the characteristic value that has emitted the
+	 * indication.
+	 */
+	void onConfirmationReceived(GattAttribute::Handle_t handle) {
+		ble_trace::CTraceHandler trace(handle);
+		ble_recorder::CEventRecorder::instance().confirmation(handle);
+		std::cout << "Confirmation received on handle 0x" << HEX_SHORT_IOSTREAM(handle) << std::endl;
+		server().dispatchConfirmation(handle);
+		if (_onConfirmation) {
+			_onConfirmation(handle);
+		}
+	}
+
+  public:
+	/**
+	 * The full constructor
+	 */
+	CGattServerBase(BLE &ble, CEventQueue &eventQueue, CGattServicesSet &&services)
+		: _services(services), _server(nullptr), _eventQueue(eventQueue), _ble(ble), _last_write_us(0),
+		  _last_write_op(GattWriteCallbackParams::OP_INVALID), _write_limit_count(0),
+		  _write_limit_reply(AUTH_CALLBACK_REPLY_ATTERR_INSUF_RESOURCES), _writes_limited(0),
+		  _signed_writes_ignored(0) {
+		_default_write_limit = {nullptr, WRITE_LIMIT_RATE, WRITE_LIMIT_BURST};
+		clearWriteBuckets();
+	}
+	/**
+	 * Starts the GATT service. This function is should be called when the
+	 * the BLE stack is initialized
+	 */
+	void start() {
+		_server = &_ble.gattServer();
+		_notifications.attach(_server);
+
+		// register the services in the list order, so the handles are the same on every start
+		std::cout << "Adding the service" << std::endl;
+		int ii = 0;
+		for (auto s : _services) {
+			s->setServer(_server);
+			// the stack registers the authorization requirement when the service is added
+			for (uint8_t ch = 0; ch < s->getCharacteristicCount(); ch++) {
+				GattCharacteristic *c = s->getCharacteristic(ch);
+				if ((c->getProperties() & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ) != 0) {
+					CReadAuthorization *chain = CReadAuthorization::find(c);
+					if (chain != nullptr) {
+						chain->setGate(callback(this, &CGattServerBase::authorizeRead));
+					} else if (!c->isReadAuthorizationEnabled()) {
+						c->setReadAuthorizationCallback(this, &CGattServerBase::authorizeRead);
+					}
+				}
+				if ((c->getProperties() & (GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE |
+										   GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE |
+										   GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_AUTHENTICATED_SIGNED_WRITES)) == 0) {
+					continue;
+				}
+				// the limit runs ahead of the authorization of the characteristic, which is never replaced
+				CWriteAuthorization *chain = CWriteAuthorization::find(c);
+				if (chain != nullptr) {
+					chain->setGate(callback(this, &CGattServerBase::authorizeWrite));
+				} else if (!c->isWriteAuthorizationEnabled()) {
+					c->setWriteAuthorizationCallback(this, &CGattServerBase::authorizeWrite);
+				} else {
+					std::cout << "\tNo write limit on UUID 0x"
+							  << HEX_SHORT_IOSTREAM(c->getValueAttribute().getUUID().getShortUUID())
+							  << ", it keeps its own write authorization" << std::endl;
+				}
+			}
+			ble_error_t err = _server->addService(*s);
+			std::ostringstream sstr;
+			sstr << "GATTServer->addService() " << ii << " ";
+			ble_utils::printError(err, sstr.str().c_str());
+			ii++;
+		}
+
+		// read write handler
+		_server->onDataSent(BLE_PROFILED_AS(this, CGattServerBase, onDataSent, "CGattServer::onDataSent"));
+		_server->onDataWritten(BLE_PROFILED_AS(this, CGattServerBase, onDataWritten, "CGattServer::onDataWritten"));
+		_server->onDataRead(BLE_PROFILED_AS(this, CGattServerBase, onDataRead, "CGattServer::onDataRead"));
+
+		// updates subscribtion handlers
+		_server->onUpdatesEnabled(BLE_PROFILED_AS(this, CGattServerBase, onUpdatesEnabled, "CGattServer::onUpdatesEnabled"));
+		_server->onUpdatesDisabled(BLE_PROFILED_AS(this, CGattServerBase, onUpdatesDisabled, "CGattServer::onUpdatesDisabled"));
+		_server->onConfirmationReceived(BLE_PROFILED_AS(this, CGattServerBase, onConfirmationReceived, "CGattServer::onConfirmationReceived"));
+
+		// print the handles
+		int ss = 0;
+		for (auto s : _services) {
+			std::cout << "\tService " << ss << " Handle 0x" << HEX_SHORT_IOSTREAM(s->getHandle())
+					  << " registered." << std::endl;
+			auto chars = s->getCharacteristics();
+			int ii = 0;
+			for (auto c : chars) {
+				std::cout << "\t\tCharacteristic " << ii << " UUID 0x"
+						  << HEX_SHORT_IOSTREAM(c->getValueAttribute().getUUID().getShortUUID())
+						  << " value handle 0x" << HEX_SHORT_IOSTREAM(c->getValueHandle()) << std::endl;
+				ii++;
+			}
+			ss++;
+		}
+
+		// the replay maps the recorded handles by the service and characteristic indexes
+		for (size_t sv = 0; sv < _services.size(); sv++) {
+			for (uint8_t ch = 0; ch < _services[sv]->getCharacteristicCount(); ch++) {
+				ble_recorder::CEventRecorder::instance().characteristic(*_services[sv]->getCharacteristic(ch),
+																		(uint8_t)sv, ch);
+			}
+		}
+
+#if BLE_ATTRIBUTE_ARENA
+		ble_arena::CAttributeArena::instance().printStats();
+#endif
+
+		// the handles are known now
+		for (auto s : _services) {
+			s->onServerStarted(_services);
+		}
+	}
+
+	/**
+	 * \brief Get the Service object
+	 *
+	 * \return CGattServicesSet&
+	 */
+	CGattServicesSet &getService() { return _services; }
+
+	/**
+	 * \brief Called when a peer is connected
+	 *
+	 */
+	void onConnection() {
+		server().dispatchConnection();
+		if (_onConnectionChanged) {
+			_onConnectionChanged(true);
+		}
+	}
+	/**
+	 * \brief Called when a peer is disconnected
+	 *
+	 */
+	void onDisconnection() {
+		clearWriteBuckets();
+		_notifications.clear();
+		server().dispatchDisconnection();
+		printWriteStats();
+		if (_onConnectionChanged) {
+			_onConnectionChanged(false);
+		}
+	}
+
+	/**
+	 * \brief Get the GATT server of the stack, nullptr before start()
+	 *
+	 */
+	GattServer *getGattServer() { return _server; }
+
+	/**
+	 * \brief Sets the callback called when notifications or indications have been sent
+	 *
+	 * \param callback The callback object. If this is nullptr, it disables callback calling.
+	 */
+	void setOnDataSent(mbed::Callback<void(unsigned)> callback) { _onDataSent = callback; }
+
+	/**
+	 * \brief Sets the callback called with the value handle of each sent notification. The stack reports only
+	 * 		  a count, the handles are those of the notifications submitted in the same order.
+	 *
+	 * \param callback The callback object. If this is nullptr, it disables callback calling.
+	 */
+	void setOnNotificationSent(mbed::Callback<void(uint16_t)> callback) { _onNotificationSent = callback; }
+	mbed::Callback<void(uint16_t)> getOnNotificationSent() const { return _onNotificationSent; }
+
+	/**
+	 * \brief Sets the callback called when an indication confirmation has been received
+	 *
+	 * \param callback The callback object. If this is nullptr, it disables callback calling.
+	 */
+	void setOnConfirmation(mbed::Callback<void(uint16_t)> callback) { _onConfirmation = callback; }
+	mbed::Callback<void(uint16_t)> getOnConfirmation() const { return _onConfirmation; }
+
+	/**
+	 * \brief Sets the callback called with true on connection and false on disconnection
+	 *
+	 * \param callback The callback object. If this is nullptr, it disables callback calling.
+	 */
+	void setOnConnectionChanged(mbed::Callback<void(bool)> callback) { _onConnectionChanged = callback; }
+	mbed::Callback<void(bool)> getOnConnectionChanged() const { return _onConnectionChanged; }
+
+	/**
+	 * \brief Sets the check of every write and read of a client, e.g. the database sync of the GATT caching.
+	 * 		  It runs ahead of the write limits and the authorization of the characteristics.
+	 *
+	 * \param callback Returns AUTH_CALLBACK_REPLY_SUCCESS to accept the request, else the ATT error
+	 */
+	void setRequestAuthorization(
+		mbed::Callback<GattAuthCallbackReply_t(ble::connection_handle_t, GattAttribute::Handle_t)> callback) {
+		_authorizeRequest = callback;
+	}
+
+	/**
+	 * \brief Sets the check of the signing key of the Signed Write Commands. A command whose peer has no
+	 * 		  authenticated key is not handed to the services. Signed Write Commands have no response, and the
+	 * 		  stack has already written the value, so the services keep acting on the last accepted write only.
+	 *
+	 * \param callback Returns true if the peer of the connection distributed its CSRK over an authenticated link
+	 */
+	void setSignedWriteAuthorization(mbed::Callback<bool(ble::connection_handle_t)> callback) {
+		_hasAuthenticatedSigningKey = callback;
+	}
+
+	/**
+	 * \brief Sets the write limit of a characteristic, should be called before start()
+	 *
+	 * \param characteristic The characteristic
+	 * \param ratePerSecond Sustained writes per second of each connection, 0 disables the limit
+	 * \param burst Writes accepted back to back
+	 * \return true if the limit is set
+	 * \return false if there are already WRITE_LIMIT_CHARACTERISTICS limits
+	 */
+	bool setWriteLimit(const GattCharacteristic &characteristic, uint16_t ratePerSecond, uint16_t burst) {
+		for (uint8_t ii = 0; ii < _write_limit_count; ii++) {
+			if (_write_limits[ii].characteristic == &characteristic) {
+				_write_limits[ii] = {&characteristic, ratePerSecond, burst};
+				return true;
+			}
+		}
+		if (_write_limit_count == WRITE_LIMIT_CHARACTERISTICS) {
+			return false;
+		}
+		_write_limits[_write_limit_count++] = {&characteristic, ratePerSecond, burst};
+		return true;
+	}
+
+	/**
+	 * \brief Sets the write limit of the characteristics without a limit of their own
+	 *
+	 * \param ratePerSecond Sustained writes per second of each connection, 0 disables the limit
+	 * \param burst Writes accepted back to back
+	 */
+	void setDefaultWriteLimit(uint16_t ratePerSecond, uint16_t burst) {
+		_default_write_limit = {nullptr, ratePerSecond, burst};
+	}
+
+	/**
+	 * \brief Sets the ATT error of a Write Request over the limit. The default is Insufficient Resources.
+	 * 		  Write Commands have no response, the stack drops them. A write over the limit never changes the
+	 * 		  value, so AUTH_CALLBACK_REPLY_SUCCESS is not accepted.
+	 *
+	 * \param reply The ATT error
+	 */
+	void setWriteLimitReply(GattAuthCallbackReply_t reply) {
+		if (reply != AUTH_CALLBACK_REPLY_SUCCESS) {
+			_write_limit_reply = reply;
+		}
+	}
+
+	/**
+	 * \brief The number of writes rejected or dropped by the write limits
+	 *
+	 */
+	uint32_t getWritesLimited() const { return _writes_limited; }
+
+	/**
+	 * \brief Prints the intervals of back to back writes. Write Commands do not wait for the ATT Write
+	 * Response, so several of them fit in one connection event.
+	 *
+	 */
+	void printWriteStats() const {
+		_write_request_interval.print("Write Request interval");
+		_write_command_interval.print("Write Command interval");
+		_signed_write_interval.print("Signed Write Command interval");
+		std::cout << "Writes over the limit: " << std::dec << _writes_limited << std::endl;
+		std::cout << "Signed Write Commands without an authenticated key: " << _signed_writes_ignored << std::endl;
+	}
+};
+
+/**
+ * The GATT server class used by the system. This class has all the services the system has implemented.
+ * \details The events are dispatched to each service through the virtual functions of CGattService, so the
+ * 			services can be chosen at run time. CStaticGattServer is the compile time alternative.
+ */
+class CGattServer : public CGattServerBase<CGattServer> {
+  public:
+	/**
+	 * The full constructor
+	 */
+	CGattServer(BLE &ble, CEventQueue &eventQueue, CGattServicesSet &&services)
+		: CGattServerBase(ble, eventQueue, std::move(services)) {}
+
+	/**
+	 * \brief Dispatches the events of the stack to the services
+	 * @{
+	 */
+	void dispatchWrite(uint16_t handle) {
+		for (auto s : _services) {
+			s->onWrite(handle);
+		}
+	}
+	void dispatchRead(uint16_t handle) {
+		for (auto s : _services) {
+			s->onRead(handle);
+		}
+	}
+	void dispatchDataSent(unsigned count) {
+		for (auto s : _services) {
+			s->onDataSent(count);
+		}
+	}
+	void dispatchUpdatesEnabled(uint16_t handle) {
+		for (auto s : _services) {
+			s->onUpdatesEnabled(handle);
+		}
+	}
+	void dispatchConfirmation(uint16_t handle) {
+		for (auto s : _services) {
+			s->onConfirmationReceived(handle);
+		}
+	}
+	void dispatchConnection() {
+		for (auto s : _services) {
+			s->onConnection();
+		}
+	}
+	void dispatchDisconnection() {
+		for (auto s : _services) {
+			s->onDisconnection();
+		}
+	}
+	/** }@*/
+};
+
+#endif //! _BLE_GATT_SERVER_H_
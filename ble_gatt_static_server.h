@@ -0,0 +1,96 @@
+#ifndef _BLE_GATT_STATIC_SERVER_H_
+#define _BLE_GATT_STATIC_SERVER_H_
+
+#include "ble_gatt_server.h"
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+/**
+ * \brief A GATT server whose services are fixed at compile time
+ * \details The services are kept in a tuple of references to their concrete types. The events are dispatched
+ * 			with qualified calls, e.g. service.CAlertNotificationServiceServer::onWrite(handle), which do not go
+ * 			through the virtual functions and can be inlined into the handler of the stack event. The interface
+ * 			is the one of CGattServer, the services are registered in the template argument order.
+ *
+ * \tparam Services The service classes, derived from CGattService
+ */
+template <typename... Services> class CStaticGattServer : public CGattServerBase<CStaticGattServer<Services...>> {
+  private:
+	typedef CGattServerBase<CStaticGattServer<Services...>> Base;
+
+	std::tuple<Services &...> _static_services; //!< The services
+
+	/**
+	 * \brief Calls a function on each service in the registration order
+	 *
+	 * \param f The function, called with a reference to the concrete service type
+	 */
+	template <typename F, size_t... I> void forEach(F f, std::index_sequence<I...>) {
+		int expand[] = {0, (f(std::get<I>(_static_services)), 0)...};
+		(void)expand;
+	}
+	template <typename F> void forEach(F f) { forEach(f, std::index_sequence_for<Services...>()); }
+
+  public:
+	/**
+	 * \brief Construct a new CStaticGattServer object
+	 *
+	 * \param ble The BLE instance
+	 * \param eventQueue The event queue of the application
+	 * \param services The services, in the order of the template arguments
+	 */
+	CStaticGattServer(BLE &ble, CEventQueue &eventQueue, Services &...services)
+		: Base(ble, eventQueue, CGattServicesSet{&services...}), _static_services(services...) {}
+
+	/**
+	 * \brief Dispatches the events of the stack to the services
+	 * @{
+	 */
+	void dispatchWrite(uint16_t handle) {
+		forEach([handle](auto &service) {
+			typedef typename std::decay<decltype(service)>::type Service;
+			service.Service::onWrite(handle);
+		});
+	}
+	void dispatchRead(uint16_t handle) {
+		forEach([handle](auto &service) {
+			typedef typename std::decay<decltype(service)>::type Service;
+			service.Service::onRead(handle);
+		});
+	}
+	void dispatchDataSent(unsigned count) {
+		forEach([count](auto &service) {
+			typedef typename std::decay<decltype(service)>::type Service;
+			service.Service::onDataSent(count);
+		});
+	}
+	void dispatchUpdatesEnabled(uint16_t handle) {
+		forEach([handle](auto &service) {
+			typedef typename std::decay<decltype(service)>::type Service;
+			service.Service::onUpdatesEnabled(handle);
+		});
+	}
+	void dispatchConfirmation(uint16_t handle) {
+		forEach([handle](auto &service) {
+			typedef typename std::decay<decltype(service)>::type Service;
+			service.Service::onConfirmationReceived(handle);
+		});
+	}
+	void dispatchConnection() {
+		forEach([](auto &service) {
+			typedef typename std::decay<decltype(service)>::type Service;
+			service.Service::onConnection();
+		});
+	}
+	void dispatchDisconnection() {
+		forEach([](auto &service) {
+			typedef typename std::decay<decltype(service)>::type Service;
+			service.Service::onDisconnection();
+		});
+	}
+	/** }@*/
+};
+
+#endif //!_BLE_GATT_STATIC_SERVER_H_
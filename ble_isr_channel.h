@@ -0,0 +1,143 @@
+#ifndef _BLE_ISR_CHANNEL_H_
+#define _BLE_ISR_CHANNEL_H_
+
+#include <mbed.h>
+
+#include "ble_event_queue.h"
+#include "ble_spsc_ring.h"
+#include "ble_utils.h"
+
+#include <atomic>
+
+#define ISR_CHANNEL_SLOTS 8 //!< Default number of interrupt sources and pending events of a channel
+
+/**
+ * \brief Channel that hands interrupt events to the event loop without allocating from the event queue
+ * \details The interrupt sources are registered at start up. post() only marks the source pending and pushes
+ * 			it into a preallocated ring. A second post of a source that is still pending is coalesced. The
+ * 			event loop is woken with a single queue event, which drains every pending source, so a press storm
+ * 			takes at most one event from the queue pool. The producers must not preempt each other, i.e. the
+ * 			sources of a channel run at the same interrupt priority.
+ *
+ * \tparam Slots Maximum number of sources, a power of two
+ */
+template <size_t Slots = ISR_CHANNEL_SLOTS> class CIsrEventChannel : private mbed::NonCopyable<CIsrEventChannel<Slots>> {
+  private:
+	/**
+	 * \brief A pending event
+	 *
+	 */
+	struct event_t {
+		uint8_t source;		  //!< The source id
+		uint32_t timestampUs; //!< The time of the first post
+	};
+
+	CEventQueue &_queue;					  //!< The queue of the event loop
+	mbed::Callback<void()> _handlers[Slots];	  //!< The handlers of the sources
+	std::atomic<bool> _pending[Slots];			  //!< Set while an event of the source is in the ring
+	size_t _sources;							  //!< Number of registered sources
+	CSpscRing<event_t, Slots> _ring;			  //!< The pending events
+	std::atomic<bool> _wakeupPending;			  //!< Set while the drain event is in the queue
+	std::atomic<uint32_t> _posted;				  //!< Events posted by the sources
+	std::atomic<uint32_t> _coalesced;			  //!< Posts merged into a pending event
+	std::atomic<uint32_t> _overruns;			  //!< Wakeups that did not fit into the queue
+	uint32_t _wakeups;							  //!< Drain events run
+	uint32_t _drained;							  //!< Events handled
+	ble_utils::LatencyStats _latency;			  //!< Time from the first post to the handler
+
+	/**
+	 * \brief Posts the drain event unless one is in the queue. When the queue is full, the events stay in the
+	 * 		  ring and the next post, coalesced or not, tries again.
+	 *
+	 */
+	void wakeup() {
+		if (_wakeupPending.exchange(true, std::memory_order_acq_rel)) {
+			return;
+		}
+		if (_queue.call(this, &CIsrEventChannel::drain) == 0) {
+			_wakeupPending.store(false, std::memory_order_release);
+			_overruns.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	/**
+	 * \brief Runs the handlers of all the pending events. Called in the event loop.
+	 *
+	 */
+	void drain() {
+		// posts after this point wake the loop again, at worst for an empty ring. The exchange orders the clear
+		// before the loads of the ring: a post that saw the flag set has pushed before it.
+		_wakeupPending.exchange(false, std::memory_order_acq_rel);
+		_wakeups++;
+		event_t event;
+		while (_ring.pop(event)) {
+			_pending[event.source].store(false, std::memory_order_release);
+			_latency.addSince(event.timestampUs);
+			_drained++;
+			if (_handlers[event.source]) {
+				_handlers[event.source]();
+			}
+		}
+	}
+
+  public:
+	/**
+	 * \brief Construct a new CIsrEventChannel object
+	 *
+	 * \param queue The queue of the event loop, which runs the handlers
+	 */
+	CIsrEventChannel(CEventQueue &queue)
+		: _queue(queue), _sources(0), _wakeupPending(false), _posted(0), _coalesced(0), _overruns(0),
+		  _wakeups(0), _drained(0) {
+		for (size_t ii = 0; ii < Slots; ii++) {
+			_pending[ii].store(false);
+		}
+	}
+
+	/**
+	 * \brief Registers an interrupt source. Must be called before the interrupts are enabled.
+	 *
+	 * \param handler The function run in the event loop for the events of the source
+	 * \return int The source id given to post(), -1 if all the slots are in use
+	 */
+	int add(mbed::Callback<void()> handler) {
+		if (_sources == Slots) {
+			return -1;
+		}
+		_handlers[_sources] = handler;
+		return (int)_sources++;
+	}
+
+	/**
+	 * \brief Posts an event of a source. Safe to call in interrupt context.
+	 *
+	 * \param source The source id returned by add()
+	 */
+	void post(int source) {
+		_posted.fetch_add(1, std::memory_order_relaxed);
+		if (_pending[source].exchange(true, std::memory_order_acq_rel)) {
+			_coalesced.fetch_add(1, std::memory_order_relaxed);
+			// the event may be waiting for a wakeup that did not fit into the queue
+			wakeup();
+			return;
+		}
+		// a source has at most one event in the ring, which holds one per source, so the push cannot fail
+		event_t event = {(uint8_t)source, ble_utils::timestampUs()};
+		_ring.push(event);
+		wakeup();
+	}
+
+	/**
+	 * \brief Prints the channel statistics
+	 *
+	 * \param name The name printed before the statistics
+	 */
+	void printStats(const char *name) {
+		std::cout << name << ": posted " << std::dec << _posted.load() << " coalesced " << _coalesced.load()
+				  << " overruns " << _overruns.load() << " wakeups " << _wakeups
+				  << " handled " << _drained << std::endl;
+		_latency.print("\tpost to handler latency");
+	}
+};
+
+#endif //!_BLE_ISR_CHANNEL_H_
@@ -0,0 +1,107 @@
+#ifndef _BLE_MESSAGE_CHANNEL_H_
+#define _BLE_MESSAGE_CHANNEL_H_
+
+#include "ble_spsc_ring.h"
+
+#include <atomic>
+
+/**
+ * \brief Bounded lock-free message channel from one thread to an other
+ * \details The messages are copied into a preallocated single producer, single consumer ring. The consumer
+ * 			thread is woken through the notify function only when the first message of a batch is sent, and
+ * 			receive() drains every message of the batch. A full ring drops the message and counts it. A failed
+ * 			wakeup, e.g. a full event queue, is counted and retried by the next send(). The
+ * 			channel depends on the standard headers only, so the same code runs with rtos::Thread on the target
+ * 			and std::thread on the host.
+ *
+ * \tparam Message The message type, copied by value
+ * \tparam Size Number of messages in flight, a power of two
+ */
+template <typename Message, size_t Size> class CMessageChannel {
+  public:
+	typedef bool (*NotifyFunction)(void *context); //!< Wakes the consumer thread, false if it could not
+
+  private:
+	CSpscRing<Message, Size> _ring;		//!< The messages in flight
+	std::atomic<bool> _wakeupPending;	//!< Set while the consumer has been notified but not drained yet
+	NotifyFunction _notify;				//!< The wakeup function of the consumer
+	void *_notifyContext;				//!< The context of the wakeup function
+	std::atomic<uint32_t> _sent;		//!< Messages sent
+	std::atomic<uint32_t> _dropped;		//!< Messages dropped because the ring was full
+	std::atomic<uint32_t> _notified;	//!< Wakeups of the consumer
+	std::atomic<uint32_t> _notifyFailed; //!< Wakeups that failed, retried by the next send
+	uint32_t _received;					//!< Messages received, owned by the consumer
+	uint32_t _maxDepth;					//!< Largest number of messages seen by the consumer in one drain
+
+  public:
+	CMessageChannel()
+		: _wakeupPending(false), _notify(nullptr), _notifyContext(nullptr), _sent(0), _dropped(0), _notified(0),
+		  _notifyFailed(0), _received(0), _maxDepth(0) {}
+
+	/**
+	 * \brief Sets the function that wakes the consumer thread, e.g. a post to its event queue
+	 *
+	 * \param notify The function, called in the producer thread. Returns false if the wakeup failed.
+	 * \param context The argument of the function
+	 */
+	void setNotify(NotifyFunction notify, void *context) {
+		_notify = notify;
+		_notifyContext = context;
+	}
+
+	/**
+	 * \brief Sends a message. Called by the producer thread only.
+	 *
+	 * \param message The message
+	 * \return true if the message was queued, it is received after the next successful wakeup
+	 * \return false if the channel is full, the message is dropped
+	 */
+	bool send(const Message &message) {
+		if (!_ring.push(message)) {
+			_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		_sent.fetch_add(1, std::memory_order_relaxed);
+		if (!_wakeupPending.exchange(true, std::memory_order_acq_rel) && _notify != nullptr) {
+			if (_notify(_notifyContext)) {
+				_notified.fetch_add(1, std::memory_order_relaxed);
+			} else {
+				// the messages stay in the ring, the next send notifies again
+				_wakeupPending.store(false, std::memory_order_release);
+				_notifyFailed.fetch_add(1, std::memory_order_relaxed);
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * \brief Handles all the queued messages. Called by the consumer thread only.
+	 *
+	 * \param handler Called for each message
+	 * \return size_t Number of messages handled
+	 */
+	template <typename Handler> size_t receive(Handler handler) {
+		// sends after this point notify again, at worst for an empty ring. The exchange orders the clear before
+		// the loads of the ring: a send that saw the flag set has pushed before it, so its message is drained.
+		_wakeupPending.exchange(false, std::memory_order_acq_rel);
+		uint32_t depth = _ring.size();
+		_maxDepth = (depth > _maxDepth) ? depth : _maxDepth;
+		size_t count = 0;
+		Message message;
+		while (_ring.pop(message)) {
+			handler(message);
+			count++;
+		}
+		_received += count;
+		return count;
+	}
+
+	uint32_t sent() const { return _sent.load(); }
+	uint32_t dropped() const { return _dropped.load(); }
+	uint32_t notified() const { return _notified.load(); }
+	uint32_t notifyFailed() const { return _notifyFailed.load(); }
+	uint32_t received() const { return _received; }
+	uint32_t maxDepth() const { return _maxDepth; }
+};
+
+#endif //!_BLE_MESSAGE_CHANNEL_H_
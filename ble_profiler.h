@@ -0,0 +1,292 @@
+#ifndef _BLE_PROFILER_H_
+#define _BLE_PROFILER_H_
+
+#if defined(__MBED__)
+#include "mbed.h"
+#else
+#include <chrono>
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+#ifndef BLE_PROFILER
+#define BLE_PROFILER 1 //!< Set to 0 to compile the profiling scopes out, the wrapped callbacks still work
+#endif
+#define PROFILER_SLOTS 32	//!< Number of profiled callbacks
+#define PROFILER_BUCKETS 24 //!< Number of log2 histogram buckets, the last one collects the longer calls
+
+namespace ble_profiler {
+
+#if defined(__MBED__) && defined(DWT_CTRL_CYCCNTENA_Msk)
+/**
+ * \brief Starts the DWT cycle counter of the Cortex-M core
+ *
+ */
+inline void enableCycleCounter() {
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+}
+/**
+ * \brief Reads the free running cycle counter
+ *
+ */
+inline uint32_t cycleCount() { return DWT->CYCCNT; }
+/**
+ * \brief The counter ticks in a microsecond
+ *
+ */
+inline uint32_t cyclesPerUs() { return SystemCoreClock / 1000000; }
+#elif defined(__MBED__)
+// Cortex-M0 cores have no DWT cycle counter, the microsecond ticker is the best there is
+inline void enableCycleCounter() {}
+inline uint32_t cycleCount() { return us_ticker_read(); }
+inline uint32_t cyclesPerUs() { return 1; }
+#else
+// on the host the monotonic clock in nanoseconds stands for the cycle counter
+inline void enableCycleCounter() {}
+inline uint32_t cycleCount() {
+	return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			   std::chrono::steady_clock::now().time_since_epoch())
+		.count();
+}
+inline uint32_t cyclesPerUs() { return 1000; }
+#endif
+
+/**
+ * \brief The profile of a callback
+ *
+ */
+struct profile_entry_t {
+	const char *name;					  //!< The callback name
+	uint32_t count;						  //!< Number of calls
+	uint64_t total;						  //!< Total cycles
+	uint32_t max;						  //!< Longest call in cycles
+	uint32_t histogram[PROFILER_BUCKETS]; //!< Calls per log2 cycle bucket, bucket n holds [2^n, 2^(n+1))
+
+	/**
+	 * \brief Records a call
+	 *
+	 * \param cycles The cycles of the call
+	 */
+	void add(uint32_t cycles) {
+		count++;
+		total += cycles;
+		max = (cycles > max) ? cycles : max;
+		uint32_t bucket = (cycles == 0) ? 0 : 31 - __builtin_clz(cycles);
+		histogram[(bucket < PROFILER_BUCKETS) ? bucket : PROFILER_BUCKETS - 1]++;
+	}
+};
+
+/**
+ * \brief The table of the profiled callbacks
+ * \details The entries are registered once, when the callback is wrapped, and are then updated in place without
+ * 			locking. Each callback runs in one context only, so an entry has a single writer. The times are
+ * 			inclusive: a handler that calls an other profiled handler is charged for both.
+ */
+class CProfiler {
+  private:
+	profile_entry_t _entries[PROFILER_SLOTS]; //!< The profiles
+	profile_entry_t _overflow;				  //!< Collects the callbacks that did not get a slot
+	size_t _used;							  //!< Number of entries in use
+
+	CProfiler() : _entries(), _overflow(), _used(0) {
+		_overflow.name = "(other)";
+		enableCycleCounter();
+	}
+
+  public:
+	/**
+	 * \brief The profiler of the system
+	 *
+	 */
+	static CProfiler &instance() {
+		static CProfiler profiler;
+		return profiler;
+	}
+
+	/**
+	 * \brief Registers a callback
+	 *
+	 * \param name The callback name, a string literal
+	 * \return profile_entry_t* The entry of the callback. An already registered name gets its existing entry.
+	 */
+	profile_entry_t *add(const char *name) {
+		for (size_t ii = 0; ii < _used; ii++) {
+			if (strcmp(_entries[ii].name, name) == 0) {
+				return &_entries[ii];
+			}
+		}
+		if (_used == PROFILER_SLOTS) {
+			return &_overflow;
+		}
+		_entries[_used].name = name;
+		return &_entries[_used++];
+	}
+
+	/**
+	 * \brief Clears the recorded calls. The callbacks stay registered.
+	 *
+	 */
+	void reset() {
+		for (size_t ii = 0; ii < _used; ii++) {
+			const char *name = _entries[ii].name;
+			_entries[ii] = profile_entry_t();
+			_entries[ii].name = name;
+		}
+		_overflow = profile_entry_t();
+		_overflow.name = "(other)";
+	}
+
+	/**
+	 * \brief Prints the profiles of the called callbacks: calls, total time, average and max cycles, and the
+	 * 		  histogram as "<bucket upper bound in cycles:calls"
+	 *
+	 */
+	void dump() const {
+		uint32_t perUs = cyclesPerUs();
+		std::cout << "Callback profile (" << std::dec << perUs << " cycles/us)" << std::endl;
+		for (size_t ii = 0; ii <= _used; ii++) {
+			const profile_entry_t &entry = (ii < _used) ? _entries[ii] : _overflow;
+			if (entry.count == 0) {
+				continue;
+			}
+			std::cout << "\t" << entry.name << ": calls " << entry.count << " total " << entry.total / perUs
+					  << " us avg " << entry.total / entry.count << " cycles max " << entry.max << " cycles"
+					  << std::endl
+					  << "\t\t";
+			for (uint32_t bucket = 0; bucket < PROFILER_BUCKETS; bucket++) {
+				if (entry.histogram[bucket] != 0) {
+					std::cout << "<" << ((uint64_t)2 << bucket) << ":" << entry.histogram[bucket] << " ";
+				}
+			}
+			std::cout << std::endl;
+		}
+	}
+};
+
+/**
+ * \brief Records the cycles from its construction to its destruction into a profile entry
+ *
+ */
+class CProfileScope {
+#if BLE_PROFILER
+  private:
+	profile_entry_t *_entry;
+	uint32_t _start;
+
+  public:
+	explicit CProfileScope(profile_entry_t *entry) : _entry(entry), _start(cycleCount()) {}
+	~CProfileScope() { _entry->add(cycleCount() - _start); }
+#else
+  public:
+	explicit CProfileScope(profile_entry_t *) {}
+#endif
+};
+
+/**
+ * \brief The profiled callback returned by CProfiled::bind()
+ * \details It converts to the callback types that are built from an object and a member function, which are both
+ * 			mbed::Callback and FunctionPointerWithContext. Where a plain callable is needed, e.g. an event queue
+ * 			call, convert it to mbed::Callback first.
+ *
+ * \tparam Binding The binding of the object and the method
+ */
+template <typename Binding> class CProfiledCallback {
+  private:
+	Binding *_binding;
+
+  public:
+	explicit CProfiledCallback(Binding *binding) : _binding(binding) {}
+	template <typename F, typename = decltype(F(std::declval<Binding *>(), &Binding::call))> operator F() const {
+		return F(_binding, &Binding::call);
+	}
+};
+
+/**
+ * \brief Profiling binding of a member function callback
+ * \details A binding holds the object and calls the method in a profiling scope. The bindings of a method are
+ * 			kept in a list and made once per object, when the callback is first registered, and live as long as
+ * 			the program: the callbacks are registered at start. On the host, a simulation binds the objects of
+ * 			many devices in one process, they share the profile of the method.
+ *
+ * \tparam T The class of the object
+ * \tparam M The type of the method, which may be inherited from a base class of T
+ * \tparam Method The method
+ */
+template <typename T, typename M, M Method> class CProfiled;
+
+template <typename T, typename B, typename R, typename... Args, R (B::*Method)(Args...)>
+class CProfiled<T, R (B::*)(Args...), Method> {
+  private:
+	T *_object;		  //!< The object the method is called on
+	CProfiled *_next; //!< The next binding of the method
+
+	static CProfiled *_first;		//!< The bindings of the method
+	static profile_entry_t *_entry; //!< The profile of the method
+
+	explicit CProfiled(T *object) : _object(object), _next(_first) { _first = this; }
+
+  public:
+	/**
+	 * \brief Calls the method in a profiling scope
+	 *
+	 */
+	R call(Args... args) {
+		CProfileScope scope(_entry);
+		return (_object->*Method)(args...);
+	}
+
+	/**
+	 * \brief Binds the object and registers the callback
+	 *
+	 * \param object The object the method is called on
+	 * \param name The name of the callback in the dump
+	 * \return The profiled callback, to be passed where the callback would be
+	 */
+	static CProfiledCallback<CProfiled> bind(T *object, const char *name) {
+		if (_entry == nullptr) {
+			_entry = CProfiler::instance().add(name);
+		}
+		CProfiled *binding = _first;
+		while (binding != nullptr && binding->_object != object) {
+			binding = binding->_next;
+		}
+		return CProfiledCallback<CProfiled>((binding != nullptr) ? binding : new CProfiled(object));
+	}
+};
+
+template <typename T, typename B, typename R, typename... Args, R (B::*Method)(Args...)>
+CProfiled<T, R (B::*)(Args...), Method> *CProfiled<T, R (B::*)(Args...), Method>::_first = nullptr;
+template <typename T, typename B, typename R, typename... Args, R (B::*Method)(Args...)>
+profile_entry_t *CProfiled<T, R (B::*)(Args...), Method>::_entry = nullptr;
+
+} // namespace ble_profiler
+
+/**
+ * \brief Wraps a member function callback in a profiling binding. Use it in place of
+ * 		  makeFunctionPointer(object, &Class::method) or callback(object, &Class::method).
+ *
+ */
+#define BLE_PROFILED(object, Class, method) BLE_PROFILED_AS(object, Class, method, #Class "::" #method)
+
+/**
+ * \brief Wraps a member function callback in a profiling binding that is named in the dump, e.g. when the
+ * 		  class is a template
+ *
+ */
+#define BLE_PROFILED_AS(object, Class, method, name)                                                                   \
+	ble_profiler::CProfiled<Class, decltype(&Class::method), &Class::method>::bind(object, name)
+
+/**
+ * \brief Profiles the rest of the enclosing block, for the handlers the stack calls through virtual functions
+ *
+ */
+#define BLE_PROFILE_SCOPE(name)                                                                                        \
+	static ble_profiler::profile_entry_t *_profile_entry = ble_profiler::CProfiler::instance().add(name);             \
+	ble_profiler::CProfileScope _profile_scope(_profile_entry)
+
+#endif //!_BLE_PROFILER_H_
\ No newline at end of file
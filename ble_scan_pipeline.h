@@ -0,0 +1,458 @@
+#ifndef _BLE_SCAN_PIPELINE_H_
+#define _BLE_SCAN_PIPELINE_H_
+
+#include "ble/BLE.h"
+#include "ble/Gap.h"
+#include "ble_utils.h"
+#include "mbed.h"
+
+#include <atomic>
+#include <cstring>
+
+#define SCAN_MAX_PROBES 8 //!< Maximum number of slots probed by the device tables
+
+/**
+ * \brief A copy of an advertisement report kept in the report ring
+ *
+ */
+struct advertisement_report_t {
+	uint64_t key;									//!< The 48-bit address and the address type, see scanKey()
+	uint32_t timestampMs;							//!< Arrival time of the report, the kernel tick in ms modulo 2^32
+	int8_t rssi;									//!< The received signal strength
+	bool connectable;								//!< Set if the advertiser accepts connections
+	uint8_t length;									//!< The length of the payload
+	uint8_t payload[ble::LEGACY_ADVERTISING_MAX_SIZE]; //!< The payload, truncated to the legacy advertising size
+};
+
+/**
+ * \brief An aggregated scan result delivered to the application
+ *
+ */
+struct scan_result_t {
+	ble::address_t address;	 //!< The advertiser address
+	uint8_t addressType;	 //!< The ble::peer_address_type_t of the advertiser
+	int8_t rssiAverage;		 //!< The average RSSI of the reports in the delivery period
+	int8_t rssiMin;			 //!< The smallest RSSI of the reports in the delivery period
+	int8_t rssiMax;			 //!< The largest RSSI of the reports in the delivery period
+	uint16_t reports;		 //!< Number of reports in the delivery period
+	bool payloadChanged;	 //!< Set if the advertiser is new or its payload changed
+	bool connectable;		 //!< Set if the advertiser accepts connections
+	uint8_t length;			 //!< The length of the latest payload
+	const uint8_t *payload;	 //!< The latest payload, valid during the callback only
+};
+
+/**
+ * \brief Scan pipeline statistics
+ *
+ */
+struct scan_stats_t {
+	uint32_t received;	 //!< Reports received from the stack
+	uint32_t dropped;	 //!< Reports dropped because the ring was full
+	uint32_t duplicates; //!< Reports with an already known payload
+	uint32_t evicted;	 //!< Devices evicted from a full device table
+	uint32_t delivered;	 //!< Results delivered to the application
+};
+
+/**
+ * \brief Packs the 48-bit address and the address type into the device table key
+ *
+ * \param type The address type
+ * \param address The address
+ * \return uint64_t The key
+ */
+inline uint64_t scanKey(uint8_t type, const ble::address_t &address) {
+	uint64_t key = type;
+	for (int ii = 5; ii >= 0; ii--) {
+		key = (key << 8) | address[ii];
+	}
+	// bit 63 marks the key as used, so a key is never 0
+	return key | (1ULL << 63);
+}
+
+/**
+ * \brief Fixed size single producer, single consumer ring of advertisement reports
+ * \details The GAP event handler produces the reports and the delivery event consumes them, the indexes are
+ * atomic so the slot contents are published with the index even if the two run in different contexts.
+ *
+ * \tparam Size Number of reports in the ring, a power of two
+ */
+template <size_t Size> class CAdvertisementRing {
+	static_assert((Size & (Size - 1)) == 0, "The ring size must be a power of two");
+
+  private:
+	advertisement_report_t _reports[Size]; //!< The report storage
+	std::atomic<uint32_t> _head;		   //!< Next slot to be written, owned by the producer
+	std::atomic<uint32_t> _tail;		   //!< Next slot to be read, owned by the consumer
+
+  public:
+	CAdvertisementRing() : _head(0), _tail(0) {}
+
+	/**
+	 * \brief Reserves the next free slot
+	 *
+	 * \return advertisement_report_t* The slot or nullptr if the ring is full
+	 */
+	advertisement_report_t *reserve() {
+		uint32_t head = _head.load(std::memory_order_relaxed);
+		return (head - _tail.load(std::memory_order_acquire) == Size) ? nullptr : &_reports[head & (Size - 1)];
+	}
+	/**
+	 * \brief Publishes the reserved slot
+	 *
+	 */
+	void commit() { _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+	/**
+	 * \brief Get the oldest report
+	 *
+	 * \return const advertisement_report_t* The report or nullptr if the ring is empty
+	 */
+	const advertisement_report_t *front() const {
+		uint32_t tail = _tail.load(std::memory_order_relaxed);
+		return (tail == _head.load(std::memory_order_acquire)) ? nullptr : &_reports[tail & (Size - 1)];
+	}
+	/**
+	 * \brief Releases the oldest report
+	 *
+	 */
+	void pop() { _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+	/**
+	 * \brief Number of reports in the ring
+	 *
+	 */
+	size_t size() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+};
+
+/**
+ * \brief Open addressing hash table keyed by the advertiser address, with an expiry time per entry
+ * \details The table never allocates. A lookup probes at most SCAN_MAX_PROBES slots. When the probed slots
+ * are all in use, the entry that expires first is replaced, so the table behaves like a cache of the most
+ * recently heard devices.
+ *
+ * \tparam Size Number of slots, a power of two
+ * \tparam Value The value type stored for each device
+ */
+template <size_t Size, typename Value> class CAddressHashMap {
+	static_assert((Size & (Size - 1)) == 0, "The table size must be a power of two");
+
+  public:
+	/**
+	 * \brief A table slot
+	 *
+	 */
+	struct slot_t {
+		uint64_t key;		//!< The device key, 0 for an unused slot
+		uint32_t expiresMs; //!< The time the entry expires
+		Value value;		//!< The device value
+	};
+
+  private:
+	slot_t _slots[Size]; //!< The slots
+
+	/**
+	 * \brief Mixes the key bits into the slot index
+	 *
+	 */
+	static uint32_t hash(uint64_t key) {
+		key ^= key >> 33;
+		key *= 0xFF51AFD7ED558CCDULL;
+		key ^= key >> 33;
+		return (uint32_t)key;
+	}
+	/**
+	 * \brief The times are compared by their signed difference, so they may wrap around 2^32 ms
+	 *
+	 */
+	static bool expired(const slot_t &slot, uint32_t nowMs) { return (int32_t)(slot.expiresMs - nowMs) <= 0; }
+	static int rank(const slot_t &slot, uint32_t nowMs) { return (slot.key == 0) ? 0 : (expired(slot, nowMs) ? 1 : 2); }
+
+  public:
+	CAddressHashMap() { clear(); }
+
+	/**
+	 * \brief Removes all the entries
+	 *
+	 */
+	void clear() {
+		for (auto &slot : _slots) {
+			slot.key = 0;
+		}
+	}
+
+	/**
+	 * \brief Finds the live entry of a device
+	 *
+	 * \param key The device key
+	 * \param nowMs The current time
+	 * \return Value* The value or nullptr if the device is not in the table or has expired
+	 */
+	Value *find(uint64_t key, uint32_t nowMs) {
+		uint32_t index = hash(key);
+		for (int ii = 0; ii < SCAN_MAX_PROBES; ii++) {
+			slot_t &slot = _slots[(index + ii) & (Size - 1)];
+			if (slot.key == key) {
+				return expired(slot, nowMs) ? nullptr : &slot.value;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * \brief Finds the entry of a device or inserts a new one. The expiry time of the entry is renewed.
+	 *
+	 * \param key The device key
+	 * \param nowMs The current time
+	 * \param lifetimeMs Time until the entry expires
+	 * \param inserted Set to true if a new entry was created, the value is then default constructed
+	 * \param evicted Set to true if a live entry of an other device was replaced
+	 * \return Value& The value
+	 */
+	Value &insert(uint64_t key, uint32_t nowMs, uint32_t lifetimeMs, bool &inserted, bool &evicted) {
+		uint32_t index = hash(key);
+		slot_t *victim = nullptr;
+		inserted = false;
+		evicted = false;
+		for (int ii = 0; ii < SCAN_MAX_PROBES; ii++) {
+			slot_t &slot = _slots[(index + ii) & (Size - 1)];
+			if (slot.key == key) {
+				inserted = expired(slot, nowMs);
+				victim = &slot;
+				break;
+			}
+			// prefer an unused slot, then an expired one, then the one that expires first
+			if (victim == nullptr || rank(slot, nowMs) < rank(*victim, nowMs) ||
+				(rank(slot, nowMs) == 2 && rank(*victim, nowMs) == 2 && (int32_t)(slot.expiresMs - victim->expiresMs) < 0)) {
+				victim = &slot;
+			}
+		}
+		if (victim->key != key) {
+			evicted = (victim->key != 0) && !expired(*victim, nowMs);
+			inserted = true;
+			victim->key = key;
+		}
+		if (inserted) {
+			victim->value = Value();
+		}
+		victim->expiresMs = nowMs + lifetimeMs;
+		return victim->value;
+	}
+
+	/**
+	 * \brief Calls a function for every live entry
+	 *
+	 * \param nowMs The current time
+	 * \param f The function, called with the key and the value
+	 */
+	template <typename F> void forEach(uint32_t nowMs, F f) {
+		for (auto &slot : _slots) {
+			if (slot.key != 0 && !expired(slot, nowMs)) {
+				f(slot.key, slot.value);
+			}
+		}
+	}
+};
+
+/**
+ * \brief Interface of the scan pipeline used by CGap
+ *
+ */
+class CScanPipelineBase {
+  public:
+	/**
+	 * \brief Stores an advertisement report. Called by the GAP for every report, must not allocate.
+	 *
+	 * \param event The advertisement report
+	 */
+	virtual void push(const ble::AdvertisingReportEvent &event) = 0;
+	/**
+	 * \brief Processes the stored reports and delivers the results to the application
+	 *
+	 */
+	virtual void deliver() = 0;
+	/**
+	 * \brief Get the pipeline statistics
+	 *
+	 */
+	virtual const scan_stats_t &getStats() const = 0;
+
+  protected:
+	~CScanPipelineBase() {}
+};
+
+/**
+ * \brief High rate advertisement report pipeline
+ * \details The reports are copied into a fixed size ring by push() and processed in batches by deliver(),
+ * which the GAP calls at the delivery rate. The dedup stage keeps a hash of the payload of each device, so a
+ * repeated payload is only counted. The RSSI aggregator accumulates the signal strength of each device over
+ * the delivery period. Only the devices that are new, changed their payload or were heard during the period
+ * are delivered, once per period.
+ *
+ * \tparam RingSize Number of reports buffered between two deliveries, a power of two
+ * \tparam Devices Number of devices tracked, a power of two
+ */
+template <size_t RingSize, size_t Devices> class CScanPipeline : public CScanPipelineBase {
+  protected:
+	/**
+	 * \brief Dedup stage value: hash of the latest payload
+	 *
+	 */
+	struct dedup_t {
+		uint32_t payloadHash;
+	};
+	/**
+	 * \brief RSSI aggregator value
+	 *
+	 */
+	struct aggregate_t {
+		int32_t rssiSum;
+		int8_t rssiMin;
+		int8_t rssiMax;
+		uint16_t reports;
+		bool payloadChanged;
+		bool connectable;
+		uint8_t length;
+		uint8_t payload[ble::LEGACY_ADVERTISING_MAX_SIZE];
+	};
+
+	CAdvertisementRing<RingSize> _ring;				   //!< The reports waiting to be processed
+	CAddressHashMap<Devices, dedup_t> _dedup;		   //!< The dedup stage
+	CAddressHashMap<Devices, aggregate_t> _aggregates; //!< The RSSI aggregator
+	uint32_t _dedupLifetimeMs;						   //!< Time a device is remembered after its last report
+	scan_stats_t _stats;							   //!< The statistics
+	mbed::Callback<void(const scan_result_t &)> _onResult; //!< The application callback
+
+	/**
+	 * \brief Get the current time of the tables. The 64-bit kernel tick is truncated to 32 bits, which the tables
+	 * 		  compare by their signed difference, so the time wraps after 49 days without harm.
+	 *
+	 */
+	static uint32_t nowMs() { return (uint32_t)rtos::Kernel::get_ms_count(); }
+
+	/**
+	 * \brief FNV-1a hash of the payload
+	 *
+	 */
+	static uint32_t payloadHash(const uint8_t *data, size_t length) {
+		uint32_t h = 2166136261u;
+		for (size_t ii = 0; ii < length; ii++) {
+			h = (h ^ data[ii]) * 16777619u;
+		}
+		return h;
+	}
+
+	/**
+	 * \brief Runs one report through the dedup and aggregation stages
+	 *
+	 * \param report The report
+	 */
+	void process(const advertisement_report_t &report) {
+		bool inserted, evicted;
+		uint32_t h = payloadHash(report.payload, report.length);
+		dedup_t &dedup = _dedup.insert(report.key, report.timestampMs, _dedupLifetimeMs, inserted, evicted);
+		bool changed = inserted || dedup.payloadHash != h;
+		dedup.payloadHash = h;
+		_stats.evicted += evicted ? 1 : 0;
+		_stats.duplicates += changed ? 0 : 1;
+
+		// the aggregate lives until the next delivery
+		aggregate_t &aggregate = _aggregates.insert(report.key, report.timestampMs, _dedupLifetimeMs, inserted, evicted);
+		if (inserted) {
+			aggregate.rssiMin = report.rssi;
+			aggregate.rssiMax = report.rssi;
+		}
+		aggregate.rssiSum += report.rssi;
+		aggregate.rssiMin = (report.rssi < aggregate.rssiMin) ? report.rssi : aggregate.rssiMin;
+		aggregate.rssiMax = (report.rssi > aggregate.rssiMax) ? report.rssi : aggregate.rssiMax;
+		aggregate.reports++;
+		aggregate.connectable = report.connectable;
+		if (changed) {
+			aggregate.payloadChanged = true;
+			aggregate.length = report.length;
+			memcpy(aggregate.payload, report.payload, report.length);
+		}
+	}
+
+  public:
+	/**
+	 * \brief Construct a new CScanPipeline object
+	 *
+	 * \param dedupLifetimeMs Time a device is remembered after its last report. A device heard again after
+	 * 						  this time is delivered as new.
+	 */
+	CScanPipeline(uint32_t dedupLifetimeMs = 10000) : _dedupLifetimeMs(dedupLifetimeMs) {
+		memset(&_stats, 0, sizeof(_stats));
+	}
+
+	/**
+	 * \brief Copies the report into the ring. The report is dropped if the ring is full.
+	 *
+	 * \param event The advertisement report
+	 */
+	virtual void push(const ble::AdvertisingReportEvent &event) override {
+		_stats.received++;
+		advertisement_report_t *report = _ring.reserve();
+		if (report == nullptr) {
+			_stats.dropped++;
+			return;
+		}
+		const ble::adv_data_t &payload = event.getPayload();
+		report->key = scanKey(event.getPeerAddressType().value(), event.getPeerAddress());
+		report->timestampMs = nowMs();
+		report->rssi = event.getRssi();
+		report->connectable = event.isConnectable();
+		report->length = (payload.size() > sizeof(report->payload)) ? sizeof(report->payload) : payload.size();
+		memcpy(report->payload, payload.data(), report->length);
+		_ring.commit();
+	}
+
+	/**
+	 * \brief Processes the buffered reports and delivers the aggregated results of the period
+	 *
+	 */
+	virtual void deliver() override {
+		for (const advertisement_report_t *report = _ring.front(); report != nullptr; report = _ring.front()) {
+			process(*report);
+			_ring.pop();
+		}
+		_aggregates.forEach(nowMs(), [this](uint64_t key, aggregate_t &aggregate) {
+			if (aggregate.reports == 0) {
+				return;
+			}
+			scan_result_t result;
+			uint8_t address[6];
+			for (int ii = 0; ii < 6; ii++) {
+				address[ii] = (uint8_t)(key >> (8 * ii));
+			}
+			result.address = ble::address_t(address);
+			result.addressType = (uint8_t)(key >> 48);
+			result.rssiAverage = (int8_t)(aggregate.rssiSum / aggregate.reports);
+			result.rssiMin = aggregate.rssiMin;
+			result.rssiMax = aggregate.rssiMax;
+			result.reports = aggregate.reports;
+			result.payloadChanged = aggregate.payloadChanged;
+			result.connectable = aggregate.connectable;
+			result.length = aggregate.length;
+			result.payload = aggregate.payload;
+			_stats.delivered++;
+			if (_onResult) {
+				_onResult(result);
+			}
+			// start the next period, the payload is kept for the next results
+			aggregate.rssiSum = 0;
+			aggregate.reports = 0;
+			aggregate.payloadChanged = false;
+			aggregate.rssiMin = INT8_MAX;
+			aggregate.rssiMax = INT8_MIN;
+		});
+	}
+
+	virtual const scan_stats_t &getStats() const override { return _stats; }
+
+	/**
+	 * \brief Sets the callback that receives the aggregated results
+	 *
+	 * \param callback The callback object. If this is nullptr, it disables callback calling.
+	 */
+	void setOnResult(mbed::Callback<void(const scan_result_t &)> callback) { _onResult = callback; }
+};
+
+#endif //! _BLE_SCAN_PIPELINE_H_
@@ -0,0 +1,67 @@
+#ifndef _BLE_SPSC_RING_H_
+#define _BLE_SPSC_RING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+/**
+ * \brief Lock-free single producer, single consumer ring with a fixed number of preallocated slots
+ *
+ * \tparam T The element type
+ * \tparam Size Number of slots, a power of two
+ */
+template <typename T, size_t Size> class CSpscRing {
+	static_assert((Size & (Size - 1)) == 0, "The ring size must be a power of two");
+
+  private:
+	T _slots[Size];				  //!< The slots
+	std::atomic<uint32_t> _head; //!< Next slot to be written, owned by the producer
+	std::atomic<uint32_t> _tail; //!< Next slot to be read, owned by the consumer
+
+  public:
+	CSpscRing() : _head(0), _tail(0) {}
+
+	/**
+	 * \brief Adds an element. Called by the producer only.
+	 *
+	 * \param value The element
+	 * \return true if the element was added
+	 * \return false if the ring is full
+	 */
+	bool push(const T &value) {
+		uint32_t head = _head.load(std::memory_order_relaxed);
+		if (head - _tail.load(std::memory_order_acquire) == Size) {
+			return false;
+		}
+		_slots[head & (Size - 1)] = value;
+		_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * \brief Removes the oldest element. Called by the consumer only.
+	 *
+	 * \param value The removed element
+	 * \return true if an element was removed
+	 * \return false if the ring is empty
+	 */
+	bool pop(T &value) {
+		uint32_t tail = _tail.load(std::memory_order_relaxed);
+		if (tail == _head.load(std::memory_order_acquire)) {
+			return false;
+		}
+		value = _slots[tail & (Size - 1)];
+		_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	/**
+	 * \brief Number of elements in the ring
+	 *
+	 */
+	uint32_t size() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+};
+
+#endif //!_BLE_SPSC_RING_H_
\ No newline at end of file
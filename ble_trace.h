@@ -0,0 +1,454 @@
+#ifndef _BLE_TRACE_H_
+#define _BLE_TRACE_H_
+
+#include <mbed.h>
+
+#include "ble/BLE.h"
+#include "ble_utils.h"
+
+#include <cstdio>
+
+#define TRACE_RECORDS 256		//!< Trace records kept in the ring, the oldest are overwritten
+#define TRACE_INFLIGHT 16		//!< Events whose stage timestamps are tracked at the same time
+#define TRACE_PENDING_SENDS 8	//!< Submitted notifications waiting for the sent event of the stack
+#define TRACE_BUCKETS 24		//!< Number of log2 microsecond buckets of the stage histograms
+#define TRACE_MAGIC 0x52544c42	//!< "BLTR" in little endian, the start of the binary export
+#define TRACE_VERSION 1			//!< Version of the binary export format
+#define TRACE_HEADER_SIZE 8		//!< Bytes of the binary export header
+#define TRACE_RECORD_SIZE 9		//!< Bytes of a record in the binary export
+
+namespace ble_trace {
+
+/**
+ * \brief The trace points of an event
+ *
+ */
+enum TracePoint {
+	TRACE_EVENT_ARRIVAL = 0,  /**< The stack asked for its events to be processed */
+	TRACE_QUEUE_DISPATCH = 1, /**< The event queue started the stack processing */
+	TRACE_HANDLER_ENTRY = 2,  /**< A GATT server handler was entered */
+	TRACE_HANDLER_EXIT = 3,	  /**< The handler returned */
+	TRACE_NOTIFY_SUBMIT = 4,  /**< A notification was handed to the stack */
+	TRACE_DATA_SENT = 5,	  /**< The stack reported the notification sent */
+	TRACE_POINTS = 6
+};
+
+/**
+ * \brief The measured stages, each between two trace points of the same event
+ *
+ */
+enum TraceStage {
+	STAGE_QUEUE_WAIT = 0,	 /**< Arrival to dispatch */
+	STAGE_TO_HANDLER = 1,	 /**< Dispatch to handler entry */
+	STAGE_HANDLER_RUN = 2,	 /**< Handler entry to exit */
+	STAGE_TO_SUBMIT = 3,	 /**< Handler entry, or dispatch, to notification submission */
+	STAGE_SUBMIT_TO_SENT = 4, /**< Notification submission to the sent event */
+	STAGE_END_TO_END = 5,	 /**< Arrival to handler exit */
+	TRACE_STAGES = 6
+};
+
+/**
+ * \brief A trace record
+ *
+ */
+struct trace_record_t {
+	uint32_t timestampUs; //!< The time of the trace point
+	uint16_t eventId;	  //!< The event the point belongs to, 0 if there is none
+	uint16_t handle;	  //!< The attribute handle, 0 if there is none
+	uint8_t point;		  //!< The TracePoint
+};
+
+/**
+ * \brief The latency distribution of a stage
+ *
+ */
+struct trace_stage_t {
+	ble_utils::LatencyStats latency;	 //!< Count, min, average and max
+	uint32_t histogram[TRACE_BUCKETS]; //!< Samples per log2 bucket, bucket n holds [2^n, 2^(n+1)) us
+
+	void add(uint32_t us) {
+		latency.add(us);
+		uint32_t bucket = (us == 0) ? 0 : 31 - __builtin_clz(us);
+		histogram[(bucket < TRACE_BUCKETS) ? bucket : TRACE_BUCKETS - 1]++;
+	}
+};
+
+/**
+ * \brief End-to-end event tracer
+ * \details Every stack event gets an id when it arrives. The id is carried through the queue to the dispatch,
+ * 			and the handlers and notifications of that dispatch are recorded with it. Every value written to
+ * 			the stack for a subscribed client is submitted with notified(), and the stack sends the
+ * 			notifications in submission order, so they are linked to their sent events in that order. The
+ * 			records go into a ring, and the stage latencies are accumulated as the points are recorded. The
+ * 			arrival may be recorded in interrupt context, so the recording runs in a critical section.
+ *
+ * 			The binary export is little endian: an 8 byte header (magic "BLTR", version, record size, record
+ * 			count as uint16) followed by the records, oldest first, each 9 bytes: timestamp uint32, event id
+ * 			uint16, handle uint16, point uint8.
+ */
+class CTracer : private mbed::NonCopyable<CTracer> {
+  private:
+	/**
+	 * \brief The trace point timestamps of an event in flight
+	 *
+	 */
+	struct inflight_t {
+		uint16_t eventId;
+		uint8_t seen;					//!< Bit mask of the recorded points
+		uint32_t timestampUs[TRACE_POINTS]; //!< The last timestamp of each point
+	};
+
+	/**
+	 * \brief A notification waiting for the sent event
+	 *
+	 */
+	struct pending_send_t {
+		uint16_t eventId;
+		uint16_t handle;
+	};
+
+	trace_record_t _records[TRACE_RECORDS];			 //!< The record ring
+	uint32_t _recorded;								 //!< Records written, the ring index is this modulo the size
+	inflight_t _inflight[TRACE_INFLIGHT];				 //!< The events in flight, indexed by id
+	pending_send_t _pendingSends[TRACE_PENDING_SENDS]; //!< The notifications waiting for the sent event
+	uint32_t _pendingHead;							 //!< Index of the oldest pending notification
+	uint32_t _pendingCount;							 //!< Number of pending notifications
+	uint16_t _nextId;								 //!< The id of the next event
+	uint16_t _currentId;							 //!< The event being dispatched, 0 if none
+	trace_stage_t _stages[TRACE_STAGES];				 //!< The stage latencies
+
+	CTracer()
+		: _records(), _recorded(0), _inflight(), _pendingSends(), _pendingHead(0), _pendingCount(0), _nextId(1),
+		  _currentId(0), _stages() {}
+
+	uint16_t newId() {
+		uint16_t id = _nextId++;
+		if (_nextId == 0) {
+			_nextId = 1;
+		}
+		return id;
+	}
+
+	/**
+	 * \brief Adds the latency of a stage if both of its points have been seen
+	 *
+	 */
+	void addStage(const inflight_t &event, TraceStage stage, TracePoint from, TracePoint to) {
+		if ((event.seen & (1 << from)) != 0) {
+			_stages[stage].add(event.timestampUs[to] - event.timestampUs[from]);
+		}
+	}
+
+	/**
+	 * \brief Records a trace point, called in a critical section
+	 *
+	 */
+	void record(uint16_t eventId, TracePoint point, uint16_t handle) {
+		uint32_t now = ble_utils::timestampUs();
+		trace_record_t &record = _records[_recorded % TRACE_RECORDS];
+		record.timestampUs = now;
+		record.eventId = eventId;
+		record.handle = handle;
+		record.point = point;
+		_recorded++;
+		if (eventId == 0) {
+			return;
+		}
+		inflight_t &event = _inflight[eventId % TRACE_INFLIGHT];
+		if (event.eventId != eventId) {
+			// the slot of an older event is reused, its remaining stages are not measured
+			event.eventId = eventId;
+			event.seen = 0;
+		}
+		event.timestampUs[point] = now;
+		switch (point) {
+		case TRACE_QUEUE_DISPATCH:
+			addStage(event, STAGE_QUEUE_WAIT, TRACE_EVENT_ARRIVAL, TRACE_QUEUE_DISPATCH);
+			break;
+		case TRACE_HANDLER_ENTRY:
+			addStage(event, STAGE_TO_HANDLER, TRACE_QUEUE_DISPATCH, TRACE_HANDLER_ENTRY);
+			break;
+		case TRACE_HANDLER_EXIT:
+			addStage(event, STAGE_HANDLER_RUN, TRACE_HANDLER_ENTRY, TRACE_HANDLER_EXIT);
+			addStage(event, STAGE_END_TO_END, TRACE_EVENT_ARRIVAL, TRACE_HANDLER_EXIT);
+			break;
+		case TRACE_NOTIFY_SUBMIT:
+			if ((event.seen & (1 << TRACE_HANDLER_ENTRY)) != 0) {
+				addStage(event, STAGE_TO_SUBMIT, TRACE_HANDLER_ENTRY, TRACE_NOTIFY_SUBMIT);
+			} else {
+				addStage(event, STAGE_TO_SUBMIT, TRACE_QUEUE_DISPATCH, TRACE_NOTIFY_SUBMIT);
+			}
+			break;
+		case TRACE_DATA_SENT:
+			addStage(event, STAGE_SUBMIT_TO_SENT, TRACE_NOTIFY_SUBMIT, TRACE_DATA_SENT);
+			break;
+		default:
+			break;
+		}
+		event.seen |= (1 << point);
+	}
+
+	static void put16(uint8_t *p, uint16_t value) {
+		p[0] = (uint8_t)value;
+		p[1] = (uint8_t)(value >> 8);
+	}
+	static void put32(uint8_t *p, uint32_t value) {
+		put16(p, (uint16_t)value);
+		put16(p + 2, (uint16_t)(value >> 16));
+	}
+
+	/**
+	 * \brief Writes the export header
+	 *
+	 */
+	static void putHeader(uint8_t *p, uint32_t count) {
+		put32(p, TRACE_MAGIC);
+		p[4] = TRACE_VERSION;
+		p[5] = TRACE_RECORD_SIZE;
+		put16(p + 6, (uint16_t)count);
+	}
+
+	/**
+	 * \brief Writes the export of a record
+	 *
+	 */
+	static void putRecord(uint8_t *p, const trace_record_t &record) {
+		put32(p, record.timestampUs);
+		put16(p + 4, record.eventId);
+		put16(p + 6, record.handle);
+		p[8] = record.point;
+	}
+
+	/**
+	 * \brief Number of records in the ring and the index of the oldest one
+	 *
+	 */
+	uint32_t available(uint32_t &first) const {
+		uint32_t count = (_recorded < TRACE_RECORDS) ? _recorded : TRACE_RECORDS;
+		first = _recorded - count;
+		return count;
+	}
+
+  public:
+	/**
+	 * \brief The tracer of the system
+	 *
+	 */
+	static CTracer &instance() {
+		static CTracer tracer;
+		return tracer;
+	}
+
+	/**
+	 * \brief Records the arrival of a stack event
+	 *
+	 * \return uint16_t The id of the new event, to be passed to dispatch()
+	 */
+	uint16_t arrival() {
+		CriticalSectionLock lock;
+		uint16_t id = newId();
+		record(id, TRACE_EVENT_ARRIVAL, 0);
+		return id;
+	}
+
+	/**
+	 * \brief Records the dispatch of an event. The points recorded until endDispatch() belong to the event.
+	 *
+	 * \param eventId The id returned by arrival()
+	 */
+	void dispatch(uint16_t eventId) {
+		CriticalSectionLock lock;
+		_currentId = eventId;
+		record(eventId, TRACE_QUEUE_DISPATCH, 0);
+	}
+
+	/**
+	 * \brief Ends the dispatch of the current event
+	 *
+	 */
+	void endDispatch() { _currentId = 0; }
+
+	/**
+	 * \brief Records the entry of a handler
+	 *
+	 * \param handle The attribute handle the handler is called for
+	 */
+	void handlerEntry(uint16_t handle) {
+		CriticalSectionLock lock;
+		record(_currentId, TRACE_HANDLER_ENTRY, handle);
+	}
+
+	/**
+	 * \brief Records the exit of a handler
+	 *
+	 * \param handle The attribute handle the handler was called for
+	 */
+	void handlerExit(uint16_t handle) {
+		CriticalSectionLock lock;
+		record(_currentId, TRACE_HANDLER_EXIT, handle);
+	}
+
+	/**
+	 * \brief Records a notification handed to the stack. Outside of a dispatch, e.g. for an alert raised by
+	 * 		  the application, the notification starts a new event.
+	 *
+	 * \param handle The value handle of the characteristic
+	 */
+	void submit(uint16_t handle) {
+		CriticalSectionLock lock;
+		uint16_t id = (_currentId != 0) ? _currentId : newId();
+		record(id, TRACE_NOTIFY_SUBMIT, handle);
+		if (_pendingCount == TRACE_PENDING_SENDS) {
+			// the oldest notification is not linked to its sent event
+			_pendingHead = (_pendingHead + 1) % TRACE_PENDING_SENDS;
+			_pendingCount--;
+		}
+		pending_send_t &pending = _pendingSends[(_pendingHead + _pendingCount) % TRACE_PENDING_SENDS];
+		pending.eventId = id;
+		pending.handle = handle;
+		_pendingCount++;
+	}
+
+	/**
+	 * \brief Records a value written to the stack as a notification if a client has subscribed to it
+	 *
+	 * \param server The GATT server of the stack
+	 * \param characteristic The characteristic written with notification
+	 */
+	void notified(GattServer *server, const GattCharacteristic &characteristic) {
+		bool enabled = false;
+		server->areUpdatesEnabled(characteristic, &enabled);
+		if (enabled) {
+			submit(characteristic.getValueHandle());
+		}
+	}
+
+	/**
+	 * \brief Records the sent notifications reported by the stack, in submission order
+	 *
+	 * \param count Number of notifications sent
+	 * \param handles Receives the value handles of the sent notifications, room for TRACE_PENDING_SENDS
+	 * \return unsigned Number of the notifications linked to a submission
+	 */
+	unsigned sent(unsigned count, uint16_t *handles) {
+		CriticalSectionLock lock;
+		unsigned linked = 0;
+		for (; count != 0 && _pendingCount != 0; count--) {
+			const pending_send_t &pending = _pendingSends[_pendingHead];
+			record(pending.eventId, TRACE_DATA_SENT, pending.handle);
+			handles[linked++] = pending.handle;
+			_pendingHead = (_pendingHead + 1) % TRACE_PENDING_SENDS;
+			_pendingCount--;
+		}
+		return linked;
+	}
+
+	/**
+	 * \brief Get the latency distribution of a stage
+	 *
+	 */
+	const trace_stage_t &getStage(TraceStage stage) const { return _stages[stage]; }
+
+	/**
+	 * \brief Size of the binary export of the records in the ring
+	 *
+	 */
+	size_t exportSize() const {
+		uint32_t first;
+		return TRACE_HEADER_SIZE + available(first) * TRACE_RECORD_SIZE;
+	}
+
+	/**
+	 * \brief Exports the records in the ring in the binary format
+	 *
+	 * \param buffer The destination
+	 * \param size Size of the destination
+	 * \return size_t The bytes written, 0 if the destination is smaller than exportSize()
+	 */
+	size_t exportTo(uint8_t *buffer, size_t size) const {
+		CriticalSectionLock lock;
+		uint32_t first;
+		uint32_t count = available(first);
+		if (size < TRACE_HEADER_SIZE + count * TRACE_RECORD_SIZE) {
+			return 0;
+		}
+		putHeader(buffer, count);
+		uint8_t *p = buffer + TRACE_HEADER_SIZE;
+		for (uint32_t ii = 0; ii < count; ii++, p += TRACE_RECORD_SIZE) {
+			putRecord(p, _records[(first + ii) % TRACE_RECORDS]);
+		}
+		return p - buffer;
+	}
+
+	/**
+	 * \brief Writes the binary export to a file. The ring is copied into a static buffer in a critical section,
+	 * 		  then the copy is written, so the records of the stack events that arrive during the write do not
+	 * 		  mix into the file. Call it from the event loop, it is not reentrant.
+	 *
+	 * \param filepath The file, overwritten
+	 * \return true if the file was written
+	 */
+	bool save(const char *filepath) const {
+		static uint8_t buffer[TRACE_HEADER_SIZE + TRACE_RECORDS * TRACE_RECORD_SIZE];
+		size_t size = exportTo(buffer, sizeof(buffer));
+		FILE *file = fopen(filepath, "wb");
+		if (file == NULL) {
+			std::cout << "Cannot write the trace to " << filepath << std::endl;
+			return false;
+		}
+		bool written = fwrite(buffer, 1, size, file) == size;
+		fclose(file);
+		return written;
+	}
+
+	/**
+	 * \brief Prints the stage latencies and their histograms as "<bucket upper bound in us:samples"
+	 *
+	 */
+	void printStats() const {
+		static const char *names[TRACE_STAGES] = {"queue wait",	  "dispatch to handler", "handler run",
+												  "to notification", "notification to sent", "end to end"};
+		std::cout << "Event trace: " << std::dec << _recorded << " records" << std::endl;
+		for (int ii = 0; ii < TRACE_STAGES; ii++) {
+			std::cout << "\t";
+			_stages[ii].latency.print(names[ii]);
+			if (_stages[ii].latency.count == 0) {
+				continue;
+			}
+			std::cout << "\t\t";
+			for (uint32_t bucket = 0; bucket < TRACE_BUCKETS; bucket++) {
+				if (_stages[ii].histogram[bucket] != 0) {
+					std::cout << "<" << ((uint64_t)2 << bucket) << ":" << _stages[ii].histogram[bucket] << " ";
+				}
+			}
+			std::cout << std::endl;
+		}
+	}
+};
+
+/**
+ * \brief Records the dispatch of an event for the lifetime of the object
+ *
+ */
+class CTraceDispatch {
+  public:
+	explicit CTraceDispatch(uint16_t eventId) { CTracer::instance().dispatch(eventId); }
+	~CTraceDispatch() { CTracer::instance().endDispatch(); }
+};
+
+/**
+ * \brief Records the entry and the exit of a handler for the lifetime of the object
+ *
+ */
+class CTraceHandler {
+  private:
+	uint16_t _handle;
+
+  public:
+	explicit CTraceHandler(uint16_t handle) : _handle(handle) { CTracer::instance().handlerEntry(handle); }
+	~CTraceHandler() { CTracer::instance().handlerExit(_handle); }
+};
+
+} // namespace ble_trace
+
+#endif //!_BLE_TRACE_H_
\ No newline at end of file
@@ -0,0 +1,259 @@
+#ifndef _BLE_TX_SCHEDULER_H_
+#define _BLE_TX_SCHEDULER_H_
+
+#include "ble_utils.h"
+#include "mbed.h"
+
+#include <stdint.h>
+
+#define TX_HIGH_LANE_RESERVE 1		//!< Transmit buffers kept for the high lane once the stack ran out of them
+#define TX_LOW_LANE_MAX_WAIT_MS 2000 //!< Low lane updates waiting longer than this are dropped
+
+/**
+ * \brief The priority lanes of the transmit scheduler, the high lane is served first
+ *
+ */
+enum TransmitLane {
+	TX_LANE_HIGH = 0,	//!< Urgent updates, e.g. incoming calls. Never held back for the other lanes.
+	TX_LANE_NORMAL = 1, //!< Regular updates, held back to keep buffers free for the high lane
+	TX_LANE_LOW = 2,	//!< Bulk updates, held back like the normal lane and dropped when they get stale
+	TX_LANES = 3		//!< Number of lanes
+};
+
+/**
+ * \brief The outcome of handing a pending update to the stack
+ *
+ */
+enum TransmitResult {
+	TX_SENT,   //!< The update was queued for a subscribed client
+	TX_STORED, //!< The value was stored, no client is subscribed
+	TX_BUSY,   //!< The stack is out of transmit buffers, the update stays pending
+	TX_FAILED  //!< The update was given up
+};
+
+/**
+ * \brief Statistics of a lane
+ *
+ */
+struct tx_lane_stats_t {
+	ble_utils::LatencyStats latency; //!< Time from the first submit of an update to its hand-off to the stack
+	uint32_t sent;					 //!< Updates handed to the stack for a subscribed client
+	uint32_t merged;				 //!< Submits merged into an already pending update
+	uint32_t dropped;				 //!< Pending updates given up
+};
+
+/**
+ * \brief Schedules the notifications of a service over the transmit buffers of the stack
+ * \details An update is identified by a key, e.g. a characteristic and category pair. The value is read when
+ * 			the update is handed to the stack, so submitting an already pending key merges into it. Pending
+ * 			updates are sent lane by lane, the oldest first inside a lane. Once the stack has run out of
+ * 			buffers, the scheduler knows how many of its updates fit in them and holds the normal and low
+ * 			lanes back while only TX_HIGH_LANE_RESERVE buffers are left, so an urgent update does not queue
+ * 			behind bulk ones. The count of buffers in use is only an estimate, the stack reports the updates
+ * 			sent by all services together.
+ *
+ * \tparam Keys Number of update keys, at most 32
+ */
+template <unsigned Keys> class CTransmitScheduler {
+	static_assert(Keys <= 32, "The pending updates of a lane are kept in a 32-bit mask");
+
+  private:
+	mbed::Callback<TransmitResult(unsigned)> _send; //!< Hands the update of a key to the stack
+
+	uint8_t _lane[Keys];			//!< The lane of each key
+	uint32_t _pending[TX_LANES];	//!< The pending keys of each lane
+	uint32_t _submitted_us[Keys];	//!< The first submit time of each pending key
+	unsigned _in_flight;			//!< Updates handed to the stack and not reported sent yet
+	unsigned _capacity;				//!< Updates the stack accepted before running out of buffers, 0 if unknown
+	tx_lane_stats_t _stats[TX_LANES]; //!< The lane statistics
+
+	/**
+	 * \brief Gives up a pending update
+	 *
+	 */
+	void drop(unsigned lane, unsigned key) {
+		_pending[lane] &= ~(1UL << key);
+		_stats[lane].dropped++;
+		ble_utils::activityCounters().notificationsDropped++;
+	}
+
+	/**
+	 * \brief Drops the low lane updates that have waited too long, a newer submit sends the current value
+	 *
+	 */
+	void dropStale() {
+		uint32_t now = ble_utils::timestampUs();
+		for (unsigned key = 0; key < Keys; key++) {
+			if ((_pending[TX_LANE_LOW] & (1UL << key)) != 0 &&
+				now - _submitted_us[key] > TX_LOW_LANE_MAX_WAIT_MS * 1000UL) {
+				drop(TX_LANE_LOW, key);
+			}
+		}
+	}
+
+	/**
+	 * \brief The longest waiting key of a lane
+	 *
+	 */
+	unsigned oldest(unsigned lane) const {
+		uint32_t now = ble_utils::timestampUs();
+		unsigned result = Keys;
+		uint32_t longestWait = 0;
+		for (unsigned key = 0; key < Keys; key++) {
+			if ((_pending[lane] & (1UL << key)) == 0) {
+				continue;
+			}
+			if (result == Keys || now - _submitted_us[key] > longestWait) {
+				longestWait = now - _submitted_us[key];
+				result = key;
+			}
+		}
+		return result;
+	}
+
+	/**
+	 * \brief Checks if the lower lanes must leave the remaining buffers to the high lane
+	 *
+	 */
+	bool reserved() const {
+		return _capacity != 0 && _in_flight != 0 && _in_flight + TX_HIGH_LANE_RESERVE >= _capacity;
+	}
+
+	/**
+	 * \brief Hands the pending updates to the stack in lane order until it runs out of buffers
+	 *
+	 */
+	void pump() {
+		dropStale();
+		for (unsigned lane = TX_LANE_HIGH; lane < TX_LANES; lane++) {
+			while (_pending[lane] != 0) {
+				if (lane != TX_LANE_HIGH && reserved()) {
+					return;
+				}
+				unsigned key = oldest(lane);
+				TransmitResult result = _send(key);
+				if (result == TX_BUSY) {
+					_capacity = _in_flight;
+					ble_utils::activityCounters().noMemRetries++;
+					return;
+				}
+				if (result == TX_FAILED) {
+					drop(lane, key);
+					continue;
+				}
+				_pending[lane] &= ~(1UL << key);
+				if (result == TX_SENT) {
+					_in_flight++;
+					if (_capacity != 0 && _in_flight > _capacity) {
+						_capacity = _in_flight;
+					}
+					_stats[lane].sent++;
+					_stats[lane].latency.addSince(_submitted_us[key]);
+				}
+			}
+		}
+	}
+
+  public:
+	/**
+	 * \brief Construct a new CTransmitScheduler object, all keys are in the normal lane
+	 *
+	 * \param send Hands the update of a key to the stack
+	 */
+	CTransmitScheduler(mbed::Callback<TransmitResult(unsigned)> send) : _send(send), _in_flight(0), _capacity(0) {
+		for (unsigned key = 0; key < Keys; key++) {
+			_lane[key] = TX_LANE_NORMAL;
+			_submitted_us[key] = 0;
+		}
+		for (unsigned lane = 0; lane < TX_LANES; lane++) {
+			_pending[lane] = 0;
+			_stats[lane].sent = 0;
+			_stats[lane].merged = 0;
+			_stats[lane].dropped = 0;
+		}
+	}
+
+	/**
+	 * \brief Sets the lane of a key. A pending update of the key moves with it.
+	 *
+	 * \param key The key
+	 * \param lane The lane
+	 */
+	void setLane(unsigned key, TransmitLane lane) {
+		if (key >= Keys || lane >= TX_LANES) {
+			return;
+		}
+		if ((_pending[_lane[key]] & (1UL << key)) != 0) {
+			_pending[_lane[key]] &= ~(1UL << key);
+			_pending[lane] |= (1UL << key);
+		}
+		_lane[key] = (uint8_t)lane;
+	}
+
+	/**
+	 * \brief Submits the update of a key and sends what the transmit buffers allow
+	 *
+	 * \param key The key
+	 */
+	void submit(unsigned key) {
+		if (key >= Keys) {
+			return;
+		}
+		unsigned lane = _lane[key];
+		if ((_pending[lane] & (1UL << key)) != 0) {
+			_stats[lane].merged++;
+		} else {
+			_pending[lane] |= (1UL << key);
+			_submitted_us[key] = ble_utils::timestampUs();
+		}
+		pump();
+	}
+
+	/**
+	 * \brief Sends the pending updates, should be called when the stack reports updates sent
+	 *
+	 * \param count Number of updates sent
+	 */
+	void onDataSent(unsigned count) {
+		_in_flight = (count < _in_flight) ? _in_flight - count : 0;
+		pump();
+	}
+
+	/**
+	 * \brief Drops the pending updates and forgets the buffer estimate, e.g. when the client is gone
+	 *
+	 */
+	void clear() {
+		for (unsigned lane = 0; lane < TX_LANES; lane++) {
+			for (unsigned key = 0; key < Keys; key++) {
+				if ((_pending[lane] & (1UL << key)) != 0) {
+					drop(lane, key);
+				}
+			}
+		}
+		_in_flight = 0;
+		_capacity = 0;
+	}
+
+	/**
+	 * \brief The statistics of a lane
+	 *
+	 */
+	const tx_lane_stats_t &stats(TransmitLane lane) const { return _stats[lane]; }
+
+	/**
+	 * \brief Prints the lane statistics to the console
+	 *
+	 * \param name The name printed before the statistics
+	 */
+	void printStats(const char *name) const {
+		static const char *names[TX_LANES] = {"high", "normal", "low"};
+		for (unsigned lane = 0; lane < TX_LANES; lane++) {
+			std::cout << name << " " << names[lane] << " lane: sent " << std::dec << _stats[lane].sent << " merged "
+					  << _stats[lane].merged << " dropped " << _stats[lane].dropped << std::endl;
+			_stats[lane].latency.print("\tsubmit to stack latency");
+		}
+	}
+};
+
+#endif //!_BLE_TX_SCHEDULER_H_
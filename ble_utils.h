@@ -1,159 +1,341 @@
-#ifndef _BLE_UTILS_H_
-#define _BLE_UTILS_H_
-#include "BLE.h"
-#include "mbed.h"
-
-#include <iomanip>
-#include <iostream>
-
-namespace ble_utils {
-
-#define HEX_BYTE_IOSTREAM(__value) setw(2) << setfill('0') << hex << (int)(__value)
-#define HEX_SHORT_IOSTREAM(__value) setw(4) << setfill('0') << hex << (int)(__value)
-void printDeviceAddress(const ble::peer_address_type_t type, const ble::address_t &address);
-void printDeviceAddress(const Gap::Address_t &address);
-void printDeviceAddress(const ble::address_t &address);
-/**
- * \brief Prints the Bluetooth Device Address.
- *
- * \param type The type of the address.
- * \param address The address.
- */
-void printDeviceAddress(Gap::AddressType_t type, const Gap::Address_t &address) {
-	/* Print out device MAC address to the console*/
-	std::cout << "LOCAL BLUETOOTH DEVICE ADDRESS ";
-	switch (type) {
-	case BLEProtocol::AddressType::PUBLIC:
-		std::cout << "PUBLIC ";
-		break;
-	case BLEProtocol::AddressType::RANDOM_STATIC:
-		std::cout << "RANDOM STATIC ";
-		break;
-	case BLEProtocol::AddressType::RANDOM_PRIVATE_RESOLVABLE:
-		std::cout << "RANDOM PRIVATE RESOLVABLE ";
-		break;
-	case BLEProtocol::AddressType::RANDOM_PRIVATE_NON_RESOLVABLE:
-		std::cout << "RANDOM PRIVATE NON-RESOLVABLE ";
-		break;
-	default:
-		std::cout << "UNKNOWN";
-		break;
-	}
-	ble_utils::printDeviceAddress(address);
-}
-
-/**
- * \brief Prints the Bluetooth address of a peer device.
- *
- * \param type The peer device address type
- * \param address The peer device address
- */
-void printDeviceAddress(const ble::peer_address_type_t type, const ble::address_t &address) {
-	/* Print out device MAC address to the console*/
-	std::cout << "PEER BLUETOOTH DEVICE ADDRESS ";
-	switch (type.value()) {
-	case ble::peer_address_type_t::PUBLIC:
-		std::cout << "PUBLIC ";
-		break;
-	case ble::peer_address_type_t::RANDOM:
-		std::cout << "RANDOM ";
-		break;
-	case ble::peer_address_type_t::RANDOM_STATIC_IDENTITY:
-		std::cout << "RANDOM STATIC IDENTITY ";
-		break;
-	case ble::peer_address_type_t::ANONYMOUS:
-		std::cout << "ANONYMOUS BROADCASTER ";
-		break;
-	default:
-		std::cout << "UNKNOWN ";
-		break;
-	}
-	ble_utils::printDeviceAddress(address);
-}
-
-/**
- * \brief Prints just the device address but not the type
- *
- * \param address The address to be printed.
- */
-void printDeviceAddress(const Gap::Address_t &address) {
-	/* Print out device MAC address to the console*/
-	std::cout << HEX_BYTE_IOSTREAM(address[5]) << HEX_BYTE_IOSTREAM(address[4])
-			  << HEX_BYTE_IOSTREAM(address[3]) << HEX_BYTE_IOSTREAM(address[2])
-			  << HEX_BYTE_IOSTREAM(address[1]) << HEX_BYTE_IOSTREAM(address[0]) << std::endl;
-}
-
-/**
- * \brief PRints just the address
- *
- * \param address address to be printed
- */
-void printDeviceAddress(const ble::address_t &address) {
-	/* Print out device MAC address to the console*/
-	std::cout << HEX_BYTE_IOSTREAM(address[5]) << HEX_BYTE_IOSTREAM(address[4])
-			  << HEX_BYTE_IOSTREAM(address[3]) << HEX_BYTE_IOSTREAM(address[2])
-			  << HEX_BYTE_IOSTREAM(address[1]) << HEX_BYTE_IOSTREAM(address[0]) << std::endl;
-}
-/**
- * \brief Print error code helper function
- *
- * \param error The error code
- * \param message The message to be prepended before the error code description.
- */
-void printError(ble_error_t error, const char *message) {
-	std::cout << message;
-	switch (error) {
-	case BLE_ERROR_NONE:
-		std::cout << "BLE_ERROR_NONE: No error";
-		break;
-	case BLE_ERROR_BUFFER_OVERFLOW:
-		std::cout << "BLE_ERROR_BUFFER_OVERFLOW: The requested action would "
-					 "cause a buffer overflow and has been aborted";
-		break;
-	case BLE_ERROR_NOT_IMPLEMENTED:
-		std::cout << "BLE_ERROR_NOT_IMPLEMENTED: Requested a feature that "
-					 "isn't yet implement or isn't supported by the target HW";
-		break;
-	case BLE_ERROR_PARAM_OUT_OF_RANGE:
-		std::cout << "BLE_ERROR_PARAM_OUT_OF_RANGE: One of the supplied "
-					 "parameters is outside the valid range";
-		break;
-	case BLE_ERROR_INVALID_PARAM:
-		std::cout << "BLE_ERROR_INVALID_PARAM: One of the supplied parameters "
-					 "is invalid";
-		break;
-	case BLE_STACK_BUSY:
-		std::cout << "BLE_STACK_BUSY: The stack is busy";
-		break;
-	case BLE_ERROR_INVALID_STATE:
-		std::cout << "BLE_ERROR_INVALID_STATE: Invalid state";
-		break;
-	case BLE_ERROR_NO_MEM:
-		std::cout << "BLE_ERROR_NO_MEM: Out of Memory";
-		break;
-	case BLE_ERROR_OPERATION_NOT_PERMITTED:
-		std::cout << "BLE_ERROR_OPERATION_NOT_PERMITTED";
-		break;
-	case BLE_ERROR_INITIALIZATION_INCOMPLETE:
-		std::cout << "BLE_ERROR_INITIALIZATION_INCOMPLETE";
-		break;
-	case BLE_ERROR_ALREADY_INITIALIZED:
-		std::cout << "BLE_ERROR_ALREADY_INITIALIZED";
-		break;
-	case BLE_ERROR_UNSPECIFIED:
-		std::cout << "BLE_ERROR_UNSPECIFIED: Unknown error";
-		break;
-	case BLE_ERROR_INTERNAL_STACK_FAILURE:
-		std::cout << "BLE_ERROR_INTERNAL_STACK_FAILURE: internal stack faillure";
-		break;
-	case BLE_ERROR_NOT_FOUND:
-		std::cout << "BLE_ERROR_NOT_FOUND: The data not found or there is "
-					 "nothing to return";
-		break;
-	}
-	std::cout << std::endl;
-}
-
-
-} // namespace ble_utils
+#ifndef _BLE_UTILS_H_
+#define _BLE_UTILS_H_
+#include "BLE.h"
+#include "mbed.h"
+
+#include <iomanip>
+#include <iostream>
+
+namespace ble_utils {
+
+#define HEX_BYTE_IOSTREAM(__value) setw(2) << setfill('0') << hex << (int)(__value)
+#define HEX_SHORT_IOSTREAM(__value) setw(4) << setfill('0') << hex << (int)(__value)
+void printDeviceAddress(const ble::peer_address_type_t type, const ble::address_t &address);
+void printDeviceAddress(const Gap::Address_t &address);
+void printDeviceAddress(const ble::address_t &address);
+
+/**
+ * \brief Returns a free running microsecond timestamp used for latency measurements
+ *
+ * \return uint32_t The current time in microseconds. Wraps around every ~71 minutes.
+ */
+inline uint32_t timestampUs() { return us_ticker_read(); }
+
+/**
+ * \brief Simple min/max/average accumulator for latency measurements in microseconds
+ *
+ */
+struct LatencyStats {
+	uint32_t count; //!< Number of samples
+	uint64_t total; //!< Sum of all samples
+	uint32_t min;	//!< Smallest sample
+	uint32_t max;	//!< Largest sample
+
+	LatencyStats() : count(0), total(0), min(UINT32_MAX), max(0) {}
+
+	/**
+	 * \brief Adds a sample
+	 *
+	 * \param us The sample in microseconds
+	 */
+	void add(uint32_t us) {
+		count++;
+		total += us;
+		min = (us < min) ? us : min;
+		max = (us > max) ? us : max;
+	}
+	/**
+	 * \brief Adds the time elapsed since the given timestamp
+	 *
+	 * \param startUs The start timestamp returned by timestampUs()
+	 */
+	void addSince(uint32_t startUs) { add(timestampUs() - startUs); }
+	/**
+	 * \brief The average of the samples
+	 *
+	 * \return uint32_t The average in microseconds, 0 if there are no samples
+	 */
+	uint32_t average() const { return (count == 0) ? 0 : (uint32_t)(total / count); }
+	/**
+	 * \brief Prints the statistics to the console
+	 *
+	 * \param name The name printed before the statistics
+	 */
+	void print(const char *name) const {
+		std::cout << name << ": count " << std::dec << count;
+		if (count != 0) {
+			std::cout << " avg " << average() << " us min " << min << " us max " << max << " us";
+		}
+		std::cout << std::endl;
+	}
+};
+
+/**
+ * \brief Counters of the GATT and GAP activity since the start, read by the diagnostics service
+ *
+ */
+struct activity_counters_t {
+	uint32_t notificationsSent;	   //!< Notifications and indications reported sent by the stack
+	uint32_t notificationsDropped; //!< Updates for a subscribed client that were given up
+	uint32_t noMemRetries;		   //!< Updates deferred because the stack was out of transmit buffers
+	uint32_t connections;		   //!< Connections completed
+};
+
+/**
+ * \brief The activity counters of the system
+ *
+ */
+inline activity_counters_t &activityCounters() {
+	static activity_counters_t counters = {0, 0, 0, 0};
+	return counters;
+}
+
+#define NOTIFICATION_FIFO_SIZE 16 //!< Notifications a GATT server tracks until the stack reports them sent
+
+/**
+ * \brief The value handles of the notifications handed to a GATT server of the stack, in submission order
+ * \details The stack reports the sent notifications as a count, so the sent ones are the oldest in the FIFO.
+ * 			The characteristics report each update for a subscribed client with notified(), which finds the
+ * 			FIFO of the GattServer they wrote to. The FIFOs are linked in a list when constructed, one per
+ * 			GATT server, as the host tools run several devices in one process.
+ */
+class CNotificationFifo : private mbed::NonCopyable<CNotificationFifo> {
+  private:
+	GattServer *_server;					  //!< The GATT server of the stack, nullptr before attach()
+	uint16_t _handles[NOTIFICATION_FIFO_SIZE]; //!< The value handles of the pending notifications
+	uint8_t _head;							  //!< Index of the oldest pending notification
+	uint8_t _count;							  //!< Number of the pending notifications
+	uint32_t _dropped;						  //!< Notifications dropped from the full FIFO
+	CNotificationFifo *_next;				  //!< The next FIFO of the list
+
+	static CNotificationFifo *&first() {
+		static CNotificationFifo *first = nullptr;
+		return first;
+	}
+
+	void push(uint16_t handle) {
+		CriticalSectionLock lock;
+		if (_count == NOTIFICATION_FIFO_SIZE) {
+			// more updates in flight than the stack has buffers for, the oldest is given up
+			_head = (_head + 1) % NOTIFICATION_FIFO_SIZE;
+			_count--;
+			_dropped++;
+		}
+		_handles[(_head + _count) % NOTIFICATION_FIFO_SIZE] = handle;
+		_count++;
+	}
+
+  public:
+	CNotificationFifo() : _server(nullptr), _handles(), _head(0), _count(0), _dropped(0), _next(first()) {
+		first() = this;
+	}
+	~CNotificationFifo() {
+		for (CNotificationFifo **p = &first(); *p != nullptr; p = &(*p)->_next) {
+			if (*p == this) {
+				*p = _next;
+				break;
+			}
+		}
+	}
+
+	/**
+	 * \brief Sets the GATT server of the stack whose notifications the FIFO tracks
+	 *
+	 */
+	void attach(GattServer *server) { _server = server; }
+
+	/**
+	 * \brief Records a value written to a GATT server of the stack, if a client has subscribed to it
+	 *
+	 * \param server The GATT server of the stack
+	 * \param characteristic The characteristic written with notification
+	 */
+	static void notified(GattServer *server, const GattCharacteristic &characteristic) {
+		bool enabled = false;
+		server->areUpdatesEnabled(characteristic, &enabled);
+		if (!enabled) {
+			return;
+		}
+		for (CNotificationFifo *fifo = first(); fifo != nullptr; fifo = fifo->_next) {
+			if (fifo->_server == server) {
+				fifo->push(characteristic.getValueHandle());
+				return;
+			}
+		}
+	}
+
+	/**
+	 * \brief Removes the sent notifications, in submission order
+	 *
+	 * \param count Number of notifications the stack reported sent
+	 * \param handles Receives their value handles, room for NOTIFICATION_FIFO_SIZE
+	 * \return unsigned Number of the handles
+	 */
+	unsigned sent(unsigned count, uint16_t *handles) {
+		CriticalSectionLock lock;
+		unsigned found = 0;
+		for (; count != 0 && _count != 0; count--) {
+			handles[found++] = _handles[_head];
+			_head = (_head + 1) % NOTIFICATION_FIFO_SIZE;
+			_count--;
+		}
+		return found;
+	}
+
+	/**
+	 * \brief Forgets the pending notifications, the stack drops them with the link
+	 *
+	 */
+	void clear() {
+		CriticalSectionLock lock;
+		_head = 0;
+		_count = 0;
+	}
+
+	uint32_t dropped() const { return _dropped; }
+};
+
+/**
+ * \brief Prints the Bluetooth Device Address.
+ *
+ * \param type The type of the address.
+ * \param address The address.
+ */
+void printDeviceAddress(Gap::AddressType_t type, const Gap::Address_t &address) {
+	/* Print out device MAC address to the console*/
+	std::cout << "LOCAL BLUETOOTH DEVICE ADDRESS ";
+	switch (type) {
+	case BLEProtocol::AddressType::PUBLIC:
+		std::cout << "PUBLIC ";
+		break;
+	case BLEProtocol::AddressType::RANDOM_STATIC:
+		std::cout << "RANDOM STATIC ";
+		break;
+	case BLEProtocol::AddressType::RANDOM_PRIVATE_RESOLVABLE:
+		std::cout << "RANDOM PRIVATE RESOLVABLE ";
+		break;
+	case BLEProtocol::AddressType::RANDOM_PRIVATE_NON_RESOLVABLE:
+		std::cout << "RANDOM PRIVATE NON-RESOLVABLE ";
+		break;
+	default:
+		std::cout << "UNKNOWN";
+		break;
+	}
+	ble_utils::printDeviceAddress(address);
+}
+
+/**
+ * \brief Prints the Bluetooth address of a peer device.
+ *
+ * \param type The peer device address type
+ * \param address The peer device address
+ */
+void printDeviceAddress(const ble::peer_address_type_t type, const ble::address_t &address) {
+	/* Print out device MAC address to the console*/
+	std::cout << "PEER BLUETOOTH DEVICE ADDRESS ";
+	switch (type.value()) {
+	case ble::peer_address_type_t::PUBLIC:
+		std::cout << "PUBLIC ";
+		break;
+	case ble::peer_address_type_t::RANDOM:
+		std::cout << "RANDOM ";
+		break;
+	case ble::peer_address_type_t::RANDOM_STATIC_IDENTITY:
+		std::cout << "RANDOM STATIC IDENTITY ";
+		break;
+	case ble::peer_address_type_t::ANONYMOUS:
+		std::cout << "ANONYMOUS BROADCASTER ";
+		break;
+	default:
+		std::cout << "UNKNOWN ";
+		break;
+	}
+	ble_utils::printDeviceAddress(address);
+}
+
+/**
+ * \brief Prints just the device address but not the type
+ *
+ * \param address The address to be printed.
+ */
+void printDeviceAddress(const Gap::Address_t &address) {
+	/* Print out device MAC address to the console*/
+	std::cout << HEX_BYTE_IOSTREAM(address[5]) << HEX_BYTE_IOSTREAM(address[4])
+			  << HEX_BYTE_IOSTREAM(address[3]) << HEX_BYTE_IOSTREAM(address[2])
+			  << HEX_BYTE_IOSTREAM(address[1]) << HEX_BYTE_IOSTREAM(address[0]) << std::endl;
+}
+
+/**
+ * \brief PRints just the address
+ *
+ * \param address address to be printed
+ */
+void printDeviceAddress(const ble::address_t &address) {
+	/* Print out device MAC address to the console*/
+	std::cout << HEX_BYTE_IOSTREAM(address[5]) << HEX_BYTE_IOSTREAM(address[4])
+			  << HEX_BYTE_IOSTREAM(address[3]) << HEX_BYTE_IOSTREAM(address[2])
+			  << HEX_BYTE_IOSTREAM(address[1]) << HEX_BYTE_IOSTREAM(address[0]) << std::endl;
+}
+/**
+ * \brief Print error code helper function
+ *
+ * \param error The error code
+ * \param message The message to be prepended before the error code description.
+ */
+void printError(ble_error_t error, const char *message) {
+	std::cout << message;
+	switch (error) {
+	case BLE_ERROR_NONE:
+		std::cout << "BLE_ERROR_NONE: No error";
+		break;
+	case BLE_ERROR_BUFFER_OVERFLOW:
+		std::cout << "BLE_ERROR_BUFFER_OVERFLOW: The requested action would "
+					 "cause a buffer overflow and has been aborted";
+		break;
+	case BLE_ERROR_NOT_IMPLEMENTED:
+		std::cout << "BLE_ERROR_NOT_IMPLEMENTED: Requested a feature that "
+					 "isn't yet implement or isn't supported by the target HW";
+		break;
+	case BLE_ERROR_PARAM_OUT_OF_RANGE:
+		std::cout << "BLE_ERROR_PARAM_OUT_OF_RANGE: One of the supplied "
+					 "parameters is outside the valid range";
+		break;
+	case BLE_ERROR_INVALID_PARAM:
+		std::cout << "BLE_ERROR_INVALID_PARAM: One of the supplied parameters "
+					 "is invalid";
+		break;
+	case BLE_STACK_BUSY:
+		std::cout << "BLE_STACK_BUSY: The stack is busy";
+		break;
+	case BLE_ERROR_INVALID_STATE:
+		std::cout << "BLE_ERROR_INVALID_STATE: Invalid state";
+		break;
+	case BLE_ERROR_NO_MEM:
+		std::cout << "BLE_ERROR_NO_MEM: Out of Memory";
+		break;
+	case BLE_ERROR_OPERATION_NOT_PERMITTED:
+		std::cout << "BLE_ERROR_OPERATION_NOT_PERMITTED";
+		break;
+	case BLE_ERROR_INITIALIZATION_INCOMPLETE:
+		std::cout << "BLE_ERROR_INITIALIZATION_INCOMPLETE";
+		break;
+	case BLE_ERROR_ALREADY_INITIALIZED:
+		std::cout << "BLE_ERROR_ALREADY_INITIALIZED";
+		break;
+	case BLE_ERROR_UNSPECIFIED:
+		std::cout << "BLE_ERROR_UNSPECIFIED: Unknown error";
+		break;
+	case BLE_ERROR_INTERNAL_STACK_FAILURE:
+		std::cout << "BLE_ERROR_INTERNAL_STACK_FAILURE: internal stack faillure";
+		break;
+	case BLE_ERROR_NOT_FOUND:
+		std::cout << "BLE_ERROR_NOT_FOUND: The data not found or there is "
+					 "nothing to return";
+		break;
+	}
+	std::cout << std::endl;
+}
+
+
+} // namespace ble_utils
 #endif //! _BLE_UTILS_H_
\ No newline at end of file
@@ -0,0 +1,106 @@
+/**
+ * \file ble_dispatch_bench.cpp
+ * \brief Compares the run time service dispatch of CGattServer with the compile time one of CStaticGattServer
+ * \details Both servers get the same four services, which only compare the handle as the real services do, so
+ * 			the measured time is the dispatch itself. Build and run on the host:
+ * 			g++ -std=c++14 -O2 -I.. -Istack ble_dispatch_bench.cpp -o ble_dispatch_bench
+ * 			./ble_dispatch_bench [events]
+ */
+#include "ble_event_queue.h"
+#include "ble_gatt_static_server.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#define BENCH_HANDLES 8 //!< Handles written in turn, half of them belong to a service
+
+/**
+ * \brief A service with one handle, which counts the events it gets
+ *
+ * \tparam N The service number, the services are distinct types for the static server
+ */
+template <int N> class CBenchService : public CGattService {
+  private:
+	uint16_t _handle;
+
+  public:
+	unsigned events; //!< Events of the service handle, and the other events
+
+	CBenchService() : CGattService(UUID((uint16_t)(0xFF00 + N)), nullptr, 0), _handle(2 * N + 1), events(0) {}
+
+	virtual void onConnection() override { events++; }
+	virtual void onDisconnection() override { events++; }
+	virtual void onWrite(uint16_t handle) override {
+		if (handle == _handle) {
+			events++;
+		}
+	}
+	virtual void onRead(uint16_t handle) override {}
+	virtual void enableAuthentication(bool enable = true) override {}
+	virtual void onDataSent(unsigned count) override { events += count; }
+};
+
+/**
+ * \brief Times the events dispatched by a server
+ *
+ * \tparam Server CGattServer or CStaticGattServer
+ * \return The nanoseconds per event
+ */
+template <typename Server> double timeWrites(Server &server, unsigned events) {
+	static volatile uint16_t handles[BENCH_HANDLES] = {1, 2, 3, 4, 5, 6, 7, 8};
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned ii = 0; ii < events; ii++) {
+		server.dispatchWrite(handles[ii % BENCH_HANDLES]);
+	}
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / events;
+}
+template <typename Server> double timeDataSent(Server &server, unsigned events) {
+	static volatile unsigned count = 1;
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned ii = 0; ii < events; ii++) {
+		server.dispatchDataSent(count);
+	}
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / events;
+}
+template <typename Server> double timeConnections(Server &server, unsigned events) {
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned ii = 0; ii < events; ii++) {
+		server.dispatchConnection();
+		server.dispatchDisconnection();
+	}
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() /
+		   (2.0 * events);
+}
+
+int main(int argc, char *argv[]) {
+	unsigned events = (argc > 1) ? atoi(argv[1]) : 10000000;
+	BLE &ble = BLE::Instance();
+	CStaticEventQueue<32 * EVENTS_EVENT_SIZE> queue;
+
+	CBenchService<0> s0, d0;
+	CBenchService<1> s1, d1;
+	CBenchService<2> s2, d2;
+	CBenchService<3> s3, d3;
+	CGattServer dynamicServer(ble, queue, {&d0, &d1, &d2, &d3});
+	CStaticGattServer<CBenchService<0>, CBenchService<1>, CBenchService<2>, CBenchService<3>> staticServer(
+		ble, queue, s0, s1, s2, s3);
+
+	std::cout << events << " events to 4 services, ns per event" << std::endl;
+	std::cout << "\t\t\tCGattServer\tCStaticGattServer" << std::endl;
+	std::cout << "\twrite\t\t" << timeWrites(dynamicServer, events) << "\t\t" << timeWrites(staticServer, events)
+			  << std::endl;
+	std::cout << "\tdata sent\t" << timeDataSent(dynamicServer, events) << "\t\t"
+			  << timeDataSent(staticServer, events) << std::endl;
+	std::cout << "\tconnection\t" << timeConnections(dynamicServer, events) << "\t\t"
+			  << timeConnections(staticServer, events) << std::endl;
+
+	// both servers must have dispatched the same events
+	unsigned dynamicEvents = d0.events + d1.events + d2.events + d3.events;
+	unsigned staticEvents = s0.events + s1.events + s2.events + s3.events;
+	if (dynamicEvents != staticEvents) {
+		std::cout << "event count mismatch: " << dynamicEvents << " != " << staticEvents << std::endl;
+		return 1;
+	}
+	return 0;
+}
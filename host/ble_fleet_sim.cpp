@@ -0,0 +1,481 @@
+/**
+ * \file ble_fleet_sim.cpp
+ * \brief Discrete-event simulation of a fleet of homework devices sharing the air
+ * \details Runs N copies of the device, each the full GAP, GATT server and service graph of CHostDevice on its
+ * 			own host stack, against N phones on a virtual clock. The model of the air:
+ * 			- the devices advertise on the three primary channels at their advertising interval plus the random
+ * 			  advDelay of the specification; two packets on one channel that overlap collide and the later one is
+ * 			  lost
+ * 			- each phone scans with a fixed window and interval, rotating the channels, and connects to its own
+ * 			  device on the first advertising packet it hears; the phone then pairs, subscribes to the New Alert
+ * 			  characteristic and enables the alerts through the control point
+ * 			- each link has connection events at the connection interval on a hopping data channel; an event
+ * 			  that overlaps an event of another link on the same channel is lost, the others carry up to
+ * 			  FLEET_PDUS_PER_EVENT notifications and free their transmit buffers
+ * 			- once ready, each device raises alerts at random with the given mean period
+ * 			For each fleet size of the sweep it reports the connection setup time from the start of the scan,
+ * 			the latency from raising an alert to its notification on the air, and the event loop load of the
+ * 			devices: the events dispatched, the queue high-water mark and the host time of the handlers. The
+ * 			report goes to stderr, the output of the classes to stdout.
+ *
+ * 			The devices share the process-wide state of the classes, which a device on the target has alone:
+ * 			- ble_trace::CTracer::instance() records the events of all the devices into one ring, and links the
+ * 			  notifications of one device to the sent events of the others, so its stage latencies are not
+ * 			  those of a device
+ * 			- ble_utils::activityCounters() counts the connections and notifications of the whole fleet, which
+ * 			  the Diagnostics service of every device reports as its own
+ * 			- the CProfiler entries of each handler add up the calls of all the devices
+ * 			None of the figures of the report come from them. The simulation measures the latencies and the
+ * 			handler time of each device, and the event queues, which every device has to itself, count the
+ * 			events. Build and run on the host:
+ * 			g++ -std=c++14 -O2 -I.. -Istack ble_fleet_sim.cpp -o ble_fleet_sim
+ * 			./ble_fleet_sim [max devices] [seconds] [alert period ms] [connection interval ms] [seed] > /dev/null
+ */
+#include "ble_host_device.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <deque>
+#include <memory>
+#include <queue>
+#include <random>
+
+#define FLEET_ADV_AIRTIME_US 376		   //!< Air time of a 31 byte advertising packet on the 1M PHY
+#define FLEET_ADV_CHANNEL_SPACING_US 500   //!< Time between the packets of an advertising event
+#define FLEET_ADV_DELAY_MAX_US 10000	   //!< The advDelay added to each advertising interval
+#define FLEET_CONNECT_IND_US 502		   //!< T_IFS and the air time of the CONNECT_IND
+#define FLEET_CONNECT_DELAY_US 1250		   //!< The transmit window delay before the first connection event
+#define FLEET_SCAN_INTERVAL_US 60000	   //!< Scan interval of the phones
+#define FLEET_SCAN_WINDOW_US 30000		   //!< Scan window of the phones
+#define FLEET_SCAN_START_SPREAD_US 1000000 //!< The phones start scanning within this time of the start
+#define FLEET_BOOT_SPREAD_US 100000		   //!< The devices start within this time of the start
+#define FLEET_DATA_CHANNELS 37			   //!< Data channels of the hopping
+#define FLEET_EVENT_AIRTIME_US 400		   //!< Air time of a connection event without data
+#define FLEET_PDU_AIRTIME_US 300		   //!< Air time added by each notification
+#define FLEET_PDUS_PER_EVENT 4			   //!< Notifications sent per connection event
+#define FLEET_SECURITY_EVENTS 6			   //!< Connection events from the connection to the encrypted link
+
+/**
+ * \brief The phone of a device
+ *
+ */
+enum CentralState { CENTRAL_IDLE, CENTRAL_SCANNING, CENTRAL_CONNECTING, CENTRAL_CONNECTED, CENTRAL_READY };
+
+/**
+ * \brief The simulation events
+ *
+ */
+enum SimEventType {
+	SIM_BOOT,		  //!< The device starts
+	SIM_SCAN,		  //!< The phone starts scanning
+	SIM_ADVERTISING, //!< An advertising event of the device
+	SIM_CONNECT,	  //!< The first connection event, the connection completes
+	SIM_SECURITY,	  //!< The link is encrypted
+	SIM_SUBSCRIBE,	  //!< The phone subscribes to the alerts
+	SIM_CONNECTION,  //!< A connection event
+	SIM_ALERT,		  //!< The device raises an alert
+	SIM_TIMER,		  //!< A timer of the device is due
+};
+
+struct sim_event_t {
+	uint64_t timeUs;
+	uint64_t sequence;
+	uint32_t node;
+	SimEventType type;
+	bool operator>(const sim_event_t &other) const {
+		return (timeUs != other.timeUs) ? timeUs > other.timeUs : sequence > other.sequence;
+	}
+};
+
+/**
+ * \brief A notification handed to the radio and waiting for a connection event
+ *
+ */
+struct pending_update_t {
+	uint64_t handedUs; //!< The time the GATT server handed it to the radio
+	bool newAlert;	   //!< Set for the New Alert characteristic
+};
+
+/**
+ * \brief A device of the fleet and its phone
+ *
+ */
+struct CFleetNode {
+	CHostDevice device;
+	BLEProtocol::AddressBytes_t central; //!< The address of the phone
+	CentralState state;
+	uint64_t scanStartUs;				 //!< The time the phone started scanning
+	uint16_t newAlertHandle;			 //!< Value handle of the New Alert characteristic
+	uint16_t controlPointHandle;		 //!< Value handle of the Alert Notification Control Point
+	uint8_t channel;					 //!< The data channel of the last connection event
+	uint8_t hop;						 //!< The hop increment of the link
+	std::deque<pending_update_t> tx;	 //!< The notifications waiting for a connection event
+	std::deque<uint64_t> raised;		 //!< The times of the alerts not delivered yet
+	uint64_t timerUs;					 //!< The due time of the queued SIM_TIMER, UINT64_MAX if none
+	uint64_t busyNs;					 //!< Host time spent in the handlers of the device
+
+	CFleetNode(uint32_t index)
+		: device(), state(CENTRAL_IDLE), scanStartUs(0), newAlertHandle(0), controlPointHandle(0), channel(0), hop(5),
+		  timerUs(UINT64_MAX), busyNs(0) {
+		for (int ii = 0; ii < 6; ii++) {
+			central[ii] = (uint8_t)(index >> (8 * (ii % 4)));
+		}
+		central[5] = 0xC0;
+	}
+};
+
+/**
+ * \brief Percentiles of a sample set
+ *
+ */
+class CSamples {
+  private:
+	std::vector<uint32_t> _samples;
+
+  public:
+	void add(uint64_t value) { _samples.push_back((uint32_t)value); }
+	size_t count() const { return _samples.size(); }
+	uint32_t percentile(unsigned p) {
+		if (_samples.empty()) {
+			return 0;
+		}
+		std::sort(_samples.begin(), _samples.end());
+		return _samples[std::min(_samples.size() - 1, _samples.size() * p / 100)];
+	}
+	uint32_t average() const {
+		uint64_t total = 0;
+		for (auto s : _samples) {
+			total += s;
+		}
+		return _samples.empty() ? 0 : (uint32_t)(total / _samples.size());
+	}
+	/**
+	 * \brief Prints the average and the percentiles in milliseconds
+	 *
+	 */
+	void print(const char *name) {
+		std::cerr << "  " << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(1)
+				  << std::setw(8) << count() << std::setw(10) << average() / 1000.0 << std::setw(10)
+				  << percentile(50) / 1000.0 << std::setw(10) << percentile(95) / 1000.0 << std::setw(10)
+				  << percentile(100) / 1000.0 << std::endl;
+	}
+};
+
+/**
+ * \brief The fleet and the air
+ *
+ */
+class CFleet {
+  private:
+	host_stack::CClock &_clock;
+	std::vector<std::unique_ptr<CFleetNode>> _nodes;
+	std::priority_queue<sim_event_t, std::vector<sim_event_t>, std::greater<sim_event_t>> _events;
+	uint64_t _sequence;
+	std::mt19937 _random;
+	uint32_t _alertPeriodMs;			//!< Mean time between the alerts of a device
+	uint32_t _connectionIntervalUs;		//!< Connection interval of the links
+	uint64_t _startUs;					//!< Start of the simulation
+	uint64_t _advBusyUs[3];				//!< End of the last packet on each advertising channel
+	uint64_t _dataBusyUs[FLEET_DATA_CHANNELS]; //!< End of the last connection event on each data channel
+
+	uint32_t _advPackets, _advCollisions;		//!< Advertising packets and the ones lost
+	uint32_t _connectionEvents, _eventsLost;	//!< Connection events and the ones lost
+	uint32_t _alertsRaised, _alertsDelivered;	//!< Alerts raised and notified on the air
+	CSamples _connectTime, _readyTime, _alertLatency;
+
+	void post(uint64_t timeUs, uint32_t node, SimEventType type) {
+		_events.push(sim_event_t{timeUs, _sequence++, node, type});
+	}
+	uint32_t uniform(uint32_t max) { return std::uniform_int_distribution<uint32_t>(0, max)(_random); }
+
+	/**
+	 * \brief Runs the due events of a device and queues its next timer
+	 *
+	 */
+	void dispatch(uint32_t index) {
+		CFleetNode &node = *_nodes[index];
+		auto started = std::chrono::steady_clock::now();
+		node.device.dispatch(0);
+		node.busyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started)
+						   .count();
+		uint64_t dueUs;
+		if (node.device.dispatchQueue().nextDue(dueUs) && (dueUs < node.timerUs || node.timerUs <= _clock.nowUs())) {
+			node.timerUs = dueUs;
+			post(dueUs, index, SIM_TIMER);
+		}
+	}
+
+	/**
+	 * \brief Checks whether the phone scans an advertising channel at a time
+	 *
+	 */
+	bool hears(const CFleetNode &node, uint64_t us, int channel) const {
+		if (node.state != CENTRAL_SCANNING || us < node.scanStartUs) {
+			return false;
+		}
+		uint64_t elapsed = us - node.scanStartUs;
+		return (elapsed % FLEET_SCAN_INTERVAL_US) < FLEET_SCAN_WINDOW_US &&
+			   (int)((elapsed / FLEET_SCAN_INTERVAL_US) % 3) == channel;
+	}
+
+	void onAdvertising(uint32_t index, uint64_t nowUs) {
+		CFleetNode &node = *_nodes[index];
+		ble::Gap &gap = node.device.ble().gap();
+		if (node.state >= CENTRAL_CONNECTING) {
+			return;
+		}
+		if (gap.isAdvertisingActive(ble::LEGACY_ADVERTISING_HANDLE)) {
+			for (int channel = 0; channel < 3; channel++) {
+				uint64_t packetUs = nowUs + channel * FLEET_ADV_CHANNEL_SPACING_US;
+				bool collided = _advBusyUs[channel] > packetUs;
+				_advBusyUs[channel] = std::max(_advBusyUs[channel], packetUs + FLEET_ADV_AIRTIME_US);
+				_advPackets++;
+				if (collided) {
+					_advCollisions++;
+				} else if (hears(node, packetUs, channel) && gap.acceptsConnection(node.central)) {
+					// the CONNECT_IND follows the packet on the same channel, the advertising event ends
+					_advBusyUs[channel] += FLEET_CONNECT_IND_US;
+					node.state = CENTRAL_CONNECTING;
+					post(packetUs + FLEET_ADV_AIRTIME_US + FLEET_CONNECT_IND_US + FLEET_CONNECT_DELAY_US +
+							 uniform(FLEET_CONNECT_DELAY_US),
+						 index, SIM_CONNECT);
+					return;
+				}
+			}
+		}
+		uint32_t intervalMs = gap.getAdvertisingParameters().getMinPrimaryInterval().valueInMs();
+		post(nowUs + intervalMs * 1000 + uniform(FLEET_ADV_DELAY_MAX_US), index, SIM_ADVERTISING);
+	}
+
+	void onConnect(uint32_t index, uint64_t nowUs) {
+		CFleetNode &node = *_nodes[index];
+		node.device.ble().gap().injectConnection(1, ble::peer_address_type_t::PUBLIC, ble::address_t(node.central));
+		dispatch(index);
+		node.state = CENTRAL_CONNECTED;
+		node.channel = (uint8_t)uniform(FLEET_DATA_CHANNELS - 1);
+		node.hop = (uint8_t)(5 + uniform(11));
+		_connectTime.add(nowUs - node.scanStartUs);
+		post(nowUs + _connectionIntervalUs, index, SIM_CONNECTION);
+		post(nowUs + FLEET_SECURITY_EVENTS * _connectionIntervalUs, index, SIM_SECURITY);
+	}
+
+	void onSecurity(uint32_t index, uint64_t nowUs) {
+		CFleetNode &node = *_nodes[index];
+		SecurityManager &sm = node.device.ble().securityManager();
+		sm.addBond(node.central);
+		sm.injectPairingResult(1, SecurityManager::SEC_STATUS_SUCCESS);
+		sm.injectLinkEncryption(1, ble::link_encryption_t::ENCRYPTED_WITH_MITM);
+		dispatch(index);
+		post(nowUs + _connectionIntervalUs, index, SIM_SUBSCRIBE);
+	}
+
+	void onSubscribe(uint32_t index, uint64_t nowUs) {
+		CFleetNode &node = *_nodes[index];
+		GattServer &server = node.device.ble().gattServer();
+		server.injectSubscription(node.newAlertHandle, 1);
+		uint8_t enable[2] = {CAlertNotificationServiceServer::ANS_ENABLE_NEW_INCOMING_ALERT_NOTIFICATION,
+							 CAlertNotificationServiceServer::ANS_TYPE_ALL_ALERTS};
+		server.injectWrite(1, node.controlPointHandle, GattWriteCallbackParams::OP_WRITE_REQ, enable, sizeof(enable));
+		dispatch(index);
+		node.state = CENTRAL_READY;
+		_readyTime.add(nowUs - node.scanStartUs);
+		scheduleAlert(index, nowUs);
+	}
+
+	void scheduleAlert(uint32_t index, uint64_t nowUs) {
+		if (_alertPeriodMs == 0) {
+			return;
+		}
+		std::exponential_distribution<double> period(1.0 / (_alertPeriodMs * 1000.0));
+		post(nowUs + 1 + (uint64_t)period(_random), index, SIM_ALERT);
+	}
+
+	void onAlert(uint32_t index, uint64_t nowUs) {
+		CFleetNode &node = *_nodes[index];
+		node.raised.push_back(nowUs);
+		_alertsRaised++;
+		node.device.ans().newAlert(CAlertNotificationServiceServer::ANS_TYPE_SIMPLE_ALERT);
+		dispatch(index);
+		scheduleAlert(index, nowUs);
+	}
+
+	void onConnectionEvent(uint32_t index, uint64_t nowUs) {
+		CFleetNode &node = *_nodes[index];
+		node.channel = (uint8_t)((node.channel + node.hop) % FLEET_DATA_CHANNELS);
+		_connectionEvents++;
+		bool collided = _dataBusyUs[node.channel] > nowUs;
+		unsigned count = collided ? 0 : (unsigned)std::min<size_t>(node.tx.size(), FLEET_PDUS_PER_EVENT);
+		_dataBusyUs[node.channel] =
+			std::max(_dataBusyUs[node.channel], nowUs + FLEET_EVENT_AIRTIME_US + count * FLEET_PDU_AIRTIME_US);
+		if (collided) {
+			_eventsLost++;
+		}
+		for (unsigned ii = 0; ii < count; ii++) {
+			pending_update_t update = node.tx.front();
+			node.tx.pop_front();
+			// an update carries the count of all the alerts raised before it
+			while (update.newAlert && !node.raised.empty() && node.raised.front() <= update.handedUs) {
+				_alertLatency.add(nowUs - node.raised.front());
+				node.raised.pop_front();
+				_alertsDelivered++;
+			}
+		}
+		if (count != 0) {
+			node.device.ble().gattServer().injectDataSent(count);
+			dispatch(index);
+		}
+		post(nowUs + _connectionIntervalUs, index, SIM_CONNECTION);
+	}
+
+	/**
+	 * \brief Finds the ANS handles of a started device and hooks its radio
+	 *
+	 */
+	void attach(CFleetNode &node) {
+		CGattService *ans = node.device.gattServer().getService()[1];
+		for (uint8_t ii = 0; ii < ans->getCharacteristicCount(); ii++) {
+			GattCharacteristic *c = ans->getCharacteristic(ii);
+			uint16_t uuid = c->getValueAttribute().getUUID().getShortUUID();
+			if (uuid == GattCharacteristic::UUID_NEW_ALERT_CHAR) {
+				node.newAlertHandle = c->getValueHandle();
+			} else if (uuid == GattCharacteristic::UUID_ALERT_NOTIFICATION_CONTROL_POINT_CHAR) {
+				node.controlPointHandle = c->getValueHandle();
+			}
+		}
+		CFleetNode *p = &node;
+		host_stack::CClock *clock = &_clock;
+		node.device.ble().gattServer().setOnUpdate([p, clock](GattAttribute::Handle_t handle, const uint8_t *,
+															   uint16_t) {
+			p->tx.push_back(pending_update_t{clock->nowUs(), handle == p->newAlertHandle});
+		});
+	}
+
+  public:
+	CFleet(uint32_t count, uint32_t alertPeriodMs, uint32_t connectionIntervalMs, uint32_t seed)
+		: _clock(host_stack::CClock::instance()), _sequence(0), _random(seed), _alertPeriodMs(alertPeriodMs),
+		  _connectionIntervalUs(connectionIntervalMs * 1000), _startUs(_clock.nowUs()), _advBusyUs(),
+		  _dataBusyUs(), _advPackets(0), _advCollisions(0), _connectionEvents(0), _eventsLost(0), _alertsRaised(0),
+		  _alertsDelivered(0) {
+		for (uint32_t ii = 0; ii < count; ii++) {
+			_nodes.emplace_back(new CFleetNode(ii));
+			post(_startUs + uniform(FLEET_BOOT_SPREAD_US), ii, SIM_BOOT);
+			post(_startUs + uniform(FLEET_SCAN_START_SPREAD_US), ii, SIM_SCAN);
+		}
+	}
+
+	/**
+	 * \brief Runs the simulation
+	 *
+	 * \param seconds The simulated time
+	 */
+	void run(uint32_t seconds) {
+		uint64_t endUs = _startUs + (uint64_t)seconds * 1000000;
+		while (!_events.empty() && _events.top().timeUs <= endUs) {
+			sim_event_t event = _events.top();
+			_events.pop();
+			_clock.advanceTo(event.timeUs);
+			CFleetNode &node = *_nodes[event.node];
+			switch (event.type) {
+			case SIM_BOOT:
+				node.device.start();
+				attach(node);
+				dispatch(event.node);
+				post(event.timeUs + uniform(FLEET_ADV_DELAY_MAX_US), event.node, SIM_ADVERTISING);
+				break;
+			case SIM_SCAN:
+				node.state = CENTRAL_SCANNING;
+				node.scanStartUs = event.timeUs;
+				break;
+			case SIM_ADVERTISING:
+				onAdvertising(event.node, event.timeUs);
+				break;
+			case SIM_CONNECT:
+				onConnect(event.node, event.timeUs);
+				break;
+			case SIM_SECURITY:
+				onSecurity(event.node, event.timeUs);
+				break;
+			case SIM_SUBSCRIBE:
+				onSubscribe(event.node, event.timeUs);
+				break;
+			case SIM_CONNECTION:
+				onConnectionEvent(event.node, event.timeUs);
+				break;
+			case SIM_ALERT:
+				onAlert(event.node, event.timeUs);
+				break;
+			case SIM_TIMER:
+				if (node.timerUs == event.timeUs) {
+					node.timerUs = UINT64_MAX;
+				}
+				dispatch(event.node);
+				break;
+			}
+		}
+		_clock.advanceTo(endUs);
+	}
+
+	/**
+	 * \brief Prints the results of the run
+	 *
+	 * \param seconds The simulated time
+	 * \param wallUs The host time of the run
+	 */
+	void report(uint32_t seconds, uint64_t wallUs) {
+		uint32_t ready = 0;
+		uint64_t dispatched = 0, maxDispatched = 0, busyNs = 0, maxBusyNs = 0;
+		size_t highWater = 0, capacity = 0;
+		uint32_t failed = 0;
+		for (auto &node : _nodes) {
+			ready += node->state == CENTRAL_READY;
+			const event_queue_stats_t &high = node->device.bleQueue().getStats();
+			const event_queue_stats_t &low = node->device.dispatchQueue().getStats();
+			uint64_t events = high.dispatched + low.dispatched;
+			dispatched += events;
+			maxDispatched = std::max(maxDispatched, events);
+			busyNs += node->busyNs;
+			maxBusyNs = std::max(maxBusyNs, node->busyNs);
+			highWater = std::max(highWater, high.highWaterBytes);
+			capacity = high.capacityBytes;
+			failed += high.failed + low.failed;
+		}
+		size_t n = _nodes.size();
+		std::cerr << std::dec << std::fixed << std::setprecision(1) << n << " devices, " << seconds << " s in "
+				  << wallUs / 1000.0 << " ms (" << std::setprecision(0) << seconds * 1e6 / std::max<uint64_t>(wallUs, 1)
+				  << "x real time), " << std::setprecision(1) << ready
+				  << " ready" << std::endl;
+		std::cerr << "  " << std::left << std::setw(22) << "ms" << std::right << std::setw(8) << "count"
+				  << std::setw(10) << "avg" << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10)
+				  << "max" << std::endl;
+		_connectTime.print("connection setup");
+		_readyTime.print("alerts enabled");
+		_alertLatency.print("alert latency");
+		std::cerr << "  air: advertising packets lost " << (_advPackets ? 100.0 * _advCollisions / _advPackets : 0.0)
+				  << "%, connection events lost "
+				  << (_connectionEvents ? 100.0 * _eventsLost / _connectionEvents : 0.0) << "%, alerts delivered "
+				  << _alertsDelivered << "/" << _alertsRaised << std::endl;
+		std::cerr << "  event loop per device: " << (double)dispatched / n / seconds << " events/s avg, "
+				  << (double)maxDispatched / seconds << " max; handlers " << busyNs / 1000.0 / n / seconds
+				  << " us/s avg, " << maxBusyNs / 1000.0 / seconds << " max (host); queue high-water " << highWater
+				  << "/" << capacity << " bytes, " << failed << " failed posts" << std::endl;
+	}
+};
+
+int main(int argc, char *argv[]) {
+	uint32_t maxDevices = (argc > 1) ? atoi(argv[1]) : 256;
+	uint32_t seconds = (argc > 2) ? atoi(argv[2]) : 60;
+	uint32_t alertPeriodMs = (argc > 3) ? atoi(argv[3]) : 2000;
+	uint32_t connectionIntervalMs = (argc > 4) ? atoi(argv[4]) : 30;
+	uint32_t seed = (argc > 5) ? atoi(argv[5]) : 1;
+	host_stack::CClock::instance().setVirtual(true);
+
+	for (uint32_t n = 1; n <= maxDevices; n = (n * 2 > maxDevices && n < maxDevices) ? maxDevices : n * 2) {
+		auto started = std::chrono::steady_clock::now();
+		CFleet fleet(n, alertPeriodMs, connectionIntervalMs, seed);
+		fleet.run(seconds);
+		auto wallUs =
+			std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+		fleet.report(seconds, wallUs);
+	}
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,448 @@
+#ifndef _BLE_GATEWAY_H_
+#define _BLE_GATEWAY_H_
+
+#include "ble_gatt_alert_notification_types.h"
+#include "ble_sim_radio.h"
+
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#define GATEWAY_MAX_IN_FLIGHT 4		//!< Default bound of the ATT operations in flight per link
+#define GATEWAY_PUMP_WINDOW_US 1250 //!< Default batch window of the submission passes, one connection event slot
+
+/**
+ * \brief Statistics of the gateway operations
+ *
+ */
+struct gateway_stats_t {
+	uint64_t submitted;		//!< Operations queued by the application
+	uint64_t completed;		//!< Operations completed successfully
+	uint64_t failed;		//!< Operations completed with an ATT error
+	uint64_t notifications; //!< Notifications received
+	uint64_t latencyTotalUs; //!< Sum of the queue to completion latencies
+	uint64_t latencyMinUs;	 //!< Smallest queue to completion latency
+	uint64_t latencyMaxUs;	 //!< Largest queue to completion latency
+	uint64_t pumps;			 //!< Submission passes over the links that handed operations to the radio
+	uint64_t batched;		 //!< Operations handed to the radio by the submission passes
+};
+
+/**
+ * \brief Host side central that multiplexes GATT operations over many peripheral links
+ * \details Every link has its own queue of asynchronous operations. The gateway keeps at most maxInFlight
+ * 			operations per link in the radio. Only one of them can be a request, because ATT is a sequential
+ * 			request/response protocol on a bearer; the rest are write commands. The operations queued on many
+ * 			links are handed to the radio in one submission pass, so a batch of reads and writes spreads over
+ * 			the connection events of all the links instead of being sent link by link. The radio calls tick()
+ * 			after every connection event, and the pass runs once per batch window, so the completions of the
+ * 			links whose events fall in the same window are submitted together.
+ */
+class CGateway : public CAlertNotificationServiceTypes {
+  public:
+	typedef std::function<void(uint16_t link, uint8_t status, const att_pdu_t &pdu)> OpCallback;
+	typedef std::function<void(uint16_t link, bool newAlert, alert_status_t status)> AlertCallback;
+	typedef std::function<void(uint16_t link, const att_pdu_t &pdu)> SendFunction;
+	typedef std::function<uint64_t()> ClockFunction;
+
+	/**
+	 * \brief An asynchronous ATT operation
+	 *
+	 */
+	struct op_t {
+		att_pdu_t pdu;		 //!< The PDU sent to the peripheral
+		OpCallback done;	 //!< Called with the response, the error or after sending a command
+		uint64_t queuedUs;	 //!< The time the operation was queued
+	};
+
+	/**
+	 * \brief A set of operations on many links, submitted in one pass
+	 *
+	 */
+	class CBatch {
+		friend class CGateway;
+		std::vector<std::pair<uint16_t, op_t>> _ops;
+
+	  public:
+		void read(uint16_t link, uint16_t handle, OpCallback done = OpCallback()) {
+			_ops.push_back(std::make_pair(link, makeOp(ATT_READ_REQ, handle, NULL, 0, done)));
+		}
+		void write(uint16_t link,
+				   uint16_t handle,
+				   const void *value,
+				   uint8_t length,
+				   bool withResponse = true,
+				   OpCallback done = OpCallback()) {
+			_ops.push_back(
+				std::make_pair(link, makeOp(withResponse ? ATT_WRITE_REQ : ATT_WRITE_CMD, handle, value, length, done)));
+		}
+		size_t size() const { return _ops.size(); }
+		void clear() { _ops.clear(); }
+	};
+
+  private:
+	/**
+	 * \brief The state of a peripheral link
+	 *
+	 */
+	struct link_t {
+		bool connected;
+		ans_handles_t handles;		 //!< The ANS handles of the peripheral
+		std::deque<op_t> queue;		 //!< Operations waiting for an in-flight slot
+		std::deque<op_t> sending;	 //!< Operations handed to the radio, not sent yet
+		std::deque<op_t> responding; //!< Requests sent, waiting for the response
+		bool requestInFlight;		 //!< Set while a request is sending or waiting for the response
+		bool dirty;					 //!< Set while the link is in the submission list
+	};
+
+	std::vector<link_t> _links;
+	std::vector<uint16_t> _dirty; //!< Links with queued operations, visited by the next submission pass
+	unsigned _maxInFlight;
+	uint32_t _pumpWindowUs; //!< The batch window of the submission passes
+	uint64_t _lastPumpUs;	//!< The time of the last submission pass
+	SendFunction _send;
+	ClockFunction _clock;
+	AlertCallback _onAlert;
+	gateway_stats_t _stats;
+
+	static op_t makeOp(uint8_t opcode, uint16_t handle, const void *value, uint8_t length, OpCallback done) {
+		op_t op;
+		op.pdu = att_pdu_t();
+		op.pdu.opcode = opcode;
+		op.pdu.handle = handle;
+		op.pdu.length = (length > ATT_MAX_VALUE_SIZE) ? ATT_MAX_VALUE_SIZE : length;
+		if (value != NULL) {
+			memcpy(op.pdu.value, value, op.pdu.length);
+		}
+		op.done = done;
+		op.queuedUs = 0;
+		return op;
+	}
+
+	void enqueue(uint16_t link, op_t &op) {
+		op.queuedUs = _clock();
+		_stats.submitted++;
+		if (link >= _links.size() || !_links[link].connected) {
+			att_pdu_t none = att_pdu_t();
+			complete(link, op, ATT_ERR_INVALID_HANDLE, none);
+			return;
+		}
+		_links[link].queue.push_back(op);
+		markDirty(link);
+	}
+
+	void markDirty(uint16_t link) {
+		if (!_links[link].dirty) {
+			_links[link].dirty = true;
+			_dirty.push_back(link);
+		}
+	}
+
+	void complete(uint16_t link, op_t &op, uint8_t status, const att_pdu_t &pdu) {
+		uint64_t latency = _clock() - op.queuedUs;
+		_stats.latencyTotalUs += latency;
+		_stats.latencyMinUs = (latency < _stats.latencyMinUs) ? latency : _stats.latencyMinUs;
+		_stats.latencyMaxUs = (latency > _stats.latencyMaxUs) ? latency : _stats.latencyMaxUs;
+		if (status == ATT_SUCCESS) {
+			_stats.completed++;
+		} else {
+			_stats.failed++;
+		}
+		if (op.done) {
+			op.done(link, status, pdu);
+		}
+	}
+
+	static bool isRequest(const op_t &op) { return op.pdu.opcode != ATT_WRITE_CMD; }
+
+	/**
+	 * \brief The ANS handles of a peripheral, all 0 for a link never attached
+	 *
+	 */
+	const ans_handles_t &handles(uint16_t link) const {
+		static const ans_handles_t none = ans_handles_t();
+		return (link < _links.size()) ? _links[link].handles : none;
+	}
+
+  public:
+	/**
+	 * \brief Construct a new CGateway object
+	 *
+	 * \param send The function that hands a PDU to the radio
+	 * \param clock The time source of the latency statistics, in microseconds
+	 * \param maxInFlight The bound of the ATT operations in flight per link
+	 * \param pumpWindowUs The batch window of the submission passes run by tick(), 0 for a pass per tick
+	 */
+	CGateway(SendFunction send,
+			 ClockFunction clock,
+			 unsigned maxInFlight = GATEWAY_MAX_IN_FLIGHT,
+			 uint32_t pumpWindowUs = GATEWAY_PUMP_WINDOW_US)
+		: _maxInFlight(maxInFlight ? maxInFlight : 1), _pumpWindowUs(pumpWindowUs), _lastPumpUs(0), _send(send),
+		  _clock(clock) {
+		resetStats();
+	}
+
+	/**
+	 * \brief Adds a connected peripheral
+	 *
+	 * \param link The connection handle
+	 * \param handles The discovered ANS handles of the peripheral
+	 */
+	void attach(uint16_t link, const ans_handles_t &handles) {
+		if (link >= _links.size()) {
+			_links.resize(link + 1);
+		}
+		link_t &l = _links[link];
+		l = link_t();
+		l.connected = true;
+		l.handles = handles;
+	}
+
+	/**
+	 * \brief Removes a disconnected peripheral. The pending operations fail, a link never attached is ignored.
+	 *
+	 */
+	void detach(uint16_t link) {
+		if (link >= _links.size()) {
+			return;
+		}
+		link_t &l = _links[link];
+		att_pdu_t none = att_pdu_t();
+		std::deque<op_t> pending;
+		pending.swap(l.responding);
+		pending.insert(pending.end(), l.sending.begin(), l.sending.end());
+		pending.insert(pending.end(), l.queue.begin(), l.queue.end());
+		l.sending.clear();
+		l.queue.clear();
+		l.connected = false;
+		l.requestInFlight = false;
+		// the link is marked disconnected first, so operations queued by the callbacks fail at once
+		for (op_t &op : pending) {
+			complete(link, op, ATT_ERR_INVALID_HANDLE, none);
+		}
+	}
+
+	/**
+	 * \brief Queues a read of an attribute
+	 *
+	 */
+	void read(uint16_t link, uint16_t handle, OpCallback done = OpCallback()) {
+		op_t op = makeOp(ATT_READ_REQ, handle, NULL, 0, done);
+		enqueue(link, op);
+	}
+
+	/**
+	 * \brief Queues a write of an attribute
+	 *
+	 * \param withResponse True for a Write Request, False for a Write Command
+	 */
+	void write(uint16_t link,
+			   uint16_t handle,
+			   const void *value,
+			   uint8_t length,
+			   bool withResponse = true,
+			   OpCallback done = OpCallback()) {
+		op_t op = makeOp(withResponse ? ATT_WRITE_REQ : ATT_WRITE_CMD, handle, value, length, done);
+		enqueue(link, op);
+	}
+
+	/**
+	 * \brief Queues the operations of a batch and hands them to the radio in one pass
+	 *
+	 */
+	void submit(CBatch &batch) {
+		for (auto &entry : batch._ops) {
+			enqueue(entry.first, entry.second);
+		}
+		batch.clear();
+		pump();
+	}
+
+	/**
+	 * \brief Subscribes to the New Alert and Unread Alert Status notifications of a peripheral
+	 *
+	 */
+	void ansSubscribe(uint16_t link, OpCallback done = OpCallback()) {
+		uint16_t cccd = 0x0001;
+		write(link, handles(link).newAlertCccd, &cccd, sizeof(cccd));
+		write(link, handles(link).unreadAlertStatusCccd, &cccd, sizeof(cccd), true, done);
+	}
+
+	/**
+	 * \brief Writes a command to the ANS control point of a peripheral
+	 *
+	 */
+	void ansControlPoint(uint16_t link, CommandId command, CategoryId category, OpCallback done = OpCallback()) {
+		control_point_t cp;
+		cp.fields.command = (uint8_t)command;
+		cp.fields.category = (uint8_t)category;
+		write(link, handles(link).controlPoint, &cp.value, sizeof(cp.value), true, done);
+	}
+
+	/**
+	 * \brief Reads the supported new alert categories of a peripheral
+	 *
+	 */
+	void ansReadSupportedNewAlerts(uint16_t link, std::function<void(uint16_t link, uint16_t categories)> done) {
+		read(link, handles(link).supportedNewAlertCategory,
+			 [done](uint16_t link, uint8_t status, const att_pdu_t &pdu) {
+				 uint16_t categories = 0;
+				 if (status == ATT_SUCCESS && pdu.length >= sizeof(categories)) {
+					 memcpy(&categories, pdu.value, sizeof(categories));
+				 }
+				 if (done) {
+					 done(link, categories);
+				 }
+			 });
+	}
+
+	/**
+	 * \brief Hands the queued operations of the links to the radio, within the in-flight bound of each link
+	 *
+	 */
+	void pump() {
+		_lastPumpUs = _clock();
+		if (_dirty.empty()) {
+			return;
+		}
+		uint64_t batched = _stats.batched;
+		std::vector<uint16_t> dirty;
+		dirty.swap(_dirty);
+		for (uint16_t link : dirty) {
+			link_t &l = _links[link];
+			l.dirty = false;
+			while (!l.queue.empty() && l.sending.size() + l.responding.size() < _maxInFlight) {
+				op_t &op = l.queue.front();
+				if (isRequest(op) && l.requestInFlight) {
+					break;
+				}
+				l.requestInFlight |= isRequest(op);
+				_send(link, op.pdu);
+				l.sending.push_back(op);
+				l.queue.pop_front();
+				_stats.batched++;
+			}
+		}
+		// a pass over links that are all at their bound hands nothing to the radio
+		if (_stats.batched != batched) {
+			_stats.pumps++;
+		}
+	}
+
+	/**
+	 * \brief Called by the radio after every connection event. Runs a submission pass once per batch window,
+	 * 		  instead of a pass for the one link whose event has just completed.
+	 *
+	 */
+	void tick() {
+		if (_clock() - _lastPumpUs >= _pumpWindowUs) {
+			pump();
+		}
+	}
+
+	/**
+	 * \brief Called by the radio when PDUs of a link have been sent in a connection event
+	 *
+	 * \param link The connection handle
+	 * \param sent Number of PDUs sent
+	 */
+	void onSent(uint16_t link, unsigned sent) {
+		if (link >= _links.size()) {
+			return;
+		}
+		link_t &l = _links[link];
+		att_pdu_t none = att_pdu_t();
+		for (unsigned ii = 0; ii < sent && !l.sending.empty(); ii++) {
+			op_t &op = l.sending.front();
+			if (isRequest(op)) {
+				l.responding.push_back(op);
+			} else {
+				// a command completes when it is on the air
+				complete(link, op, ATT_SUCCESS, none);
+			}
+			l.sending.pop_front();
+		}
+		markDirty(link);
+	}
+
+	/**
+	 * \brief Called by the radio for every PDU received from a peripheral
+	 *
+	 */
+	void onReceive(uint16_t link, const att_pdu_t &pdu) {
+		if (link >= _links.size()) {
+			return;
+		}
+		link_t &l = _links[link];
+		if (pdu.opcode == ATT_HANDLE_VALUE_NTF) {
+			_stats.notifications++;
+			if (_onAlert && (pdu.handle == l.handles.newAlert || pdu.handle == l.handles.unreadAlertStatus)) {
+				alert_status_t status;
+				memcpy(&status.value, pdu.value, sizeof(status.value));
+				_onAlert(link, pdu.handle == l.handles.newAlert, status);
+			}
+			return;
+		}
+		if (l.responding.empty()) {
+			std::cout << "Unexpected ATT response 0x" << std::hex << (int)pdu.opcode << std::dec << " on link "
+					  << link << std::endl;
+			return;
+		}
+		op_t op = l.responding.front();
+		l.responding.pop_front();
+		l.requestInFlight = false;
+		complete(link, op, (pdu.opcode == ATT_ERROR_RSP) ? pdu.status : (uint8_t)ATT_SUCCESS, pdu);
+		markDirty(link);
+	}
+
+	/**
+	 * \brief Sets the callback that receives the ANS notifications
+	 *
+	 */
+	void setOnAlert(AlertCallback callback) { _onAlert = callback; }
+
+	/**
+	 * \brief Number of operations queued or in flight on a link
+	 *
+	 */
+	size_t pending(uint16_t link) const {
+		if (link >= _links.size()) {
+			return 0;
+		}
+		const link_t &l = _links[link];
+		return l.queue.size() + l.sending.size() + l.responding.size();
+	}
+
+	const gateway_stats_t &getStats() const { return _stats; }
+
+	void resetStats() {
+		memset(&_stats, 0, sizeof(_stats));
+		_stats.latencyMinUs = UINT64_MAX;
+	}
+
+	/**
+	 * \brief Prints the aggregate statistics
+	 *
+	 * \param elapsedUs The time the statistics cover
+	 */
+	void printStats(uint64_t elapsedUs) const {
+		uint64_t done = _stats.completed + _stats.failed;
+		double seconds = elapsedUs / 1e6;
+		std::cout << "Gateway: " << _links.size() << " links, " << done << " operations ("
+				  << _stats.failed << " failed), " << _stats.notifications << " notifications" << std::endl;
+		if (seconds > 0) {
+			std::cout << "\t" << (uint64_t)(done / seconds) << " operations/s, "
+					  << (uint64_t)(_stats.notifications / seconds) << " notifications/s" << std::endl;
+		}
+		if (done != 0) {
+			std::cout << "\tlatency avg " << _stats.latencyTotalUs / done << " us min " << _stats.latencyMinUs
+					  << " us max " << _stats.latencyMaxUs << " us" << std::endl;
+		}
+		if (_stats.pumps != 0) {
+			std::cout << "\t" << (double)_stats.batched / _stats.pumps << " operations per submission pass" << std::endl;
+		}
+	}
+};
+
+#endif //!_BLE_GATEWAY_H_
@@ -0,0 +1,114 @@
+/**
+ * \file ble_gateway_bench.cpp
+ * \brief Runs the gateway against the simulated radio and reports the aggregate operation rate
+ * \details Build and run on the host:
+ * 			g++ -std=c++14 -O2 -I.. -I. ble_gateway_bench.cpp -o ble_gateway_bench
+ * 			./ble_gateway_bench [links] [seconds] [max in flight] [connection interval us] [batch window us]
+ */
+#include "ble_gateway.h"
+#include "ble_sim_radio.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#define BENCH_OPS_PER_LINK 8 //!< Operations kept queued on each link by the workload
+
+/**
+ * \brief Closed loop workload: every completed operation queues the next one on the same link
+ *
+ */
+class CGatewayBench : public CAlertNotificationServiceTypes {
+  private:
+	CSimRadio &_radio;
+	CGateway &_gateway;
+	unsigned _step;
+
+  public:
+	CGatewayBench(CSimRadio &radio, CGateway &gateway) : _radio(radio), _gateway(gateway), _step(0) {}
+
+	/**
+	 * \brief Queues the next operation of the mix on a link
+	 *
+	 */
+	void issue(uint16_t link) {
+		CGateway::OpCallback next = [this](uint16_t link, uint8_t, const att_pdu_t &) { issue(link); };
+		control_point_t cp;
+		switch (_step++ % 4) {
+		case 0:
+			_gateway.read(link, _radio.getAnsHandles(link).supportedNewAlertCategory, next);
+			break;
+		case 1:
+			cp.fields.command = ANS_NOTIFY_NEW_INCOMING_ALERT_IMMEDIATELY;
+			cp.fields.category = (uint8_t)(_step % 10);
+			_gateway.write(link, _radio.getAnsHandles(link).controlPoint, &cp.value, sizeof(cp.value), true, next);
+			break;
+		default:
+			// the control point also accepts write commands, which pipeline behind the request
+			cp.fields.command = ANS_ENABLE_UNREAD_CATEGORY_STATUS_NOTIFICATION;
+			cp.fields.category = (uint8_t)(_step % 10);
+			_gateway.write(link, _radio.getAnsHandles(link).controlPoint, &cp.value, sizeof(cp.value), false, next);
+			break;
+		}
+	}
+};
+
+int main(int argc, char *argv[]) {
+	unsigned links = (argc > 1) ? atoi(argv[1]) : 200;
+	unsigned seconds = (argc > 2) ? atoi(argv[2]) : 10;
+	unsigned maxInFlight = (argc > 3) ? atoi(argv[3]) : GATEWAY_MAX_IN_FLIGHT;
+	unsigned intervalUs = (argc > 4) ? atoi(argv[4]) : SIM_CONNECTION_INTERVAL_US;
+	unsigned windowUs = (argc > 5) ? atoi(argv[5]) : GATEWAY_PUMP_WINDOW_US;
+
+	CSimRadio radio(intervalUs);
+	CGateway gateway([&radio](uint16_t link, const att_pdu_t &pdu) { radio.send(link, pdu); },
+					 [&radio]() { return radio.nowUs(); }, maxInFlight, windowUs);
+	radio.setOnReceive([&gateway](uint16_t link, const att_pdu_t &pdu) { gateway.onReceive(link, pdu); });
+	radio.setOnSent([&gateway](uint16_t link, unsigned sent) { gateway.onSent(link, sent); });
+
+	// connect and configure every peripheral in one batch
+	CGateway::CBatch batch;
+	for (unsigned ii = 0; ii < links; ii++) {
+		uint16_t link = radio.connect();
+		ans_handles_t handles = radio.getAnsHandles(link);
+		gateway.attach(link, handles);
+		uint16_t cccd = 0x0001;
+		CAlertNotificationServiceTypes::control_point_t cp;
+		cp.fields.command = CAlertNotificationServiceTypes::ANS_ENABLE_NEW_INCOMING_ALERT_NOTIFICATION;
+		cp.fields.category = CAlertNotificationServiceTypes::ANS_TYPE_ALL_ALERTS;
+		batch.write(link, handles.newAlertCccd, &cccd, sizeof(cccd));
+		batch.write(link, handles.unreadAlertStatusCccd, &cccd, sizeof(cccd));
+		batch.write(link, handles.controlPoint, &cp.value, sizeof(cp.value));
+	}
+	gateway.submit(batch);
+	radio.run(radio.nowUs() + 10 * intervalUs, [&gateway]() { gateway.tick(); });
+	std::cout << "Configured " << links << " links in " << radio.nowUs() / 1000 << " ms" << std::endl;
+
+	CGatewayBench bench(radio, gateway);
+	gateway.resetStats();
+	for (unsigned ii = 0; ii < links; ii++) {
+		for (unsigned jj = 0; jj < BENCH_OPS_PER_LINK; jj++) {
+			bench.issue((uint16_t)ii);
+		}
+	}
+	uint64_t startUs = radio.nowUs();
+	unsigned alerts = 0;
+	auto wallStart = std::chrono::steady_clock::now();
+	for (uint64_t t = startUs; t < startUs + seconds * 1000000ULL; t += 100000) {
+		// a new alert on every tenth peripheral every 100 ms
+		for (unsigned ii = alerts % 10; ii < links; ii += 10) {
+			radio.raiseAlert((uint16_t)ii, CAlertNotificationServiceTypes::ANS_TYPE_EMAIL);
+		}
+		alerts++;
+		radio.run(t + 100000, [&gateway]() { gateway.tick(); });
+	}
+	auto wallUs =
+		std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - wallStart).count();
+
+	std::cout << "Simulated " << seconds << " s, " << radio.pdus() << " PDUs, connection interval " << intervalUs
+			  << " us, " << maxInFlight << " operations in flight per link, batch window " << windowUs << " us"
+			  << std::endl;
+	gateway.printStats(radio.nowUs() - startUs);
+	std::cout << "Wall clock " << wallUs / 1000 << " ms" << std::endl;
+	return 0;
+}
@@ -0,0 +1,217 @@
+/**
+ * \file ble_gatt_client_exercise.cpp
+ * \brief Runs CGattClient against the homework device on the host stack
+ * \details A central stack with the GATT client connects to a CHostDevice, whose GattServer is attached as the
+ * 			peer of the GattClient of the central. The exercise goes through:
+ * 			- the discovery of the device layout, stored into the cache file
+ * 			- a reconnection of a new client, which restores the cache file and validates it with the Database Hash
+ * 			- a Service Changed indication of the device, which invalidates the cache and runs the discovery
+ * 			  again
+ * 			- the rejection of a cache blob whose characteristic refers to a service it does not have
+ * 			- the allocation of the cache entries while the attached links have pinned them
+ * 			The failed checks go to stderr, the output of the classes to stdout. Build and run on the host:
+ * 			g++ -std=c++14 -O2 -I.. -Istack ble_gatt_client_exercise.cpp -o ble_gatt_client_exercise
+ * 			./ble_gatt_client_exercise [cache file] > /dev/null
+ */
+#include "ble_gatt_client.h"
+#include "ble_host_device.h"
+
+#include <cstdio>
+#include <iostream>
+
+#define EXERCISE_CONNECTION 1		//!< The connection handle on both stacks
+#define EXERCISE_DISPATCH_ROUNDS 32 //!< The event loop rounds run for each step
+
+static const uint8_t centralAddress[6] = {0x01, 0x00, 0x00, 0x00, 0xE0, 0xC0};
+static const uint8_t deviceAddress[6] = {0x02, 0x00, 0x00, 0x00, 0xE0, 0xC0};
+static unsigned failures = 0;
+
+static void check(bool condition, const char *what) {
+	if (!condition) {
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+/**
+ * \brief The central: its own stack, the event queue of the application and the GATT client
+ *
+ */
+class CCentral : private mbed::NonCopyable<CCentral> {
+  private:
+	BLE _ble;
+	CStaticEventQueue<HOST_EVENT_QUEUE_SIZE> _queue;
+	CGattClient _client;
+
+	void onReady(ble::connection_handle_t connection, bool fromCache) {
+		(void)connection;
+		(fromCache ? readyFromCache : readyAfterDiscovery)++;
+	}
+
+  public:
+	unsigned readyAfterDiscovery;
+	unsigned readyFromCache;
+
+	CCentral(const char *cacheFilepath)
+		: _ble(), _queue(), _client(_ble, _queue, cacheFilepath), readyAfterDiscovery(0), readyFromCache(0) {
+		_client.setOnReady(callback(this, &CCentral::onReady));
+		_client.start();
+	}
+
+	/**
+	 * \brief Connects to the device and attaches it to the client
+	 *
+	 */
+	void connect(CHostDevice &device) {
+		device.ble().gap().injectConnection(EXERCISE_CONNECTION, ble::peer_address_type_t::PUBLIC,
+											ble::address_t(centralAddress));
+		_ble.gattClient().attachPeer(EXERCISE_CONNECTION, device.ble().gattServer());
+		run(device);
+		ble_error_t error =
+			_client.attach(EXERCISE_CONNECTION, ble::peer_address_type_t::PUBLIC, ble::address_t(deviceAddress));
+		check(error == BLE_ERROR_NONE, "attach");
+		run(device);
+	}
+
+	void disconnect(CHostDevice &device) {
+		_client.detach(EXERCISE_CONNECTION);
+		_ble.gattClient().detachPeer(EXERCISE_CONNECTION);
+		device.ble().gap().injectDisconnection(EXERCISE_CONNECTION,
+												ble::disconnection_reason_t::REMOTE_USER_TERMINATED_CONNECTION);
+		run(device);
+	}
+
+	/**
+	 * \brief Runs the events of both sides, the requests run on the device and the responses on the central
+	 *
+	 */
+	void run(CHostDevice &device) {
+		for (int ii = 0; ii < EXERCISE_DISPATCH_ROUNDS; ii++) {
+			device.dispatch(0);
+			_ble.processEvents();
+			_queue.dispatch(0);
+		}
+	}
+
+	CGattClient &client() { return _client; }
+};
+
+/**
+ * \brief Discovery, cache restore and Service Changed invalidation against the device
+ *
+ */
+static void exerciseDevice(const char *cacheFilepath) {
+	CHostDevice device;
+	check(device.start(), "device start");
+	remove(cacheFilepath);
+
+	uint16_t serviceChangedHandle = GattAttribute::INVALID_HANDLE;
+	{
+		CCentral central(cacheFilepath);
+		central.connect(device);
+		check(central.readyAfterDiscovery == 1 && central.readyFromCache == 0, "ready after the discovery");
+		const CGattClientCache::characteristic_t *hash =
+			central.client().findCharacteristic(EXERCISE_CONNECTION, UUID_GENERIC_ATTRIBUTE_SERVICE,
+												UUID_DATABASE_HASH_CHAR);
+		check(hash != nullptr, "Database Hash discovered");
+		const CGattClientCache::characteristic_t *serviceChanged =
+			central.client().findCharacteristic(EXERCISE_CONNECTION, UUID_GENERIC_ATTRIBUTE_SERVICE,
+												GattCharacteristic::UUID_SERVICE_CHANGED_CHAR);
+		check(serviceChanged != nullptr && serviceChanged->cccdHandle != GattAttribute::INVALID_HANDLE,
+			  "Service Changed and its CCCD discovered");
+		if (serviceChanged != nullptr) {
+			serviceChangedHandle = serviceChanged->valueHandle;
+			check(device.ble().gattServer().getClientConfiguration(serviceChangedHandle) == CCCD_INDICATIONS,
+				  "Service Changed subscribed");
+		}
+		check(central.client().findCharacteristic(EXERCISE_CONNECTION, GattService::UUID_IMMEDIATE_ALERT_SERVICE,
+												  GattCharacteristic::UUID_ALERT_LEVEL_CHAR) != nullptr,
+			  "Alert Level discovered");
+		central.disconnect(device);
+	}
+	{
+		// a new client, as after a reset of the central, restores the cache file
+		CCentral central(cacheFilepath);
+		central.connect(device);
+		check(central.readyFromCache == 1 && central.readyAfterDiscovery == 0, "ready from the restored cache");
+		check(serviceChangedHandle != GattAttribute::INVALID_HANDLE &&
+				  device.ble().gattServer().getClientConfiguration(serviceChangedHandle) == CCCD_INDICATIONS,
+			  "Service Changed subscribed from the cache");
+
+		// the device indicates the whole handle range as changed
+		uint8_t range[4] = {0x01, 0x00, 0xFF, 0xFF};
+		ble_error_t error = device.ble().gattServer().write(serviceChangedHandle, range, sizeof(range));
+		check(error == BLE_ERROR_NONE, "Service Changed indicated");
+		central.run(device);
+		check(central.readyAfterDiscovery == 1, "discovered again after Service Changed");
+		check(central.client().findCharacteristic(EXERCISE_CONNECTION, UUID_GENERIC_ATTRIBUTE_SERVICE,
+												  UUID_DATABASE_HASH_CHAR) != nullptr,
+			  "Database Hash discovered again");
+		central.disconnect(device);
+	}
+	{
+		// the discovery after Service Changed has stored the new layout
+		CCentral central(cacheFilepath);
+		central.connect(device);
+		check(central.readyFromCache == 1, "ready from the cache stored after Service Changed");
+		central.disconnect(device);
+	}
+	remove(cacheFilepath);
+}
+
+/**
+ * \brief A characteristic that refers to a service out of the entry is rejected
+ *
+ */
+static void exerciseCorruptCache() {
+	CGattClientCache cache;
+	CGattClientCache::entry_t *entry = cache.allocate(ble::peer_address_type_t::PUBLIC, ble::address_t(deviceAddress));
+	entry->serviceCount = 1;
+	entry->services[0] = {UUID_GENERIC_ATTRIBUTE_SERVICE, 1, 9};
+	entry->characteristicCount = 1;
+	entry->characteristics[0] = {GattCharacteristic::UUID_SERVICE_CHANGED_CHAR,
+								 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE, 0, 3, 4};
+	entry->valid = true;
+
+	static uint8_t blob[GATT_CLIENT_CACHE_MAX_SIZE];
+	size_t length = cache.serialize(blob, sizeof(blob));
+	CGattClientCache restored;
+	check(restored.deserialize(blob, length), "valid blob restored");
+	// header, entry header, one service, then the service index of the characteristic
+	blob[4 + 27 + 6 + 3] = 1;
+	check(!restored.deserialize(blob, length), "service index out of the entry rejected");
+	check(restored.find(ble::peer_address_type_t::PUBLIC, ble::address_t(deviceAddress)) == nullptr,
+		  "rejected blob leaves the cache empty");
+}
+
+/**
+ * \brief The entries of the attached links are not replaced
+ *
+ */
+static void exercisePinnedEntries() {
+	CGattClientCache cache;
+	CGattClientCache::entry_t *entries[GATT_CLIENT_CACHE_PEERS];
+	uint8_t address[6] = {0x10, 0x00, 0x00, 0x00, 0xE0, 0xC0};
+	for (int ii = 0; ii < GATT_CLIENT_CACHE_PEERS; ii++, address[0]++) {
+		entries[ii] = cache.allocate(ble::peer_address_type_t::PUBLIC, ble::address_t(address));
+		check(entries[ii] != nullptr, "entry allocated");
+		CGattClientCache::pin(*entries[ii]);
+	}
+	check(cache.allocate(ble::peer_address_type_t::PUBLIC, ble::address_t(address)) == nullptr,
+		  "allocation fails when all the entries are pinned");
+	entries[0]->valid = true;
+	entries[1]->valid = true;
+	CGattClientCache::unpin(*entries[1]);
+	CGattClientCache::entry_t *entry = cache.allocate(ble::peer_address_type_t::PUBLIC, ble::address_t(address));
+	check(entry == entries[1], "allocation replaces the unpinned entry");
+	check(entries[0]->valid, "pinned entry kept");
+}
+
+int main(int argc, char *argv[]) {
+	const char *cacheFilepath = (argc > 1) ? argv[1] : "gatt_client_cache.bin";
+	exerciseDevice(cacheFilepath);
+	exerciseCorruptCache();
+	exercisePinnedEntries();
+	std::cerr << (failures == 0 ? "GATT client exercise passed" : "GATT client exercise failed") << std::endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+/**
+ * \file ble_gatt_coro_exercise.cpp
+ * \brief Runs the GATT coroutines of CGattCoro on the host stack
+ * \details A GATT server with a test service of three notify and one indicate characteristics, the coroutines
+ * 			co_await the updates and the connection. The exercise checks that:
+ * 			- a sent notification resumes only the coroutine waiting for its handle, in submission order, also
+ * 			  behind a notification sent without a coroutine
+ * 			- a confirmation resumes the indication and still reaches the callback set before CGattCoro
+ * 			- a connection while the event queue is full keeps its result, the resumption is retried by the
+ * 			  timer without an other GATT event
+ * 			- a disconnection ends the waits with BLE_ERROR_INVALID_STATE
+ * 			The failed checks go to stderr, the output of the classes to stdout. Build and run on the host:
+ * 			g++ -std=c++20 -O2 -I.. -Istack ble_gatt_coro_exercise.cpp -o ble_gatt_coro_exercise
+ * 			./ble_gatt_coro_exercise > /dev/null
+ */
+#include "ble_event_queue.h"
+#include "ble_gatt_client.h"
+#include "ble_gatt_coro.h"
+#include "ble_gatt_server.h"
+
+#include <iostream>
+
+#if !defined(__cpp_impl_coroutine)
+#error "Build with -std=c++20"
+#endif
+
+#define EXERCISE_QUEUE_SIZE (16 * EVENTS_EVENT_SIZE) //!< The application queue the coroutines resume on
+
+static unsigned failures = 0;
+
+static void check(bool condition, const char *what) {
+	if (!condition) {
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+/**
+ * \brief The test service
+ *
+ */
+class CExerciseService : public CGattService {
+  public:
+	CNotifyOnlyCharacteristic<uint16_t> first;
+	CNotifyOnlyCharacteristic<uint16_t> second;
+	CNotifyOnlyCharacteristic<uint16_t> plain; //!< Notified without a coroutine
+	CIndicateOnlyCharacteristic<uint16_t> indicated;
+
+  private:
+	GattCharacteristic *_characteristics[4];
+
+  public:
+	CExerciseService()
+		: CGattService(UUID(0xFFF0), _characteristics, 4), first(UUID(0xFFF1), 0), second(UUID(0xFFF2), 0),
+		  plain(UUID(0xFFF3), 0), indicated(UUID(0xFFF4), 0),
+		  _characteristics{&first, &second, &plain, &indicated} {}
+
+	virtual void onConnection() override {}
+	virtual void onDisconnection() override {}
+	virtual void onWrite(uint16_t handle) override { (void)handle; }
+	virtual void onRead(uint16_t handle) override { (void)handle; }
+	virtual void enableAuthentication(bool enable = true) override { (void)enable; }
+};
+
+/**
+ * \brief CGattCoro with the retry timer at hand, the host timers fire when the tool says so
+ *
+ */
+class CExerciseCoro : public CGattCoro {
+  public:
+	CExerciseCoro(CGattServer &server, CEventQueue &eventQueue) : CGattCoro(server, eventQueue) {}
+	void fireRetryTimer() { _retryTimer.fire(); }
+};
+
+/**
+ * \brief The result of a co_await
+ *
+ */
+struct wait_result_t {
+	bool done;
+	ble_error_t error;
+};
+
+static CGattTask notify(CGattCoro &coro, CCharacteristic<uint16_t> &characteristic, uint16_t value,
+						wait_result_t &result) {
+	result.error = co_await coro.set(characteristic, value);
+	result.done = true;
+}
+
+static CGattTask indicate(CGattCoro &coro, CCharacteristic<uint16_t> &characteristic, uint16_t value,
+						  wait_result_t &result) {
+	result.error = co_await coro.indicate(characteristic, value);
+	result.done = true;
+}
+
+static CGattTask connection(CGattCoro &coro, wait_result_t &result) {
+	result.error = co_await coro.waitForConnection();
+	result.done = true;
+}
+
+static BLE stackBle;
+static CStaticEventQueue<EXERCISE_QUEUE_SIZE> queue;
+static unsigned confirmations = 0;
+
+/**
+ * \brief Runs the events of the stack, then the resumptions on the queue
+ *
+ */
+static void run() {
+	stackBle.processEvents();
+	queue.dispatch(0);
+}
+
+static void onConfirmation(uint16_t handle) {
+	(void)handle;
+	confirmations++;
+}
+
+int main() {
+	CExerciseService service;
+	CGattServer server(stackBle, queue, {&service});
+	server.start();
+	GattServer &stack = stackBle.gattServer();
+	// the callback set before CGattCoro is chained
+	server.setOnConfirmation(callback(onConfirmation));
+	CExerciseCoro coro(server, queue);
+
+	wait_result_t connected = {false, BLE_ERROR_UNSPECIFIED};
+	connection(coro, connected);
+	check(!connected.done, "waits for the connection");
+	// the queue is full when the connection wakes the coroutine
+	while (queue.call([]() {}) != 0) {
+	}
+	server.onConnection();
+	queue.dispatch(0);
+	check(!connected.done, "resumption refused by the full queue");
+	coro.fireRetryTimer();
+	queue.dispatch(0);
+	check(connected.done && connected.error == BLE_ERROR_NONE, "connection resumed by the retry with its result");
+
+	stack.injectSubscription(service.first.getValueHandle(), CCCD_NOTIFICATIONS);
+	stack.injectSubscription(service.second.getValueHandle(), CCCD_NOTIFICATIONS);
+	stack.injectSubscription(service.plain.getValueHandle(), CCCD_NOTIFICATIONS);
+	stack.injectSubscription(service.indicated.getValueHandle(), CCCD_INDICATIONS);
+	run();
+
+	wait_result_t first = {false, BLE_ERROR_UNSPECIFIED};
+	wait_result_t second = {false, BLE_ERROR_UNSPECIFIED};
+	check(service.plain.set(&stack, 1) == BLE_ERROR_NONE, "notification without a coroutine");
+	notify(coro, service.second, 2, second);
+	notify(coro, service.first, 3, first);
+	stack.injectDataSent(1);
+	run();
+	check(!first.done && !second.done, "the notification without a coroutine resumes none");
+	stack.injectDataSent(1);
+	run();
+	check(second.done && !first.done, "the older notification resumes its coroutine only");
+	stack.injectDataSent(1);
+	run();
+	check(first.done && first.error == BLE_ERROR_NONE, "the next notification resumes its coroutine");
+
+	wait_result_t indication = {false, BLE_ERROR_UNSPECIFIED};
+	indicate(coro, service.indicated, 4, indication);
+	stack.injectDataSent(1);
+	run();
+	check(!indication.done, "an indication waits for the confirmation");
+	stack.injectConfirmation(service.indicated.getValueHandle());
+	run();
+	check(indication.done && indication.error == BLE_ERROR_NONE, "the confirmation resumes the indication");
+	check(confirmations == 1, "the confirmation reaches the chained callback");
+
+	wait_result_t lost = {false, BLE_ERROR_UNSPECIFIED};
+	notify(coro, service.first, 5, lost);
+	server.onDisconnection();
+	run();
+	check(lost.done && lost.error == BLE_ERROR_INVALID_STATE, "the disconnection ends the wait");
+
+	coro.printLatency();
+	std::cerr << (failures == 0 ? "GATT coroutine exercise passed" : "GATT coroutine exercise failed") << std::endl;
+	return (failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,119 @@
+#ifndef _BLE_HOST_DEVICE_H_
+#define _BLE_HOST_DEVICE_H_
+
+/**
+ * \file ble_host_device.h
+ * \brief The homework device on the host stack
+ * \details Builds the same object graph as CHomework in main_ble_homework.cpp, the GAP with the security
+ * 			manager, the GATT server and the four services on a two level scheduler, without the buttons and the
+ * 			PWM that do not exist on the host. The host tools drive it through the inject functions of the stack
+ * 			and dispatch its queues themselves. Compile with the host stack first on the include path:
+ * 			-I.. -Istack from this directory.
+ */
+
+#include "ble_event_queue.h"
+#include "ble_event_scheduler.h"
+#include "ble_gap_sm.h"
+#include "ble_gatt_alert_notification_service.h"
+#include "ble_gatt_diagnostics_service.h"
+#include "ble_gatt_generic_attribute_service.h"
+#include "ble_gatt_immedate_alert_service.h"
+#include "ble_gatt_server.h"
+
+#define HOST_EVENT_QUEUE_SIZE (32 * EVENTS_EVENT_SIZE)			  //!< As EVENT_QUEUE_SIZE of the device
+#define HOST_LOW_PRIORITY_EVENT_QUEUE_SIZE (16 * EVENTS_EVENT_SIZE) //!< As LOW_PRIORITY_EVENT_QUEUE_SIZE
+
+/**
+ * \brief The homework device on the host stack
+ *
+ */
+class CHostDevice : private mbed::NonCopyable<CHostDevice> {
+  protected:
+	BLE _ble;														 //!< The stack of this device
+	CStaticEventQueue<HOST_EVENT_QUEUE_SIZE> _ble_queue;			 //!< The BLE stack and GATT events
+	CStaticEventQueue<HOST_LOW_PRIORITY_EVENT_QUEUE_SIZE> _app_queue; //!< The UI and housekeeping events
+	CEventScheduler _scheduler;										 //!< Runs _ble_queue ahead of _app_queue
+	CGapSecurity _gap;												 //!< The GAP with the security manager
+	CGenericAttributeServiceServer _gatt;							 //!< The Generic Attribute service
+	CAlertNotificationServiceServer _ans;							 //!< The alert notification service
+	CImmediateAlertServiceServer _ias;								 //!< The immediate alert service
+	CDiagnosticsServiceServer _diagnostics;							 //!< The diagnostics service
+	CGattServer _gatt_server;										 //!< The GATT server of the services
+	uint8_t _alert_level;											 //!< The last alert level written to the IAS
+
+	void onConnection() {
+		_gatt_server.onConnection();
+		_ias.setAlert(CImmediateAlertServiceServer::IAS_ALERT_LEVEL_NO_ALERT);
+	}
+	void onDisconnection() {
+		_gatt_server.onDisconnection();
+		_ias.setAlert(CImmediateAlertServiceServer::IAS_ALERT_LEVEL_NO_ALERT);
+		_ans.clearAlert(CAlertNotificationServiceServer::ANS_TYPE_ALL_ALERTS);
+	}
+	void onConnectionEvent(const ble::ConnectionCompleteEvent &event) {
+		_gatt.onPeerConnected(event.getPeerAddress(), _gap.isBonded(event.getPeerAddress()));
+	}
+	void onAlertLevelChanged(uint8_t level) { _alert_level = level; }
+
+  public:
+	/**
+	 * \brief Construct a new CHostDevice object, wired as CHomework
+	 *
+	 * \param deviceName The device name
+	 */
+	CHostDevice(const char *deviceName = "Homework")
+		: _ble(), _ble_queue(), _app_queue(), _scheduler(_ble_queue, _app_queue),
+		  _gap(_ble, _ble_queue, deviceName, SecurityManager::IO_CAPS_DISPLAY_ONLY),
+		  _gatt(), _ans(CAlertNotificationServiceServer::ANS_TYPE_MASK_SIMPLE_ALERT, 0, true /* signed writes */),
+		  _ias(true /* signed writes */), _diagnostics(_ble_queue),
+		  _gatt_server(_ble, _ble_queue, {&_gatt, &_ans, &_ias, &_diagnostics}), _alert_level(0) {
+		_gap.setScheduler(_scheduler);
+		_gap.setOnInitCallback(BLE_PROFILED(&_gatt_server, CGattServer, start));
+		_gap.setOnConnection(BLE_PROFILED(this, CHostDevice, onConnection));
+		_gap.setOnDisconnection(BLE_PROFILED(this, CHostDevice, onDisconnection));
+		_gap.setOnConnectionEvent(BLE_PROFILED(this, CHostDevice, onConnectionEvent));
+		_gap.setOnBonded(BLE_PROFILED(&_gatt, CGenericAttributeServiceServer, onPeerBonded));
+		_gatt_server.setRequestAuthorization(BLE_PROFILED(&_gatt, CGenericAttributeServiceServer, authorizeRequest));
+		_gatt_server.setSignedWriteAuthorization(BLE_PROFILED(&_gap, CGapSecurity, hasAuthenticatedSigningKey));
+		_ias.setOnAlertLevelWritten(BLE_PROFILED(this, CHostDevice, onAlertLevelChanged));
+		_gap.enableAcceptListAdvertising();
+		_ias.enableAuthentication();
+		_ans.enableAuthentication();
+		_diagnostics.enableAuthentication();
+	}
+
+	/**
+	 * \brief Initializes the stack and runs the events that are due, the GATT server is started on return
+	 *
+	 * \return true if the initialization was started
+	 */
+	bool start() {
+		if (!_gap.start()) {
+			return false;
+		}
+		dispatch(0);
+		return true;
+	}
+
+	/**
+	 * \brief Dispatches both queues, the BLE events first
+	 *
+	 * \param ms The dispatch time, 0 runs the events that are due
+	 */
+	void dispatch(int ms) { _app_queue.dispatch(ms); }
+
+	/**
+	 * \brief Get the queue that dispatches the device, the BLE queue is chained to it
+	 *
+	 */
+	CEventQueue &dispatchQueue() { return _app_queue; }
+	CEventQueue &bleQueue() { return _ble_queue; }
+	BLE &ble() { return _ble; }
+	CGattServer &gattServer() { return _gatt_server; }
+	CGenericAttributeServiceServer &gatt() { return _gatt; }
+	CAlertNotificationServiceServer &ans() { return _ans; }
+	CImmediateAlertServiceServer &ias() { return _ias; }
+	uint8_t alertLevel() const { return _alert_level; }
+};
+
+#endif //!_BLE_HOST_DEVICE_H_
\ No newline at end of file
@@ -0,0 +1,352 @@
+/**
+ * \file ble_replay.cpp
+ * \brief Replays a recorded event trace of the device against the GATT server on the host
+ * \details Reads the events.bin file written by ble_recorder::CEventRecorder and feeds the recorded connections,
+ * 			writes, reads, subscriptions, confirmations, pairing results and alerts to the same GAP, GATT server
+ * 			and service classes, built as on the device by CHostDevice on the host stack. The recorded handles are
+ * 			mapped through the characteristic records of the session, so a trace stays usable when the GATT
+ * 			layout changes. By default the replay runs on the virtual clock: the timers of the classes fire at
+ * 			the recorded times relative to the events, but the replay takes only the handler time, and two
+ * 			replays of the same trace give the same updates. With realtime set, the original timing is kept.
+ * 			The handler time of each event type and a digest of the updates handed to the radio are reported
+ * 			on stderr, the output of the classes goes to stdout. Build and run on the host:
+ * 			g++ -std=c++14 -O2 -I.. -Istack ble_replay.cpp -o ble_replay
+ * 			./ble_replay events.bin [realtime 0|1] [session, default the last]
+ */
+// a replay runs one device, so its characteristic values are kept in the attribute arena as on the target
+#define BLE_ATTRIBUTE_ARENA 1
+
+#include "ble_host_device.h"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+using namespace ble_recorder;
+
+/**
+ * \brief The names of the record types, for the report
+ *
+ */
+static const char *const recordNames[REC_TYPES] = {
+	"session start", "characteristic", "connection", "disconnection", "advertising end", "write", "read",
+	"updates enabled", "updates disabled", "confirmation", "data sent", "pairing result", "link encryption", "alert",
+};
+
+/**
+ * \brief The shortest valid payload of each record type, see RecordType
+ *
+ */
+static const uint8_t recordMinLengths[REC_TYPES] = {0, 5, 8, 1, 1, 5, 4, 0, 0, 0, 2, 1, 1, 1};
+
+/**
+ * \brief A validated trace file, mapped read-only
+ *
+ */
+class CTraceFile {
+  private:
+	const uint8_t *_data;			 //!< The mapped file
+	size_t _size;					 //!< Size of the file
+	std::vector<size_t> _records;	 //!< Offsets of the valid records
+	std::vector<size_t> _sessions; //!< Indexes in _records of the session starts
+
+  public:
+	CTraceFile() : _data(nullptr), _size(0) {}
+	~CTraceFile() {
+		if (_data != nullptr) {
+			munmap((void *)_data, _size);
+		}
+	}
+
+	/**
+	 * \brief Maps and validates a trace. A truncated last record, e.g. after a reset during a flush, ends the
+	 * 		  trace. A record whose payload is too short for its type is skipped.
+	 *
+	 * \return false if the file is not a trace
+	 */
+	bool open(const char *path) {
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) {
+			std::cerr << "Cannot open " << path << std::endl;
+			return false;
+		}
+		struct stat st;
+		if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(recorder_file_header_t)) {
+			std::cerr << path << " is not an event trace" << std::endl;
+			close(fd);
+			return false;
+		}
+		_size = st.st_size;
+		void *data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (data == MAP_FAILED) {
+			std::cerr << "Cannot map " << path << std::endl;
+			_size = 0;
+			return false;
+		}
+		_data = static_cast<const uint8_t *>(data);
+		const recorder_file_header_t *header = reinterpret_cast<const recorder_file_header_t *>(_data);
+		if (header->magic != RECORDER_MAGIC || header->version != RECORDER_VERSION ||
+			header->headerSize < sizeof(recorder_file_header_t) || header->headerSize > _size) {
+			std::cerr << path << " is not a version " << RECORDER_VERSION << " event trace" << std::endl;
+			return false;
+		}
+		size_t offset = header->headerSize;
+		while (offset + sizeof(record_header_t) <= _size) {
+			const record_header_t *record = at(offset);
+			if (record->type >= REC_TYPES || offset + recordSize(record->length) > _size) {
+				std::cerr << "Trace ends with an invalid record at offset " << offset << std::endl;
+				break;
+			}
+			if (record->length < recordMinLengths[record->type]) {
+				std::cerr << "Skipped a " << recordNames[record->type] << " record of " << (int)record->length
+						  << " bytes at offset " << offset << std::endl;
+				offset += recordSize(record->length);
+				continue;
+			}
+			if (record->type == REC_SESSION_START) {
+				_sessions.push_back(_records.size());
+			}
+			_records.push_back(offset);
+			offset += recordSize(record->length);
+		}
+		return true;
+	}
+
+	const record_header_t *at(size_t offset) const { return reinterpret_cast<const record_header_t *>(_data + offset); }
+	const record_header_t *record(size_t index) const { return at(_records[index]); }
+	static const uint8_t *payload(const record_header_t *record) {
+		return reinterpret_cast<const uint8_t *>(record) + sizeof(record_header_t);
+	}
+	size_t records() const { return _records.size(); }
+	size_t sessions() const { return _sessions.size(); }
+	size_t sessionBegin(size_t session) const { return _sessions[session]; }
+	size_t sessionEnd(size_t session) const {
+		return (session + 1 < _sessions.size()) ? _sessions[session + 1] : _records.size();
+	}
+};
+
+static uint16_t get16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+/**
+ * \brief Replays one session of a trace on a device
+ *
+ */
+class CReplay {
+  private:
+	CHostDevice &_device;
+	host_stack::CClock &_clock;
+	std::map<std::pair<uint8_t, uint8_t>, uint16_t> _layout; //!< The value handles of the device by index
+	std::map<uint16_t, uint16_t> _handles;					  //!< Recorded value handle to device value handle
+	std::map<uint16_t, uint8_t> _properties;				  //!< Properties by device value handle
+	ble_utils::LatencyStats _handling[REC_TYPES];			  //!< Handler time of each type in nanoseconds
+	uint32_t _unmapped;										  //!< Events on handles missing from the layout
+	uint32_t _updates;										  //!< Updates handed to the radio
+	uint64_t _digest;										  //!< FNV-1a digest of the updates
+
+	void onUpdate(GattAttribute::Handle_t handle, const uint8_t *data, uint16_t length) {
+		_updates++;
+		uint8_t bytes[2] = {(uint8_t)handle, (uint8_t)(handle >> 8)};
+		for (uint8_t b : bytes) {
+			_digest = (_digest ^ b) * 0x100000001b3ULL;
+		}
+		for (uint16_t ii = 0; ii < length; ii++) {
+			_digest = (_digest ^ data[ii]) * 0x100000001b3ULL;
+		}
+	}
+
+	/**
+	 * \brief Maps a recorded attribute handle to the device. Handles outside the recorded layout, e.g. of the
+	 * 		  descriptors, are used as they are.
+	 *
+	 */
+	uint16_t map(uint16_t handle) {
+		auto it = _handles.find(handle);
+		if (it == _handles.end()) {
+			_unmapped++;
+			return handle;
+		}
+		return it->second;
+	}
+
+	/**
+	 * \brief Runs the timers of the device up to a time, then moves the clock there
+	 *
+	 */
+	void advanceTo(uint64_t targetUs) {
+		uint64_t dueUs = 0;
+		while (_device.dispatchQueue().nextDue(dueUs) && dueUs <= targetUs) {
+			_clock.advanceTo(dueUs);
+			_device.dispatch(0);
+		}
+		_clock.advanceTo(targetUs);
+	}
+
+	/**
+	 * \brief Hands a record to the stack as the radio would
+	 *
+	 */
+	void inject(const record_header_t *record) {
+		const uint8_t *p = CTraceFile::payload(record);
+		BLE &ble = _device.ble();
+		switch (record->type) {
+		case REC_CHARACTERISTIC: {
+			auto it = _layout.find(std::make_pair(p[0], p[1]));
+			if (it != _layout.end()) {
+				_handles[record->handle] = it->second;
+				_properties[it->second] = p[2];
+			}
+			break;
+		}
+		case REC_CONNECTION:
+			ble.gap().injectConnection(record->handle, ble::peer_address_type_t(p[1]), ble::address_t(p + 2),
+									   (ble_error_t)p[0]);
+			break;
+		case REC_DISCONNECTION:
+			ble.gap().injectDisconnection(record->handle, (ble::disconnection_reason_t::type)p[0]);
+			break;
+		case REC_ADVERTISING_END:
+			ble.gap().injectAdvertisingEnd(p[0] != 0);
+			break;
+		case REC_WRITE:
+			ble.gattServer().injectWrite(get16(p), map(record->handle), (GattWriteCallbackParams::WriteOp_t)p[2],
+										 p + 5, record->length - 5, get16(p + 3));
+			break;
+		case REC_READ:
+			ble.gattServer().injectRead(get16(p), map(record->handle), get16(p + 2));
+			break;
+		case REC_UPDATES_ENABLED: {
+			uint16_t handle = map(record->handle);
+			bool indicate = (_properties[handle] & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY) == 0;
+			ble.gattServer().injectSubscription(handle, indicate ? 2 : 1);
+			break;
+		}
+		case REC_UPDATES_DISABLED:
+			ble.gattServer().injectSubscription(map(record->handle), 0);
+			break;
+		case REC_CONFIRMATION:
+			ble.gattServer().injectConfirmation(map(record->handle));
+			break;
+		case REC_DATA_SENT:
+			ble.gattServer().injectDataSent(get16(p));
+			break;
+		case REC_PAIRING_RESULT:
+			ble.securityManager().injectPairingResult(record->handle,
+													  (SecurityManager::SecurityCompletionStatus_t)p[0]);
+			break;
+		case REC_LINK_ENCRYPTION:
+			ble.securityManager().injectLinkEncryption(record->handle, (ble::link_encryption_t::type)p[0]);
+			break;
+		case REC_ALERT:
+			_device.ans().newAlert((CAlertNotificationServiceServer::CategoryId)p[0]);
+			break;
+		default:
+			break;
+		}
+	}
+
+  public:
+	CReplay(CHostDevice &device)
+		: _device(device), _clock(host_stack::CClock::instance()), _unmapped(0), _updates(0),
+		  _digest(0xcbf29ce484222325ULL) {
+		CGattServicesSet &services = _device.gattServer().getService();
+		for (size_t sv = 0; sv < services.size(); sv++) {
+			for (uint8_t ch = 0; ch < services[sv]->getCharacteristicCount(); ch++) {
+				_layout[std::make_pair((uint8_t)sv, ch)] = services[sv]->getCharacteristic(ch)->getValueHandle();
+			}
+		}
+		_device.ble().gattServer().setOnUpdate(
+			GattServer::UpdateCallback_t(this, &CReplay::onUpdate));
+	}
+
+	/**
+	 * \brief Replays the records of a session in their recorded timing
+	 *
+	 */
+	void run(const CTraceFile &trace, size_t begin, size_t end) {
+		uint64_t startUs = _clock.nowUs();
+		uint64_t offsetUs = 0;
+		uint32_t previous = trace.record(begin)->timestampUs;
+		for (size_t ii = begin; ii < end; ii++) {
+			const record_header_t *record = trace.record(ii);
+			// the timestamps wrap, only the differences count
+			offsetUs += (uint32_t)(record->timestampUs - previous);
+			previous = record->timestampUs;
+			advanceTo(startUs + offsetUs);
+
+			auto started = std::chrono::steady_clock::now();
+			inject(record);
+			_device.dispatch(0);
+			auto elapsed = std::chrono::steady_clock::now() - started;
+			_handling[record->type].add(
+				(uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+		}
+		// let the timers of the last connection run out, e.g. the retries and the advertising fallback
+		advanceTo(_clock.nowUs() + 1000);
+	}
+
+	/**
+	 * \brief Prints the handler time of each event type and the digest of the updates
+	 *
+	 */
+	void report(std::ostream &os) const {
+		os << std::dec << std::left << std::setw(18) << "event" << std::right << std::setw(8) << "count"
+		   << std::setw(12) << "avg ns" << std::setw(12) << "min ns" << std::setw(12) << "max ns" << std::endl;
+		for (int ii = 0; ii < REC_TYPES; ii++) {
+			const ble_utils::LatencyStats &stats = _handling[ii];
+			if (stats.count == 0) {
+				continue;
+			}
+			os << std::left << std::setw(18) << recordNames[ii] << std::right << std::setw(8) << stats.count
+			   << std::setw(12) << stats.average() << std::setw(12) << stats.min << std::setw(12) << stats.max
+			   << std::endl;
+		}
+		os << "Updates to the radio: " << _updates << ", digest " << std::hex << std::setw(16) << std::setfill('0')
+		   << _digest << std::setfill(' ') << std::dec << std::endl;
+		if (_unmapped != 0) {
+			os << _unmapped << " events on handles outside the recorded layout" << std::endl;
+		}
+	}
+};
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		std::cerr << "Usage: " << argv[0] << " events.bin [realtime 0|1] [session]" << std::endl;
+		return 1;
+	}
+	bool realtime = (argc > 2) && atoi(argv[2]) != 0;
+	CTraceFile trace;
+	if (!trace.open(argv[1])) {
+		return 1;
+	}
+	if (trace.sessions() == 0) {
+		std::cerr << "No session in the trace" << std::endl;
+		return 1;
+	}
+	size_t session = (argc > 3) ? (size_t)atoi(argv[3]) : trace.sessions() - 1;
+	if (session >= trace.sessions()) {
+		std::cerr << "The trace has " << trace.sessions() << " sessions" << std::endl;
+		return 1;
+	}
+	host_stack::CClock::instance().setVirtual(!realtime);
+
+	CHostDevice device;
+	if (!device.start()) {
+		return 1;
+	}
+	CReplay replay(device);
+	auto started = std::chrono::steady_clock::now();
+	replay.run(trace, trace.sessionBegin(session), trace.sessionEnd(session));
+	auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started);
+
+	std::cerr << "Session " << session << " of " << trace.sessions() << ": "
+			  << trace.sessionEnd(session) - trace.sessionBegin(session) << " records replayed in "
+			  << elapsedMs.count() << " ms, " << (realtime ? "recorded timing" : "virtual clock") << std::endl;
+	replay.report(std::cerr);
+	ble_profiler::CProfiler::instance().dump();
+	return 0;
+}
\ No newline at end of file
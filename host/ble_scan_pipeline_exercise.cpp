@@ -0,0 +1,168 @@
+/**
+ * \file ble_scan_pipeline_exercise.cpp
+ * \brief Runs CScanPipeline on the host stack with the virtual clock
+ * \details The exercise feeds advertisement reports into the pipeline and checks that:
+ * 			- a repeated payload is counted as a duplicate and the reports of a period are aggregated
+ * 			- the reports beyond the ring size are dropped
+ * 			- the device tables keep their lifetime across the 2^32 us and 2^32 ms wraps of the clock
+ * 			- the report ring hands the reports over between two threads in order
+ * 			The failed checks go to stderr. Build and run on the host:
+ * 			g++ -std=c++14 -O2 -pthread -I.. -Istack ble_scan_pipeline_exercise.cpp -o ble_scan_pipeline_exercise
+ * 			./ble_scan_pipeline_exercise
+ */
+#include "ble_scan_pipeline.h"
+
+#include <iostream>
+#include <thread>
+
+#define EXERCISE_RING_SIZE 16	  //!< Reports buffered between two deliveries
+#define EXERCISE_DEVICES 64		  //!< Devices tracked by the pipeline
+#define EXERCISE_LIFETIME_MS 10000 //!< Time a device is remembered after its last report
+#define EXERCISE_HANDOVERS 1000000 //!< Reports handed over between the threads
+
+static unsigned failures = 0;
+
+static void check(bool condition, const char *what) {
+	if (!condition) {
+		std::cerr << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+/**
+ * \brief The pipeline with the results of the last delivery
+ *
+ */
+class CExercisePipeline : public CScanPipeline<EXERCISE_RING_SIZE, EXERCISE_DEVICES> {
+  private:
+	void onResult(const scan_result_t &result) {
+		results++;
+		reports = result.reports;
+		payloadChanged = result.payloadChanged;
+	}
+
+  public:
+	unsigned results;
+	uint16_t reports;
+	bool payloadChanged;
+
+	CExercisePipeline() : CScanPipeline(EXERCISE_LIFETIME_MS), results(0), reports(0), payloadChanged(false) {
+		setOnResult(callback(this, &CExercisePipeline::onResult));
+	}
+
+	/**
+	 * \brief Delivers the period and returns the number of results
+	 *
+	 */
+	unsigned period() {
+		results = 0;
+		deliver();
+		return results;
+	}
+};
+
+static void report(CScanPipelineBase &pipeline, uint8_t device, uint8_t payloadByte, int8_t rssi = -60) {
+	uint8_t address[6] = {device, 0x00, 0x00, 0x00, 0xE0, 0xC0};
+	uint8_t payload[3] = {0x02, 0x01, payloadByte};
+	ble::AdvertisingReportEvent event(ble::peer_address_type_t::PUBLIC, ble::address_t(address), rssi,
+									  ble::adv_data_t(payload, sizeof(payload)), true);
+	pipeline.push(event);
+}
+
+static void advanceMs(uint64_t ms) {
+	host_stack::CClock &clock = host_stack::CClock::instance();
+	clock.advanceTo(clock.nowUs() + ms * 1000);
+}
+
+/**
+ * \brief Dedup, aggregation and ring overflow
+ *
+ */
+static void exerciseAggregation() {
+	CExercisePipeline pipeline;
+	report(pipeline, 1, 0xA0, -50);
+	report(pipeline, 1, 0xA0, -70);
+	report(pipeline, 2, 0xB0);
+	check(pipeline.period() == 2, "one result per device");
+	check(pipeline.getStats().duplicates == 1, "repeated payload counted as duplicate");
+
+	report(pipeline, 1, 0xA0);
+	check(pipeline.period() == 1 && pipeline.reports == 1 && !pipeline.payloadChanged, "known payload aggregated");
+	report(pipeline, 1, 0xA1);
+	check(pipeline.period() == 1 && pipeline.payloadChanged, "changed payload delivered");
+
+	for (int ii = 0; ii <= EXERCISE_RING_SIZE; ii++) {
+		report(pipeline, 3, 0xC0);
+	}
+	check(pipeline.getStats().dropped == 1, "report beyond the ring size dropped");
+	check(pipeline.period() == 1 && pipeline.reports == EXERCISE_RING_SIZE, "ring contents aggregated");
+}
+
+/**
+ * \brief The lifetime of a device across the wrap of the clock
+ *
+ * \param wrapMs The time the clock wraps at
+ * \param what The check
+ */
+static void exerciseWrap(uint64_t wrapMs, const char *what) {
+	host_stack::CClock &clock = host_stack::CClock::instance();
+	clock.advanceTo((wrapMs - EXERCISE_LIFETIME_MS / 2) * 1000);
+	CExercisePipeline pipeline;
+	report(pipeline, 1, 0xA0);
+	report(pipeline, 2, 0xB0);
+	check(pipeline.period() == 2 && pipeline.payloadChanged, what);
+
+	// across the wrap the device is still known
+	advanceMs(EXERCISE_LIFETIME_MS - 1000);
+	report(pipeline, 1, 0xA0);
+	check(pipeline.period() == 1 && !pipeline.payloadChanged, what);
+
+	// and the other one is forgotten once its lifetime is over
+	advanceMs(2000);
+	report(pipeline, 2, 0xB0);
+	check(pipeline.period() == 1 && pipeline.payloadChanged, what);
+}
+
+/**
+ * \brief A producer thread and a consumer thread on the report ring
+ *
+ */
+static void exerciseHandover() {
+	static CAdvertisementRing<EXERCISE_RING_SIZE> ring;
+	std::thread producer([]() {
+		for (uint32_t ii = 0; ii < EXERCISE_HANDOVERS;) {
+			advertisement_report_t *report = ring.reserve();
+			if (report == nullptr) {
+				std::this_thread::yield();
+				continue;
+			}
+			report->key = ii;
+			report->timestampMs = ~ii;
+			ring.commit();
+			ii++;
+		}
+	});
+	bool ordered = true;
+	for (uint32_t ii = 0; ii < EXERCISE_HANDOVERS;) {
+		const advertisement_report_t *report = ring.front();
+		if (report == nullptr) {
+			std::this_thread::yield();
+			continue;
+		}
+		ordered = ordered && (report->key == ii) && (report->timestampMs == ~ii);
+		ring.pop();
+		ii++;
+	}
+	producer.join();
+	check(ordered && ring.size() == 0, "reports handed over in order");
+}
+
+int main() {
+	host_stack::CClock::instance().setVirtual(true);
+	exerciseAggregation();
+	exerciseWrap((1ULL << 32) / 1000, "lifetime across the 2^32 us wrap");
+	exerciseWrap(1ULL << 32, "lifetime across the 2^32 ms wrap");
+	exerciseHandover();
+	std::cerr << (failures == 0 ? "Scan pipeline exercise passed" : "Scan pipeline exercise failed") << std::endl;
+	return (failures == 0) ? 0 : 1;
+}
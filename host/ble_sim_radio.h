@@ -0,0 +1,378 @@
+#ifndef _BLE_SIM_RADIO_H_
+#define _BLE_SIM_RADIO_H_
+
+#include "ble_gatt_alert_notification_types.h"
+
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <queue>
+#include <random>
+#include <vector>
+
+#define ATT_MAX_VALUE_SIZE 20			  //!< Largest attribute value carried by the simulated PDUs (default MTU)
+#define SIM_CONNECTION_INTERVAL_US 7500 //!< Default connection interval of the simulated links
+#define SIM_PDUS_PER_EVENT 4			  //!< Default number of PDUs exchanged in each direction per connection event
+
+/**
+ * \brief The ATT opcodes used by the gateway
+ *
+ */
+enum AttOpcode {
+	ATT_ERROR_RSP = 0x01,
+	ATT_READ_REQ = 0x0A,
+	ATT_READ_RSP = 0x0B,
+	ATT_WRITE_REQ = 0x12,
+	ATT_WRITE_RSP = 0x13,
+	ATT_HANDLE_VALUE_NTF = 0x1B,
+	ATT_WRITE_CMD = 0x52,
+};
+
+/**
+ * \brief The ATT error codes returned by the simulated peripherals
+ *
+ */
+enum AttError {
+	ATT_SUCCESS = 0x00,
+	ATT_ERR_INVALID_HANDLE = 0x01,
+	ATT_ERR_READ_NOT_PERMITTED = 0x02,
+	ATT_ERR_WRITE_NOT_PERMITTED = 0x03,
+	ATT_ERR_ANS_COMMAND_NOT_SUPPORTED = 0xA0, //!< Alert Notification Service specific error
+};
+
+/**
+ * \brief A simulated ATT PDU
+ *
+ */
+struct att_pdu_t {
+	uint8_t opcode;						//!< The AttOpcode
+	uint16_t handle;					//!< The attribute handle
+	uint8_t status;						//!< The AttError of an ATT_ERROR_RSP
+	uint8_t length;						//!< The value length
+	uint8_t value[ATT_MAX_VALUE_SIZE]; //!< The value
+};
+
+/**
+ * \brief The attribute handles of the Alert Notification Service on the peripherals
+ *
+ */
+struct ans_handles_t {
+	uint16_t supportedNewAlertCategory;
+	uint16_t supportedUnreadAlertCategory;
+	uint16_t unreadAlertStatus;
+	uint16_t unreadAlertStatusCccd;
+	uint16_t newAlert;
+	uint16_t newAlertCccd;
+	uint16_t controlPoint;
+};
+
+/**
+ * \brief Model of a peripheral running the firmware, reduced to the Alert Notification Service
+ *
+ */
+class CSimPeripheral : public CAlertNotificationServiceTypes {
+  public:
+	/**
+	 * \brief The handle layout registered by the firmware
+	 *
+	 */
+	static ans_handles_t handles() { return ans_handles_t{0x0003, 0x0005, 0x0007, 0x0008, 0x000A, 0x000B, 0x000D}; }
+
+  private:
+	uint16_t _supported_new_alert_category;
+	uint16_t _supported_unread_alert_category;
+	uint16_t _enabled_new_alert_category;
+	uint16_t _enabled_unread_alert_category;
+	uint16_t _cccd_new_alert;
+	uint16_t _cccd_unread_alert_status;
+	alert_status_t _alert_status[10];
+
+	static void put16(att_pdu_t &pdu, uint16_t value) {
+		pdu.length = sizeof(value);
+		memcpy(pdu.value, &value, sizeof(value));
+	}
+	static uint16_t get16(const att_pdu_t &pdu) {
+		uint16_t value = 0;
+		memcpy(&value, pdu.value, (pdu.length < sizeof(value)) ? pdu.length : sizeof(value));
+		return value;
+	}
+	static att_pdu_t error(const att_pdu_t &request, AttError status) {
+		att_pdu_t rsp = att_pdu_t();
+		rsp.opcode = ATT_ERROR_RSP;
+		rsp.handle = request.handle;
+		rsp.status = status;
+		return rsp;
+	}
+
+	bool controlPoint(uint16_t value, std::vector<att_pdu_t> &out) {
+		control_point_t cp;
+		cp.value = value;
+		uint16_t mask = (cp.fields.category == ANS_TYPE_ALL_ALERTS) ? (uint16_t)ANS_TYPE_MASK_ALL_ALERTS
+																	 : (uint16_t)(1 << cp.fields.category);
+		if (cp.fields.category != ANS_TYPE_ALL_ALERTS && cp.fields.category >= 10) {
+			return false;
+		}
+		switch (cp.fields.command) {
+		case ANS_ENABLE_NEW_INCOMING_ALERT_NOTIFICATION:
+			_enabled_new_alert_category |= mask;
+			break;
+		case ANS_ENABLE_UNREAD_CATEGORY_STATUS_NOTIFICATION:
+			_enabled_unread_alert_category |= mask;
+			break;
+		case ANS_DISABLE_NEW_INCOMING_ALERT_NOTIFICATION:
+			_enabled_new_alert_category &= ~mask;
+			break;
+		case ANS_DISABLE_UNREAD_CATEGORY_STATUS_NOTIFICATION:
+			_enabled_unread_alert_category &= ~mask;
+			break;
+		case ANS_NOTIFY_NEW_INCOMING_ALERT_IMMEDIATELY:
+		case ANS_NOTIFY_UNREAD_CATEGORY_STATUS_IMMEDIATELY:
+			for (int ii = 0; ii < 10; ii++) {
+				if ((mask & (1 << ii)) != 0) {
+					notify(cp.fields.command == ANS_NOTIFY_NEW_INCOMING_ALERT_IMMEDIATELY, ii, out);
+				}
+			}
+			break;
+		default:
+			return false;
+		}
+		return true;
+	}
+
+	void notify(bool newAlert, int category, std::vector<att_pdu_t> &out) {
+		uint16_t enabled = newAlert ? _enabled_new_alert_category : _enabled_unread_alert_category;
+		uint16_t cccd = newAlert ? _cccd_new_alert : _cccd_unread_alert_status;
+		if ((enabled & (1 << category)) == 0 || (cccd & 0x0001) == 0) {
+			return;
+		}
+		att_pdu_t ntf = att_pdu_t();
+		ntf.opcode = ATT_HANDLE_VALUE_NTF;
+		ntf.handle = newAlert ? handles().newAlert : handles().unreadAlertStatus;
+		put16(ntf, _alert_status[category].value);
+		out.push_back(ntf);
+	}
+
+  public:
+	CSimPeripheral(uint16_t supportedNewAlerts = ANS_TYPE_MASK_ALL_ALERTS,
+				   uint16_t supportedUnreadAlerts = ANS_TYPE_MASK_ALL_ALERTS)
+		: _supported_new_alert_category(supportedNewAlerts), _supported_unread_alert_category(supportedUnreadAlerts),
+		  _enabled_new_alert_category(0), _enabled_unread_alert_category(0), _cccd_new_alert(0),
+		  _cccd_unread_alert_status(0) {
+		for (int ii = 0; ii < 10; ii++) {
+			_alert_status[ii].fields.category = (uint8_t)ii;
+			_alert_status[ii].fields.count = 0;
+		}
+	}
+
+	/**
+	 * \brief Handles a PDU received from the central
+	 *
+	 * \param pdu The received PDU
+	 * \param out The PDUs sent back to the central
+	 */
+	void receive(const att_pdu_t &pdu, std::vector<att_pdu_t> &out) {
+		const ans_handles_t h = handles();
+		att_pdu_t rsp = att_pdu_t();
+		rsp.handle = pdu.handle;
+		switch (pdu.opcode) {
+		case ATT_READ_REQ:
+			rsp.opcode = ATT_READ_RSP;
+			if (pdu.handle == h.supportedNewAlertCategory) {
+				put16(rsp, _supported_new_alert_category);
+			} else if (pdu.handle == h.supportedUnreadAlertCategory) {
+				put16(rsp, _supported_unread_alert_category);
+			} else if (pdu.handle == h.newAlertCccd) {
+				put16(rsp, _cccd_new_alert);
+			} else if (pdu.handle == h.unreadAlertStatusCccd) {
+				put16(rsp, _cccd_unread_alert_status);
+			} else if (pdu.handle == h.controlPoint || pdu.handle == h.newAlert || pdu.handle == h.unreadAlertStatus) {
+				rsp = error(pdu, ATT_ERR_READ_NOT_PERMITTED);
+			} else {
+				rsp = error(pdu, ATT_ERR_INVALID_HANDLE);
+			}
+			out.push_back(rsp);
+			break;
+		case ATT_WRITE_REQ:
+		case ATT_WRITE_CMD: {
+			AttError status = ATT_SUCCESS;
+			std::vector<att_pdu_t> notifications;
+			if (pdu.handle == h.controlPoint) {
+				status = controlPoint(get16(pdu), notifications) ? ATT_SUCCESS : ATT_ERR_ANS_COMMAND_NOT_SUPPORTED;
+			} else if (pdu.handle == h.newAlertCccd) {
+				_cccd_new_alert = get16(pdu);
+			} else if (pdu.handle == h.unreadAlertStatusCccd) {
+				_cccd_unread_alert_status = get16(pdu);
+			} else if (pdu.handle == h.supportedNewAlertCategory || pdu.handle == h.supportedUnreadAlertCategory) {
+				status = ATT_ERR_WRITE_NOT_PERMITTED;
+			} else {
+				status = ATT_ERR_INVALID_HANDLE;
+			}
+			if (pdu.opcode == ATT_WRITE_REQ) {
+				if (status == ATT_SUCCESS) {
+					rsp.opcode = ATT_WRITE_RSP;
+					out.push_back(rsp);
+				} else {
+					out.push_back(error(pdu, status));
+				}
+			}
+			out.insert(out.end(), notifications.begin(), notifications.end());
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	/**
+	 * \brief Raises a new alert on the peripheral, as CAlertNotificationServiceServer::newAlert() does
+	 *
+	 * \param category The alert category
+	 * \param out The notifications sent to the central
+	 */
+	void newAlert(CategoryId category, std::vector<att_pdu_t> &out) {
+		if ((int)category >= 10) {
+			return;
+		}
+		_alert_status[(int)category].fields.count++;
+		notify(true, (int)category, out);
+		notify(false, (int)category, out);
+	}
+};
+
+/**
+ * \brief Discrete event simulation of the radio between the gateway and many peripherals
+ * \details Each link has a connection event every connection interval. The events of the links are
+ * 			staggered over the interval. In each connection event at most pdusPerEvent PDUs are sent in each
+ * 			direction. The peripheral answers in the next connection event, as the stack of the firmware does.
+ * 			The time is virtual, so hundreds of links are simulated faster than real time.
+ */
+class CSimRadio {
+  public:
+	typedef std::function<void(uint16_t link, const att_pdu_t &pdu)> ReceiveCallback;
+	typedef std::function<void(uint16_t link, unsigned sent)> SentCallback;
+
+  private:
+	struct sim_link_t {
+		CSimPeripheral peripheral;
+		std::deque<att_pdu_t> tx;  //!< Central to peripheral
+		std::deque<att_pdu_t> rx;  //!< Peripheral to central, sent in the next connection event
+		uint64_t nextEventUs;
+	};
+	typedef std::pair<uint64_t, uint16_t> event_t;
+
+	std::vector<sim_link_t> _links;
+	std::priority_queue<event_t, std::vector<event_t>, std::greater<event_t>> _events;
+	uint64_t _nowUs;
+	uint32_t _connectionIntervalUs;
+	unsigned _pdusPerEvent;
+	std::mt19937 _random;
+	ReceiveCallback _onReceive;
+	SentCallback _onSent;
+	uint64_t _pdus;
+
+  public:
+	/**
+	 * \brief Construct a new CSimRadio object
+	 *
+	 * \param connectionIntervalUs The connection interval of every link
+	 * \param pdusPerEvent The PDUs exchanged in each direction per connection event
+	 * \param seed The seed of the connection event staggering
+	 */
+	CSimRadio(uint32_t connectionIntervalUs = SIM_CONNECTION_INTERVAL_US,
+			  unsigned pdusPerEvent = SIM_PDUS_PER_EVENT,
+			  uint32_t seed = 1)
+		: _nowUs(0), _connectionIntervalUs(connectionIntervalUs), _pdusPerEvent(pdusPerEvent), _random(seed),
+		  _pdus(0) {}
+
+	/**
+	 * \brief Connects a new simulated peripheral
+	 *
+	 * \return uint16_t The connection handle of the link
+	 */
+	uint16_t connect() {
+		uint16_t link = (uint16_t)_links.size();
+		_links.push_back(sim_link_t());
+		_links.back().nextEventUs = _nowUs + _random() % _connectionIntervalUs;
+		_events.push(event_t(_links.back().nextEventUs, link));
+		return link;
+	}
+
+	/**
+	 * \brief Queues a PDU to the peripheral. It is sent in one of the next connection events.
+	 *
+	 */
+	void send(uint16_t link, const att_pdu_t &pdu) { _links[link].tx.push_back(pdu); }
+
+	/**
+	 * \brief Raises an alert on a peripheral
+	 *
+	 */
+	void raiseAlert(uint16_t link, CAlertNotificationServiceTypes::CategoryId category) {
+		std::vector<att_pdu_t> out;
+		_links[link].peripheral.newAlert(category, out);
+		_links[link].rx.insert(_links[link].rx.end(), out.begin(), out.end());
+	}
+
+	/**
+	 * \brief Runs the connection events until the given time
+	 *
+	 * \param untilUs The virtual time to stop at
+	 * \param idle Called after each connection event, e.g. to queue more operations
+	 */
+	void run(uint64_t untilUs, const std::function<void()> &idle = std::function<void()>()) {
+		std::vector<att_pdu_t> out;
+		while (!_events.empty() && _events.top().first <= untilUs) {
+			event_t event = _events.top();
+			_events.pop();
+			_nowUs = event.first;
+			sim_link_t &link = _links[event.second];
+
+			// the peripheral responses of the previous event
+			for (unsigned ii = 0; ii < _pdusPerEvent && !link.rx.empty(); ii++) {
+				att_pdu_t pdu = link.rx.front();
+				link.rx.pop_front();
+				_pdus++;
+				if (_onReceive) {
+					_onReceive(event.second, pdu);
+				}
+			}
+			// the central PDUs
+			unsigned sent = 0;
+			out.clear();
+			for (; sent < _pdusPerEvent && !link.tx.empty(); sent++) {
+				link.peripheral.receive(link.tx.front(), out);
+				link.tx.pop_front();
+				_pdus++;
+			}
+			link.rx.insert(link.rx.end(), out.begin(), out.end());
+			if (sent != 0 && _onSent) {
+				_onSent(event.second, sent);
+			}
+
+			link.nextEventUs += _connectionIntervalUs;
+			_events.push(event_t(link.nextEventUs, event.second));
+			if (idle) {
+				idle();
+			}
+		}
+		_nowUs = untilUs;
+	}
+
+	uint64_t nowUs() const { return _nowUs; }
+	uint64_t pdus() const { return _pdus; }
+	size_t links() const { return _links.size(); }
+	ans_handles_t getAnsHandles(uint16_t) const { return CSimPeripheral::handles(); }
+
+	/**
+	 * \brief Sets the callback that receives the PDUs from the peripherals
+	 *
+	 */
+	void setOnReceive(ReceiveCallback callback) { _onReceive = callback; }
+	/**
+	 * \brief Sets the callback that is called when central PDUs have been sent in a connection event
+	 *
+	 */
+	void setOnSent(SentCallback callback) { _onSent = callback; }
+};
+
+#endif //!_BLE_SIM_RADIO_H_
@@ -0,0 +1,238 @@
+/**
+ * \file ble_thread_bench.cpp
+ * \brief Exercises the message channels of the BLE thread model with std::thread
+ * \details A BLE thread and an application thread exchange messages as CHomework does with BLE_THREAD set:
+ * 			the application sends alerts and the BLE thread answers with alert level changes. As in CHomework,
+ * 			each thread dispatches its own bounded event queue and a channel wakes its consumer by posting the
+ * 			drain function to the queue of the consumer, which may fail. A wakeup lost by the channel leaves
+ * 			the application waiting, it is counted as a stall after BENCH_STALL_MS and the messages are
+ * 			drained by hand. Build and run on the host:
+ * 			g++ -std=c++14 -O2 -pthread -I.. ble_thread_bench.cpp -o ble_thread_bench
+ * 			./ble_thread_bench [messages] [burst] [queue events]
+ * 			The exit code is 1 if a wakeup was lost.
+ */
+#include "ble_message_channel.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#define BENCH_SLOTS 16		   //!< Messages in flight in each direction, as BLE_MESSAGE_SLOTS
+#define BENCH_QUEUE_EVENTS 4   //!< Default number of events each thread queue holds
+#define BENCH_MAX_QUEUE_EVENTS 64 //!< Largest number of events a thread queue can hold
+#define BENCH_STALL_MS 1000	   //!< Time without a wakeup after which the application counts a stall
+
+/**
+ * \brief A bench message, with the send time for the round trip latency
+ *
+ */
+struct bench_message_t {
+	uint8_t type;
+	uint8_t value;
+	std::chrono::steady_clock::time_point sent;
+};
+
+typedef CMessageChannel<bench_message_t, BENCH_SLOTS> CBenchMessageChannel;
+
+/**
+ * \brief The event queue of a thread: bounded, posted from the other thread and dispatched by its own thread
+ *
+ */
+class CThreadQueue {
+  public:
+	typedef void (*Event)(void *context); //!< An event function
+
+  private:
+	struct event_t {
+		Event f;
+		void *context;
+	};
+
+	std::mutex _mutex;
+	std::condition_variable _cv;
+	event_t _events[BENCH_MAX_QUEUE_EVENTS];
+	unsigned _capacity; //!< Number of events the queue holds
+	unsigned _head;		//!< The oldest event
+	unsigned _count;	//!< Number of pending events
+
+  public:
+	CThreadQueue(unsigned capacity)
+		: _capacity((capacity == 0 || capacity > BENCH_MAX_QUEUE_EVENTS) ? BENCH_MAX_QUEUE_EVENTS : capacity),
+		  _head(0), _count(0) {}
+
+	/**
+	 * \brief Posts an event
+	 *
+	 * \return false if the queue is full
+	 */
+	bool call(Event f, void *context) {
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_count == _capacity) {
+			return false;
+		}
+		_events[(_head + _count++) % _capacity] = {f, context};
+		_cv.notify_one();
+		return true;
+	}
+
+	/**
+	 * \brief Runs the pending events, waits for the first one
+	 *
+	 * \param timeoutMs The longest wait
+	 * \return false if no event was posted in time
+	 */
+	bool dispatch(int timeoutMs) {
+		for (bool first = true;; first = false) {
+			event_t event;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				if (first &&
+					!_cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return _count != 0; })) {
+					return false;
+				}
+				if (_count == 0) {
+					return true;
+				}
+				event = _events[_head];
+				_head = (_head + 1) % _capacity;
+				_count--;
+			}
+			event.f(event.context);
+		}
+	}
+};
+
+/**
+ * \brief The two threads of CHomework with BLE_THREAD set, reduced to their message handling
+ *
+ */
+class CBenchDevice {
+  private:
+	CThreadQueue _bleQueue; //!< Dispatched by the BLE thread
+	CThreadQueue _appQueue; //!< Dispatched by the application thread
+
+  public:
+	CBenchMessageChannel toBle; //!< Alerts from the application thread
+	CBenchMessageChannel toApp; //!< Alert level changes from the BLE thread
+	uint64_t totalUs;
+	uint64_t maxUs;
+	unsigned received;
+	std::atomic<bool> stop;
+
+  private:
+	/**
+	 * \brief Wakes the consumer of a channel by posting its drain function to the consumer queue, as
+	 * 		  CHomework::notifyBle() and CHomework::notifyApp()
+	 *
+	 */
+	static bool notifyBle(void *context) {
+		CBenchDevice *self = static_cast<CBenchDevice *>(context);
+		return self->_bleQueue.call(&CBenchDevice::onBleMessages, self);
+	}
+	static bool notifyApp(void *context) {
+		CBenchDevice *self = static_cast<CBenchDevice *>(context);
+		return self->_appQueue.call(&CBenchDevice::onAppMessages, self);
+	}
+
+	/**
+	 * \brief Handles the alerts on the BLE thread, the answer carries the send time of the alert
+	 *
+	 */
+	static void onBleMessages(void *context) {
+		CBenchDevice *self = static_cast<CBenchDevice *>(context);
+		self->toBle.receive([self](const bench_message_t &message) {
+			bench_message_t answer = {1, message.value, message.sent};
+			while (!self->toApp.send(answer)) {
+				std::this_thread::yield();
+			}
+		});
+	}
+
+  public:
+	CBenchDevice(unsigned queueEvents)
+		: _bleQueue(queueEvents), _appQueue(queueEvents), totalUs(0), maxUs(0), received(0), stop(false) {
+		toBle.setNotify(&CBenchDevice::notifyBle, this);
+		toApp.setNotify(&CBenchDevice::notifyApp, this);
+	}
+
+	/**
+	 * \brief Handles the alert level changes on the application thread
+	 *
+	 */
+	static void onAppMessages(void *context) {
+		CBenchDevice *self = static_cast<CBenchDevice *>(context);
+		self->toApp.receive([self](const bench_message_t &answer) {
+			uint64_t us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() -
+																				 answer.sent)
+							  .count();
+			self->totalUs += us;
+			self->maxUs = (us > self->maxUs) ? us : self->maxUs;
+			self->received++;
+		});
+	}
+
+	/**
+	 * \brief The BLE thread function
+	 *
+	 */
+	void runBle() {
+		while (!stop.load()) {
+			_bleQueue.dispatch(10);
+		}
+	}
+
+	/**
+	 * \brief Dispatches the application queue once
+	 *
+	 * \return false if no wakeup came in BENCH_STALL_MS
+	 */
+	bool dispatchApp() { return _appQueue.dispatch(BENCH_STALL_MS); }
+};
+
+int main(int argc, char *argv[]) {
+	unsigned messages = (argc > 1) ? atoi(argv[1]) : 100000;
+	unsigned burst = (argc > 2) ? atoi(argv[2]) : 8;
+	unsigned queueEvents = (argc > 3) ? atoi(argv[3]) : BENCH_QUEUE_EVENTS;
+
+	static CBenchDevice device(queueEvents);
+	std::thread ble([]() { device.runBle(); });
+
+	unsigned sent = 0, stalls = 0;
+	auto start = std::chrono::steady_clock::now();
+	while (device.received < messages) {
+		for (unsigned ii = 0; ii < burst && sent < messages; ii++) {
+			bench_message_t alert = {0, (uint8_t)sent, std::chrono::steady_clock::now()};
+			if (!device.toBle.send(alert)) {
+				break; // counted by the channel, retried in the next burst
+			}
+			sent++;
+		}
+		if (!device.dispatchApp()) {
+			// the answers, or the alerts, wait in a ring without a wakeup
+			stalls++;
+			CBenchDevice::onAppMessages(&device);
+		}
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	device.stop.store(true);
+	ble.join();
+
+	uint64_t elapsedUs = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+	unsigned received = device.received;
+	std::cout << received << " round trips in " << elapsedUs / 1000 << " ms, "
+			  << (uint64_t)(received * 1e6 / (elapsedUs ? elapsedUs : 1)) << " messages/s" << std::endl;
+	std::cout << "\tround trip avg " << device.totalUs / (received ? received : 1) << " us max " << device.maxUs
+			  << " us" << std::endl;
+	std::cout << "\tto BLE: sent " << device.toBle.sent() << " dropped " << device.toBle.dropped() << " wakeups "
+			  << device.toBle.notified() << " failed wakeups " << device.toBle.notifyFailed() << " max depth "
+			  << device.toBle.maxDepth() << std::endl;
+	std::cout << "\tto application: sent " << device.toApp.sent() << " dropped " << device.toApp.dropped()
+			  << " wakeups " << device.toApp.notified() << " failed wakeups " << device.toApp.notifyFailed()
+			  << " max depth " << device.toApp.maxDepth() << std::endl;
+	std::cout << "\tstalls " << stalls << std::endl;
+	return (stalls == 0) ? 0 : 1;
+}
@@ -0,0 +1,6 @@
+#ifndef _HOST_STACK_BLE_API_H_
+#define _HOST_STACK_BLE_API_H_
+
+#include "ble/BLE.h"
+
+#endif //!_HOST_STACK_BLE_API_H_
@@ -0,0 +1,23 @@
+#ifndef _HOST_STACK_LITTLE_FILE_SYSTEM_H_
+#define _HOST_STACK_LITTLE_FILE_SYSTEM_H_
+
+/**
+ * \file LittleFileSystem.h
+ * \brief Host stand-in of the mbed OS file system. There is no block device, so the classes keep their state in RAM.
+ */
+
+#include "mbed.h"
+
+class BlockDevice {
+  public:
+	static BlockDevice *get_default_instance() { return nullptr; }
+};
+
+class LittleFileSystem {
+  public:
+	LittleFileSystem(const char *) {}
+	int mount(BlockDevice *) { return -1; }
+	int reformat(BlockDevice *) { return -1; }
+};
+
+#endif //!_HOST_STACK_LITTLE_FILE_SYSTEM_H_
@@ -0,0 +1,1818 @@
+#ifndef _HOST_STACK_BLE_H_
+#define _HOST_STACK_BLE_H_
+
+/**
+ * \file BLE.h
+ * \brief Host stand-in of the mbed OS BLE API
+ * \details A functional model of the parts of the stack the GAP, GATT server and service classes use. The
+ * 			GATT server assigns the handles as the Cordio stack does, stores the attribute values, runs the
+ * 			authorization callbacks and keeps the CCCD state and a limited pool of transmit buffers. Nothing is
+ * 			sent over the air: the host tools play the peer by calling the inject functions, which queue the
+ * 			event in the stack and signal onEventsToProcess(), so the events reach the classes through
+ * 			BLE::processEvents() on the event queue as on the device. The security manager pairs whoever asks.
+ * 			The GATT client talks to the GattServer of an other host stack, attached as the peer of a connection.
+ */
+
+#include "mbed.h"
+
+#include <deque>
+#include <vector>
+
+enum ble_error_t {
+	BLE_ERROR_NONE = 0,
+	BLE_ERROR_BUFFER_OVERFLOW = 1,
+	BLE_ERROR_NOT_IMPLEMENTED = 2,
+	BLE_ERROR_PARAM_OUT_OF_RANGE = 3,
+	BLE_ERROR_INVALID_PARAM = 4,
+	BLE_STACK_BUSY = 5,
+	BLE_ERROR_INVALID_STATE = 6,
+	BLE_ERROR_NO_MEM = 7,
+	BLE_ERROR_OPERATION_NOT_PERMITTED = 8,
+	BLE_ERROR_INITIALIZATION_INCOMPLETE = 9,
+	BLE_ERROR_ALREADY_INITIALIZED = 10,
+	BLE_ERROR_UNSPECIFIED = 11,
+	BLE_ERROR_INTERNAL_STACK_FAILURE = 12,
+	BLE_ERROR_NOT_FOUND = 13,
+};
+
+namespace BLEProtocol {
+struct AddressType {
+	enum Type { PUBLIC = 0, RANDOM_STATIC, RANDOM_PRIVATE_RESOLVABLE, RANDOM_PRIVATE_NON_RESOLVABLE };
+};
+typedef AddressType::Type AddressType_t;
+typedef uint8_t AddressBytes_t[6];
+struct Address_t {
+	AddressType_t type;
+	AddressBytes_t address;
+};
+} // namespace BLEProtocol
+
+namespace host_stack {
+
+/**
+ * \brief The events the stack has for the application, drained by BLE::processEvents()
+ *
+ */
+class CStackEvents {
+  private:
+	std::deque<std::function<void()>> _pending; //!< The events not processed yet
+	mbed::Callback<void()> _signal;				//!< Calls the onEventsToProcess callback of the application
+
+  public:
+	void setSignal(mbed::Callback<void()> signal) { _signal = signal; }
+
+	/**
+	 * \brief Queues an event and signals the application
+	 *
+	 */
+	void post(std::function<void()> event) {
+		_pending.push_back(event);
+		if (_signal) {
+			_signal();
+		}
+	}
+
+	/**
+	 * \brief Runs the queued events, including the ones queued while processing
+	 *
+	 */
+	void process() {
+		while (!_pending.empty()) {
+			std::function<void()> event = _pending.front();
+			_pending.pop_front();
+			event();
+		}
+	}
+
+	size_t pending() const { return _pending.size(); }
+};
+
+} // namespace host_stack
+
+namespace ble {
+
+typedef uint16_t connection_handle_t;
+typedef uint16_t attribute_handle_t;
+typedef uint8_t advertising_handle_t;
+static const advertising_handle_t LEGACY_ADVERTISING_HANDLE = 0;
+static const uint8_t LEGACY_ADVERTISING_MAX_SIZE = 31;
+
+template <typename E> struct SafeEnum {
+	E _v;
+	SafeEnum(E v) : _v(v) {}
+	E value() const { return _v; }
+	bool operator==(SafeEnum o) const { return _v == o._v; }
+	bool operator!=(SafeEnum o) const { return _v != o._v; }
+};
+
+struct peer_address_type_t : SafeEnum<uint8_t> {
+	enum type { PUBLIC = 0, RANDOM, PUBLIC_IDENTITY, RANDOM_STATIC_IDENTITY, ANONYMOUS = 0xFF };
+	peer_address_type_t(type t = PUBLIC) : SafeEnum<uint8_t>(t) {}
+	peer_address_type_t(uint8_t t) : SafeEnum<uint8_t>(t) {}
+};
+struct own_address_type_t {
+	enum type { PUBLIC, RANDOM, RESOLVABLE_PRIVATE_ADDRESS_PUBLIC_FALLBACK };
+};
+struct connection_role_t : SafeEnum<uint8_t> {
+	enum type { CENTRAL = 0, PERIPHERAL };
+	connection_role_t(type t = PERIPHERAL) : SafeEnum<uint8_t>(t) {}
+};
+
+template <size_t N> struct byte_array_t {
+	uint8_t _v[N];
+	byte_array_t() { memset(_v, 0, N); }
+	byte_array_t(const uint8_t *p) { memcpy(_v, p, N); }
+	uint8_t &operator[](size_t i) { return _v[i]; }
+	const uint8_t &operator[](size_t i) const { return _v[i]; }
+	uint8_t *data() { return _v; }
+	const uint8_t *data() const { return _v; }
+	static size_t size() { return N; }
+	bool operator==(const byte_array_t &o) const { return memcmp(_v, o._v, N) == 0; }
+	bool operator!=(const byte_array_t &o) const { return !(*this == o); }
+};
+struct address_t : byte_array_t<6> {
+	address_t() {}
+	address_t(const uint8_t *p) : byte_array_t<6>(p) {}
+};
+typedef byte_array_t<16> csrk_t;
+typedef byte_array_t<16> ltk_t;
+typedef byte_array_t<16> irk_t;
+typedef byte_array_t<8> rand_t;
+typedef byte_array_t<2> ediv_t;
+typedef uint32_t sign_count_t;
+
+struct link_encryption_t : SafeEnum<uint8_t> {
+	enum type { NOT_ENCRYPTED, ENCRYPTION_IN_PROGRESS, ENCRYPTED, ENCRYPTED_WITH_MITM, ENCRYPTED_WITH_SC_AND_MITM };
+	link_encryption_t(type t) : SafeEnum<uint8_t>(t) {}
+};
+struct att_security_requirement_t : SafeEnum<uint8_t> {
+	enum type { NONE, UNAUTHENTICATED, AUTHENTICATED, SC_AUTHENTICATED };
+	att_security_requirement_t(type t = NONE) : SafeEnum<uint8_t>(t) {}
+};
+struct disconnection_reason_t : SafeEnum<uint8_t> {
+	enum type {
+		AUTHENTICATION_FAILURE = 0x05,
+		CONNECTION_TIMEOUT = 0x08,
+		REMOTE_USER_TERMINATED_CONNECTION = 0x13,
+		REMOTE_DEV_TERMINATION_DUE_TO_LOW_RESOURCES = 0x14,
+		REMOTE_DEV_TERMINATION_DUE_TO_POWER_OFF = 0x15,
+		LOCAL_HOST_TERMINATED_CONNECTION = 0x16,
+		UNACCEPTABLE_CONNECTION_PARAMETERS = 0x3B
+	};
+	disconnection_reason_t(type t) : SafeEnum<uint8_t>(t) {}
+};
+struct local_disconnection_reason_t : SafeEnum<uint8_t> {
+	enum type { USER_TERMINATION = 0x13, AUTHENTICATION_FAILURE = 0x05, LOW_RESOURCES = 0x14, POWER_OFF = 0x15 };
+	local_disconnection_reason_t(type t) : SafeEnum<uint8_t>(t) {}
+};
+struct advertising_type_t : SafeEnum<uint8_t> {
+	enum type { CONNECTABLE_UNDIRECTED, CONNECTABLE_DIRECTED, SCANNABLE_UNDIRECTED, NON_CONNECTABLE_UNDIRECTED };
+	advertising_type_t(type t) : SafeEnum<uint8_t>(t) {}
+};
+struct advertising_filter_policy_t : SafeEnum<uint8_t> {
+	enum type { NO_FILTER, FILTER_SCAN_REQUESTS, FILTER_CONNECTION_REQUEST, FILTER_SCAN_AND_CONNECTION_REQUESTS };
+	advertising_filter_policy_t(type t) : SafeEnum<uint8_t>(t) {}
+};
+struct scanning_filter_policy_t : SafeEnum<uint8_t> {
+	enum type { NO_FILTER, FILTER_ADVERTISING };
+	scanning_filter_policy_t(type t) : SafeEnum<uint8_t>(t) {}
+};
+struct duplicates_filter_t : SafeEnum<uint8_t> {
+	enum type { DISABLE, ENABLE, PERIODIC_RESET };
+	duplicates_filter_t(type t) : SafeEnum<uint8_t>(t) {}
+};
+struct phy_t : SafeEnum<uint8_t> {
+	enum type { NONE, LE_1M, LE_2M, LE_CODED };
+	phy_t(type t = LE_1M) : SafeEnum<uint8_t>(t) {}
+};
+
+struct millisecond_t {
+	uint32_t v;
+	explicit millisecond_t(uint32_t x) : v(x) {}
+	uint32_t value() const { return v; }
+};
+struct adv_interval_t {
+	uint32_t v; //!< The interval in milliseconds
+	adv_interval_t(millisecond_t m) : v(m.v) {}
+	explicit adv_interval_t(uint32_t x = 0) : v(x) {}
+	uint32_t valueInMs() const { return v; }
+};
+struct scan_interval_t {
+	uint32_t v;
+	scan_interval_t(millisecond_t m) : v(m.v) {}
+};
+struct scan_window_t {
+	uint32_t v;
+	scan_window_t(millisecond_t m) : v(m.v) {}
+};
+struct scan_duration_t {
+	uint32_t v;
+	scan_duration_t(millisecond_t m = millisecond_t(0)) : v(m.v) {}
+};
+struct scan_period_t {
+	uint32_t v;
+	scan_period_t(millisecond_t m = millisecond_t(0)) : v(m.v) {}
+};
+struct adv_duration_t {
+	uint32_t v;
+	adv_duration_t(millisecond_t m = millisecond_t(0)) : v(m.v) {}
+};
+typedef int8_t rssi_t;
+typedef int8_t advertising_power_t;
+
+template <typename T> struct Span {
+	T *_p;
+	size_t _n;
+	Span(T *p = nullptr, size_t n = 0) : _p(p), _n(n) {}
+	T *data() const { return _p; }
+	size_t size() const { return _n; }
+	T &operator[](size_t i) const { return _p[i]; }
+};
+typedef Span<const uint8_t> adv_data_t;
+
+class AdvertisingParameters {
+  private:
+	advertising_type_t _type;
+	adv_interval_t _minInterval;
+	advertising_filter_policy_t _filter;
+
+  public:
+	AdvertisingParameters(advertising_type_t type = advertising_type_t::CONNECTABLE_UNDIRECTED,
+						  adv_interval_t minInterval = adv_interval_t(millisecond_t(100)),
+						  adv_interval_t maxInterval = adv_interval_t(millisecond_t(100)),
+						  bool legacy = true)
+		: _type(type), _minInterval(minInterval), _filter(advertising_filter_policy_t::NO_FILTER) {
+		(void)maxInterval;
+		(void)legacy;
+	}
+	AdvertisingParameters &setFilter(advertising_filter_policy_t filter) {
+		_filter = filter;
+		return *this;
+	}
+	AdvertisingParameters &setType(advertising_type_t type) {
+		_type = type;
+		return *this;
+	}
+	AdvertisingParameters &setOwnAddressType(own_address_type_t::type) { return *this; }
+	advertising_type_t getType() const { return _type; }
+	adv_interval_t getMinPrimaryInterval() const { return _minInterval; }
+	advertising_filter_policy_t getFilter() const { return _filter; }
+};
+
+class ScanParameters {
+  public:
+	ScanParameters(phy_t = phy_t::LE_1M,
+				   scan_interval_t = millisecond_t(100),
+				   scan_window_t = millisecond_t(100),
+				   bool = false) {}
+	ScanParameters &setFilter(scanning_filter_policy_t) { return *this; }
+	ScanParameters &set1mPhyConfiguration(scan_interval_t, scan_window_t, bool) { return *this; }
+};
+
+/**
+ * \brief Builds the flags and the complete local name AD structures
+ *
+ */
+class AdvertisingDataBuilder {
+  private:
+	uint8_t *_buffer;
+	size_t _capacity;
+	uint8_t _flags;
+	const char *_name;
+	size_t _size;
+
+	void build() {
+		_size = 0;
+		if (_capacity >= 3) {
+			_buffer[_size++] = 2;
+			_buffer[_size++] = 0x01;
+			_buffer[_size++] = _flags;
+		}
+		if (_name != nullptr) {
+			size_t length = strlen(_name);
+			length = (_size + 2 + length > _capacity) ? _capacity - _size - 2 : length;
+			_buffer[_size++] = (uint8_t)(length + 1);
+			_buffer[_size++] = 0x09;
+			memcpy(_buffer + _size, _name, length);
+			_size += length;
+		}
+	}
+
+  public:
+	AdvertisingDataBuilder(uint8_t *buffer, size_t capacity = LEGACY_ADVERTISING_MAX_SIZE)
+		: _buffer(buffer), _capacity(capacity), _flags(0x06), _name(nullptr), _size(0) {}
+	template <size_t N>
+	AdvertisingDataBuilder(uint8_t (&buffer)[N])
+		: _buffer(buffer), _capacity(N), _flags(0x06), _name(nullptr), _size(0) {}
+	ble_error_t setFlags(uint8_t flags = 0x06) {
+		_flags = flags;
+		build();
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t setName(const char *name) {
+		_name = name;
+		build();
+		return BLE_ERROR_NONE;
+	}
+	Span<const uint8_t> getAdvertisingData() const { return Span<const uint8_t>(_buffer, _size); }
+	void clear() {
+		_name = nullptr;
+		_size = 0;
+	}
+};
+
+class ConnectionCompleteEvent {
+  private:
+	ble_error_t _status;
+	connection_handle_t _handle;
+	peer_address_type_t _peerAddressType;
+	address_t _peerAddress;
+	connection_role_t _ownRole;
+
+  public:
+	ConnectionCompleteEvent(ble_error_t status,
+							connection_handle_t handle,
+							peer_address_type_t peerAddressType,
+							const address_t &peerAddress,
+							connection_role_t ownRole = connection_role_t::PERIPHERAL)
+		: _status(status), _handle(handle), _peerAddressType(peerAddressType), _peerAddress(peerAddress),
+		  _ownRole(ownRole) {}
+	ble_error_t getStatus() const { return _status; }
+	connection_handle_t getConnectionHandle() const { return _handle; }
+	connection_role_t getOwnRole() const { return _ownRole; }
+	peer_address_type_t getPeerAddressType() const { return _peerAddressType; }
+	const address_t &getPeerAddress() const { return _peerAddress; }
+	const address_t &getPeerResolvablePrivateAddress() const { return _peerAddress; }
+};
+
+class AdvertisingEndEvent {
+  private:
+	advertising_handle_t _advHandle;
+	bool _connected;
+
+  public:
+	AdvertisingEndEvent(advertising_handle_t advHandle, bool connected)
+		: _advHandle(advHandle), _connected(connected) {}
+	bool isConnected() const { return _connected; }
+	advertising_handle_t getAdvHandle() const { return _advHandle; }
+};
+
+class DisconnectionCompleteEvent {
+  private:
+	connection_handle_t _handle;
+	disconnection_reason_t _reason;
+
+  public:
+	DisconnectionCompleteEvent(connection_handle_t handle, disconnection_reason_t reason)
+		: _handle(handle), _reason(reason) {}
+	connection_handle_t getConnectionHandle() const { return _handle; }
+	disconnection_reason_t getReason() const { return _reason; }
+};
+
+class AdvertisingReportEvent {
+  private:
+	peer_address_type_t _peerAddressType;
+	address_t _peerAddress;
+	rssi_t _rssi;
+	adv_data_t _payload;
+	bool _connectable;
+
+  public:
+	AdvertisingReportEvent(peer_address_type_t peerAddressType,
+						   const address_t &peerAddress,
+						   rssi_t rssi,
+						   adv_data_t payload,
+						   bool connectable)
+		: _peerAddressType(peerAddressType), _peerAddress(peerAddress), _rssi(rssi), _payload(payload),
+		  _connectable(connectable) {}
+	peer_address_type_t getPeerAddressType() const { return _peerAddressType; }
+	const address_t &getPeerAddress() const { return _peerAddress; }
+	rssi_t getRssi() const { return _rssi; }
+	const adv_data_t &getPayload() const { return _payload; }
+	bool isConnectable() const { return _connectable; }
+};
+
+class ScanTimeoutEvent {};
+class ConnectionParameters {};
+
+/**
+ * \brief The GAP of the host stack
+ *
+ */
+class Gap {
+  public:
+	typedef BLEProtocol::AddressType_t AddressType_t;
+	typedef uint8_t Address_t[6];
+	static const unsigned ADDR_LEN = 6;
+	struct PeripheralPrivacyConfiguration_t {
+		bool use_non_resolvable_random_address;
+		enum resolution_strategy_t {
+			DO_NOT_RESOLVE,
+			REJECT_NON_RESOLVED_ADDRESS,
+			PERFORM_PAIRING_PROCEDURE,
+			PERFORM_AUTHENTICATION_PROCEDURE
+		} resolution_strategy;
+	};
+	struct Whitelist_t {
+		BLEProtocol::Address_t *addresses;
+		uint8_t size;
+		uint8_t capacity;
+	};
+
+	class EventHandler {
+	  public:
+		virtual void onConnectionComplete(const ConnectionCompleteEvent &) {}
+		virtual void onAdvertisingEnd(const AdvertisingEndEvent &) {}
+		virtual void onDisconnectionComplete(const DisconnectionCompleteEvent &) {}
+		virtual void onDataLengthChange(connection_handle_t, uint16_t, uint16_t) {}
+		virtual void onAdvertisingReport(const AdvertisingReportEvent &) {}
+		virtual void onScanTimeout(const ScanTimeoutEvent &) {}
+
+	  protected:
+		~EventHandler() {}
+	};
+
+  private:
+	host_stack::CStackEvents &_events;
+	EventHandler *_handler;
+	Address_t _address;				  //!< The device address
+	bool _advertising;				  //!< Set while advertising
+	AdvertisingParameters _parameters; //!< The advertising parameters
+	std::vector<BLEProtocol::Address_t> _whitelist;
+	mbed::Callback<void(connection_handle_t)> _onLinkLost; //!< Lets the GATT server drop the link state
+
+  public:
+	Gap(host_stack::CStackEvents &events) : _events(events), _handler(nullptr), _address(), _advertising(false) {}
+
+	ble_error_t getAddress(AddressType_t *type, Address_t address) {
+		*type = BLEProtocol::AddressType::RANDOM_STATIC;
+		memcpy(address, _address, ADDR_LEN);
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t setDeviceName(const uint8_t *) { return BLE_ERROR_NONE; }
+	ble_error_t setAdvertisingParameters(advertising_handle_t, const AdvertisingParameters &parameters) {
+		_parameters = parameters;
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t setAdvertisingPayload(advertising_handle_t, Span<const uint8_t>) { return BLE_ERROR_NONE; }
+	ble_error_t startAdvertising(advertising_handle_t, adv_duration_t = adv_duration_t(), uint8_t = 0) {
+		_advertising = true;
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t stopAdvertising(advertising_handle_t) {
+		_advertising = false;
+		return BLE_ERROR_NONE;
+	}
+	bool isAdvertisingActive(advertising_handle_t) { return _advertising; }
+	ble_error_t enablePrivacy(bool) { return BLE_ERROR_NONE; }
+	ble_error_t setPeripheralPrivacyConfiguration(const PeripheralPrivacyConfiguration_t *) { return BLE_ERROR_NONE; }
+	void setEventHandler(EventHandler *handler) { _handler = handler; }
+	uint8_t getMaxWhitelistSize() const { return 8; }
+	ble_error_t getWhitelist(Whitelist_t &whitelist) const {
+		whitelist.size = 0;
+		for (size_t ii = 0; ii < _whitelist.size() && whitelist.size < whitelist.capacity; ii++) {
+			whitelist.addresses[whitelist.size++] = _whitelist[ii];
+		}
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t setWhitelist(const Whitelist_t &whitelist) {
+		if (_advertising) {
+			return BLE_ERROR_INVALID_STATE;
+		}
+		_whitelist.assign(whitelist.addresses, whitelist.addresses + whitelist.size);
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t setScanParameters(const ScanParameters &) { return BLE_ERROR_NONE; }
+	ble_error_t startScan(duplicates_filter_t = duplicates_filter_t::DISABLE,
+						  scan_duration_t = scan_duration_t(),
+						  scan_period_t = scan_period_t()) {
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t stopScan() { return BLE_ERROR_NONE; }
+	ble_error_t disconnect(connection_handle_t handle, local_disconnection_reason_t) {
+		injectDisconnection(handle, disconnection_reason_t::LOCAL_HOST_TERMINATED_CONNECTION);
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t connect(peer_address_type_t, const address_t &, const ConnectionParameters &) { return BLE_ERROR_NONE; }
+	ble_error_t cancelConnect() { return BLE_ERROR_NONE; }
+
+	/**
+	 * \name Host stack functions
+	 * The host tools play the radio and the peers with these.
+	 * @{
+	 */
+	void setAddress(const Address_t address) { memcpy(_address, address, ADDR_LEN); }
+	const AdvertisingParameters &getAdvertisingParameters() const { return _parameters; }
+	void setOnLinkLost(mbed::Callback<void(connection_handle_t)> onLinkLost) { _onLinkLost = onLinkLost; }
+
+	/**
+	 * \brief Checks whether the controller would accept a connection request of a peer
+	 *
+	 */
+	bool acceptsConnection(const BLEProtocol::AddressBytes_t peer) const {
+		if (!_advertising) {
+			return false;
+		}
+		if (_parameters.getFilter() == advertising_filter_policy_t::NO_FILTER ||
+			_parameters.getFilter() == advertising_filter_policy_t::FILTER_SCAN_REQUESTS) {
+			return true;
+		}
+		for (auto &entry : _whitelist) {
+			if (memcmp(entry.address, peer, ADDR_LEN) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/**
+	 * \brief A peer connects, or a connect() completes in the central role. The legacy advertising stops
+	 * 		  when a peer connects to it.
+	 *
+	 */
+	void injectConnection(connection_handle_t handle,
+						  peer_address_type_t peerAddressType,
+						  const address_t &peerAddress,
+						  ble_error_t status = BLE_ERROR_NONE,
+						  connection_role_t ownRole = connection_role_t::PERIPHERAL) {
+		if (status == BLE_ERROR_NONE && ownRole == connection_role_t::PERIPHERAL) {
+			_advertising = false;
+		}
+		_events.post([this, handle, peerAddressType, peerAddress, status, ownRole]() {
+			if (_handler != nullptr) {
+				_handler->onConnectionComplete(
+					ConnectionCompleteEvent(status, handle, peerAddressType, peerAddress, ownRole));
+			}
+		});
+	}
+
+	/**
+	 * \brief The link is lost or closed
+	 *
+	 */
+	void injectDisconnection(connection_handle_t handle, disconnection_reason_t reason) {
+		if (_onLinkLost) {
+			_onLinkLost(handle);
+		}
+		_events.post([this, handle, reason]() {
+			if (_handler != nullptr) {
+				_handler->onDisconnectionComplete(DisconnectionCompleteEvent(handle, reason));
+			}
+		});
+	}
+
+	/**
+	 * \brief The advertising ends
+	 *
+	 */
+	void injectAdvertisingEnd(bool connected) {
+		_advertising = false;
+		_events.post([this, connected]() {
+			if (_handler != nullptr) {
+				_handler->onAdvertisingEnd(AdvertisingEndEvent(LEGACY_ADVERTISING_HANDLE, connected));
+			}
+		});
+	}
+	/** @}*/
+};
+
+} // namespace ble
+
+typedef ble::Gap Gap;
+
+/**
+ * \brief A 16 bit or a 128 bit UUID. The long UUIDs are stored little endian as by mbed.
+ *
+ */
+class UUID {
+  public:
+	enum UUID_Type_t { UUID_TYPE_SHORT = 0, UUID_TYPE_LONG = 1 };
+	typedef uint16_t ShortUUIDBytes_t;
+	static const unsigned LENGTH_OF_LONG_UUID = 16;
+
+  private:
+	UUID_Type_t _type;
+	uint8_t _base[LENGTH_OF_LONG_UUID];
+	ShortUUIDBytes_t _short;
+
+	static int hexDigit(char c) {
+		if (c >= '0' && c <= '9') {
+			return c - '0';
+		}
+		if (c >= 'a' && c <= 'f') {
+			return c - 'a' + 10;
+		}
+		if (c >= 'A' && c <= 'F') {
+			return c - 'A' + 10;
+		}
+		return -1;
+	}
+
+  public:
+	UUID(ShortUUIDBytes_t uuid = 0) : _type(UUID_TYPE_SHORT), _base(), _short(uuid) {
+		_base[0] = (uint8_t)uuid;
+		_base[1] = (uint8_t)(uuid >> 8);
+	}
+	template <size_t N> UUID(const char (&uuid)[N]) : _type(UUID_TYPE_LONG), _base(), _short(0) { parse(uuid); }
+	ShortUUIDBytes_t getShortUUID() const { return _short; }
+	const uint8_t *getBaseUUID() const { return _base; }
+	uint8_t getLen() const { return (_type == UUID_TYPE_SHORT) ? 2 : LENGTH_OF_LONG_UUID; }
+	UUID_Type_t shortOrLong() const { return _type; }
+	bool operator==(const UUID &other) const {
+		return _type == other._type && memcmp(_base, other._base, getLen()) == 0;
+	}
+
+  private:
+	/**
+	 * \brief Parses the "xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx" form
+	 *
+	 */
+	void parse(const char *uuid) {
+		int index = LENGTH_OF_LONG_UUID - 1;
+		for (const char *p = uuid; *p != '\0' && p[1] != '\0' && index >= 0;) {
+			if (*p == '-') {
+				p++;
+				continue;
+			}
+			_base[index--] = (uint8_t)((hexDigit(p[0]) << 4) | hexDigit(p[1]));
+			p += 2;
+		}
+		_short = (ShortUUIDBytes_t)((_base[13] << 8) | _base[12]);
+	}
+};
+
+#define BLE_UUID_UNKNOWN 0
+
+class GattAttribute {
+  public:
+	typedef ble::attribute_handle_t Handle_t;
+	static const Handle_t INVALID_HANDLE = 0;
+
+	GattAttribute(const UUID &uuid,
+				  uint8_t *value = NULL,
+				  uint16_t len = 0,
+				  uint16_t maxLen = 0,
+				  bool hasVariableLen = true)
+		: _uuid(uuid), _value(value), _len(len), _maxLen(maxLen), _variableLen(hasVariableLen), _handle(0) {}
+	Handle_t getHandle() const { return _handle; }
+	const UUID &getUUID() const { return _uuid; }
+	uint16_t getLength() const { return _len; }
+	uint16_t getMaxLength() const { return _maxLen; }
+	uint16_t *getLengthPtr() { return &_len; }
+	uint8_t *getValuePtr() { return _value; }
+	bool hasVariableLength() const { return _variableLen; }
+	void setHandle(Handle_t handle) { _handle = handle; }
+	void setReadSecurityRequirement(ble::att_security_requirement_t) {}
+	void setWriteSecurityRequirement(ble::att_security_requirement_t) {}
+	void allowRead(bool) {}
+	void allowWrite(bool) {}
+
+  private:
+	UUID _uuid;
+	uint8_t *_value;
+	uint16_t _len;
+	uint16_t _maxLen;
+	bool _variableLen;
+	Handle_t _handle;
+};
+
+enum { BLE_GATT_UNIT_NONE = 0x2700, BLE_GATT_FORMAT_UINT8 = 4 };
+
+struct GattWriteCallbackParams {
+	enum WriteOp_t {
+		OP_INVALID = 0x00,
+		OP_WRITE_REQ = 0x01,
+		OP_WRITE_CMD = 0x02,
+		OP_SIGN_WRITE_CMD = 0x03,
+		OP_PREP_WRITE_REQ = 0x04,
+		OP_EXEC_WRITE_REQ_CANCEL = 0x05,
+		OP_EXEC_WRITE_REQ_NOW = 0x06,
+	};
+	ble::connection_handle_t connHandle;
+	GattAttribute::Handle_t handle;
+	WriteOp_t writeOp;
+	uint16_t offset;
+	uint16_t len;
+	const uint8_t *data;
+};
+
+struct GattReadCallbackParams {
+	ble::connection_handle_t connHandle;
+	GattAttribute::Handle_t handle;
+	uint16_t offset;
+	uint16_t len;
+	const uint8_t *data;
+	ble_error_t status;
+};
+
+enum GattAuthCallbackReply_t {
+	AUTH_CALLBACK_REPLY_SUCCESS = 0x00,
+	AUTH_CALLBACK_REPLY_ATTERR_INVALID_HANDLE = 0x0101,
+	AUTH_CALLBACK_REPLY_ATTERR_READ_NOT_PERMITTED = 0x0102,
+	AUTH_CALLBACK_REPLY_ATTERR_WRITE_NOT_PERMITTED = 0x0103,
+	AUTH_CALLBACK_REPLY_ATTERR_INVALID_PDU = 0x0104,
+	AUTH_CALLBACK_REPLY_ATTERR_INSUF_AUTHENTICATION = 0x0105,
+	AUTH_CALLBACK_REPLY_ATTERR_REQUEST_NOT_SUPPORTED = 0x0106,
+	AUTH_CALLBACK_REPLY_ATTERR_INVALID_OFFSET = 0x0107,
+	AUTH_CALLBACK_REPLY_ATTERR_INSUF_AUTHORIZATION = 0x0108,
+	AUTH_CALLBACK_REPLY_ATTERR_PREPARE_QUEUE_FULL = 0x0109,
+	AUTH_CALLBACK_REPLY_ATTERR_ATTRIBUTE_NOT_FOUND = 0x010A,
+	AUTH_CALLBACK_REPLY_ATTERR_ATTRIBUTE_NOT_LONG = 0x010B,
+	AUTH_CALLBACK_REPLY_ATTERR_INSUF_ENCRYPTION_KEY_SIZE = 0x010C,
+	AUTH_CALLBACK_REPLY_ATTERR_INVALID_ATT_VAL_LENGTH = 0x010D,
+	AUTH_CALLBACK_REPLY_ATTERR_UNLIKELY_ERROR = 0x010E,
+	AUTH_CALLBACK_REPLY_ATTERR_INSUF_ENCRYPTION = 0x010F,
+	AUTH_CALLBACK_REPLY_ATTERR_UNSUPPORTED_GROUP_TYPE = 0x0110,
+	AUTH_CALLBACK_REPLY_ATTERR_INSUF_RESOURCES = 0x0111,
+	AUTH_CALLBACK_REPLY_ATTERR_APP_BEGIN = 0x0180,
+	AUTH_CALLBACK_REPLY_ATTERR_APP_END = 0x019F,
+	AUTH_CALLBACK_REPLY_ATTERR_WRITE_REQUEST_REJECTED = 0x01FC,
+	AUTH_CALLBACK_REPLY_ATTERR_CLIENT_CHARACTERISTIC_CONFIGURATION_DESCRIPTOR_IMPROPERLY_CONFIGURED = 0x01FD,
+	AUTH_CALLBACK_REPLY_ATTERR_PROCEDURE_ALREADY_IN_PROGRESS = 0x01FE,
+	AUTH_CALLBACK_REPLY_ATTERR_OUT_OF_RANGE = 0x01FF,
+};
+
+struct GattWriteAuthCallbackParams {
+	ble::connection_handle_t connHandle;
+	GattAttribute::Handle_t handle;
+	uint16_t offset;
+	uint16_t len;
+	const uint8_t *data;
+	GattAuthCallbackReply_t authorizationReply;
+};
+
+struct GattReadAuthCallbackParams {
+	ble::connection_handle_t connHandle;
+	GattAttribute::Handle_t handle;
+	uint16_t offset;
+	uint16_t len;
+	uint8_t *data;
+	GattAuthCallbackReply_t authorizationReply;
+};
+
+class GattCharacteristic {
+  public:
+	enum {
+		UUID_ALERT_LEVEL_CHAR = 0x2A06,
+		UUID_SUPPORTED_NEW_ALERT_CATEGORY_CHAR = 0x2A47,
+		UUID_SUPPORTED_UNREAD_ALERT_CATEGORY_CHAR = 0x2A48,
+		UUID_UNREAD_ALERT_CHAR = 0x2A45,
+		UUID_NEW_ALERT_CHAR = 0x2A46,
+		UUID_ALERT_NOTIFICATION_CONTROL_POINT_CHAR = 0x2A44,
+		UUID_SERVICE_CHANGED_CHAR = 0x2A05,
+		BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG = 0x2902,
+	};
+	enum Properties_t {
+		BLE_GATT_CHAR_PROPERTIES_NONE = 0x00,
+		BLE_GATT_CHAR_PROPERTIES_BROADCAST = 0x01,
+		BLE_GATT_CHAR_PROPERTIES_READ = 0x02,
+		BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE = 0x04,
+		BLE_GATT_CHAR_PROPERTIES_WRITE = 0x08,
+		BLE_GATT_CHAR_PROPERTIES_NOTIFY = 0x10,
+		BLE_GATT_CHAR_PROPERTIES_INDICATE = 0x20,
+		BLE_GATT_CHAR_PROPERTIES_AUTHENTICATED_SIGNED_WRITES = 0x40,
+		BLE_GATT_CHAR_PROPERTIES_EXTENDED_PROPERTIES = 0x80,
+	};
+	typedef ble::att_security_requirement_t SecurityRequirement_t;
+
+	GattCharacteristic(const UUID &uuid,
+					   uint8_t *valuePtr = NULL,
+					   uint16_t len = 0,
+					   uint16_t maxLen = 0,
+					   uint8_t props = BLE_GATT_CHAR_PROPERTIES_NONE,
+					   GattAttribute *descriptors[] = NULL,
+					   unsigned numDescriptors = 0,
+					   bool hasVariableLen = true)
+		: _valueAttribute(uuid, valuePtr, len, maxLen, hasVariableLen), _props(props), _descriptors(descriptors),
+		  _descriptorCount((uint8_t)numDescriptors), _writeSecurity(SecurityRequirement_t::NONE) {}
+
+	GattAttribute &getValueAttribute() { return _valueAttribute; }
+	const GattAttribute &getValueAttribute() const { return _valueAttribute; }
+	GattAttribute::Handle_t getValueHandle() const { return _valueAttribute.getHandle(); }
+	uint8_t getProperties() const { return _props; }
+	void setReadSecurityRequirement(SecurityRequirement_t) {}
+	void setWriteSecurityRequirement(SecurityRequirement_t requirement) { _writeSecurity = requirement; }
+	void setUpdateSecurityRequirement(SecurityRequirement_t) {}
+	SecurityRequirement_t getWriteSecurityRequirement() const { return _writeSecurity; }
+
+	void setWriteAuthorizationCallback(void (*callback)(GattWriteAuthCallbackParams *)) {
+		_writeAuthorization = callback;
+	}
+	template <typename T> void setWriteAuthorizationCallback(T *object, void (T::*member)(GattWriteAuthCallbackParams *)) {
+		_writeAuthorization = mbed::Callback<void(GattWriteAuthCallbackParams *)>(object, member);
+	}
+	void setReadAuthorizationCallback(void (*callback)(GattReadAuthCallbackParams *)) {
+		_readAuthorization = callback;
+	}
+	template <typename T> void setReadAuthorizationCallback(T *object, void (T::*member)(GattReadAuthCallbackParams *)) {
+		_readAuthorization = mbed::Callback<void(GattReadAuthCallbackParams *)>(object, member);
+	}
+	bool isReadAuthorizationEnabled() const { return (bool)_readAuthorization; }
+	bool isWriteAuthorizationEnabled() const { return (bool)_writeAuthorization; }
+
+	/**
+	 * \brief Runs the write authorization callback, the reply is success without one
+	 *
+	 */
+	GattAuthCallbackReply_t authorizeWrite(GattWriteAuthCallbackParams *params) {
+		if (!_writeAuthorization) {
+			return AUTH_CALLBACK_REPLY_SUCCESS;
+		}
+		params->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+		_writeAuthorization(params);
+		return params->authorizationReply;
+	}
+	/**
+	 * \brief Runs the read authorization callback, the reply is success without one
+	 *
+	 */
+	GattAuthCallbackReply_t authorizeRead(GattReadAuthCallbackParams *params) {
+		if (!_readAuthorization) {
+			return AUTH_CALLBACK_REPLY_SUCCESS;
+		}
+		params->authorizationReply = AUTH_CALLBACK_REPLY_SUCCESS;
+		_readAuthorization(params);
+		return params->authorizationReply;
+	}
+
+	uint8_t getDescriptorCount() const { return _descriptorCount; }
+	GattAttribute *getDescriptor(uint8_t index) { return (index < _descriptorCount) ? _descriptors[index] : nullptr; }
+
+  private:
+	GattAttribute _valueAttribute;
+	uint8_t _props;
+	GattAttribute **_descriptors;
+	uint8_t _descriptorCount;
+	SecurityRequirement_t _writeSecurity;
+	mbed::Callback<void(GattWriteAuthCallbackParams *)> _writeAuthorization;
+	mbed::Callback<void(GattReadAuthCallbackParams *)> _readAuthorization;
+};
+
+class GattService {
+  public:
+	enum {
+		UUID_GENERIC_ATTRIBUTE_SERVICE = 0x1801,
+		UUID_IMMEDIATE_ALERT_SERVICE = 0x1802,
+		UUID_ALERT_NOTIFICATION_SERVICE = 0x1811,
+	};
+	GattService(const UUID &uuid, GattCharacteristic *characteristics[], unsigned numCharacteristics)
+		: _uuid(uuid), _characteristics(characteristics), _count((uint8_t)numCharacteristics), _handle(0) {}
+	const UUID &getUUID() const { return _uuid; }
+	uint16_t getHandle() const { return _handle; }
+	uint8_t getCharacteristicCount() const { return _count; }
+	GattCharacteristic *getCharacteristic(uint8_t index) { return (index < _count) ? _characteristics[index] : nullptr; }
+	void setHandle(uint16_t handle) { _handle = handle; }
+
+  private:
+	UUID _uuid;
+	GattCharacteristic **_characteristics;
+	uint8_t _count;
+	uint16_t _handle;
+};
+
+/**
+ * \brief The GATT server of the host stack
+ *
+ */
+class GattServer {
+  public:
+	typedef mbed::Callback<void(const GattWriteCallbackParams *)> DataWrittenCallback_t;
+	typedef mbed::Callback<void(GattAttribute::Handle_t, const uint8_t *, uint16_t)> UpdateCallback_t;
+
+  private:
+	/**
+	 * \brief An entry of the attribute table
+	 *
+	 */
+	struct attribute_t {
+		GattAttribute *attribute;			  //!< The attribute, nullptr for the declarations and the CCCDs
+		GattCharacteristic *characteristic; //!< The characteristic of a value attribute
+		uint16_t cccd;						  //!< The client configuration of a value attribute, 1 notify, 2 indicate
+	};
+
+	host_stack::CStackEvents &_events;
+	std::vector<attribute_t> _attributes; //!< The attribute table, index is the handle - 1
+	std::vector<GattService *> _services; //!< The services in the handle order
+	unsigned _txBuffers;				  //!< Number of transmit buffers
+	unsigned _txInFlight;				  //!< Buffers holding updates not sent yet
+	GattAuthCallbackReply_t _lastReply;	  //!< The reply of the last authorized peer operation
+	UpdateCallback_t _onUpdate;			  //!< Sees every update handed to the radio
+	UpdateCallback_t _onPeerUpdate;		  //!< Delivers the updates to a GattClient of the host stack
+
+	mbed::Callback<void(unsigned)> _dataSent;
+	DataWrittenCallback_t _dataWritten;
+	mbed::Callback<void(const GattReadCallbackParams *)> _dataRead;
+	mbed::Callback<void(GattAttribute::Handle_t)> _updatesEnabled;
+	mbed::Callback<void(GattAttribute::Handle_t)> _updatesDisabled;
+	mbed::Callback<void(GattAttribute::Handle_t)> _confirmationReceived;
+
+	attribute_t *find(GattAttribute::Handle_t handle) {
+		if (handle == 0 || handle > _attributes.size() || _attributes[handle - 1].attribute == nullptr) {
+			return nullptr;
+		}
+		return &_attributes[handle - 1];
+	}
+
+	GattAttribute::Handle_t append(GattAttribute *attribute, GattCharacteristic *characteristic) {
+		attribute_t entry = {attribute, characteristic, 0};
+		_attributes.push_back(entry);
+		return (GattAttribute::Handle_t)_attributes.size();
+	}
+
+  public:
+	GattServer(host_stack::CStackEvents &events)
+		: _events(events), _txBuffers(4), _txInFlight(0), _lastReply(AUTH_CALLBACK_REPLY_SUCCESS) {}
+
+	/**
+	 * \brief Adds a service. The handles follow the Cordio layout: the service declaration, then for each
+	 * 		  characteristic its declaration, its value, its CCCD if it notifies or indicates and its descriptors.
+	 *
+	 */
+	ble_error_t addService(GattService &service) {
+		_services.push_back(&service);
+		service.setHandle(append(nullptr, nullptr));
+		for (uint8_t ii = 0; ii < service.getCharacteristicCount(); ii++) {
+			GattCharacteristic *characteristic = service.getCharacteristic(ii);
+			append(nullptr, nullptr);
+			characteristic->getValueAttribute().setHandle(
+				append(&characteristic->getValueAttribute(), characteristic));
+			if ((characteristic->getProperties() & (GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY |
+													 GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE)) != 0) {
+				append(nullptr, nullptr);
+			}
+			for (uint8_t dd = 0; dd < characteristic->getDescriptorCount(); dd++) {
+				GattAttribute *descriptor = characteristic->getDescriptor(dd);
+				descriptor->setHandle(append(descriptor, nullptr));
+			}
+		}
+		return BLE_ERROR_NONE;
+	}
+
+	ble_error_t read(GattAttribute::Handle_t handle, uint8_t *buffer, uint16_t *length) {
+		attribute_t *entry = find(handle);
+		if (entry == nullptr) {
+			return BLE_ERROR_INVALID_PARAM;
+		}
+		uint16_t valueLength = entry->attribute->getLength();
+		memcpy(buffer, entry->attribute->getValuePtr(), (*length < valueLength) ? *length : valueLength);
+		*length = valueLength;
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t read(ble::connection_handle_t, GattAttribute::Handle_t handle, uint8_t *buffer, uint16_t *length) {
+		return read(handle, buffer, length);
+	}
+
+	/**
+	 * \brief Updates a value. Unless local only, a subscribed client is notified or indicated, which takes a
+	 * 		  transmit buffer until the update is reported sent.
+	 *
+	 */
+	ble_error_t write(GattAttribute::Handle_t handle, const uint8_t *value, uint16_t length, bool localOnly = false) {
+		attribute_t *entry = find(handle);
+		if (entry == nullptr) {
+			return BLE_ERROR_INVALID_PARAM;
+		}
+		if (length > entry->attribute->getMaxLength()) {
+			return BLE_ERROR_INVALID_PARAM;
+		}
+		memmove(entry->attribute->getValuePtr(), value, length);
+		*entry->attribute->getLengthPtr() = length;
+		if (localOnly || entry->cccd == 0) {
+			return BLE_ERROR_NONE;
+		}
+		if (_txInFlight >= _txBuffers) {
+			return BLE_ERROR_NO_MEM;
+		}
+		_txInFlight++;
+		if (_onUpdate) {
+			_onUpdate(handle, value, length);
+		}
+		if (_onPeerUpdate) {
+			_onPeerUpdate(handle, value, length);
+		}
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t write(ble::connection_handle_t,
+					  GattAttribute::Handle_t handle,
+					  const uint8_t *value,
+					  uint16_t length,
+					  bool localOnly = false) {
+		return write(handle, value, length, localOnly);
+	}
+
+	ble_error_t areUpdatesEnabled(const GattCharacteristic &characteristic, bool *enabled) {
+		attribute_t *entry = find(characteristic.getValueHandle());
+		*enabled = (entry != nullptr) && (entry->cccd != 0);
+		return (entry != nullptr) ? BLE_ERROR_NONE : BLE_ERROR_INVALID_PARAM;
+	}
+	ble_error_t areUpdatesEnabled(ble::connection_handle_t, const GattCharacteristic &characteristic, bool *enabled) {
+		return areUpdatesEnabled(characteristic, enabled);
+	}
+
+	void onDataSent(mbed::Callback<void(unsigned)> callback) { _dataSent = callback; }
+	void onDataWritten(DataWrittenCallback_t callback) { _dataWritten = callback; }
+	void onDataRead(mbed::Callback<void(const GattReadCallbackParams *)> callback) { _dataRead = callback; }
+	void onUpdatesEnabled(mbed::Callback<void(GattAttribute::Handle_t)> callback) { _updatesEnabled = callback; }
+	void onUpdatesDisabled(mbed::Callback<void(GattAttribute::Handle_t)> callback) { _updatesDisabled = callback; }
+	void onConfirmationReceived(mbed::Callback<void(GattAttribute::Handle_t)> callback) {
+		_confirmationReceived = callback;
+	}
+	void onShutdown(mbed::Callback<void(const GattServer *)>) {}
+
+	/**
+	 * \name Host stack functions
+	 * The host tools play the radio and the client with these.
+	 * @{
+	 */
+	/**
+	 * \brief Sets the number of transmit buffers, an update fails with BLE_ERROR_NO_MEM when none is free
+	 *
+	 */
+	void setTransmitBuffers(unsigned count) { _txBuffers = count; }
+	unsigned getTransmitBuffersInFlight() const { return _txInFlight; }
+	/**
+	 * \brief Sets the callback that sees every notification and indication handed to the radio
+	 *
+	 */
+	void setOnUpdate(UpdateCallback_t callback) { _onUpdate = callback; }
+	/**
+	 * \brief Get the reply of the authorization callback of the last injected read or write
+	 *
+	 */
+	GattAuthCallbackReply_t getLastAuthorizationReply() const { return _lastReply; }
+	/**
+	 * \brief Get the number of attributes, the last handle
+	 *
+	 */
+	GattAttribute::Handle_t getLastHandle() const { return (GattAttribute::Handle_t)_attributes.size(); }
+	/**
+	 * \brief Get the services in the handle order, a GattClient of the host stack discovers them
+	 *
+	 */
+	const std::vector<GattService *> &getServices() const { return _services; }
+	/**
+	 * \brief Get the attribute of a handle, nullptr for the declarations and the CCCDs
+	 *
+	 */
+	GattAttribute *getAttribute(GattAttribute::Handle_t handle) {
+		attribute_t *entry = find(handle);
+		return (entry != nullptr) ? entry->attribute : nullptr;
+	}
+	/**
+	 * \brief Get the value handle of a characteristic whose CCCD has the handle
+	 *
+	 * \return GattAttribute::Handle_t The value handle, GattAttribute::INVALID_HANDLE if the handle is no CCCD
+	 */
+	GattAttribute::Handle_t getCccdValueHandle(GattAttribute::Handle_t handle) const {
+		if (handle < 2 || handle > _attributes.size() || _attributes[handle - 1].attribute != nullptr) {
+			return GattAttribute::INVALID_HANDLE;
+		}
+		const attribute_t &value = _attributes[handle - 2];
+		if (value.characteristic == nullptr ||
+			(value.characteristic->getProperties() & (GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY |
+													   GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE)) == 0) {
+			return GattAttribute::INVALID_HANDLE;
+		}
+		return handle - 1;
+	}
+	/**
+	 * \brief Get the client configuration of a value, 1 notify, 2 indicate, 0 if the client has not subscribed
+	 *
+	 */
+	uint16_t getClientConfiguration(GattAttribute::Handle_t handle) {
+		attribute_t *entry = find(handle);
+		return (entry != nullptr) ? entry->cccd : 0;
+	}
+	/**
+	 * \brief Sets the callback that delivers the notifications and indications to a GattClient of the host stack
+	 *
+	 */
+	void setOnPeerUpdate(UpdateCallback_t callback) { _onPeerUpdate = callback; }
+
+	/**
+	 * \brief The link is gone, the subscriptions end and the pending updates are discarded
+	 *
+	 */
+	void clearLinkState() {
+		for (auto &entry : _attributes) {
+			entry.cccd = 0;
+		}
+		_txInFlight = 0;
+	}
+
+	/**
+	 * \brief A client writes an attribute. The write authorization runs first, as in the stack, and a
+	 * 		  rejected write neither changes the value nor reaches onDataWritten.
+	 *
+	 */
+	void injectWrite(ble::connection_handle_t connection,
+					 GattAttribute::Handle_t handle,
+					 GattWriteCallbackParams::WriteOp_t op,
+					 const uint8_t *data,
+					 uint16_t length,
+					 uint16_t offset = 0) {
+		std::vector<uint8_t> value(data, data + length);
+		_events.post([this, connection, handle, op, value, offset]() {
+			attribute_t *entry = find(handle);
+			if (entry == nullptr) {
+				_lastReply = AUTH_CALLBACK_REPLY_ATTERR_INVALID_HANDLE;
+				return;
+			}
+			uint16_t length = (uint16_t)value.size();
+			if (entry->characteristic != nullptr && op != GattWriteCallbackParams::OP_PREP_WRITE_REQ) {
+				GattWriteAuthCallbackParams params = {connection, handle, offset, length, value.data(),
+													  AUTH_CALLBACK_REPLY_SUCCESS};
+				_lastReply = entry->characteristic->authorizeWrite(&params);
+				if (_lastReply != AUTH_CALLBACK_REPLY_SUCCESS) {
+					return;
+				}
+			} else {
+				_lastReply = AUTH_CALLBACK_REPLY_SUCCESS;
+			}
+			if (op != GattWriteCallbackParams::OP_PREP_WRITE_REQ) {
+				if (offset + length > entry->attribute->getMaxLength()) {
+					_lastReply = AUTH_CALLBACK_REPLY_ATTERR_INVALID_ATT_VAL_LENGTH;
+					return;
+				}
+				memcpy(entry->attribute->getValuePtr() + offset, value.data(), length);
+				if (entry->attribute->hasVariableLength()) {
+					*entry->attribute->getLengthPtr() = offset + length;
+				}
+			}
+			if (_dataWritten) {
+				GattWriteCallbackParams params = {connection, handle, op, offset, length, value.data()};
+				_dataWritten(&params);
+			}
+		});
+	}
+
+	/**
+	 * \brief A client reads an attribute, through the read authorization if the characteristic has one
+	 *
+	 * \param reply Optional, gets the authorization reply and the value, as the response to the client
+	 */
+	void injectRead(ble::connection_handle_t connection,
+					GattAttribute::Handle_t handle,
+					uint16_t offset = 0,
+					std::function<void(GattAuthCallbackReply_t, const uint8_t *, uint16_t)> reply = nullptr) {
+		_events.post([this, connection, handle, offset, reply]() {
+			attribute_t *entry = find(handle);
+			if (entry == nullptr) {
+				_lastReply = AUTH_CALLBACK_REPLY_ATTERR_INVALID_HANDLE;
+				if (reply) {
+					reply(_lastReply, nullptr, 0);
+				}
+				return;
+			}
+			_lastReply = AUTH_CALLBACK_REPLY_SUCCESS;
+			if (entry->characteristic != nullptr) {
+				GattReadAuthCallbackParams params = {connection, handle, offset, entry->attribute->getLength(),
+													 nullptr, AUTH_CALLBACK_REPLY_SUCCESS};
+				_lastReply = entry->characteristic->authorizeRead(&params);
+				if (_lastReply != AUTH_CALLBACK_REPLY_SUCCESS) {
+					if (reply) {
+						reply(_lastReply, nullptr, 0);
+					}
+					return;
+				}
+			}
+			if (_dataRead) {
+				GattReadCallbackParams params = {connection, handle, offset, entry->attribute->getLength(),
+												 entry->attribute->getValuePtr(), BLE_ERROR_NONE};
+				_dataRead(&params);
+			}
+			if (reply) {
+				reply(_lastReply, entry->attribute->getValuePtr(), entry->attribute->getLength());
+			}
+		});
+	}
+
+	/**
+	 * \brief A client writes the CCCD of a characteristic value
+	 *
+	 * \param handle The value handle
+	 * \param configuration 0 to unsubscribe, 1 for notifications, 2 for indications
+	 */
+	void injectSubscription(GattAttribute::Handle_t handle, uint16_t configuration) {
+		_events.post([this, handle, configuration]() {
+			attribute_t *entry = find(handle);
+			if (entry == nullptr) {
+				return;
+			}
+			entry->cccd = configuration;
+			if (configuration != 0 && _updatesEnabled) {
+				_updatesEnabled(handle);
+			} else if (configuration == 0 && _updatesDisabled) {
+				_updatesDisabled(handle);
+			}
+		});
+	}
+
+	/**
+	 * \brief A client confirms an indication
+	 *
+	 */
+	void injectConfirmation(GattAttribute::Handle_t handle) {
+		_events.post([this, handle]() {
+			if (_confirmationReceived) {
+				_confirmationReceived(handle);
+			}
+		});
+	}
+
+	/**
+	 * \brief The radio has sent updates, their transmit buffers are free
+	 *
+	 */
+	void injectDataSent(unsigned count) {
+		_txInFlight = (count > _txInFlight) ? 0 : _txInFlight - count;
+		_events.post([this, count]() {
+			if (_dataSent) {
+				_dataSent(count);
+			}
+		});
+	}
+	/** @}*/
+};
+
+/**
+ * \brief The security manager of the host stack. The bonds are kept in RAM.
+ *
+ */
+class SecurityManager {
+  public:
+	enum SecurityIOCapabilities_t {
+		IO_CAPS_DISPLAY_ONLY = 0x00,
+		IO_CAPS_DISPLAY_YESNO = 0x01,
+		IO_CAPS_KEYBOARD_ONLY = 0x02,
+		IO_CAPS_NONE = 0x03,
+		IO_CAPS_KEYBOARD_DISPLAY = 0x04,
+	};
+	enum SecurityMode_t {
+		SECURITY_MODE_NO_ACCESS,
+		SECURITY_MODE_ENCRYPTION_OPEN_LINK,
+		SECURITY_MODE_ENCRYPTION_NO_MITM,
+		SECURITY_MODE_ENCRYPTION_WITH_MITM,
+		SECURITY_MODE_SIGNED_NO_MITM,
+		SECURITY_MODE_SIGNED_WITH_MITM,
+	};
+	enum SecurityCompletionStatus_t {
+		SEC_STATUS_SUCCESS = 0x00,
+		SEC_STATUS_TIMEOUT = 0x01,
+		SEC_STATUS_PDU_INVALID = 0x02,
+		SEC_STATUS_PASSKEY_ENTRY_FAILED = 0x81,
+		SEC_STATUS_OOB_NOT_AVAILABLE = 0x82,
+		SEC_STATUS_AUTH_REQ = 0x83,
+		SEC_STATUS_CONFIRM_VALUE = 0x84,
+		SEC_STATUS_PAIRING_NOT_SUPP = 0x85,
+		SEC_STATUS_ENC_KEY_SIZE = 0x86,
+		SEC_STATUS_SMP_CMD_UNSUPPORTED = 0x87,
+		SEC_STATUS_UNSPECIFIED = 0x88,
+		SEC_STATUS_REPEATED_ATTEMPTS = 0x89,
+		SEC_STATUS_INVALID_PARAMS = 0x8A,
+		SEC_STATUS_DHKEY_CHECK_FAILED = 0x8B,
+		SEC_STATUS_COMPARISON_FAILED = 0x8C,
+	};
+	enum Keypress_t { KEYPRESS_STARTED, KEYPRESS_ENTERED, KEYPRESS_ERASED, KEYPRESS_CLEARED, KEYPRESS_COMPLETED };
+	static const unsigned PASSKEY_LEN = 6;
+	typedef uint8_t Passkey_t[PASSKEY_LEN];
+
+	class EventHandler {
+	  public:
+		virtual void pairingRequest(ble::connection_handle_t) {}
+		virtual void pairingError(ble::connection_handle_t, SecurityCompletionStatus_t) {}
+		virtual void pairingResult(ble::connection_handle_t, SecurityCompletionStatus_t) {}
+		virtual void linkEncryptionResult(ble::connection_handle_t, ble::link_encryption_t) {}
+		virtual void passkeyDisplay(ble::connection_handle_t, const Passkey_t) {}
+		virtual void confirmationRequest(ble::connection_handle_t) {}
+		virtual void passkeyRequest(ble::connection_handle_t) {}
+		virtual void keypressNotification(ble::connection_handle_t, Keypress_t) {}
+		virtual void signingKey(ble::connection_handle_t, const ble::csrk_t *, bool) {}
+		virtual void legacyPairingOobRequest(ble::connection_handle_t) {}
+		virtual void whitelistFromBondTable(Gap::Whitelist_t *) {}
+
+	  protected:
+		~EventHandler() {}
+	};
+
+  private:
+	host_stack::CStackEvents &_events;
+	EventHandler *_handler;
+	std::vector<BLEProtocol::Address_t> _bonds; //!< The bonded identities
+
+  public:
+	SecurityManager(host_stack::CStackEvents &events) : _events(events), _handler(nullptr) {}
+
+	ble_error_t init(bool = true, bool = true, SecurityIOCapabilities_t = IO_CAPS_NONE, const Passkey_t = NULL,
+					 bool = true, const char * = NULL) {
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t setDatabaseFilepath(const char * = NULL) { return BLE_ERROR_NONE; }
+	ble_error_t preserveBondingStateOnReset(bool) { return BLE_ERROR_NONE; }
+	ble_error_t purgeAllBondingState() {
+		_bonds.clear();
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t generateWhitelistFromBondTable(Gap::Whitelist_t *whitelist) {
+		whitelist->size = 0;
+		for (size_t ii = 0; ii < _bonds.size() && whitelist->size < whitelist->capacity; ii++) {
+			whitelist->addresses[whitelist->size++] = _bonds[ii];
+		}
+		_events.post([this, whitelist]() {
+			if (_handler != nullptr) {
+				_handler->whitelistFromBondTable(whitelist);
+			}
+		});
+		return BLE_ERROR_NONE;
+	}
+	ble_error_t allowLegacyPairing(bool = true) { return BLE_ERROR_NONE; }
+	void setSecurityManagerEventHandler(EventHandler *handler) { _handler = handler; }
+	ble_error_t setPairingRequestAuthorisation(bool = true) { return BLE_ERROR_NONE; }
+	ble_error_t acceptPairingRequest(ble::connection_handle_t) { return BLE_ERROR_NONE; }
+	ble_error_t cancelPairingRequest(ble::connection_handle_t) { return BLE_ERROR_NONE; }
+	ble_error_t setLinkSecurity(ble::connection_handle_t, SecurityMode_t) { return BLE_ERROR_NONE; }
+	ble_error_t setLinkEncryption(ble::connection_handle_t, ble::link_encryption_t) { return BLE_ERROR_NONE; }
+	ble_error_t getLinkEncryption(ble::connection_handle_t, ble::link_encryption_t *) { return BLE_ERROR_NONE; }
+	ble_error_t confirmationEntered(ble::connection_handle_t, bool) { return BLE_ERROR_NONE; }
+	ble_error_t passkeyEntered(ble::connection_handle_t, Passkey_t) { return BLE_ERROR_NONE; }
+	ble_error_t enableSigning(ble::connection_handle_t, bool = true) { return BLE_ERROR_NONE; }
+	ble_error_t getSigningKey(ble::connection_handle_t, bool) { return BLE_ERROR_NONE; }
+	ble_error_t setHintFutureRoleReversal(bool = true) { return BLE_ERROR_NONE; }
+	ble_error_t requestAuthentication(ble::connection_handle_t) { return BLE_ERROR_NONE; }
+	ble_error_t setKeypressNotification(bool = true) { return BLE_ERROR_NONE; }
+
+	/**
+	 * \name Host stack functions
+	 * @{
+	 */
+	/**
+	 * \brief Adds a bonded identity, as a completed pairing would
+	 *
+	 */
+	void addBond(const BLEProtocol::AddressBytes_t address) {
+		BLEProtocol::Address_t bond;
+		bond.type = BLEProtocol::AddressType::PUBLIC;
+		memcpy(bond.address, address, sizeof(bond.address));
+		_bonds.push_back(bond);
+	}
+	void injectPairingRequest(ble::connection_handle_t connection) {
+		_events.post([this, connection]() {
+			if (_handler != nullptr) {
+				_handler->pairingRequest(connection);
+			}
+		});
+	}
+	void injectPairingResult(ble::connection_handle_t connection, SecurityCompletionStatus_t status) {
+		_events.post([this, connection, status]() {
+			if (_handler != nullptr) {
+				_handler->pairingResult(connection, status);
+			}
+		});
+	}
+	void injectLinkEncryption(ble::connection_handle_t connection, ble::link_encryption_t result) {
+		_events.post([this, connection, result]() {
+			if (_handler != nullptr) {
+				_handler->linkEncryptionResult(connection, result);
+			}
+		});
+	}
+	/** @}*/
+};
+
+class GattClient;
+class DiscoveredCharacteristic;
+
+/**
+ * \brief A service found by the service discovery
+ *
+ */
+class DiscoveredService {
+  private:
+	UUID _uuid;
+	GattAttribute::Handle_t _start;
+	GattAttribute::Handle_t _end;
+
+  public:
+	DiscoveredService() : _uuid(), _start(0), _end(0) {}
+	void setup(const UUID &uuid, GattAttribute::Handle_t start, GattAttribute::Handle_t end) {
+		_uuid = uuid;
+		_start = start;
+		_end = end;
+	}
+	const UUID &getUUID() const { return _uuid; }
+	GattAttribute::Handle_t getStartHandle() const { return _start; }
+	GattAttribute::Handle_t getEndHandle() const { return _end; }
+};
+
+/**
+ * \brief A descriptor found by the descriptor discovery
+ *
+ */
+class DiscoveredCharacteristicDescriptor {
+  private:
+	ble::connection_handle_t _connection;
+	GattAttribute::Handle_t _handle;
+	UUID _uuid;
+
+  public:
+	DiscoveredCharacteristicDescriptor(ble::connection_handle_t connection,
+									   GattAttribute::Handle_t handle,
+									   const UUID &uuid)
+		: _connection(connection), _handle(handle), _uuid(uuid) {}
+	ble::connection_handle_t getConnectionHandle() const { return _connection; }
+	GattAttribute::Handle_t getAttributeHandle() const { return _handle; }
+	const UUID &getUUID() const { return _uuid; }
+};
+
+struct CharacteristicDescriptorDiscovery {
+	struct DiscoveryCallbackParams_t {
+		const DiscoveredCharacteristic &characteristic;
+		const DiscoveredCharacteristicDescriptor &descriptor;
+	};
+	struct TerminationCallbackParams_t {
+		const DiscoveredCharacteristic &characteristic;
+		ble_error_t status;
+		uint8_t error_code;
+	};
+	typedef FunctionPointerWithContext<const DiscoveryCallbackParams_t *> DiscoveryCallback_t;
+	typedef FunctionPointerWithContext<const TerminationCallbackParams_t *> TerminationCallback_t;
+};
+
+/**
+ * \brief A characteristic found by the service discovery
+ *
+ */
+class DiscoveredCharacteristic {
+  public:
+	struct Properties_t {
+		uint8_t _bits;
+		Properties_t(uint8_t bits = 0) : _bits(bits) {}
+		bool broadcast() const { return (_bits & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_BROADCAST) != 0; }
+		bool read() const { return (_bits & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ) != 0; }
+		bool writeWoResp() const {
+			return (_bits & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE_WITHOUT_RESPONSE) != 0;
+		}
+		bool write() const { return (_bits & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_WRITE) != 0; }
+		bool notify() const { return (_bits & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY) != 0; }
+		bool indicate() const { return (_bits & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE) != 0; }
+		bool authSignedWrite() const {
+			return (_bits & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_AUTHENTICATED_SIGNED_WRITES) != 0;
+		}
+	};
+	typedef CharacteristicDescriptorDiscovery::DiscoveryCallback_t DescriptorCallback_t;
+	typedef CharacteristicDescriptorDiscovery::TerminationCallback_t DescriptorTerminationCallback_t;
+
+  private:
+	GattClient *_client;
+	ble::connection_handle_t _connection;
+	UUID _uuid;
+	Properties_t _props;
+	GattAttribute::Handle_t _declHandle;
+	GattAttribute::Handle_t _valueHandle;
+	GattAttribute::Handle_t _lastHandle;
+
+  public:
+	DiscoveredCharacteristic()
+		: _client(nullptr), _connection(0), _uuid(), _props(), _declHandle(0), _valueHandle(0), _lastHandle(0) {}
+	void setup(GattClient *client,
+			   ble::connection_handle_t connection,
+			   const UUID &uuid,
+			   uint8_t props,
+			   GattAttribute::Handle_t declHandle,
+			   GattAttribute::Handle_t valueHandle,
+			   GattAttribute::Handle_t lastHandle) {
+		_client = client;
+		_connection = connection;
+		_uuid = uuid;
+		_props = Properties_t(props);
+		_declHandle = declHandle;
+		_valueHandle = valueHandle;
+		_lastHandle = lastHandle;
+	}
+	const UUID &getUUID() const { return _uuid; }
+	const Properties_t &getProperties() const { return _props; }
+	GattAttribute::Handle_t getDeclHandle() const { return _declHandle; }
+	GattAttribute::Handle_t getValueHandle() const { return _valueHandle; }
+	GattAttribute::Handle_t getLastHandle() const { return _lastHandle; }
+	ble::connection_handle_t getConnectionHandle() const { return _connection; }
+	GattClient *getGattClient() const { return _client; }
+
+	ble_error_t discoverDescriptors(const DescriptorCallback_t &onDescriptor,
+									const DescriptorTerminationCallback_t &onTermination) const;
+};
+
+enum HVXType_t { BLE_HVX_NOTIFICATION = 0x01, BLE_HVX_INDICATION = 0x02 };
+
+struct GattHVXCallbackParams {
+	ble::connection_handle_t connHandle;
+	GattAttribute::Handle_t handle;
+	HVXType_t type;
+	uint16_t len;
+	const uint8_t *data;
+};
+
+struct ServiceDiscovery {
+	typedef FunctionPointerWithContext<const DiscoveredService *> ServiceCallback_t;
+	typedef FunctionPointerWithContext<const DiscoveredCharacteristic *> CharacteristicCallback_t;
+	typedef FunctionPointerWithContext<ble::connection_handle_t> TerminationCallback_t;
+};
+
+/**
+ * \brief The GATT client of the host stack
+ * \details The host tools attach the GattServer of an other host stack as the peer of a connection. The
+ * 			discovery walks the attribute table of the peer, the reads and writes go through its inject
+ * 			functions and the updates it sends to a subscribed client come back as notifications and
+ * 			indications. The stack confirms the indications, as Cordio does. The requests run on the events of
+ * 			the peer, the responses on the events of this stack, so the tools process both. Write responses
+ * 			are not modelled.
+ */
+class GattClient {
+  public:
+	enum WriteOp_t { GATT_OP_WRITE_REQ = 0x01, GATT_OP_WRITE_CMD = 0x02, GATT_OP_SIGNED_WRITE_CMD = 0x03 };
+	typedef FunctionPointerWithContext<const GattReadCallbackParams *> ReadCallback_t;
+	typedef FunctionPointerWithContext<const GattHVXCallbackParams *> HVXCallback_t;
+
+  private:
+	/**
+	 * \brief The peer of a connection
+	 *
+	 */
+	struct peer_t {
+		ble::connection_handle_t connection;
+		GattServer *server;
+	};
+
+	host_stack::CStackEvents &_events;
+	std::vector<peer_t> _peers;							   //!< The connected peers
+	ServiceDiscovery::TerminationCallback_t _onTermination; //!< Called when a service discovery ends
+	ReadCallback_t _onDataRead;							   //!< Called when a read completes
+	HVXCallback_t _onHVX;								   //!< Called on notifications and indications
+
+	GattServer *findPeer(ble::connection_handle_t connection) {
+		for (auto &peer : _peers) {
+			if (peer.connection == connection) {
+				return peer.server;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * \brief Get the last handle of a characteristic, before the next declaration or the end of the service
+	 *
+	 */
+	static GattAttribute::Handle_t lastHandle(GattService &service, uint8_t index, GattAttribute::Handle_t end) {
+		GattCharacteristic *next = service.getCharacteristic(index + 1);
+		return (next != nullptr) ? (GattAttribute::Handle_t)(next->getValueHandle() - 2) : end;
+	}
+
+  public:
+	GattClient(host_stack::CStackEvents &events) : _events(events) {}
+
+	ble_error_t launchServiceDiscovery(ble::connection_handle_t connection,
+									   ServiceDiscovery::ServiceCallback_t onService = nullptr,
+									   ServiceDiscovery::CharacteristicCallback_t onCharacteristic = nullptr) {
+		GattServer *peer = findPeer(connection);
+		if (peer == nullptr) {
+			return BLE_ERROR_INVALID_PARAM;
+		}
+		_events.post([this, connection, peer, onService, onCharacteristic]() {
+			const std::vector<GattService *> &services = peer->getServices();
+			for (size_t ii = 0; ii < services.size(); ii++) {
+				GattService &service = *services[ii];
+				GattAttribute::Handle_t end = (ii + 1 < services.size())
+												  ? (GattAttribute::Handle_t)(services[ii + 1]->getHandle() - 1)
+												  : peer->getLastHandle();
+				DiscoveredService discovered;
+				discovered.setup(service.getUUID(), service.getHandle(), end);
+				if (onService) {
+					onService(&discovered);
+				}
+				for (uint8_t cc = 0; cc < service.getCharacteristicCount(); cc++) {
+					GattCharacteristic &characteristic = *service.getCharacteristic(cc);
+					DiscoveredCharacteristic c;
+					c.setup(this, connection, characteristic.getValueAttribute().getUUID(),
+							characteristic.getProperties(), characteristic.getValueHandle() - 1,
+							characteristic.getValueHandle(), lastHandle(service, cc, end));
+					if (onCharacteristic) {
+						onCharacteristic(&c);
+					}
+				}
+			}
+			if (_onTermination) {
+				_onTermination(connection);
+			}
+		});
+		return BLE_ERROR_NONE;
+	}
+	void onServiceDiscoveryTermination(ServiceDiscovery::TerminationCallback_t callback) { _onTermination = callback; }
+
+	/**
+	 * \brief Discovers the descriptors of a characteristic, the CCCD is reported with its UUID 0x2902
+	 *
+	 */
+	ble_error_t
+	discoverCharacteristicDescriptors(const DiscoveredCharacteristic &characteristic,
+									  const DiscoveredCharacteristic::DescriptorCallback_t &onDescriptor,
+									  const DiscoveredCharacteristic::DescriptorTerminationCallback_t &onTermination) {
+		GattServer *peer = findPeer(characteristic.getConnectionHandle());
+		if (peer == nullptr) {
+			return BLE_ERROR_INVALID_PARAM;
+		}
+		_events.post([peer, characteristic, onDescriptor, onTermination]() {
+			for (GattAttribute::Handle_t handle = characteristic.getValueHandle() + 1;
+				 handle <= characteristic.getLastHandle(); handle++) {
+				GattAttribute *attribute = peer->getAttribute(handle);
+				UUID uuid = (attribute != nullptr) ? attribute->getUUID()
+												   : UUID(GattCharacteristic::BLE_UUID_DESCRIPTOR_CLIENT_CHAR_CONFIG);
+				if (attribute == nullptr && peer->getCccdValueHandle(handle) != characteristic.getValueHandle()) {
+					continue;
+				}
+				DiscoveredCharacteristicDescriptor descriptor(characteristic.getConnectionHandle(), handle, uuid);
+				CharacteristicDescriptorDiscovery::DiscoveryCallbackParams_t params = {characteristic, descriptor};
+				if (onDescriptor) {
+					onDescriptor(&params);
+				}
+			}
+			CharacteristicDescriptorDiscovery::TerminationCallbackParams_t params = {characteristic, BLE_ERROR_NONE, 0};
+			if (onTermination) {
+				onTermination(&params);
+			}
+		});
+		return BLE_ERROR_NONE;
+	}
+
+	ble_error_t read(ble::connection_handle_t connection, GattAttribute::Handle_t handle, uint16_t offset) {
+		GattServer *peer = findPeer(connection);
+		if (peer == nullptr) {
+			return BLE_ERROR_INVALID_PARAM;
+		}
+		peer->injectRead(connection, handle, offset,
+						 [this, connection, handle, offset](GattAuthCallbackReply_t reply, const uint8_t *data,
+															uint16_t length) {
+							 std::vector<uint8_t> value(data, data + length);
+							 _events.post([this, connection, handle, offset, reply, value]() {
+								 GattReadCallbackParams params = {
+									 connection, handle, offset, (uint16_t)value.size(), value.data(),
+									 (reply == AUTH_CALLBACK_REPLY_SUCCESS) ? BLE_ERROR_NONE : BLE_ERROR_UNSPECIFIED};
+								 if (_onDataRead) {
+									 _onDataRead(&params);
+								 }
+							 });
+						 });
+		return BLE_ERROR_NONE;
+	}
+	void onDataRead(ReadCallback_t callback) { _onDataRead = callback; }
+
+	/**
+	 * \brief Writes an attribute of the peer, a write of a CCCD subscribes to the characteristic
+	 *
+	 */
+	ble_error_t write(WriteOp_t op,
+					  ble::connection_handle_t connection,
+					  GattAttribute::Handle_t handle,
+					  uint16_t length,
+					  const uint8_t *value) {
+		GattServer *peer = findPeer(connection);
+		if (peer == nullptr) {
+			return BLE_ERROR_INVALID_PARAM;
+		}
+		GattAttribute::Handle_t valueHandle = peer->getCccdValueHandle(handle);
+		if (valueHandle != GattAttribute::INVALID_HANDLE) {
+			peer->injectSubscription(valueHandle, (length >= 2) ? (uint16_t)(value[0] | (value[1] << 8)) : 0);
+			return BLE_ERROR_NONE;
+		}
+		GattWriteCallbackParams::WriteOp_t writeOp = GattWriteCallbackParams::OP_SIGN_WRITE_CMD;
+		if (op == GATT_OP_WRITE_REQ) {
+			writeOp = GattWriteCallbackParams::OP_WRITE_REQ;
+		} else if (op == GATT_OP_WRITE_CMD) {
+			writeOp = GattWriteCallbackParams::OP_WRITE_CMD;
+		}
+		peer->injectWrite(connection, handle, writeOp, value, length);
+		return BLE_ERROR_NONE;
+	}
+	void onHVX(HVXCallback_t callback) { _onHVX = callback; }
+
+	/**
+	 * \name Host stack functions
+	 * @{
+	 */
+	/**
+	 * \brief Connects the GattServer of an other host stack as the peer of a connection
+	 *
+	 */
+	void attachPeer(ble::connection_handle_t connection, GattServer &server) {
+		detachPeer(connection);
+		_peers.push_back(peer_t{connection, &server});
+		GattServer *peer = &server;
+		server.setOnPeerUpdate([this, connection, peer](GattAttribute::Handle_t handle, const uint8_t *data,
+														uint16_t length) {
+			std::vector<uint8_t> value(data, data + length);
+			HVXType_t type = (peer->getClientConfiguration(handle) == 2) ? BLE_HVX_INDICATION : BLE_HVX_NOTIFICATION;
+			_events.post([this, connection, peer, handle, type, value]() {
+				GattHVXCallbackParams params = {connection, handle, type, (uint16_t)value.size(), value.data()};
+				if (_onHVX) {
+					_onHVX(&params);
+				}
+				if (type == BLE_HVX_INDICATION && findPeer(connection) == peer) {
+					peer->injectConfirmation(handle);
+				}
+			});
+		});
+	}
+	void detachPeer(ble::connection_handle_t connection) {
+		for (auto it = _peers.begin(); it != _peers.end(); ++it) {
+			if (it->connection == connection) {
+				it->server->setOnPeerUpdate(nullptr);
+				_peers.erase(it);
+				return;
+			}
+		}
+	}
+	/** @}*/
+};
+
+inline ble_error_t
+DiscoveredCharacteristic::discoverDescriptors(const DescriptorCallback_t &onDescriptor,
+											  const DescriptorTerminationCallback_t &onTermination) const {
+	if (_client == nullptr) {
+		return BLE_ERROR_INVALID_STATE;
+	}
+	return _client->discoverCharacteristicDescriptors(*this, onDescriptor, onTermination);
+}
+
+/**
+ * \brief The BLE instance of the host stack. The host tools may construct several, one per simulated device.
+ *
+ */
+class BLE : private mbed::NonCopyable<BLE> {
+  public:
+	struct InitializationCompleteCallbackContext {
+		BLE &ble;
+		ble_error_t error;
+	};
+	struct OnEventsToProcessCallbackContext {
+		BLE &ble;
+	};
+	typedef mbed::Callback<void(OnEventsToProcessCallbackContext *)> OnEventsToProcessCallback_t;
+
+  private:
+	host_stack::CStackEvents _events;
+	ble::Gap _gap;
+	GattServer _gattServer;
+	GattClient _gattClient;
+	SecurityManager _securityManager;
+	OnEventsToProcessCallback_t _onEventsToProcess;
+	bool _initialized;
+
+	void signal() {
+		if (_onEventsToProcess) {
+			OnEventsToProcessCallbackContext context = {*this};
+			_onEventsToProcess(&context);
+		}
+	}
+
+  public:
+	BLE()
+		: _events(), _gap(_events), _gattServer(_events), _gattClient(_events), _securityManager(_events),
+		  _initialized(false) {
+		_events.setSignal(mbed::Callback<void()>(this, &BLE::signal));
+		_gap.setOnLinkLost([this](ble::connection_handle_t) { _gattServer.clearLinkState(); });
+	}
+
+	static BLE &Instance() {
+		static BLE ble;
+		return ble;
+	}
+
+	/**
+	 * \brief Initializes the stack. The completion is an event, delivered by processEvents().
+	 *
+	 */
+	template <typename T> ble_error_t init(T *object, void (T::*member)(InitializationCompleteCallbackContext *)) {
+		if (_initialized) {
+			return BLE_ERROR_ALREADY_INITIALIZED;
+		}
+		mbed::Callback<void(InitializationCompleteCallbackContext *)> complete(object, member);
+		_events.post([this, complete]() {
+			_initialized = true;
+			InitializationCompleteCallbackContext context = {*this, BLE_ERROR_NONE};
+			complete(&context);
+		});
+		return BLE_ERROR_NONE;
+	}
+	bool hasInitialized() const { return _initialized; }
+	ble_error_t shutdown() {
+		_initialized = false;
+		return BLE_ERROR_NONE;
+	}
+	void onEventsToProcess(const OnEventsToProcessCallback_t &callback) { _onEventsToProcess = callback; }
+	void processEvents() { _events.process(); }
+
+	ble::Gap &gap() { return _gap; }
+	GattServer &gattServer() { return _gattServer; }
+	GattClient &gattClient() { return _gattClient; }
+	SecurityManager &securityManager() { return _securityManager; }
+};
+
+#endif //!_HOST_STACK_BLE_H_
\ No newline at end of file
@@ -0,0 +1,7 @@
+#ifndef _HOST_STACK_GAP_H_
+#define _HOST_STACK_GAP_H_
+
+// the host stack declares the whole API in ble/BLE.h
+#include "ble/BLE.h"
+
+#endif //!_HOST_STACK_GAP_H_
@@ -0,0 +1,279 @@
+#ifndef _HOST_STACK_MBED_EVENTS_H_
+#define _HOST_STACK_MBED_EVENTS_H_
+
+/**
+ * \file mbed_events.h
+ * \brief Host stand-in of the mbed OS event queue
+ * \details The events run in due time order on the thread that dispatches the queue, as on the device. The pool
+ * 			accounting of the equeue library is kept: every event takes an EVENTS_EVENT_SIZE block carved from the
+ * 			slab or reused from the free chunks, so CEventQueue reports the same occupancy as on the device and a
+ * 			post fails when the pool is exhausted. The events themselves are kept in a vector, not in the pool.
+ */
+
+#include "mbed.h"
+
+#include <vector>
+
+struct equeue_event {
+	unsigned size;
+	struct equeue_event *next;
+	struct equeue_event *sibling;
+};
+struct equeue {
+	struct equeue_event *chunks;
+	struct equeue_slab {
+		size_t size;
+		unsigned char *data;
+	} slab;
+};
+
+#define EVENTS_EVENT_SIZE (sizeof(void *) * 8)
+#define EVENTS_QUEUE_SIZE (32 * EVENTS_EVENT_SIZE)
+
+namespace events {
+
+class EventQueue : private mbed::NonCopyable<EventQueue> {
+  private:
+	/**
+	 * \brief A pending event
+	 *
+	 */
+	struct event_t {
+		int id;						//!< The event id
+		uint64_t dueUs;				//!< The time the event runs
+		uint64_t periodUs;			//!< The period of a periodic event, 0 otherwise
+		uint64_t sequence;			//!< Orders the events due at the same time by post order
+		std::function<void()> f;	//!< The function
+		struct equeue_event *block; //!< The pool block of the event
+	};
+
+	std::vector<equeue_event> _blocks; //!< The pool, one block per event
+	std::vector<event_t> _events;	   //!< The pending events
+	std::vector<EventQueue *> _chained; //!< The queues chained to this queue, dispatched with it
+	EventQueue *_target;				//!< The queue this queue is chained to
+	int _nextId;						//!< The id of the next event
+	uint64_t _sequence;					//!< The post counter
+	int _runningId;						//!< The id of the event that runs, 0 if none
+	bool _runningCancelled;				//!< Set if the running periodic event cancelled itself
+	bool _break;						//!< Set by break_dispatch()
+
+	struct equeue_event *allocate() {
+		struct equeue_event *block = _equeue.chunks;
+		if (block != NULL) {
+			_equeue.chunks = block->next;
+		} else if (_equeue.slab.size >= EVENTS_EVENT_SIZE) {
+			block = &_blocks[_blocks.size() - _equeue.slab.size / EVENTS_EVENT_SIZE];
+			_equeue.slab.size -= EVENTS_EVENT_SIZE;
+		}
+		return block;
+	}
+
+	void release(struct equeue_event *block) {
+		block->size = EVENTS_EVENT_SIZE;
+		block->sibling = NULL;
+		block->next = _equeue.chunks;
+		_equeue.chunks = block;
+	}
+
+	int post(uint64_t delayUs, uint64_t periodUs, std::function<void()> f) {
+		struct equeue_event *block = allocate();
+		if (block == NULL) {
+			return 0;
+		}
+		event_t event = {_nextId++, host_stack::CClock::instance().nowUs() + delayUs, periodUs, _sequence++, f,
+						 block};
+		_events.push_back(event);
+		return event.id;
+	}
+
+	/**
+	 * \brief Finds the earliest pending event of this queue
+	 *
+	 */
+	event_t *earliest() {
+		event_t *first = nullptr;
+		for (auto &event : _events) {
+			if (first == nullptr || event.dueUs < first->dueUs ||
+				(event.dueUs == first->dueUs && event.sequence < first->sequence)) {
+				first = &event;
+			}
+		}
+		return first;
+	}
+
+	/**
+	 * \brief Finds the queue, this or a chained one, that has the earliest pending event
+	 *
+	 */
+	EventQueue *earliestQueue(uint64_t &dueUs) {
+		EventQueue *queue = nullptr;
+		event_t *event = earliest();
+		if (event != nullptr) {
+			queue = this;
+			dueUs = event->dueUs;
+		}
+		for (auto chained : _chained) {
+			uint64_t chainedDueUs = 0;
+			EventQueue *candidate = chained->earliestQueue(chainedDueUs);
+			if (candidate != nullptr && (queue == nullptr || chainedDueUs < dueUs)) {
+				queue = candidate;
+				dueUs = chainedDueUs;
+			}
+		}
+		return queue;
+	}
+
+	/**
+	 * \brief Runs the earliest event of this queue
+	 *
+	 */
+	void runEarliest() {
+		event_t *first = earliest();
+		event_t event = *first;
+		_events.erase(_events.begin() + (first - _events.data()));
+		_runningId = event.id;
+		_runningCancelled = false;
+		event.f();
+		_runningId = 0;
+		if (event.periodUs != 0 && !_runningCancelled) {
+			event.dueUs += event.periodUs;
+			_events.push_back(event);
+		} else {
+			release(event.block);
+		}
+	}
+
+  protected:
+	struct equeue _equeue; //!< The pool accounting, read by CEventQueue
+
+  public:
+	/**
+	 * \brief Construct a new EventQueue object
+	 *
+	 * \param size Size of the event pool in bytes
+	 * \param buffer The event pool, only its size is used on the host
+	 */
+	EventQueue(unsigned size = EVENTS_QUEUE_SIZE, unsigned char *buffer = NULL)
+		: _blocks(size / EVENTS_EVENT_SIZE), _target(nullptr), _nextId(1), _sequence(0), _runningId(0),
+		  _runningCancelled(false), _break(false) {
+		(void)buffer;
+		_equeue.chunks = NULL;
+		_equeue.slab.size = _blocks.size() * EVENTS_EVENT_SIZE;
+		_equeue.slab.data = NULL;
+	}
+	~EventQueue() { chain(nullptr); }
+
+	template <typename F> int call(F f) { return post(0, 0, f); }
+	template <typename T, typename R, typename... A, typename... B> int call(T *obj, R (T::*m)(A...), B... b) {
+		return call([=]() { (obj->*m)(b...); });
+	}
+	template <typename F> int call_in(int ms, F f) { return post((uint64_t)ms * 1000, 0, f); }
+	template <typename T, typename R, typename... A, typename... B>
+	int call_in(int ms, T *obj, R (T::*m)(A...), B... b) {
+		return call_in(ms, [=]() { (obj->*m)(b...); });
+	}
+	template <typename F> int call_every(int ms, F f) { return post((uint64_t)ms * 1000, (uint64_t)ms * 1000, f); }
+	template <typename T, typename R, typename... A, typename... B>
+	int call_every(int ms, T *obj, R (T::*m)(A...), B... b) {
+		return call_every(ms, [=]() { (obj->*m)(b...); });
+	}
+
+	/**
+	 * \brief Cancels a pending event. A periodic event may cancel itself while it runs.
+	 *
+	 */
+	bool cancel(int id) {
+		if (id != 0 && id == _runningId) {
+			_runningCancelled = true;
+			return true;
+		}
+		for (size_t ii = 0; ii < _events.size(); ii++) {
+			if (_events[ii].id == id) {
+				release(_events[ii].block);
+				_events.erase(_events.begin() + ii);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	int time_left(int id) {
+		uint64_t nowUs = host_stack::CClock::instance().nowUs();
+		for (auto &event : _events) {
+			if (event.id == id) {
+				return (event.dueUs > nowUs) ? (int)((event.dueUs - nowUs) / 1000) : 0;
+			}
+		}
+		return -1;
+	}
+
+	/**
+	 * \brief Get the due time of the earliest pending event of this queue and of the chained queues
+	 *
+	 * \param dueUs Receives the due time
+	 * \return false if no event is pending
+	 */
+	bool nextDue(uint64_t &dueUs) { return earliestQueue(dueUs) != nullptr; }
+
+	/**
+	 * \brief Dispatches the events of this queue and of the chained queues in due time order
+	 * \details With a negative time the queue is dispatched until break_dispatch(), or until no event is left,
+	 * 			as nothing else can post on the single threaded host. The clock is advanced to the due time of
+	 * 			each event: the virtual clock jumps, the real clock is slept.
+	 *
+	 * \param ms The dispatch time, 0 runs the events that are due, negative dispatches forever
+	 */
+	void dispatch(int ms = -1) {
+		host_stack::CClock &clock = host_stack::CClock::instance();
+		uint64_t endUs = clock.nowUs() + ((ms > 0) ? (uint64_t)ms * 1000 : 0);
+		_break = false;
+		while (!_break) {
+			uint64_t dueUs;
+			EventQueue *queue = earliestQueue(dueUs);
+			uint64_t nowUs = clock.nowUs();
+			if (queue != nullptr && dueUs <= nowUs) {
+				queue->runEarliest();
+			} else if (queue != nullptr && (ms < 0 || dueUs <= endUs)) {
+				clock.advanceTo(dueUs);
+			} else {
+				if (ms > 0) {
+					clock.advanceTo(endUs);
+				}
+				break;
+			}
+		}
+	}
+	void dispatch_forever() { dispatch(-1); }
+	void break_dispatch() { _break = true; }
+
+	/**
+	 * \brief Chains this queue to a target queue, the target then dispatches the events of both
+	 *
+	 * \param target The target queue, nullptr to unchain
+	 */
+	void chain(EventQueue *target) {
+		if (_target != nullptr) {
+			std::vector<EventQueue *> &chained = _target->_chained;
+			for (size_t ii = 0; ii < chained.size(); ii++) {
+				if (chained[ii] == this) {
+					chained.erase(chained.begin() + ii);
+					break;
+				}
+			}
+		}
+		_target = target;
+		if (target != nullptr) {
+			target->_chained.push_back(this);
+		}
+	}
+
+	/**
+	 * \brief Get the number of pending events, for the host tools
+	 *
+	 */
+	size_t pending() const { return _events.size(); }
+};
+
+} // namespace events
+
+#endif //!_HOST_STACK_MBED_EVENTS_H_
\ No newline at end of file
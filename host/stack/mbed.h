@@ -0,0 +1,297 @@
+#ifndef _HOST_STACK_MBED_H_
+#define _HOST_STACK_MBED_H_
+
+/**
+ * \file mbed.h
+ * \brief Host stand-in of the mbed OS API used by the BLE classes
+ * \details Lets the host tools compile the real GAP, GATT server and service classes on a PC. The time base is
+ * 			host_stack::CClock, which runs either on the steady clock or on a virtual clock that the event queues
+ * 			advance, so a simulation can run much faster than real time. Interrupts do not exist on the host, so
+ * 			the critical sections are empty: the host tools run the classes on one thread.
+ */
+
+#define HOST_STACK 1 //!< The classes are built on the host stack, e.g. several devices in one process
+
+#include <chrono>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+typedef int PinName;
+enum { LED1 = 1, LED2, LED3, LED4, BUTTON1, BUTTON2, NC = -1 };
+
+namespace host_stack {
+
+/**
+ * \brief The time base of the host stack
+ *
+ */
+class CClock {
+  private:
+	bool _virtual;									//!< Set if the time only moves when advanced
+	uint64_t _nowUs;								//!< The virtual time
+	std::chrono::steady_clock::time_point _start; //!< The start of the real time
+
+	CClock() : _virtual(false), _nowUs(0), _start(std::chrono::steady_clock::now()) {}
+
+  public:
+	/**
+	 * \brief The clock of the process
+	 *
+	 */
+	static CClock &instance() {
+		static CClock clock;
+		return clock;
+	}
+
+	/**
+	 * \brief Selects the virtual or the real time. The virtual time continues from the current time.
+	 *
+	 */
+	void setVirtual(bool isVirtual) {
+		_nowUs = nowUs();
+		_virtual = isVirtual;
+		_start = std::chrono::steady_clock::now() - std::chrono::microseconds(_nowUs);
+	}
+	bool isVirtual() const { return _virtual; }
+
+	/**
+	 * \brief The time since the start in microseconds
+	 *
+	 */
+	uint64_t nowUs() const {
+		if (_virtual) {
+			return _nowUs;
+		}
+		return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - _start)
+			.count();
+	}
+
+	/**
+	 * \brief Moves the virtual time forward, or sleeps until the time in real time
+	 *
+	 * \param us The time to advance to. An earlier time is ignored.
+	 */
+	void advanceTo(uint64_t us) {
+		if (_virtual) {
+			_nowUs = (us > _nowUs) ? us : _nowUs;
+		} else {
+			std::this_thread::sleep_until(_start + std::chrono::microseconds(us));
+		}
+	}
+};
+
+} // namespace host_stack
+
+namespace mbed {
+
+template <typename T> class NonCopyable {
+  protected:
+	NonCopyable() {}
+	~NonCopyable() {}
+
+  private:
+	NonCopyable(const NonCopyable &);
+	NonCopyable &operator=(const NonCopyable &);
+};
+
+template <typename F> class Callback;
+
+/**
+ * \brief The mbed::Callback of the host, a std::function with the constructors of the mbed one
+ *
+ */
+template <typename R, typename... A> class Callback<R(A...)> {
+  private:
+	std::function<R(A...)> _f;
+
+  public:
+	Callback() {}
+	Callback(std::nullptr_t) {}
+	Callback(R (*f)(A...)) {
+		if (f != nullptr) {
+			_f = f;
+		}
+	}
+	template <typename T, typename U> Callback(U *obj, R (T::*method)(A...)) {
+		_f = [obj, method](A... args) { return (obj->*method)(args...); };
+	}
+	template <typename T, typename U> Callback(U *obj, R (T::*method)(A...) const) {
+		_f = [obj, method](A... args) { return (obj->*method)(args...); };
+	}
+	template <typename F, typename = decltype(std::declval<F>()(std::declval<A>()...))> Callback(F f) : _f(f) {}
+
+	R operator()(A... args) const { return _f(args...); }
+	R call(A... args) const { return _f(args...); }
+	explicit operator bool() const { return (bool)_f; }
+};
+
+template <typename T, typename U, typename R, typename... A> Callback<R(A...)> callback(U *obj, R (T::*method)(A...)) {
+	return Callback<R(A...)>(obj, method);
+}
+template <typename R, typename... A> Callback<R(A...)> callback(R (*f)(A...)) { return Callback<R(A...)>(f); }
+
+template <typename C> using FunctionPointerWithContext = Callback<void(C)>;
+template <typename T, typename U, typename C> Callback<void(C)> makeFunctionPointer(U *obj, void (T::*method)(C)) {
+	return Callback<void(C)>(obj, method);
+}
+
+class DigitalOut {
+  private:
+	int _value;
+
+  public:
+	DigitalOut(PinName, int value = 0) : _value(value) {}
+	DigitalOut &operator=(int value) {
+		_value = value;
+		return *this;
+	}
+	operator int() const { return _value; }
+	int read() const { return _value; }
+	void write(int value) { _value = value; }
+};
+
+class DigitalIn {
+  public:
+	DigitalIn(PinName) {}
+	int read() { return 1; }
+	operator int() { return 1; }
+};
+
+/**
+ * \brief Interrupt input, trigger() calls the handler as the edge would
+ *
+ */
+class InterruptIn {
+  private:
+	Callback<void()> _fall, _rise;
+
+  public:
+	InterruptIn(PinName) {}
+	void rise(Callback<void()> handler) { _rise = handler; }
+	void fall(Callback<void()> handler) { _fall = handler; }
+	void trigger() {
+		if (_fall) {
+			_fall();
+		}
+	}
+};
+
+class PwmOut {
+  private:
+	int _pulsewidthUs;
+
+  public:
+	PwmOut(PinName) : _pulsewidthUs(0) {}
+	void period_us(int) {}
+	void pulsewidth_us(int us) { _pulsewidthUs = us; }
+	int read_pulsewidth_us() const { return _pulsewidthUs; }
+};
+
+/**
+ * \brief One-shot timer. The host tools call fire() when they want the timeout to happen.
+ *
+ */
+class Timeout {
+  protected:
+	Callback<void()> _handler;
+
+  public:
+	void attach(Callback<void()> handler, float) { _handler = handler; }
+	void attach_us(Callback<void()> handler, uint32_t) { _handler = handler; }
+	void detach() { _handler = nullptr; }
+	void fire() {
+		if (_handler) {
+			_handler();
+		}
+	}
+};
+class Ticker : public Timeout {};
+
+class CriticalSectionLock {
+  public:
+	CriticalSectionLock() {}
+	~CriticalSectionLock() {}
+};
+inline void core_util_critical_section_enter() {}
+inline void core_util_critical_section_exit() {}
+
+} // namespace mbed
+
+/**
+ * \brief Halts on a fatal error as the mbed error(), the message goes to stderr
+ *
+ */
+[[noreturn]] inline void error(const char *format, ...) {
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+	abort();
+}
+
+inline uint32_t us_ticker_read() { return (uint32_t)host_stack::CClock::instance().nowUs(); }
+
+using namespace mbed;
+
+namespace rtos {
+namespace Kernel {
+inline uint64_t get_ms_count() { return host_stack::CClock::instance().nowUs() / 1000; }
+} // namespace Kernel
+
+typedef int osPriority;
+enum { osPriorityBelowNormal = 16, osPriorityNormal = 24, osPriorityAboveNormal = 32, osPriorityHigh = 40 };
+
+class Mutex : private mbed::NonCopyable<Mutex> {
+  private:
+	std::recursive_mutex _mutex;
+
+  public:
+	void lock() { _mutex.lock(); }
+	void unlock() { _mutex.unlock(); }
+};
+
+class ScopedMutexLock : private mbed::NonCopyable<ScopedMutexLock> {
+  private:
+	Mutex &_mutex;
+
+  public:
+	explicit ScopedMutexLock(Mutex &mutex) : _mutex(mutex) { _mutex.lock(); }
+	~ScopedMutexLock() { _mutex.unlock(); }
+};
+
+class Thread : private mbed::NonCopyable<Thread> {
+  private:
+	std::thread _thread;
+
+  public:
+	Thread(osPriority = osPriorityNormal, uint32_t = 0, unsigned char * = nullptr, const char * = nullptr) {}
+	~Thread() {
+		if (_thread.joinable()) {
+			_thread.detach();
+		}
+	}
+	int start(mbed::Callback<void()> task) {
+		_thread = std::thread([task]() { task(); });
+		return 0;
+	}
+	int join() {
+		_thread.join();
+		return 0;
+	}
+};
+} // namespace rtos
+
+using namespace rtos;
+using namespace std;
+
+#include "events/mbed_events.h"
+
+#endif //!_HOST_STACK_MBED_H_
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef _HOST_STACK_MBEDTLS_AES_H_
+#define _HOST_STACK_MBEDTLS_AES_H_
+
+/**
+ * \file aes.h
+ * \brief Host stand-in of the mbed TLS AES block cipher
+ * \details NOT AES and not cryptographic: the block is mixed with the key by a keyed permutation, so the CMAC of
+ * 			the GATT Database Hash changes with the database as on the device, but the value differs from the
+ * 			one of the device. The host tools only compare hashes computed on the host.
+ */
+
+#include <cstdint>
+#include <cstring>
+
+#define MBEDTLS_AES_ENCRYPT 1
+#define MBEDTLS_AES_DECRYPT 0
+
+typedef struct {
+	unsigned char key[16];
+} mbedtls_aes_context;
+
+inline void mbedtls_aes_init(mbedtls_aes_context *ctx) { memset(ctx, 0, sizeof(*ctx)); }
+inline void mbedtls_aes_free(mbedtls_aes_context *ctx) { memset(ctx, 0, sizeof(*ctx)); }
+inline int mbedtls_aes_setkey_enc(mbedtls_aes_context *ctx, const unsigned char *key, unsigned int keybits) {
+	if (keybits != 128) {
+		return -0x0020; // MBEDTLS_ERR_AES_INVALID_KEY_LENGTH
+	}
+	memcpy(ctx->key, key, 16);
+	return 0;
+}
+inline int mbedtls_aes_crypt_ecb(mbedtls_aes_context *ctx,
+								 int mode,
+								 const unsigned char input[16],
+								 unsigned char output[16]) {
+	(void)mode;
+	unsigned char block[16];
+	memcpy(block, input, 16);
+	for (int round = 0; round < 4; round++) {
+		for (int ii = 0; ii < 16; ii++) {
+			block[ii] = (unsigned char)((block[ii] ^ ctx->key[(ii + round) & 15]) * 167 + block[(ii + 15) & 15]);
+		}
+	}
+	memcpy(output, block, 16);
+	return 0;
+}
+
+#endif //!_HOST_STACK_MBEDTLS_AES_H_
@@ -1,183 +1,494 @@
-/* mbed Microcontroller Library
- * Copyright (c) 2017 ARM Limited
- *
- * Licensed under the Apache License, Version 2.0 (the "License");
- * you may not use this file except in compliance with the License.
- * You may obtain a copy of the License at
- *
- *     http://www.apache.org/licenses/LICENSE-2.0
- *
- * Unless required by applicable law or agreed to in writing, software
- * distributed under the License is distributed on an "AS IS" BASIS,
- * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
- * See the License for the specific language governing permissions and
- * limitations under the License.
- */
-
-#include "ble_gap_sm.h"
-#include "ble_gatt_alert_notification_service.h"
-#include "ble_gatt_immedate_alert_service.h"
-#include "ble_gatt_server.h"
-#include "ble_utils.h"
-#include <mbed.h>
-
-#define PWM_PERIOD_US 100
-/**
- * \brief The homework BLE device implementation class.
- *
- */
-
-class CHomework {
-  protected:
-	CGapSecurity _gap;		  //!< The GAP implementation. This should be instantiated with
-							  //!< SecurityManager::IO_CAPS_DISPLAY_ONLY capabilities:
-	CGattServer _gatt_server; //!< This is the Gatt server which requires setting a set of services. The C++
-							  //!< initializer list can be used.
-	CAlertNotificationServiceServer
-		_ans; //!< The alert notification service. This should be instantiated with
-			  //!< CAlertNotificationServiceServer::ANS_TYPE_MASK_SIMPLE_ALERT as supported new alerts
-	CImmediateAlertServiceServer _ias; //!< This is the Immedate alert service instance
-
-	events::EventQueue *_event_queue; //!< A pointer to the system event queue
-	BLE &_ble;						  //!< A reference to one and only system BLE instance
-
-	InterruptIn _alert_button; //!< The alert button.
-	PwmOut _alert_led_pwm;	   //!< The Alert LED pwm object
-	Ticker tiktok;             // GPIO interrupts don't seem to work when BLE is running so I used this
-	/**
-	 * \brief Button Press ISR implementation
-	 *
-	 */
-	void onButtonPressed(void) {
-		// TODO use event_queue call to dispatch button event pressed function handling to onButtonAlert
-		// function
-        	_event_queue->call(this, &CHomework::onButtonAlert);
-	}
-
-	/**
-	 * \brief Callback function of the Alert button pressed event dispatched by the system event queue
-	 *
-	 */
-	void onButtonAlert(void) {
-		/*
-		 * TODO
-		 * Indicate new alert to Alert Notification Service (_ans) with type
-		 * CAlertNotificationServiceServer::ANS_TYPE_SIMPLE_ALERT
-		 */
-        	_ans.newAlert(CAlertNotificationServiceServer::ANS_TYPE_SIMPLE_ALERT);
-	}
-	/**
-	 * \brief Immediate Alert Service Alert Level characteristic written callback function
-	 *
-	 * \param level The new level
-	 */
-	void onAlertLevelChanged(uint8_t level) {
-		float pulsewidth = 0.0f;
-		level = (level > 2) ? 2 : level;
-		std::cout << "Alert level: " << level << std::endl;
-		switch (level) {
-			case CImmediateAlertServiceServer::IAS_ALERT_LEVEL_NO_ALERT:
-				std::cout << "No alert" << std::endl;
-				// TODO  pulsewidth value to NO_ALERT state (LED should be off)
-				pulsewidth = PWM_PERIOD_US;
-				break;
-			case CImmediateAlertServiceServer::IAS_ALERT_LEVEL_MEDIUM:
-				// TODO  pulsewidth value to MEDIUM ALERT state (LED should be half bright)
-				std::cout << "Medium alert" << std::endl;
-				pulsewidth = PWM_PERIOD_US / 2;
-				break;
-			case CImmediateAlertServiceServer::IAS_ALERT_LEVEL_HIGH:
-				// TODO  pulsewidth value to HIGH ALERT state (LED should be bright)
-				std::cout << "High alert" << std::endl;
-				pulsewidth = 0.0f;
-				break;
-			default:
-				// TODO  pulsewidth value to HIGH ALERT state (LED should be bright)
-				std::cout << "Default" << std::endl;
-				pulsewidth = 0.0f;
-				break;
-		}
-		// TODO update the PwmOut object pulsewidth
-     		_alert_led_pwm.pulsewidth_us(pulsewidth);
-	}
-
-	/**
-	 * \brief The onConnection callback of the GAP.
-	 *
-	 */
-	void onConnection() {
-		_gatt_server.onConnection();
-		// TODO set the Alert Level LED brightness to NO_ALERT level
-        	_ias.setAlert(CImmediateAlertServiceServer::IAS_ALERT_LEVEL_NO_ALERT);
-	}
-	/**
-	 * \brief The onDisconnection callback of the GAP
-	 *
-	 */
-	void onDisconnection() {
-		_gatt_server.onDisconnection();
-		// TODO set the Alert Level LED brightness to NO_ALERT level
-		// TODO clear Alert Notification Service Alert Counts by using _ans->clearAlert()
-        	_ias.setAlert(CImmediateAlertServiceServer::IAS_ALERT_LEVEL_NO_ALERT);
-        	_ans.clearAlert(CAlertNotificationServiceServer::ANS_TYPE_ALL_ALERTS);
-	}
-
-  public:
-	/**
-	 * \brief Construct a new CHomework object
-	 *
-	 * \param ble A reference to the BLE instance
-	 * \param queue The system event queue
-	 * \param deviceName The device name
-	 * \param buttonPin Alert button pin name
-	 * \param ledPin Alert LED pin
-	 */
-	CHomework(BLE &ble,
-			  events::EventQueue *queue,
-			  const char *deviceName,
-			  PinName buttonPin = BUTTON1,
-			  PinName ledPin = LED2)
-        : _ble(ble), _event_queue(queue),
-		  _gap(ble, *queue, deviceName, SecurityManager::IO_CAPS_DISPLAY_ONLY),
-		  _ans(CAlertNotificationServiceServer::ANS_TYPE_MASK_SIMPLE_ALERT, 0),
-		  _ias(), _gatt_server(ble, *queue, {&_ans, &_ias}), _alert_button(buttonPin),
-		  _alert_led_pwm(ledPin) {
-		_gap.setOnInitCallback(callback(&_gatt_server, &CGattServer::start));
-		/*
-		* TODO
-		* 1. Configure _gap onConnection callback to use This object's onConnection function
-		* 2. Configure _gap onDisconnection callback to use This object's onDisconnection function
-		* 3. Configure _ias onAlertLevelWritten callback to use This object's onAlertLevelChanged function
-		* 4. Configure button rise ISR function to use This object's onButtonPress function
-		* 5. Configure LED pwm period to PWM_PERIOD_US
-		* 6. Turn off the Alert Level LED by seeting its pwm pulsewidth
-		* 7. Enable authentication requirement for Immediate Alert Service object _ias
-		* 8. Enable authentication requirement for Alert Notification Service object _ans
-		*/
-		_gap.setOnConnection(callback(this, &CHomework::onConnection));
-		_gap.setOnDisconnection(callback(this, &CHomework::onDisconnection));
-		_ias.setOnAlertLevelWritten(callback(this, &CHomework::onAlertLevelChanged));
-		_alert_button.fall(callback(this, &CHomework::onButtonPressed));
-		_alert_led_pwm.period_us(PWM_PERIOD_US);
-		_alert_led_pwm.pulsewidth_us(PWM_PERIOD_US);
-		_ias.enableAuthentication();
-		_ans.enableAuthentication();
-
-		tiktok.attach(callback(this, &CHomework::onButtonPressed), 5.0);
-	}
-
-	void run() {
-		// just let GAP class handle the event loops
-		_gap.run();
-	}
-};
-
-int main() {
-	BLE &ble = BLE::Instance();
-	events::EventQueue *event_queue = new events::EventQueue; // create the queue in the heap
-	CHomework hw(ble, event_queue, "Homework");
-	// bind the event queue to the ble interface, initialize the interface
-	// and start advertising
-	hw.run();
-	return 0;
-}
+/* mbed Microcontroller Library
+ * Copyright (c) 2017 ARM Limited
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ble_event_recorder.h"
+#include "ble_event_scheduler.h"
+#include "ble_gap_sm.h"
+#include "ble_gatt_alert_notification_service.h"
+#include "ble_gatt_diagnostics_service.h"
+#include "ble_gatt_generic_attribute_service.h"
+#include "ble_gatt_immedate_alert_service.h"
+#include "ble_gatt_server.h"
+#include "ble_gatt_static_server.h"
+#include "ble_isr_channel.h"
+#include "ble_message_channel.h"
+#include "ble_profiler.h"
+#include "ble_trace.h"
+#include "ble_utils.h"
+#include <mbed.h>
+
+#include "LittleFileSystem.h"
+
+#define PWM_PERIOD_US 100
+#define BOND_FS_NAME "fs"						  //!< The mount point of the bond storage file system
+#define BOND_DB_FILEPATH "/" BOND_FS_NAME "/bonds.db" //!< The security database file
+#define EVENT_QUEUE_SIZE (32 * EVENTS_EVENT_SIZE)			 //!< The event pool of the BLE stack and GATT events
+#define LOW_PRIORITY_EVENT_QUEUE_SIZE (16 * EVENTS_EVENT_SIZE) //!< The event pool of the UI and housekeeping events
+#define GATT_CACHING_FILEPATH "/" BOND_FS_NAME "/gatt_caching.bin" //!< The GATT Database Hash and the bonded clients
+#define TRACE_FILEPATH "/" BOND_FS_NAME "/trace.bin"		   //!< The binary event trace of the last connection
+#define EVENTS_FILEPATH "/" BOND_FS_NAME "/events.bin"	   //!< The recorded stack events, replayed on the host
+
+#ifndef BLE_THREAD
+#define BLE_THREAD 0 //!< Set to 1 to run the BLE stack and the GATT server on their own thread
+#endif
+#define BLE_THREAD_STACK_SIZE 4096 //!< Stack size of the BLE thread
+#define BLE_MESSAGE_SLOTS 16		//!< Messages in flight between the BLE thread and the application thread
+#ifndef BLE_STATIC_DISPATCH
+#define BLE_STATIC_DISPATCH 0 //!< Set to 1 to dispatch the GATT events to the concrete service types
+#endif
+
+#if BLE_STATIC_DISPATCH
+typedef CStaticGattServer<CGenericAttributeServiceServer,
+						  CAlertNotificationServiceServer,
+						  CImmediateAlertServiceServer,
+						  CDiagnosticsServiceServer>
+	CHomeworkGattServer;
+#else
+typedef CGattServer CHomeworkGattServer;
+#endif
+
+/**
+ * \brief The messages between the BLE thread and the application thread
+ *
+ */
+struct app_message_t {
+	enum Type {
+		NEW_ALERT,			  //!< Application to BLE: raise an ANS alert, value is the category
+		OPEN_ADVERTISING,	  //!< Application to BLE: start the open advertising window
+		ALERT_LEVEL_CHANGED, //!< BLE to application: the IAS alert level was written, value is the level
+	};
+	uint8_t type;  //!< The message type
+	uint8_t value; //!< The message argument
+};
+
+typedef CMessageChannel<app_message_t, BLE_MESSAGE_SLOTS> CAppMessageChannel;
+/**
+ * \brief The homework BLE device implementation class.
+ *
+ */
+
+class CHomework {
+  protected:
+	CGapSecurity _gap;		  //!< The GAP implementation. This should be instantiated with
+							  //!< SecurityManager::IO_CAPS_DISPLAY_ONLY capabilities:
+	CHomeworkGattServer _gatt_server; //!< This is the Gatt server which requires setting a set of services. The C++
+							  //!< initializer list can be used.
+	CGenericAttributeServiceServer _gatt; //!< The Generic Attribute service with the GATT caching characteristics
+	CAlertNotificationServiceServer
+		_ans; //!< The alert notification service. This should be instantiated with
+			  //!< CAlertNotificationServiceServer::ANS_TYPE_MASK_SIMPLE_ALERT as supported new alerts
+	CImmediateAlertServiceServer _ias; //!< This is the Immedate alert service instance
+	CDiagnosticsServiceServer _diagnostics; //!< Exposes the runtime metrics to the clients
+
+	CEventQueue &_ble_queue; //!< The queue of the BLE stack and the GATT events
+	CEventQueue &_app_queue; //!< The queue of the UI and housekeeping events
+#if BLE_THREAD
+	rtos::Thread _ble_thread;		//!< Runs the BLE stack and the GATT server
+	CAppMessageChannel _to_ble;	//!< Messages from the application thread to the BLE thread
+	CAppMessageChannel _to_app;	//!< Messages from the BLE thread to the application thread
+#else
+	CEventScheduler _scheduler; //!< Runs the BLE events ahead of the application events on one thread
+#endif
+	BLE &_ble;						  //!< A reference to one and only system BLE instance
+
+	CIsrEventChannel<> _isr_channel; //!< Hands the button interrupts to the event loop
+	int _alert_source;				 //!< The channel source id of the alert button
+	int _open_advertising_source;	 //!< The channel source id of the open advertising button
+	const char *_trace_filepath;	 //!< The file the event trace is saved to on disconnection, NULL if none
+
+	InterruptIn _alert_button; //!< The alert button.
+	InterruptIn _open_advertising_button; //!< The button that lets unknown peers connect and pair
+	PwmOut _alert_led_pwm;	   //!< The Alert LED pwm object
+	Ticker tiktok;             // GPIO interrupts don't seem to work when BLE is running so I used this
+	/**
+	 * \brief Button Press ISR implementation
+	 *
+	 */
+	void onButtonPressed(void) {
+		// TODO use event_queue call to dispatch button event pressed function handling to onButtonAlert
+		// function
+		_isr_channel.post(_alert_source);
+	}
+
+	/**
+	 * \brief The alert Ticker ISR, profiled apart from the GPIO interrupt of the button
+	 *
+	 */
+	void onAlertTicker(void) { _isr_channel.post(_alert_source); }
+
+	/**
+	 * \brief Open advertising button press ISR implementation
+	 *
+	 */
+	void onOpenAdvertisingButtonPressed(void) { _isr_channel.post(_open_advertising_source); }
+
+	/**
+	 * \brief Callback function of the open advertising button pressed event dispatched by the system event queue
+	 *
+	 */
+	void onOpenAdvertising(void) {
+#if BLE_THREAD
+		sendToBle(app_message_t::OPEN_ADVERTISING, 0);
+#else
+		_gap.openAdvertising();
+#endif
+	}
+
+	/**
+	 * \brief Callback function of the Alert button pressed event dispatched by the system event queue
+	 *
+	 */
+	void onButtonAlert(void) {
+		/*
+		 * TODO
+		 * Indicate new alert to Alert Notification Service (_ans) with type
+		 * CAlertNotificationServiceServer::ANS_TYPE_SIMPLE_ALERT
+		 */
+#if BLE_THREAD
+		sendToBle(app_message_t::NEW_ALERT, CAlertNotificationServiceServer::ANS_TYPE_SIMPLE_ALERT);
+#else
+        	_ans.newAlert(CAlertNotificationServiceServer::ANS_TYPE_SIMPLE_ALERT);
+#endif
+	}
+	/**
+	 * \brief Immediate Alert Service Alert Level characteristic written callback function
+	 *
+	 * \param level The new level
+	 */
+	void onAlertLevelChanged(uint8_t level) {
+#if BLE_THREAD
+		// the PWM is application work, it runs on the application thread
+		app_message_t message = {app_message_t::ALERT_LEVEL_CHANGED, level};
+		_to_app.send(message);
+	}
+
+	/**
+	 * \brief Sets the alert LED brightness, on the application thread
+	 *
+	 * \param level The new level
+	 */
+	void setAlertLed(uint8_t level) {
+#endif
+		float pulsewidth = 0.0f;
+		level = (level > 2) ? 2 : level;
+		std::cout << "Alert level: " << level << std::endl;
+		switch (level) {
+			case CImmediateAlertServiceServer::IAS_ALERT_LEVEL_NO_ALERT:
+				std::cout << "No alert" << std::endl;
+				// TODO  pulsewidth value to NO_ALERT state (LED should be off)
+				pulsewidth = PWM_PERIOD_US;
+				break;
+			case CImmediateAlertServiceServer::IAS_ALERT_LEVEL_MEDIUM:
+				// TODO  pulsewidth value to MEDIUM ALERT state (LED should be half bright)
+				std::cout << "Medium alert" << std::endl;
+				pulsewidth = PWM_PERIOD_US / 2;
+				break;
+			case CImmediateAlertServiceServer::IAS_ALERT_LEVEL_HIGH:
+				// TODO  pulsewidth value to HIGH ALERT state (LED should be bright)
+				std::cout << "High alert" << std::endl;
+				pulsewidth = 0.0f;
+				break;
+			default:
+				// TODO  pulsewidth value to HIGH ALERT state (LED should be bright)
+				std::cout << "Default" << std::endl;
+				pulsewidth = 0.0f;
+				break;
+		}
+		// TODO update the PwmOut object pulsewidth
+     		_alert_led_pwm.pulsewidth_us(pulsewidth);
+	}
+
+	/**
+	 * \brief The onConnection callback of the GAP.
+	 *
+	 */
+	void onConnection() {
+		_gatt_server.onConnection();
+		// TODO set the Alert Level LED brightness to NO_ALERT level
+        	_ias.setAlert(CImmediateAlertServiceServer::IAS_ALERT_LEVEL_NO_ALERT);
+	}
+	/**
+	 * \brief The connection complete event of the GAP, restores the GATT caching state of the peer
+	 *
+	 */
+	void onConnectionEvent(const ble::ConnectionCompleteEvent &event) {
+		_gatt.onPeerConnected(event.getPeerAddress(), _gap.isBonded(event.getPeerAddress()));
+	}
+	/**
+	 * \brief The onDisconnection callback of the GAP
+	 *
+	 */
+	void onDisconnection() {
+		_gatt_server.onDisconnection();
+		// TODO set the Alert Level LED brightness to NO_ALERT level
+		// TODO clear Alert Notification Service Alert Counts by using _ans->clearAlert()
+        	_ias.setAlert(CImmediateAlertServiceServer::IAS_ALERT_LEVEL_NO_ALERT);
+        	_ans.clearAlert(CAlertNotificationServiceServer::ANS_TYPE_ALL_ALERTS);
+		// the statistics are printed and the files written from the application queue, not in the stack callback
+		if (_app_queue.call(this, &CHomework::reportConnection) == 0) {
+			std::cout << "Cannot queue the connection report" << std::endl;
+		}
+	}
+
+	/**
+	 * \brief Prints the statistics of the connection, saves the event trace and flushes the event recording.
+	 * 		  Called on the application queue. With BLE_THREAD the counters of the BLE thread are read without
+	 * 		  locking, a line may miss an event in flight.
+	 *
+	 */
+	void reportConnection() {
+		_isr_channel.printStats("Button events");
+		_ans.printStats();
+		ble_profiler::CProfiler::instance().dump();
+		ble_trace::CTracer::instance().printStats();
+#if BLE_THREAD
+		printThreadStats();
+#else
+		_scheduler.printStats();
+#endif
+		if (_trace_filepath != NULL) {
+			ble_trace::CTracer::instance().save(_trace_filepath);
+		}
+		// the connection is complete in the recording, it can be replayed
+		ble_recorder::CEventRecorder::instance().flush();
+		ble_recorder::CEventRecorder::instance().printStats();
+	}
+
+#if BLE_THREAD
+	/**
+	 * \brief Sends a message to the BLE thread
+	 *
+	 */
+	void sendToBle(uint8_t type, uint8_t value) {
+		app_message_t message = {type, value};
+		if (!_to_ble.send(message)) {
+			std::cout << "BLE thread message dropped, type " << (int)type << std::endl;
+		}
+	}
+
+	/**
+	 * \brief Wakes the consumer of a channel by posting its drain function to the consumer queue
+	 *
+	 */
+	static bool notifyBle(void *context) {
+		CHomework *self = static_cast<CHomework *>(context);
+		return self->_ble_queue.call(self, &CHomework::onBleMessages) != 0;
+	}
+	static bool notifyApp(void *context) {
+		CHomework *self = static_cast<CHomework *>(context);
+		return self->_app_queue.call(self, &CHomework::onAppMessages) != 0;
+	}
+
+	/**
+	 * \brief Handles the messages of the application thread, on the BLE thread
+	 *
+	 */
+	void onBleMessages() {
+		_to_ble.receive([this](const app_message_t &message) {
+			switch (message.type) {
+			case app_message_t::NEW_ALERT:
+				_ans.newAlert((CAlertNotificationServiceServer::CategoryId)message.value);
+				break;
+			case app_message_t::OPEN_ADVERTISING:
+				_gap.openAdvertising();
+				break;
+			default:
+				break;
+			}
+		});
+	}
+
+	/**
+	 * \brief Handles the messages of the BLE thread, on the application thread
+	 *
+	 */
+	void onAppMessages() {
+		_to_app.receive([this](const app_message_t &message) {
+			if (message.type == app_message_t::ALERT_LEVEL_CHANGED) {
+				setAlertLed(message.value);
+			}
+		});
+	}
+
+	/**
+	 * \brief The BLE thread function
+	 *
+	 */
+	void runBle() { _gap.run(); }
+
+	/**
+	 * \brief Prints the message channel statistics
+	 *
+	 */
+	void printThreadStats() {
+		std::cout << "To BLE: sent " << std::dec << _to_ble.sent() << " dropped " << _to_ble.dropped()
+				  << " failed wakeups " << _to_ble.notifyFailed() << " depth " << _to_ble.maxDepth()
+				  << ", to application: sent " << _to_app.sent() << " dropped " << _to_app.dropped()
+				  << " failed wakeups " << _to_app.notifyFailed() << " depth " << _to_app.maxDepth() << std::endl;
+		_ble_queue.printStats("BLE queue");
+		_app_queue.printStats("Application queue");
+	}
+#endif
+
+  public:
+	/**
+	 * \brief Construct a new CHomework object
+	 *
+	 * \param ble A reference to the BLE instance
+	 * \param bleQueue The queue of the BLE stack and the GATT events
+	 * \param appQueue The queue of the UI and housekeeping events. With BLE_THREAD, the application thread
+	 * 				   dispatches it and the BLE thread dispatches bleQueue.
+	 * \param deviceName The device name
+	 * \param buttonPin Alert button pin name
+	 * \param ledPin Alert LED pin
+	 * \param bondDbFilepath The file to store the bonds. If NULL, the bonds are lost on reset.
+	 * \param openAdvButtonPin The button that starts open advertising when only bonded peers are accepted
+	 * \param gattCachingFilepath The file to store the GATT Database Hash and the caching state of the bonded
+	 * 							  clients. If NULL, the bonded clients rediscover the services after every reset.
+	 * \param traceFilepath The file the binary event trace is saved to on every disconnection. If NULL, the
+	 * 						trace is not saved.
+	 */
+	CHomework(BLE &ble,
+			  CEventQueue &bleQueue,
+			  CEventQueue &appQueue,
+			  const char *deviceName,
+			  PinName buttonPin = BUTTON1,
+			  PinName ledPin = LED2,
+			  const char *bondDbFilepath = NULL,
+			  PinName openAdvButtonPin = BUTTON2,
+			  const char *gattCachingFilepath = NULL,
+			  const char *traceFilepath = NULL)
+		// in the declaration order, the server only keeps the addresses of the services constructed after it
+		: _gap(ble, bleQueue, deviceName, SecurityManager::IO_CAPS_DISPLAY_ONLY, LED1, LED1, bondDbFilepath),
+#if BLE_STATIC_DISPATCH
+		  _gatt_server(ble, bleQueue, _gatt, _ans, _ias, _diagnostics),
+#else
+		  _gatt_server(ble, bleQueue, {&_gatt, &_ans, &_ias, &_diagnostics}),
+#endif
+		  _gatt(gattCachingFilepath),
+		  _ans(CAlertNotificationServiceServer::ANS_TYPE_MASK_SIMPLE_ALERT, 0, true /* signed writes */),
+		  _ias(true /* signed writes */), _diagnostics(bleQueue), _ble_queue(bleQueue), _app_queue(appQueue),
+#if BLE_THREAD
+		  _ble_thread(osPriorityHigh, BLE_THREAD_STACK_SIZE),
+#else
+		  _scheduler(bleQueue, appQueue),
+#endif
+		  _ble(ble), _isr_channel(appQueue), _trace_filepath(traceFilepath), _alert_button(buttonPin),
+		  _open_advertising_button(openAdvButtonPin), _alert_led_pwm(ledPin) {
+#if BLE_THREAD
+		_to_ble.setNotify(&CHomework::notifyBle, this);
+		_to_app.setNotify(&CHomework::notifyApp, this);
+#else
+		_gap.setScheduler(_scheduler);
+#endif
+		_gap.setOnInitCallback(BLE_PROFILED_AS(&_gatt_server, CHomeworkGattServer, start, "CGattServer::start"));
+		/*
+		* TODO
+		* 1. Configure _gap onConnection callback to use This object's onConnection function
+		* 2. Configure _gap onDisconnection callback to use This object's onDisconnection function
+		* 3. Configure _ias onAlertLevelWritten callback to use This object's onAlertLevelChanged function
+		* 4. Configure button rise ISR function to use This object's onButtonPress function
+		* 5. Configure LED pwm period to PWM_PERIOD_US
+		* 6. Turn off the Alert Level LED by seeting its pwm pulsewidth
+		* 7. Enable authentication requirement for Immediate Alert Service object _ias
+		* 8. Enable authentication requirement for Alert Notification Service object _ans
+		*/
+		_gap.setOnConnection(BLE_PROFILED(this, CHomework, onConnection));
+		_gap.setOnDisconnection(BLE_PROFILED(this, CHomework, onDisconnection));
+		// the GATT caching state of a client is kept per bond
+		_gap.setOnConnectionEvent(BLE_PROFILED(this, CHomework, onConnectionEvent));
+		_gap.setOnBonded(BLE_PROFILED(&_gatt, CGenericAttributeServiceServer, onPeerBonded));
+		_gatt_server.setRequestAuthorization(BLE_PROFILED(&_gatt, CGenericAttributeServiceServer, authorizeRequest));
+		_gatt_server.setSignedWriteAuthorization(BLE_PROFILED(&_gap, CGapSecurity, hasAuthenticatedSigningKey));
+		_ias.setOnAlertLevelWritten(BLE_PROFILED(this, CHomework, onAlertLevelChanged));
+		// the sources are registered before the interrupts are enabled
+		_alert_source = _isr_channel.add(BLE_PROFILED(this, CHomework, onButtonAlert));
+		_open_advertising_source = _isr_channel.add(BLE_PROFILED(this, CHomework, onOpenAdvertising));
+		_alert_button.fall(BLE_PROFILED(this, CHomework, onButtonPressed));
+		_open_advertising_button.fall(BLE_PROFILED(this, CHomework, onOpenAdvertisingButtonPressed));
+		// once bonds exist, accept connections only from the bonded peers
+		_gap.enableAcceptListAdvertising();
+		_alert_led_pwm.period_us(PWM_PERIOD_US);
+		_alert_led_pwm.pulsewidth_us(PWM_PERIOD_US);
+		_ias.enableAuthentication();
+		_ans.enableAuthentication();
+		_diagnostics.enableAuthentication();
+
+		tiktok.attach(BLE_PROFILED(this, CHomework, onAlertTicker), 5.0);
+	}
+
+	void run() {
+#if BLE_THREAD
+		// the BLE thread dispatches the BLE queue, this thread the application queue
+		_ble_thread.start(callback(this, &CHomework::runBle));
+		_app_queue.dispatch_forever();
+#else
+		// just let GAP class handle the event loops
+		_gap.run();
+#endif
+	}
+};
+
+/**
+ * \brief Mounts the file system holding the security database and the GATT caching state
+ *
+ * \param fs The file system to be mounted
+ * \return true if the file system is mounted
+ * \return false if there is no storage, the bonds are kept in RAM
+ */
+bool mountBondStorage(LittleFileSystem &fs) {
+	BlockDevice *bd = BlockDevice::get_default_instance();
+	if (bd == NULL) {
+		std::cout << "No block device, bonds are kept in RAM" << std::endl;
+		return false;
+	}
+	if (fs.mount(bd) != 0) {
+		std::cout << "Formatting the bond storage" << std::endl;
+		if (fs.reformat(bd) != 0) {
+			std::cout << "Bond storage not available, bonds are kept in RAM" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int main() {
+	BLE &ble = BLE::Instance();
+	static LittleFileSystem bond_fs(BOND_FS_NAME);
+	// the event pools are static, the occupancy statistics show how much of them is used
+	static CStaticEventQueue<EVENT_QUEUE_SIZE> event_queue;
+	static CStaticEventQueue<LOW_PRIORITY_EVENT_QUEUE_SIZE> low_priority_queue; // the UI and housekeeping events
+	bool storage = mountBondStorage(bond_fs);
+	if (storage) {
+		// before the stack is initialized, so the session records the characteristics. The file is written
+		// from the low priority queue, never from the BLE thread.
+		ble_recorder::CEventRecorder::instance().start(EVENTS_FILEPATH, low_priority_queue);
+	}
+	CHomework hw(ble,
+				 event_queue,
+				 low_priority_queue,
+				 "Homework",
+				 BUTTON1,
+				 LED2,
+				 storage ? BOND_DB_FILEPATH : NULL,
+				 BUTTON2,
+				 storage ? GATT_CACHING_FILEPATH : NULL,
+				 storage ? TRACE_FILEPATH : NULL);
+	// bind the event queue to the ble interface, initialize the interface
+	// and start advertising
+	hw.run();
+	return 0;
+}